@@ -1,11 +1,17 @@
 #ifndef _LOGGING_ASYNC_LOGGING_H_
 #define _LOGGING_ASYNC_LOGGING_H_
 
+#include <sys/uio.h>
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <thread>
 #include "buffer_queue.h"
+#include "consumer_options.h"
+#include "flight_recorder.h"
+#include "log_dedup.h"
 #include "log_file.h"
+#include "log_merge.h"
 
 namespace logging {
 /**
@@ -17,6 +23,23 @@ namespace logging {
  * task (only one) obtains the buffer_ptr from the output_queue, writes the data
  * in the buffer to the file, and then puts the buffer_ptr back into the
  * input_queue for next writing.
+ * Urgent records (WARNING and ERROR by default) take a separate priority lane
+ * with its own current buffer and a small set of reserved buffers. The
+ * consumer is woken up as soon as an urgent record arrives and always writes
+ * the priority lane first, with an immediate flush (or sync), so such a
+ * record waits for at most one normal buffer write. The priority lane never
+ * drops a record: when its reserved buffers are all in use the writer waits
+ * for the consumer to hand one back.
+ * A record larger than a buffer is stored in an extent allocated for it and
+ * queued as a buffer of its own right behind the current one, so it is
+ * written whole and in order, straight from the extent. A payload
+ * (append_payload) is not copied at all: its buffer holds the header and a
+ * reference to the caller's memory, which is written in place.
+ * With a reorder window set, the consumer merges the buffers of both lanes
+ * by record time (RecordMerger) and writes a record once the window has
+ * passed it, so the file is in time order at the cost of that delay, which
+ * priority records share. The merge copies the records and hands the buffers
+ * back to the lanes at once, and writes early when it holds too much.
  */
 
 class AsyncLogging
@@ -28,11 +51,22 @@ public:
      * @param [in] file_name: Log file name
      * @param [in] roll_cycle_minutes: Log file rolling period, in minutes.
      * @param [in] roll_size_bytes: File rolling size, in bytes
+     * @param [in] retention: Limits on the rolled log files
+     * @param [in] container: Write the seekable container format instead of
+     * plain text
      * @note  If roll_cycle_minutes is equal to 0, no new log files will be
      * generated based on time rolling. If roll_size_bytes is equal to 0, new
      * log files will not be rolled based on the log file size.
      */
-    void init(std::string file_name, uint64_t roll_cycle_minutes = 0, uint64_t roll_size_bytes = 0);
+    void init(std::string file_name, uint64_t roll_cycle_minutes = 0, uint64_t roll_size_bytes = 0,
+              const RetentionPolicy &retention = RetentionPolicy(), bool container = false);
+
+    /**
+     * @brief Asynchronous logger initialization with a custom destination
+     * @param [in] sink: Destination of the log data, e.g. a SocketSink. The
+     * logger takes ownership.
+     */
+    void init(std::unique_ptr<LogSink> sink);
 
     /**
      * @brief Logger destructor
@@ -43,6 +77,22 @@ public:
 
     AsyncLogging(void)
         : _cur_buffer_ptr(nullptr)
+        , _next_seq(0)
+        , _last_timestamp_us(0)
+        , _urgent_buffer_ptr(nullptr)
+        , _urgent_pending(false)
+        , _urgent_sync(false)
+        , _framing(false)
+        , _dedup_window_ms(0)
+        , _reorder_window_ms(0)
+        , _merge_collect_ms(0)
+        , _payload_scratch_size(0)
+        , _flight(nullptr)
+        , _flight_triggers(0)
+        , _fork_pending(false)
+        , _fork_prepared(false)
+        , _restart_pending(false)
+        , _sink_swap_pending(false)
         , _running(false)
     {
     }
@@ -51,8 +101,128 @@ public:
      * @brief Log data writing
      * @param [in] data : Log data source address
      * @param [in] size : Log data length
+     * @param [in] timestamp_us : Record time in microseconds since epoch, 0
+     * if unknown (the time of the previous record is used)
+     * @param [in] urgent : Take the priority lane
+     * @param [in] time_begin : Start of the time stamp in the record
+     * @param [in] time_end : End of the time stamp in the record, 0 if there
+     * is none
+     */
+    void append_data(const char *data, size_t size, uint64_t timestamp_us = 0, bool urgent = false,
+                     size_t time_begin = 0, size_t time_end = 0);
+
+    /**
+     * @brief Write one record whose data is split into several pieces, the
+     * pieces are stored back to back in the same buffer
+     * @param [in] pieces : Pieces of the record, in order
+     * @param [in] num_pieces : Number of pieces
+     * @param [in] timestamp_us : Record time in microseconds since epoch, 0
+     * if unknown (the time of the previous record is used)
+     * @param [in] urgent : Take the priority lane
+     * @param [in] time_begin : Start of the time stamp in the record
+     * @param [in] time_end : End of the time stamp in the record, 0 if there
+     * is none
+     */
+    void append_datav(const struct iovec *pieces, int num_pieces, uint64_t timestamp_us = 0,
+                      bool urgent = false, size_t time_begin = 0, size_t time_end = 0);
+
+    /**
+     * @brief Write one record whose body is a caller buffer (LOG_PAYLOAD).
+     * The header pieces are copied into a buffer of its own, queued right
+     * behind the current one; the payload is written from where it is by the
+     * background thread, encoded there if asked to, and then released.
+     * @param [in] pieces : Pieces of the header, in order
+     * @param [in] num_pieces : Number of pieces
+     * @param [in] payload : The payload, released once written or dropped
+     * @param [in] timestamp_us : Record time in microseconds since epoch, 0
+     * if unknown (the time of the previous record is used)
+     * @param [in] urgent : Take the priority lane
+     * @param [in] time_begin : Start of the time stamp in the header
+     * @param [in] time_end : End of the time stamp in the header, 0 if there
+     * is none
+     */
+    void append_payload(const struct iovec *pieces, int num_pieces, Payload &&payload, uint64_t timestamp_us = 0,
+                        bool urgent = false, size_t time_begin = 0, size_t time_end = 0);
+
+    /**
+     * @brief Whether the priority lane waits until its data is stored durably
+     * (fdatasync for log files) instead of only flushing it
+     */
+    void set_urgent_sync (bool sync)
+    {
+        _urgent_sync = sync;
+    }
+
+    /**
+     * @brief Whether every record is prefixed with its sequence number and
+     * checksum, see log_frame.h. Can be switched while running.
+     */
+    void set_record_framing (bool framing)
+    {
+        _framing = framing;
+    }
+
+    /**
+     * @brief Collapse repeated records within a window, see LogDedup. Can be
+     * changed while running, 0 disables it.
+     */
+    void set_dedup_window (uint32_t window_ms)
+    {
+        _dedup_window_ms = window_ms;
+    }
+
+    /**
+     * @brief Counters of the duplicate collapsing
+     */
+    DedupStats dedup_stats (void) const
+    {
+        return _dedup.stats();
+    }
+
+    /**
+     * @brief Write the records of both lanes in time stamp order, holding
+     * them back for up to the window, see RecordMerger. Can be changed while
+     * running, 0 disables it.
+     */
+    void set_reorder_window (uint32_t window_ms)
+    {
+        _reorder_window_ms = window_ms;
+    }
+
+    /**
+     * @brief Counters of the record merge
+     */
+    MergeStats merge_stats (void) const
+    {
+        return _merger.stats();
+    }
+
+    /**
+     * @brief Flight recorder whose dumps the background thread writes, must
+     * be set before start() and outlive the logger
+     */
+    void set_flight_recorder (FlightRecorder *recorder)
+    {
+        _flight = recorder;
+    }
+
+    /**
+     * @brief Have the background thread dump the flight recorder
+     * @param [in] trigger : FlightRecorder::Trigger value
+     * @param [in] wake : Wake the background thread up, otherwise the dump
+     * waits for its next round (at most IDLE_FLUSH_MS). Without waking the
+     * call is async-signal-safe.
      */
-    void append_data(const char *data, size_t size);
+    void request_flight_dump(uint32_t trigger, bool wake = true);
+
+    /**
+     * @brief Set the placement, scheduling and wait strategy of the
+     * background thread, must be called before start()
+     */
+    void set_consumer_options (const ConsumerOptions &options)
+    {
+        _consumer_options = options;
+    }
 
     /**
      * @brief start background daemon task
@@ -60,9 +230,72 @@ public:
     void start();
 
     bool is_running(void) {return _running;}
+
+    /**
+     * @brief Switch to another destination while running. The background
+     * thread installs the new sink between two buffers and destroys the old
+     * one, producers are not paused.
+     * @note Records still queued at that point go to the new sink.
+     */
+    void replace_sink(std::unique_ptr<LogSink> sink);
+
+    /**
+     * @brief Buffer hand-offs between the producers and the background thread,
+     * and how many of them had to wake a waiting thread
+     */
+    void notify_stats(uint64_t &pushes, uint64_t &notifies);
+
+    /**
+     * @brief fork() support, to be called from the pthread_atfork prepare
+     * handler. Pauses the background thread at a point where it holds no lock
+     * and lets the sink write out its buffered data.
+     */
+    void prepare_fork(void);
+
+    /**
+     * @brief fork() support, pthread_atfork parent handler. Resumes the
+     * background thread.
+     */
+    void after_fork_parent(void);
+
+    /**
+     * @brief fork() support, pthread_atfork child handler. Abandons the
+     * queues and buffers, rebuilds the locks and stops the logger until
+     * restart_after_fork. Nothing is allocated, opened or started here.
+     */
+    void after_fork_child(void);
+
+    /**
+     * @brief Whether the logger of a forked child waits for
+     * restart_after_fork
+     */
+    bool restart_pending (void) const
+    {
+        return _restart_pending;
+    }
+
+    /**
+     * @brief Restart the logger of a forked child after after_fork_child,
+     * outside the atfork handler: creates the queues and buffers and starts
+     * the background thread.
+     * @param [in] sink: Destination for the child, e.g. a file of its own. If
+     * null, the child keeps using the inherited sink.
+     * @note Records buffered at fork time belong to the parent, which writes
+     * them; the child starts with empty buffers.
+     */
+    void restart_after_fork(std::unique_ptr<LogSink> sink = nullptr);
 private:
     /* Simple type, initialized directly */
     static const size_t NUM_OF_AVAILABLE_BUFFERS = 300; 
+    /* Buffers reserved for the priority lane */
+    static const size_t NUM_OF_URGENT_BUFFERS = 8;
+    /* Wait for a free priority buffer in steps of this length, in ms, to
+     * notice a stopped consumer */
+    static const uint32_t URGENT_WAIT_MS = 100;
+    /* Partly filled buffers are written after this much idle time, in ms */
+    static const uint32_t IDLE_FLUSH_MS = 1000;
+    /* Encoded payloads up to this size keep their scratch buffer */
+    static const size_t PAYLOAD_SCRATCH_KEEP = 1024 * 1024;
 
     /**
      * @brief Background log consumption thread implementation, responsible for
@@ -70,12 +303,185 @@ private:
      */
     void background_consume_thread(void);
 
+    /**
+     * @brief Write the data of a buffer, with the description of its records,
+     * to the log file
+     */
+    void write_buffer(DataBuffer &buffer, bool flush_now = false);
+
+    /**
+     * @brief Store a record in the priority lane
+     */
+    void append_urgent(const struct iovec *pieces, int num_pieces, size_t size, uint64_t timestamp_us,
+                       size_t time_begin, size_t time_end);
+
+    /**
+     * @brief Write the record of a buffer with a payload: the header from the
+     * buffer, the payload in place (or encoded into _payload_scratch) and the
+     * newline unless the encoding ends with one, in one gather write
+     */
+    void write_payload(DataBuffer &buffer, const BlockMeta &meta, bool flush_now);
+
+    /**
+     * @brief Write the records of the duplicate collapsing for the windows
+     * that have ended, background thread
+     * @param[in] all Close every window, e.g. before the sink goes away
+     */
+    void write_dedup_summaries(bool all);
+
+    /**
+     * @brief Write the requested flight recorder dump, background thread
+     */
+    void write_flight_dump(void);
+
+    /**
+     * @brief Hand a buffer with data to the record merge if it is on,
+     * background thread
+     * @retval false if the merge is off, the caller writes the buffer
+     */
+    bool merge_buffer(DataBuffer_ptr &buffer_ptr, bool urgent);
+
+    /**
+     * @brief Write the merged records whose time is past the reorder window,
+     * background thread
+     * @param[in] all Write all of them, e.g. before the logger goes away
+     */
+    void drain_merged(bool all);
+
+    /**
+     * @brief Write the merged records up to a time, and more while the merge
+     * holds too many buffers, background thread
+     * @param[in] watermark Records up to this time (microseconds since epoch)
+     * are written
+     */
+    void write_merged(uint64_t watermark);
+
+    /**
+     * @brief Hand the partly filled current buffers of both lanes to the
+     * record merge, background thread
+     */
+    void collect_merge_buffers(void);
+
+    /**
+     * @brief Return an empty buffer to its lane, background thread
+     */
+    void release_buffer(DataBuffer_ptr &buffer_ptr, bool urgent);
+
+    /**
+     * @brief Queue the current buffer of the priority lane and take a free
+     * one if there is any, called with _urgent_lock held. Otherwise the lane
+     * is left without a current buffer, see wait_urgent_buffer.
+     */
+    void hand_over_urgent(void);
+
+    /**
+     * @brief Make sure the priority lane has a current buffer, waiting for
+     * the consumer to hand back a reserved one if need be. The lock is
+     * released while waiting.
+     * @param[in] lock Holds _urgent_lock, held again on return
+     * @retval false if the consumer has stopped
+     */
+    bool wait_urgent_buffer(std::unique_lock<std::mutex> &lock);
+
+    /**
+     * @brief Account a record just stored in a buffer of a lane, called with
+     * the lock of the lane held
+     * @param[in] start Data size before the record and its frame prefix
+     */
+    void note_stored(DataBuffer &buffer, size_t start, size_t frame_size, uint64_t timestamp_us, uint64_t seq,
+                     size_t time_begin, size_t time_end);
+
+    /**
+     * @brief Write all the data of the priority lane, called by the consumer
+     */
+    void write_urgent(void);
+
+    /**
+     * @brief Create the queues and buffers of both lanes
+     */
+    void create_buffers(void);
+
+    /**
+     * @brief Apply the consumer options to the calling (background) thread
+     */
+    void apply_consumer_options(void);
+
+    /**
+     * @brief Wait for a full buffer with the configured strategy
+     * @retval The buffer, or nullptr after IDLE_FLUSH_MS (half the reorder
+     * window if shorter) or when woken up for the priority lane, a sink swap,
+     * a fork or shutdown
+     */
+    DataBuffer_ptr wait_buffer(void);
+
+    /**
+     * @brief Install the sink handed over by replace_sink, background thread
+     */
+    void swap_sink(void);
+
     /* The buffer currently in use */
     DataBuffer_ptr _cur_buffer_ptr;
 
     /* Mutex lock to ensure thread safety of access to _cur_buffer_ptr */
     std::mutex _buffer_lock;
 
+    /* Sequence number of the next record, shared by both lanes and taken
+     * under the lock of the lane so that it grows within each buffer */
+    std::atomic<uint64_t> _next_seq;
+    /* Time of the last record, protected by _buffer_lock */
+    uint64_t _last_timestamp_us;
+
+    /* Priority lane: current buffer (protected by _urgent_lock), full
+     * buffers waiting for the consumer and reserved free buffers */
+    DataBuffer_ptr               _urgent_buffer_ptr;
+    std::mutex                   _urgent_lock;
+    std::unique_ptr<BufferQueue> _urgent_output_queue_ptr;
+    std::unique_ptr<BufferQueue> _urgent_input_queue_ptr;
+    /* Set when the priority lane has data for the consumer */
+    std::atomic<bool> _urgent_pending;
+    std::atomic<bool> _urgent_sync;
+
+    /* Records are framed with their sequence number and checksum */
+    std::atomic<bool> _framing;
+
+    /* Duplicate collapsing, the window is read by the producers (which note
+     * the record spans while it is set) and the background thread */
+    std::atomic<uint32_t> _dedup_window_ms;
+    LogDedup              _dedup;
+    std::string           _dedup_summaries;
+
+    /* Record merge of the lanes, the window is read by the producers (which
+     * index their records while it is set) and the background thread */
+    std::atomic<uint32_t> _reorder_window_ms;
+    RecordMerger          _merger;
+    DataBuffer_ptr        _merge_out;
+    /* Last time the current buffers were collected, steady clock ms */
+    uint64_t              _merge_collect_ms;
+
+    /* Encoded payloads, background thread */
+    std::unique_ptr<char[]> _payload_scratch;
+    size_t                  _payload_scratch_size;
+
+    /* Flight recorder and the triggers of the dump requested from the
+     * background thread */
+    FlightRecorder       *_flight;
+    std::atomic<uint32_t> _flight_triggers;
+
+    /* Held by the background thread while it works on a buffer, taken by
+     * prepare_fork to pause it; _fork_pending makes it step aside */
+    std::mutex        _fork_lock;
+    std::atomic<bool> _fork_pending;
+    bool              _fork_prepared;
+    /* Set in a forked child until restart_after_fork */
+    bool              _restart_pending;
+
+    ConsumerOptions _consumer_options;
+
+    /* Sink handed over by replace_sink, installed by the background thread */
+    std::mutex               _sink_swap_lock;
+    std::unique_ptr<LogSink> _pending_sink;
+    std::atomic<bool>        _sink_swap_pending;
+
     /* Points to the input queue, from which the logger obtains the free buffer,
      * fills it with log data and then puts it into the output queue. */
     std::unique_ptr<BufferQueue> _input_queue_ptr;
@@ -89,7 +495,9 @@ private:
     bool _running = false;
 
     std::thread              _background_thread;
-    std::unique_ptr<LogFile> _log_file_ptr;
+    /* Destination of the log data, a LogFile unless another sink was given
+     * to init */
+    std::unique_ptr<LogSink> _sink_ptr;
 };
 
 } // namespace logging
@@ -1,6 +1,7 @@
 #ifndef _LOGGING_APPEND_FILE_H_
 #define _LOGGING_APPEND_FILE_H_
 
+#include <sys/uio.h>
 #include <string>
 
 namespace logging {
@@ -11,6 +12,9 @@ namespace logging {
 class BaseFile
 {
 public:
+    /* Pieces append_datav hands to one writev */
+    static const int MAX_PIECES = 16;
+
     /**
      * @brief BaseFile constructor
      * @param[in] file_name The file name that needs to be created。
@@ -27,12 +31,28 @@ public:
      */
     void append_data(const char *data, size_t size, bool fulsh_now = false);
 
+    /**
+     * @brief Append data given as several pieces to the file with writev,
+     * bypassing the stdio buffer, which is flushed first
+     * @param[in] pieces Pieces of the data, in order
+     * @param[in] num_pieces Number of pieces, written MAX_PIECES at a time
+     */
+    void append_datav(const struct iovec *pieces, int num_pieces);
+
     /**
      * @brief Get the amount of data written to the current file
      * @return Number of bytes
      */
     size_t get_written_bytes(void);
 
+    /**
+     * @brief Whether another file has taken the given name since this file
+     * was opened under it, e.g. after another process rolled it
+     * @param[in] file_name The name the file was opened under
+     * @return false if no file has the name
+     */
+    bool replaced(const std::string &file_name);
+
     /**
      * @brief Rename file
      * @param[in] old_filename Identifies the path to the file to be renamed
@@ -50,6 +70,11 @@ public:
      */
     void flush(void);
 
+    /**
+     * @brief Flush file buffer and wait until the data reaches the disk
+     */
+    void sync(void);
+
 private:
     char   _local_buffer[32 * 1024];
     FILE  *_file;
@@ -1,13 +1,46 @@
 #ifndef _LOGGING_BUFFER_QUEUE_H_
 #define _LOGGING_BUFFER_QUEUE_H_
 
+#include <atomic>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <queue>
+#include <vector>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "log_frame.h"
+#include "log_payload.h"
 
 namespace logging {
 
+/**
+ * @brief Position of a record in a DataBuffer and of the time stamp in the
+ * record, for the consumer side duplicate collapsing (log_dedup.h)
+ */
+struct RecordSpan
+{
+    uint32_t offset;
+    uint32_t size;
+    uint32_t time_begin; // Relative to offset, time_begin == time_end if there is no time stamp
+    uint32_t time_end;
+};
+
+/**
+ * @brief A record of a DataBuffer with its order key, for the consumer side
+ * merge of the lanes (log_merge.h)
+ */
+struct RecordIndex
+{
+    uint32_t offset;     // Start of the record, including its frame prefix
+    uint32_t size;
+    uint32_t time_begin; // Time stamp in the record, for the duplicate collapsing
+    uint32_t time_end;
+    uint64_t ts_us;
+    uint64_t seq;
+    bool     span;       // The record may be collapsed, see note_span
+};
+
 /**
  * @brief Buffer data structure.
  *        Stored in the data queue is a pointer to the data structure.
@@ -17,10 +50,24 @@ class DataBuffer
 public:
     DataBuffer(void)
         : _cur_size(0)
+        , _record_count(0)
+        , _first_ts(0)
+        , _last_ts(0)
+        , _first_seq(0)
+        , _last_seq(0)
+        , _frame_count(0)
+        , _span_count(0)
+        , _data(_buffer)
+        , _payload_framed(false)
     {
     }
 
-    size_t get_buffer_size (void)
+    ~DataBuffer(void)
+    {
+        release_payload();
+    }
+
+    static size_t get_buffer_size (void)
     {
         return _BUFFER_SIZE;
     }
@@ -32,7 +79,24 @@ public:
 
     const char *get_buffer (void)
     {
-        return _buffer;
+        return _data;
+    }
+
+    /**
+     * @brief Writable data, for the consumer that rewrites a buffer before
+     * writing it, see set_data_size
+     */
+    char *get_data (void)
+    {
+        return _data;
+    }
+
+    /**
+     * @brief Cut the data short after the consumer has rewritten it
+     */
+    void set_data_size (size_t size)
+    {
+        _cur_size = (size < _cur_size) ? size : _cur_size;
     }
     /**
      * @brief Save input data into internal buffer
@@ -41,15 +105,182 @@ public:
      */
     void input_data(const char *data, size_t size);
 
+    /**
+     * @brief Store a record too large for the buffer in an extent of its own.
+     * The buffer must be empty and holds only this record until it is reset.
+     * @param[in] frame Frame prefix of the record (note_frame is implied),
+     * nullptr if none
+     * @param[in] frame_size Size of the frame prefix
+     * @param[in] pieces Pieces of the record, gathered into the extent
+     * @param[in] num_pieces Number of pieces
+     * @retval false if the extent can not be allocated
+     */
+    bool input_extent(const char *frame, size_t frame_size, const struct iovec *pieces, int num_pieces);
+
+    /**
+     * @brief Attach a payload (LOG_PAYLOAD) to the record stored in the
+     * buffer, which holds only that record until it is reset. The consumer
+     * writes the payload in place after the data, see get_payload.
+     * @param[in] payload The payload, its release is called by reset_buffer
+     * @param[in] framed Frame the record, the consumer builds the frame prefix
+     * @retval false if the payload can not be stored, it is released
+     */
+    bool set_payload(Payload &&payload, bool framed);
+
+    /**
+     * @brief The payload of the record, nullptr if there is none
+     */
+    const Payload *get_payload (void)
+    {
+        return _payload.get();
+    }
+
+    bool payload_framed (void)
+    {
+        return _payload_framed;
+    }
+
     /**
      * @brief reset buffer
      */
     void reset_buffer(void);
 
+    /**
+     * @brief Account a record that has been stored with input_data
+     * @param[in] timestamp_us Record time in microseconds since epoch
+     * @param[in] seq Record sequence number
+     */
+    void note_record (uint64_t timestamp_us, uint64_t seq)
+    {
+        if (0 == _record_count)
+        {
+            _first_ts  = timestamp_us;
+            _first_seq = seq;
+        }
+        _last_ts  = timestamp_us;
+        _last_seq = seq;
+        _record_count++;
+    }
+
+    /**
+     * @brief Account a frame prefix (see log_frame.h) about to be stored with
+     * input_data, its checksum is filled in by seal_frames
+     */
+    void note_frame(void);
+
+    /**
+     * @brief Fill in the checksums of the framed records, called by the
+     * consumer before the data is written
+     */
+    void seal_frames(void);
+
+    /**
+     * @brief Note where the record just stored with input_data lies, records
+     * without a span are passed through by the duplicate collapsing
+     * @param[in] offset Data size before the record was stored
+     * @param[in] time_begin Start of the time stamp in the record
+     * @param[in] time_end End of the time stamp in the record
+     */
+    void note_span(size_t offset, size_t time_begin, size_t time_end);
+
+    /**
+     * @brief Index the record just stored with input_data, see RecordIndex
+     * @param[in] offset Data size before the record was stored
+     * @param[in] timestamp_us Record time in microseconds since epoch
+     * @param[in] seq Record sequence number
+     * @param[in] span The record may be collapsed, with its time stamp
+     * between time_begin and time_end (relative to offset)
+     */
+    void note_index (size_t offset, uint64_t timestamp_us, uint64_t seq, bool span, size_t time_begin,
+                     size_t time_end)
+    {
+        RecordIndex entry;
+        entry.offset     = static_cast<uint32_t>(offset);
+        entry.size       = static_cast<uint32_t>(_cur_size - offset);
+        entry.time_begin = static_cast<uint32_t>(time_begin);
+        entry.time_end   = static_cast<uint32_t>(time_end);
+        entry.ts_us      = timestamp_us;
+        entry.seq        = seq;
+        entry.span       = span;
+        _index.push_back(entry);
+    }
+
+    /**
+     * @brief Records indexed since the last reset, the capacity is kept
+     */
+    const std::vector<RecordIndex> &get_index (void)
+    {
+        return _index;
+    }
+
+    const RecordSpan *get_spans (void)
+    {
+        return _spans.get();
+    }
+
+    uint32_t get_span_count (void)
+    {
+        return _span_count;
+    }
+
+    uint32_t get_record_count (void)
+    {
+        return _record_count;
+    }
+
+    uint64_t get_first_ts (void)
+    {
+        return _first_ts;
+    }
+
+    uint64_t get_last_ts (void)
+    {
+        return _last_ts;
+    }
+
+    uint64_t get_first_seq (void)
+    {
+        return _first_seq;
+    }
+
+    uint64_t get_last_seq (void)
+    {
+        return _last_seq;
+    }
+
 private:
+    /**
+     * @brief Hand the payload back to its owner
+     */
+    void release_payload(void);
+
     static const size_t _BUFFER_SIZE = 32 * 1024;
     /* The amount of data currently cached */
     size_t _cur_size;
+    /* Records noted since the last reset, with their time and sequence range */
+    uint32_t _record_count;
+    uint64_t _first_ts;
+    uint64_t _last_ts;
+    uint64_t _first_seq;
+    uint64_t _last_seq;
+    /* Offsets of the frame prefixes waiting for their checksum, every frame
+     * takes at least RECORD_FRAME_SIZE bytes. Allocated when the first one is
+     * noted, buffers of unframed logging never need them. */
+    static const size_t         _MAX_FRAMES = _BUFFER_SIZE / RECORD_FRAME_SIZE;
+    uint32_t                    _frame_count;
+    std::unique_ptr<uint32_t[]> _frame_offsets;
+    /* Record spans, allocated when the first one is noted */
+    static const size_t           _MAX_SPANS = 1024;
+    uint32_t                      _span_count;
+    std::unique_ptr<RecordSpan[]> _spans;
+    /* Record index for the merge of the lanes */
+    std::vector<RecordIndex> _index;
+    /* The data, _buffer or the extent of a record too large for it */
+    char                   *_data;
+    std::unique_ptr<char[]> _extent;
+    /* Payload written after the data, see set_payload */
+    std::unique_ptr<Payload> _payload;
+    bool                     _payload_framed;
     /* The buffer where the data is actually stored */
     char _buffer[_BUFFER_SIZE];
 };
@@ -77,6 +308,21 @@ public:
      */
     DataBuffer_ptr pop_buffer(uint32_t timeout_ms = 0);
 
+    /**
+     * @brief Get a buffer from the buffer queue without waiting
+     * @retval a pointer to the data buffer, nullptr if the queue is empty
+     */
+    DataBuffer_ptr try_pop_buffer(void);
+
+    /**
+     * @brief Number of buffers in the queue, read without taking the lock.
+     * Used by polling consumers to avoid contending with the producers.
+     */
+    size_t size_hint (void) const
+    {
+        return _count.load(std::memory_order_acquire);
+    }
+
     /**
      * @brief Push a buffer into the queue
      * @param [in] DataBuffer_ptr pointer to buffer
@@ -89,11 +335,50 @@ public:
      */
     bool empty(void);
 
+    /**
+     * @brief Make a waiting (or the next) pop_buffer return nullptr
+     * immediately, used to wake up the consumer for other work
+     */
+    void wakeup(void);
+
+    /**
+     * @brief Batch the notifications of a waiting pop_buffer: the waiter is
+     * only woken once batch buffers are queued, and picks up a smaller number
+     * of buffers after at most max_delay_ms.
+     * @param [in] batch: Buffers per wakeup, 1 wakes the waiter on every push
+     * @param [in] max_delay_ms: Longest time a queued buffer waits for the
+     * rest of its batch
+     */
+    void set_notify_batch(size_t batch, uint32_t max_delay_ms);
+
+    /* Number of pushes, each of which used to notify the condition variable */
+    uint64_t push_count (void) const
+    {
+        return _pushes.load(std::memory_order_relaxed);
+    }
+
+    /* Number of notifications actually issued */
+    uint64_t notify_count (void) const
+    {
+        return _notifies.load(std::memory_order_relaxed);
+    }
+
     int size(void) {return _buffer_queue.size();}
 private:
     std::queue<DataBuffer_ptr> _buffer_queue;
     std::mutex                 _mutex;
     std::condition_variable    _cv;
+    bool                       _wakeup = false;
+    /* Mirror of _buffer_queue.size(), updated under _mutex */
+    std::atomic<size_t>        _count;
+    /* Threads blocked in pop_buffer, pushes only notify when there is one */
+    uint32_t                   _waiters = 0;
+    size_t                     _notify_batch = 1;
+    uint32_t                   _batch_delay_ms = 0;
+    /* No buffer came during the last wait slice, see pop_buffer */
+    bool                       _batch_idle = true;
+    std::atomic<uint64_t>      _pushes;
+    std::atomic<uint64_t>      _notifies;
 }; // class BufferQueue
 
 } // namespace logging
@@ -0,0 +1,39 @@
+#ifndef _LOGGING_CONSUMER_OPTIONS_H_
+#define _LOGGING_CONSUMER_OPTIONS_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace logging {
+
+/**
+ * @brief How the background thread waits for full buffers
+ */
+enum WaitStrategy
+{
+    WAIT_BLOCKING = 0,  // Sleep on the queue condition variable, no CPU used while idle
+    WAIT_SPIN_YIELD,    // Poll for spin_us, then poll with sched_yield between checks
+    WAIT_BUSY_POLL,     // Poll without ever giving up the CPU, for a dedicated core
+};
+
+/**
+ * @brief Placement and scheduling of the background thread of AsyncLogging
+ * @note All the settings are applied by the thread itself when it starts;
+ * failures are reported on stderr and the thread runs anyway.
+ */
+struct ConsumerOptions
+{
+    int          cpu             = -1;              // Pin to this CPU, -1 leaves the affinity alone
+    int          nice            = 0;               // Nice value of the thread, 0 leaves it alone
+    int          sched_policy    = -1;              // SCHED_OTHER, SCHED_FIFO, SCHED_RR..., -1 leaves it alone
+    int          sched_priority  = 0;               // Priority for SCHED_FIFO and SCHED_RR
+    std::string  name            = "tinylog";       // Thread name, at most 15 characters are kept
+    WaitStrategy wait            = WAIT_BLOCKING;
+    uint32_t     spin_us         = 50;              // WAIT_SPIN_YIELD: time spent spinning before yielding
+    uint32_t     notify_batch    = 8;               // WAIT_BLOCKING: wake the thread once per this many buffers
+    uint32_t     notify_delay_ms = 2;               // WAIT_BLOCKING: longest wait of a buffer for its batch
+};
+
+} // namespace logging
+
+#endif // _LOGGING_CONSUMER_OPTIONS_H_
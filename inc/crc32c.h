@@ -0,0 +1,27 @@
+#ifndef _LOGGING_CRC32C_H_
+#define _LOGGING_CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace logging {
+
+/**
+ * @brief Compute the CRC32C (Castagnoli) checksum of a memory block, with the
+ * SSE4.2 crc32 instruction where the CPU has it
+ * @param[in] crc Initial value, 0 to start a new checksum or the result of a
+ * previous call to continue it
+ * @param[in] data Data source address
+ * @param[in] size data size
+ * @retval The updated checksum
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t size);
+
+/**
+ * @brief Whether crc32c uses the SSE4.2 instruction on this CPU
+ */
+bool crc32c_hardware(void);
+
+} // namespace logging
+
+#endif // _LOGGING_CRC32C_H_
@@ -0,0 +1,169 @@
+#ifndef _LOGGING_FLIGHT_RECORDER_H_
+#define _LOGGING_FLIGHT_RECORDER_H_
+
+#include <sys/uio.h>
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "buffer_queue.h"
+
+namespace logging {
+
+/**
+ * @brief Flight recorder counters
+ */
+struct FlightStats
+{
+    uint64_t records;      // Records captured
+    uint64_t overwritten;  // Captured bytes dropped by the ring before a dump
+    uint64_t dumps;        // Dumps written
+    uint64_t dumped_bytes; // Bytes written by the dumps
+};
+
+/**
+ * @brief In-memory flight recorder. Records below the log level are kept in
+ * a ring of DataBuffers instead of being written; the oldest filled buffer is
+ * reused when the ring is full. A dump appends what the ring holds to a side
+ * file and empties the ring, so consecutive dumps do not repeat each other.
+ * @note Every capturing thread fills a buffer of the ring of its own, so a
+ * capture only takes a lock no other thread contends for, and the ring lock
+ * once per filled buffer. A dump therefore lists the records buffer by
+ * buffer, oldest filled first: the records of one thread are in order, those
+ * of different threads are not interleaved by time. The record is still
+ * formatted in full, a capture saves the write, not the building.
+ */
+class FlightRecorder
+{
+public:
+    /* Why a dump was written, may be combined */
+    enum Trigger
+    {
+        TRIGGER_RECORD = 1, // A record at or above the trigger level
+        TRIGGER_SIGNAL = 2, // SIGUSR1
+        TRIGGER_API    = 4, // log_flight_dump
+    };
+
+    FlightRecorder(void);
+
+    /**
+     * @brief Size the ring and set the side file, the records held so far
+     * are kept if the size does not change
+     * @param[in] bytes Ring size, rounded up to whole buffers, 0 disables the
+     * recorder and releases the ring
+     * @param[in] file Side file the dumps are appended to
+     * @retval false if the ring can not be allocated, the recorder is disabled
+     */
+    bool configure(size_t bytes, const std::string &file);
+
+    bool enabled (void) const
+    {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Capture a record
+     * @param[in] pieces Pieces of the record, in order
+     * @param[in] num_pieces Number of pieces
+     */
+    void append(const struct iovec *pieces, int num_pieces);
+
+    /**
+     * @brief Append the records held by the ring to the side file and empty
+     * the ring
+     * @param[in] triggers Trigger values, named in the dump header
+     * @retval false if the side file can not be written
+     */
+    bool dump(uint32_t triggers);
+
+    /**
+     * @brief Bytes held by the ring
+     */
+    size_t held_bytes(void);
+
+    FlightStats stats(void) const;
+
+    /**
+     * @brief fork() support: the prepare handler takes the locks and the
+     * parent releases them. The child handler releases them as well and
+     * notes the slot of the forking thread; restart_after_fork, called
+     * before the child records anything, rebuilds the slot locks and forgets
+     * the parent's records and the other threads.
+     */
+    void prepare_fork(void);
+    void after_fork_parent(void);
+    void after_fork_child(void);
+    void restart_after_fork(void);
+
+private:
+    /* The buffer a thread captures into */
+    struct Slot
+    {
+        std::mutex  lock;
+        DataBuffer *buffer = nullptr;
+    };
+
+    /* The slots of a thread, released when it exits */
+    struct ThreadSlots
+    {
+        ~ThreadSlots(void);
+
+        std::vector<std::pair<FlightRecorder *, Slot *>> slots;
+    };
+
+    /**
+     * @brief The slot of the calling thread, registered on first use
+     * @retval nullptr if it can not be allocated
+     */
+    Slot *thread_slot(void);
+
+    /**
+     * @brief Hand the buffer of an exiting thread to the ring and forget the
+     * slot
+     */
+    void release_slot(Slot *slot);
+
+    /**
+     * @brief Queue the buffer of a slot as filled, or as free if it is empty.
+     * Called with the slot lock and _lock held.
+     */
+    void detach_buffer(Slot &slot);
+
+    /**
+     * @brief A free buffer, or the oldest filled one with its records
+     * dropped. Called with _lock held.
+     * @retval nullptr if every buffer is held by a thread or the ring is empty
+     */
+    DataBuffer *take_buffer(void);
+
+    /* Lock order: _slots_lock, then a slot lock, then _lock */
+    std::mutex                         _slots_lock;
+    std::vector<std::unique_ptr<Slot>> _slots;
+    static thread_local ThreadSlots    _thread_slots;
+    /* In a forked child until restart_after_fork: the slot of the forking
+     * thread, the one that is kept */
+    bool  _restart_pending;
+    Slot *_fork_slot;
+
+    std::mutex                  _lock;
+    std::vector<DataBuffer_ptr> _ring;
+    /* Buffers given up by the threads, oldest first, and unused ones */
+    std::deque<DataBuffer *>    _filled;
+    std::vector<DataBuffer *>   _free;
+    std::string                 _file;
+    std::atomic<bool>           _enabled;
+    /* Serializes the writes of the side file */
+    std::mutex                  _file_lock;
+
+    std::atomic<uint64_t> _records;
+    std::atomic<uint64_t> _overwritten;
+    std::atomic<uint64_t> _dumps;
+    std::atomic<uint64_t> _dumped_bytes;
+}; // class FlightRecorder
+
+} // namespace logging
+
+#endif // _LOGGING_FLIGHT_RECORDER_H_
@@ -0,0 +1,72 @@
+#ifndef _LOGGING_LOG_CONFIG_H_
+#define _LOGGING_LOG_CONFIG_H_
+
+#include <functional>
+#include <istream>
+#include <string>
+#include <thread>
+#include "logging.h"
+
+namespace logging {
+
+/**
+ * @brief Read "key = value" lines into a configuration. Keys are the field
+ * names of LogControl; '#' starts a comment. Fields that are not mentioned
+ * keep their value.
+ * @param[in] in Configuration text
+ * @param[inout] cfg Configuration to update, left untouched on error
+ * @param[out] error Description of the first error
+ * @retval true on success
+ */
+bool parse_log_config(std::istream &in, LogContorl &cfg, std::string &error);
+
+/**
+ * @brief Watches a configuration file with inotify and calls back when it has
+ * been rewritten or replaced. The directory is watched rather than the file,
+ * so that editors that save by renaming a new file over the old one are seen.
+ */
+class ConfigWatcher
+{
+public:
+    ConfigWatcher(void);
+
+    /**
+     * @brief ConfigWatcher destructor, stops watching
+     */
+    ~ConfigWatcher(void);
+
+    /**
+     * @brief Start watching
+     * @param[in] path Configuration file
+     * @param[in] on_change Called from the watcher thread after a change
+     * @retval true if the watch could be set up
+     */
+    bool start(const std::string &path, std::function<void(void)> on_change);
+
+    /**
+     * @brief Stop watching and wait for the watcher thread
+     */
+    void stop(void);
+
+    bool running (void) const
+    {
+        return _thread.joinable();
+    }
+
+private:
+    /**
+     * @brief Watcher thread, waits for inotify events or the stop request
+     */
+    void watch_thread(void);
+
+    std::string               _name;
+    std::function<void(void)> _on_change;
+    int                       _inotify_fd;
+    /* eventfd written by stop() */
+    int                       _stop_fd;
+    std::thread               _thread;
+}; // class ConfigWatcher
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_CONFIG_H_
@@ -0,0 +1,263 @@
+#ifndef _LOGGING_LOG_CONTAINER_H_
+#define _LOGGING_LOG_CONTAINER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace logging {
+
+/**
+ * @brief Seekable log container format.
+ *
+ * A container file starts with a ContainerFileHeader followed by blocks. Each
+ * block holds the data of one DataBuffer flush and starts with a
+ * ContainerBlockHeader describing it (time range, record count, sequence
+ * range, checksum). When a file is rolled or closed, an index block is
+ * appended: its payload lists every data block with delta-encoded varints and
+ * ends with a ContainerTrailer, so the trailer is always the last 16 bytes of
+ * a finished file. Readers locate the index from the trailer and binary
+ * search it; files without a valid trailer (still being written, or cut by a
+ * crash) are indexed by hopping from block header to block header.
+ *
+ * All integers are stored in host byte order (little endian on the
+ * supported platforms).
+ */
+
+/* Magic numbers, "TLC1", "TLB1", "TLI1", "TLT1" */
+static const uint32_t CONTAINER_FILE_MAGIC    = 0x31434C54;
+static const uint32_t CONTAINER_BLOCK_MAGIC   = 0x31424C54;
+static const uint32_t CONTAINER_INDEX_MAGIC   = 0x31494C54;
+static const uint32_t CONTAINER_TRAILER_MAGIC = 0x31544C54;
+static const uint16_t CONTAINER_VERSION       = 1;
+
+struct ContainerFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;   // sizeof(ContainerFileHeader)
+    uint64_t reserved;
+};
+
+struct ContainerBlockHeader
+{
+    uint32_t magic;             // CONTAINER_BLOCK_MAGIC or CONTAINER_INDEX_MAGIC
+    uint32_t payload_size;      // Bytes following this header
+    uint64_t first_ts_us;       // Timestamp of the first record, microseconds since epoch
+    uint32_t last_ts_delta_us;  // Last record timestamp minus first_ts_us
+    uint32_t record_count;
+    uint64_t first_seq;         // Sequence number of the first record
+    uint32_t seq_span;          // Last sequence number minus first_seq
+    uint32_t payload_crc;       // CRC32C of the payload
+    uint32_t header_crc;        // CRC32C of all the preceding header fields
+    uint32_t reserved;
+};
+
+struct ContainerTrailer
+{
+    uint64_t index_offset;  // File offset of the index block header
+    uint32_t block_count;   // Number of data blocks listed in the index
+    uint32_t magic;         // CONTAINER_TRAILER_MAGIC
+};
+
+static_assert(sizeof(ContainerFileHeader) == 16, "unexpected container file header size");
+static_assert(sizeof(ContainerBlockHeader) == 48, "unexpected container block header size");
+static_assert(sizeof(ContainerTrailer) == 16, "unexpected container trailer size");
+
+/**
+ * @brief Description of the records held by one block
+ */
+struct BlockMeta
+{
+    BlockMeta(void)
+        : first_ts_us(0)
+        , last_ts_us(0)
+        , record_count(0)
+        , first_seq(0)
+        , last_seq(0)
+    {
+    }
+
+    uint64_t first_ts_us;
+    uint64_t last_ts_us;
+    uint32_t record_count;
+    uint64_t first_seq;
+    uint64_t last_seq;
+};
+
+/**
+ * @brief Location and description of a data block inside a container file
+ */
+struct ContainerBlock
+{
+    uint64_t  offset;       // File offset of the block header
+    uint32_t  payload_size;
+    uint32_t  payload_crc;
+    BlockMeta meta;
+};
+
+/**
+ * @brief Fill in a block header for a payload
+ * @param[in] meta Description of the records in the payload
+ * @param[in] payload Payload source address
+ * @param[in] size Payload size
+ * @param[out] header The header to be written in front of the payload
+ */
+void container_block_header(const BlockMeta &meta, const char *payload, uint32_t size, ContainerBlockHeader &header);
+
+/**
+ * @brief Fill in a container file header
+ */
+void container_file_header(ContainerFileHeader &header);
+
+/**
+ * @brief Block list of a container file being written, serialized as the
+ * index block when the file is finished.
+ */
+class ContainerIndex
+{
+public:
+    /**
+     * @brief Register a block that has been written
+     * @param[in] offset File offset of the block header
+     * @param[in] payload_size Payload size of the block
+     * @param[in] meta Description of the records in the block
+     */
+    void add(uint64_t offset, uint32_t payload_size, const BlockMeta &meta);
+
+    /**
+     * @brief Serialize the index block (header, entries and trailer)
+     * @param[in] index_offset File offset at which the index block is written
+     * @param[out] out Bytes to append to the file
+     */
+    void encode(uint64_t index_offset, std::string &out) const;
+
+    void clear(void)
+    {
+        _blocks.clear();
+    }
+
+    size_t size(void) const
+    {
+        return _blocks.size();
+    }
+
+    /**
+     * @brief Replace the block list, used when appending to an existing file
+     */
+    void assign(const std::vector<ContainerBlock> &blocks)
+    {
+        _blocks = blocks;
+    }
+
+private:
+    std::vector<ContainerBlock> _blocks;
+};
+
+/**
+ * @brief Read-only access to a container file. The file is memory mapped and
+ * the block list is taken from the index block when the file has been
+ * finished, otherwise it is rebuilt by hopping over the block headers.
+ */
+class ContainerReader
+{
+public:
+    ContainerReader(void);
+    ~ContainerReader(void);
+
+    /**
+     * @brief Open a container file
+     * @param[in] path Path of the file
+     * @retval true on success, false if the file can not be mapped or is not
+     * a container file
+     */
+    bool open(const std::string &path);
+
+    /**
+     * @brief Unmap the file
+     */
+    void close(void);
+
+    /**
+     * @brief Check whether a memory block starts with a container file header
+     */
+    static bool is_container(const char *data, size_t size);
+
+    /**
+     * @brief Whether the block list was loaded from an index block
+     */
+    bool has_index(void) const
+    {
+        return _has_index;
+    }
+
+    size_t block_count(void) const
+    {
+        return _blocks.size();
+    }
+
+    const ContainerBlock &block(size_t i) const
+    {
+        return _blocks[i];
+    }
+
+    const std::vector<ContainerBlock> &blocks(void) const
+    {
+        return _blocks;
+    }
+
+    /**
+     * @brief Payload of a block, valid until close()
+     */
+    const char *payload(size_t i) const;
+
+    /**
+     * @brief Check the payload checksum of a block
+     */
+    bool verify(size_t i) const;
+
+    /**
+     * @brief Binary search for the first block that may hold records at or
+     * after a time
+     * @param[in] ts_us Time in microseconds since epoch
+     * @retval Block number, block_count() if no block has such records
+     */
+    size_t find_block(uint64_t ts_us) const;
+
+    /**
+     * @brief Size of the mapped file
+     */
+    size_t file_size(void) const
+    {
+        return _size;
+    }
+
+private:
+    /**
+     * @brief Load the block list from the index block located by the trailer
+     */
+    bool load_index(void);
+
+    /**
+     * @brief Rebuild the block list by walking the block headers
+     */
+    void scan_blocks(void);
+
+    /**
+     * @brief Validate the block header at an offset
+     */
+    bool read_header(uint64_t offset, ContainerBlockHeader &header) const;
+
+    const char                 *_map;
+    size_t                      _size;
+    bool                        _has_index;
+    std::vector<ContainerBlock> _blocks;
+    /* Running maximum of the last timestamps, monotonic so that it can be
+     * binary searched even if blocks overlap in time */
+    std::vector<uint64_t> _max_last_ts;
+}; // class ContainerReader
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_CONTAINER_H_
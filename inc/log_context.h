@@ -0,0 +1,80 @@
+#ifndef _LOGGING_LOG_CONTEXT_H_
+#define _LOGGING_LOG_CONTEXT_H_
+
+#include <stdint.h>
+#include <string>
+#include "log_kv.h"
+
+namespace logging {
+
+/**
+ * @brief Per-thread context of the records (LogControl::show_context): the
+ * thread id, the thread name and fields such as request or trace ids set
+ * with ScopedLogContext. The context is rendered once per change and format
+ * and cached, a record only copies the cached bytes.
+ */
+
+/**
+ * @brief Name the calling thread in its records, the name given to
+ * pthread_setname_np (or the process name) is used otherwise
+ */
+void log_set_thread_name(const char *name);
+
+/**
+ * @brief The rendered context of the calling thread: " tid=.. thread=..
+ * key=value" for text headers and logfmt records, ",\"tid\":..,..." for JSON
+ * records
+ */
+const std::string &log_context_rendered(KvFormat format);
+
+/**
+ * @brief Re-read the thread ids in a forked child, called by the fork
+ * handler
+ */
+void log_context_after_fork(void);
+
+/**
+ * @brief Sets a context field of the calling thread for its lifetime, an
+ * outer value of the same key is restored afterwards. Used by LOG_CONTEXT.
+ */
+class ScopedLogContext
+{
+public:
+    /**
+     * @param [in] key : Field name, a string that outlives the object
+     * @param [in] value : Field value
+     */
+    ScopedLogContext(const char *key, const std::string &value);
+    ScopedLogContext(const char *key, const char *value);
+    ScopedLogContext(const char *key, long long value);
+    ScopedLogContext(const char *key, unsigned long long value);
+    ScopedLogContext(const char *key, int value)
+        : ScopedLogContext(key, static_cast<long long>(value))
+    {
+    }
+    ScopedLogContext(const char *key, unsigned int value)
+        : ScopedLogContext(key, static_cast<unsigned long long>(value))
+    {
+    }
+    ScopedLogContext(const char *key, long value)
+        : ScopedLogContext(key, static_cast<long long>(value))
+    {
+    }
+    ScopedLogContext(const char *key, unsigned long value)
+        : ScopedLogContext(key, static_cast<unsigned long long>(value))
+    {
+    }
+
+    ~ScopedLogContext(void);
+
+    ScopedLogContext(const ScopedLogContext &)            = delete;
+    ScopedLogContext &operator=(const ScopedLogContext &) = delete;
+
+private:
+    /* Position of the field in the thread context */
+    size_t _index;
+}; // class ScopedLogContext
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_CONTEXT_H_
@@ -0,0 +1,113 @@
+#ifndef _LOGGING_LOG_DEDUP_H_
+#define _LOGGING_LOG_DEDUP_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "buffer_queue.h"
+
+namespace logging {
+
+/**
+ * @brief Duplicate collapsing counters
+ */
+struct DedupStats
+{
+    uint64_t records;     // Records looked at
+    uint64_t collapsed;   // Records dropped as repeats
+    uint64_t summaries;   // "last message repeated N times" records written
+    uint64_t bytes_saved; // Bytes of the dropped records
+};
+
+/**
+ * @brief Consumer side collapsing of repeated records.
+ * A record is identified by its bytes without the time stamp, as noted with
+ * DataBuffer::note_span. The first occurrence is written and opens a window;
+ * repeats within the window are dropped and only counted. When the window
+ * ends, one record stands for all of them: the last repeat (for its time)
+ * followed by " [last message repeated N times]", or with a "repeated" field
+ * for LOG_KV records. A record that appears again later opens a new window.
+ * Only the background thread uses a LogDedup, the statistics may be read
+ * from anywhere.
+ */
+class LogDedup
+{
+public:
+    LogDedup(void);
+
+    /**
+     * @brief Drop the repeats from a buffer, moving the remaining data
+     * together
+     * @param[inout] buffer Buffer about to be written
+     * @param[in] window_ms Length of the window
+     * @param[in] now_ms Current time in milliseconds, monotonic
+     * @param[out] summaries Appended with the records for windows that ended,
+     * to be written before the buffer
+     */
+    void filter(DataBuffer &buffer, uint32_t window_ms, uint64_t now_ms, std::string &summaries);
+
+    /**
+     * @brief Close the windows that have ended
+     * @param[in] now_ms Current time in milliseconds, monotonic, UINT64_MAX
+     * to close all of them
+     * @param[out] summaries Appended with their records
+     */
+    void expire(uint64_t now_ms, std::string &summaries);
+
+    /**
+     * @brief Whether a window is open
+     */
+    bool pending (void) const
+    {
+        return _live > 0;
+    }
+
+    /**
+     * @brief Forget every window without writing anything, e.g. in a forked
+     * child whose parent writes them
+     */
+    void reset(void);
+
+    DedupStats stats(void) const;
+
+private:
+    struct Entry
+    {
+        uint64_t    hash       = 0;
+        uint64_t    expires_ms = 0; // 0 when the slot is free
+        uint64_t    count      = 0; // Repeats dropped so far
+        uint32_t    time_begin = 0; // Time stamp position in record
+        uint32_t    time_end   = 0;
+        std::string record;     // First occurrence
+        std::string last_time;  // Time stamp of the last repeat
+    };
+
+    /* Distinct records followed at a time, more are passed through */
+    static const size_t TABLE_SIZE = 256;
+    static const size_t MAX_LIVE   = TABLE_SIZE / 2;
+
+    /**
+     * @brief Find the slot of a record, or the free slot it would take
+     */
+    Entry *lookup(uint64_t hash, const char *record, const RecordSpan &span);
+
+    /**
+     * @brief Append the record that stands for the repeats of an entry
+     */
+    void summarize(const Entry &entry, std::string &summaries);
+
+    std::vector<Entry> _table;
+    size_t             _live;
+    /* Earliest end of an open window */
+    uint64_t           _next_expiry_ms;
+
+    std::atomic<uint64_t> _records;
+    std::atomic<uint64_t> _collapsed;
+    std::atomic<uint64_t> _summaries;
+    std::atomic<uint64_t> _bytes_saved;
+}; // class LogDedup
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_DEDUP_H_
@@ -0,0 +1,123 @@
+#ifndef _LOGGING_LOG_EPOCH_H_
+#define _LOGGING_LOG_EPOCH_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace logging {
+
+/**
+ * @brief Epoch based reclamation (a small RCU) for objects that are read on the
+ * hot path without locks and replaced now and then.
+ *
+ * Readers announce themselves in a slot of their own: read_lock() stores the
+ * current epoch in the slot, read_unlock() clears it. A writer publishes the
+ * replacement first and then hands the old object to retire(), which stamps it
+ * with a new epoch. The object is freed by a later reclaim() once no slot is
+ * still in an older epoch, i.e. once every reader that could have seen it is
+ * done. Neither side ever waits for the other.
+ * @note Slots are never freed, a thread releases its slot on exit and the next
+ * thread reuses it.
+ */
+class EpochDomain
+{
+public:
+    struct Slot
+    {
+        Slot(void)
+            : epoch(0)
+            , in_use(true)
+            , next(nullptr)
+        {
+        }
+
+        /* Epoch the reader entered in, 0 when outside a read section */
+        std::atomic<uint64_t> epoch;
+        std::atomic<bool>     in_use;
+        Slot                 *next;
+    };
+
+    EpochDomain(void)
+        : _slots(nullptr)
+        , _epoch(1)
+    {
+    }
+
+    /**
+     * @brief EpochDomain destructor, frees everything still retired
+     */
+    ~EpochDomain(void);
+
+    /**
+     * @brief Get a reader slot for the calling thread, lock free
+     */
+    Slot *acquire_slot(void);
+
+    /**
+     * @brief Give a slot back, e.g. when its thread exits
+     */
+    void release_slot (Slot *slot)
+    {
+        slot->epoch.store(0, std::memory_order_release);
+        slot->in_use.store(false, std::memory_order_release);
+    }
+
+    /**
+     * @brief Enter a read section, pointers loaded afterwards stay valid until
+     * read_unlock
+     */
+    void read_lock (Slot *slot)
+    {
+        slot->epoch.store(_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+        /* The slot store must be visible before the protected pointer is read,
+         * pairs with the fence in retire */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void read_unlock (Slot *slot)
+    {
+        slot->epoch.store(0, std::memory_order_release);
+    }
+
+    /**
+     * @brief Hand over an object that has been unpublished, it is deleted once
+     * no reader can hold it any more
+     */
+    template <typename T>
+    void retire (const T *object)
+    {
+        retire(const_cast<T *>(object), [] (void *p) { delete static_cast<T *>(p); });
+    }
+
+    void retire(void *object, void (*deleter)(void *));
+
+    /**
+     * @brief Free the retired objects no reader can hold any more
+     * @retval Number of objects still waiting
+     */
+    size_t reclaim(void);
+
+private:
+    struct Retired
+    {
+        void    *object;
+        void   (*deleter)(void *);
+        uint64_t epoch;
+    };
+
+    /**
+     * @brief Oldest epoch a reader is currently in, UINT64_MAX if none
+     */
+    uint64_t min_reader_epoch(void);
+
+    std::atomic<Slot *>   _slots;
+    std::atomic<uint64_t> _epoch;
+    std::mutex            _retired_lock;
+    std::vector<Retired>  _retired;
+}; // class EpochDomain
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_EPOCH_H_
@@ -1,10 +1,18 @@
 #ifndef _LOGGING_LOG_FILE_H_
 #define _LOGGING_LOG_FILE_H_
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include "base_file.h"
+#include "log_container.h"
+#include "log_retention.h"
+#include "log_sink.h"
 
 namespace logging {
 
@@ -13,8 +21,17 @@ namespace logging {
  * Whenever the file existence time reaches the set rolling cycle time, or the
  * file size reaches the set rolling size, a new file will be automatically
  * generated.
+ * @note Rolling is done by a helper thread so that the writer never waits for
+ * the disk: the next file is pre-opened as "<file_name>.next", at roll time
+ * the writer only swaps the file pointers, and the helper thread flushes,
+ * syncs, closes and renames the old file afterwards. The helper thread also
+ * acts as the timer for time based rolling and as the housekeeping thread
+ * that applies the retention policy to rolled files.
+ * In container mode the data is written as blocks of the seekable container
+ * format (see log_container.h), and the index block is appended by the
+ * helper thread when a file is rolled.
  */
-class LogFile
+class LogFile : public LogSink
 {
 public:
     /**
@@ -24,8 +41,19 @@ public:
      * value is 0, no new files will be generated based on time rolling.
      * @param[in] roll_size_bytes File rolling size, in bytes. If the value is
      * 0, new log files will not be rolled based on the log file size.
+     * @param[in] retention Limits on the number, total size and age of rolled
+     * files. By default rolled files are never removed.
+     * @param[in] container Whether to write the seekable container format
+     * instead of plain text
      */
-    LogFile(std::string file_name, uint64_t roll_cycle_minutes = 0, uint64_t roll_size_bytes = 0);
+    LogFile(std::string file_name, uint64_t roll_cycle_minutes = 0, uint64_t roll_size_bytes = 0,
+            const RetentionPolicy &retention = RetentionPolicy(), bool container = false);
+
+    /**
+     * @brief LogFile destructor, finishes pending rolls and stops the helper
+     * thread
+     */
+    ~LogFile(void) override;
 
     /**
      * @brief Write log data
@@ -34,22 +62,118 @@ public:
      * @param [in] flush_now Whether to flush the buffer data to the file
      * immediately
      */
-    void write_logdata(const char *logdata, uint32_t size, bool flush_now = false);
+    void write_logdata(const char *logdata, uint32_t size, bool flush_now = false) override;
+
+    /**
+     * @brief Write the data of one buffer flush together with the
+     * description of its records. In text mode the description is ignored.
+     * @param [in] logdata The source address of the data to be written
+     * @param [in] size The size of the data to be written
+     * @param [in] meta Time range, record count and sequence range of the data
+     * @param [in] flush_now Whether to flush the buffer data to the file
+     * immediately
+     */
+    void write_block(const char *logdata, uint32_t size, const BlockMeta &meta, bool flush_now = false) override;
+
+    /**
+     * @brief Write one block given as several pieces. In text mode they go to
+     * the file with writev, without being copied; the container format
+     * joins them into one block.
+     * @param [in] pieces Pieces of the data, in order
+     * @param [in] num_pieces Number of pieces
+     * @param [in] meta Time range, record count and sequence range of the data
+     * @param [in] flush_now Whether to flush the buffer data to the file
+     * immediately
+     */
+    void write_blockv(const struct iovec *pieces, int num_pieces, const BlockMeta &meta,
+                      bool flush_now = false) override;
 
     /**
      * @brief Flush buffer data to file
      */
-    void flush(void);
+    void flush(void) override;
+
+    /**
+     * @brief Flush buffer data to file and wait until it reaches the disk
+     */
+    void sync(void) override;
+
+    /**
+     * @brief Flush the file and hold the roll lock across fork()
+     */
+    void prepare_fork(void) override;
+
+    /**
+     * @brief Release the roll lock in the parent
+     */
+    void after_fork_parent(void) override;
+
+    /**
+     * @brief The child keeps appending to the current file and leaves rolling
+     * and retention to the parent, which owns the helper thread. It reopens
+     * the file name once the parent has rolled the file.
+     */
+    void after_fork_child(void) override;
 
 private:
+    /* A file that has been swapped out and waits to be closed and renamed */
+    struct RollTask
+    {
+        std::unique_ptr<BaseFile> file;
+        std::time_t               create_time;
+        uint32_t                  index;
+        /* Container mode: block list and end offset of the file */
+        ContainerIndex            blocks;
+        uint64_t                  end_offset;
+    };
+
     /**
      * @brief The current log file is saved in the format of logfile.YMDH. A new
      * log file is also generated.
+     * @note Only swaps in the pre-opened file, the old file is handed over to
+     * the helper thread.
      */
     void roll_log_file(void);
 
+    /**
+     * @brief Roll the file if the size limit is reached or the helper thread
+     * has signalled the end of the rolling cycle
+     */
+    void check_roll(void);
+
+    /**
+     * @brief Forked child sharing the file: reopen the file name once the
+     * parent has rolled the file away from it
+     */
+    void follow_roll(void);
+
+    /**
+     * @brief Container mode: append the index block of a file
+     */
+    void write_index(BaseFile &file, const ContainerIndex &blocks, uint64_t end_offset);
+
+    /**
+     * @brief Helper thread: closes and renames rolled files, pre-opens the
+     * next file and raises the time based roll flag.
+     */
+    void roll_thread(void);
+
+    /**
+     * @brief Close, sync and rename a swapped out file, then move the
+     * pre-opened file to the active file name. Runs on the helper thread.
+     */
+    void finish_roll(RollTask &task);
+
+    /**
+     * @brief Build the name of a rolled file
+     */
+    std::string rolled_file_name(std::time_t create_time, uint32_t index);
+
     std::string _file_name;
 
+    /* Name under which the next file is pre-opened */
+    std::string _next_file_name;
+
     /* Every how many minutes a new log file is generated. */
     uint64_t _roll_cycle_minutes;
 
@@ -62,11 +186,44 @@ private:
     /* Current log file creation time */
     std::time_t _file_create_time;
 
+    /* Suffix index of the next rolled file, continues after the largest index
+     * found on disk at startup */
+    uint32_t _roll_index;
+
+    /* Index of rolled files, only used by the helper thread after
+     * construction */
+    LogRetention _retention;
+
+    /* Container mode, current offset and block list of the active file */
+    bool           _container;
+    uint64_t       _file_offset;
+    ContainerIndex _blocks;
+
+    /* Set by the helper thread when the rolling cycle has elapsed */
+    std::atomic<bool> _time_roll_due;
+
+    /* Protects _next_file, _roll_tasks, _file_create_time (for the helper
+     * thread) and _roll_running */
+    std::mutex                _roll_lock;
+    std::condition_variable   _roll_cv;
+    std::unique_ptr<BaseFile> _next_file;
+    std::deque<RollTask>      _roll_tasks;
+    bool                      _roll_running;
+    std::thread               _roll_thread;
+    /* Set in a forked child that shares the file with its parent */
+    bool                      _forked_child;
+    /* Set once the file may be appended to by other processes: every write
+     * is flushed at once so that each buffer reaches the file with a single
+     * O_APPEND write and records of different processes do not interleave */
+    bool                      _shared;
+
     static const uint32_t SECONDS_PER_MINUTE = 60;
     static const uint32_t CHECK_PERIOD       = 1024;
     static const uint32_t MAX_FILENAME_SIZE  = 100;
+    /* How often the helper thread checks the age limit */
+    static const uint32_t RETENTION_CHECK_SECONDS = 60;
 }; // LogFile
 
 } // namespace logging
 
-#endif // LOGGING_LOG_FILE_H_
\ No newline at end of file
+#endif // LOGGING_LOG_FILE_H_
@@ -0,0 +1,133 @@
+#ifndef _LOGGING_LOG_FRAME_H_
+#define _LOGGING_LOG_FRAME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace logging {
+
+/**
+ * @brief Per-record framing.
+ * With framing enabled every record is preceded by a fixed size text prefix
+ *
+ *     @<seq>:<crc>:<size> <record>
+ *
+ * seq is the record sequence number (16 hex digits), crc the CRC32C of the
+ * record bytes and size their number (8 hex digits each). Sequence numbers
+ * are shared by both lanes and taken even for records that are dropped, so a
+ * lost record leaves a gap; the checksum catches records that were damaged
+ * or cut short. The prefix is plain text so the files stay readable with the
+ * usual tools.
+ * Producers only format the prefix with a zero checksum; the background
+ * thread fills in the checksums of a buffer right before writing it, which
+ * keeps the CRC off the hot path and still covers everything from the buffer
+ * to the disk.
+ */
+static const size_t RECORD_FRAME_SIZE = 36;
+
+/**
+ * @brief Format the frame prefix of a record, with a zero checksum
+ * @param[in] seq Record sequence number
+ * @param[in] size Record size
+ * @param[out] out RECORD_FRAME_SIZE bytes, not terminated
+ */
+void record_frame(uint64_t seq, uint32_t size, char *out);
+
+/**
+ * @brief Fill in the checksum of a frame prefix
+ * @param[inout] frame Prefix written by record_frame
+ * @param[in] crc CRC32C of the record bytes
+ */
+void set_frame_crc(char *frame, uint32_t crc);
+
+/**
+ * @brief Parse a frame prefix
+ * @param[in] p Data that may start with a frame prefix
+ * @param[in] avail Bytes available at p
+ * @param[out] seq Record sequence number
+ * @param[out] crc CRC32C of the record bytes
+ * @param[out] size Record size
+ * @retval true if p starts with a well formed prefix
+ */
+bool parse_record_frame(const char *p, size_t avail, uint64_t &seq, uint32_t &crc, uint32_t &size);
+
+/**
+ * @brief Result of a framing check
+ */
+struct FrameReport
+{
+    /* A run of missing sequence numbers, first to last inclusive */
+    struct Gap
+    {
+        uint64_t run;
+        uint64_t first;
+        uint64_t last;
+    };
+
+    uint64_t         records       = 0; // Records with a valid checksum
+    uint64_t         corrupt       = 0; // Records whose checksum does not match
+    uint64_t         torn          = 0; // Records cut short by the next record or the end of the data
+    uint64_t         missing       = 0; // Sequence numbers never seen
+    uint64_t         duplicates    = 0; // Sequence numbers seen more than once
+    uint64_t         unframed      = 0; // Bytes outside any frame
+    uint64_t         runs          = 0; // Logger runs, each starts again at sequence number 0
+    std::vector<Gap> gaps;              // The first MAX_GAPS gaps
+
+    static const size_t MAX_GAPS = 64;
+
+    bool clean (void) const
+    {
+        return (0 == corrupt) && (0 == torn) && (0 == missing) && (0 == duplicates);
+    }
+};
+
+/**
+ * @brief Checks framed log data: the checksum of every record and the
+ * sequence numbers of each run for gaps and duplicates. Feed the data of the
+ * files in the order they were written, then call finish.
+ */
+class FrameVerifier
+{
+public:
+    FrameVerifier(void)
+        : _has_zero(false)
+    {
+    }
+
+    /**
+     * @brief Check a piece of data that holds whole records, e.g. a file or
+     * a container block
+     * @param[in] data Data source address
+     * @param[in] size Data size
+     */
+    void scan(const char *data, size_t size);
+
+    /**
+     * @brief Look for gaps in the sequence numbers seen so far
+     * @retval The report, the verifier starts over afterwards
+     */
+    FrameReport finish(void);
+
+private:
+    /**
+     * @brief Offset of the next frame prefix after pos, size if there is none.
+     * Records need not end with a new line, so any '@' may start one.
+     */
+    static size_t next_frame(const char *data, size_t size, size_t pos);
+
+    /**
+     * @brief Close the current run and account its gaps
+     */
+    void end_run(void);
+
+    FrameReport           _report;
+    std::vector<uint64_t> _seqs;
+    /* Whether the current run has seen sequence number 0 */
+    bool                  _has_zero;
+}; // class FrameVerifier
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_FRAME_H_
@@ -0,0 +1,50 @@
+#ifndef _LOGGING_LOG_HEXDUMP_H_
+#define _LOGGING_LOG_HEXDUMP_H_
+
+#include <stddef.h>
+
+namespace logging {
+
+/**
+ * @brief Hex dump of binary data in the classic offset/hex/ASCII columns
+ * (hexdump -C), used by LOG_HEXDUMP:
+ *
+ *     00000000  48 65 6c 6c 6f 2c 20 77  6f 72 6c 64 0a 00 01 02  |Hello, world....|
+ *
+ * Every line covers 16 bytes and ends with a newline. In the last one the hex
+ * column is padded with spaces and the ASCII column is as long as the data.
+ * Bytes outside the printable ASCII range show as '.'.
+ */
+static const size_t HEXDUMP_BYTES_PER_LINE = 16;
+static const size_t HEXDUMP_LINE_SIZE      = 79;
+
+/**
+ * @brief Size of the hex dump of size bytes
+ */
+inline size_t
+hexdump_size (size_t size)
+{
+    size_t rest = size % HEXDUMP_BYTES_PER_LINE;
+    return size / HEXDUMP_BYTES_PER_LINE * HEXDUMP_LINE_SIZE
+           + ((0 != rest) ? HEXDUMP_LINE_SIZE - HEXDUMP_BYTES_PER_LINE + rest : 0);
+}
+
+/**
+ * @brief Format a hex dump, with AVX2 or SSSE3 where the CPU has them
+ * @param[in] data Data source address
+ * @param[in] size data size
+ * @param[in] offset Offset shown for the first byte
+ * @param[out] out hexdump_size(size) bytes
+ * @retval Number of bytes written to out
+ */
+size_t hexdump_format(const void *data, size_t size, size_t offset, char *out);
+
+/**
+ * @brief Instruction set used by hexdump_format on this CPU: "avx2", "ssse3"
+ * or "scalar"
+ */
+const char *hexdump_isa(void);
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_HEXDUMP_H_
@@ -0,0 +1,121 @@
+#ifndef _LOGGING_LOG_KV_H_
+#define _LOGGING_LOG_KV_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "log_stream.h"
+
+namespace logging {
+
+/**
+ * @brief Output format of structured (key-value) log records
+ */
+enum KvFormat
+{
+    KV_FORMAT_JSON = 0,     // One JSON object per line
+    KV_FORMAT_LOGFMT,       // key=value pairs separated by spaces
+};
+
+/**
+ * @brief A single typed key-value field of a structured log record.
+ * @note Strings are referenced, not copied, so a field must not outlive the
+ * statement that created it. Use kv() to build fields.
+ */
+struct KvField
+{
+    enum Type
+    {
+        KV_NONE = 0,
+        KV_INT,
+        KV_UINT,
+        KV_DOUBLE,
+        KV_BOOL,
+        KV_STRING,
+    };
+
+    KvField(void)
+        : key(nullptr)
+        , key_len(0)
+        , type(KV_NONE)
+        , str_len(0)
+    {
+        value.i = 0;
+    }
+
+    const char *key;
+    size_t      key_len;
+    Type        type;
+    union
+    {
+        int64_t     i;
+        uint64_t    u;
+        double      d;
+        bool        b;
+        const char *s;
+    } value;
+    size_t str_len;
+};
+
+/* Field constructors, the value type selects the encoding */
+KvField kv(const char *key, bool value);
+KvField kv(const char *key, int value);
+KvField kv(const char *key, long value);
+KvField kv(const char *key, long long value);
+KvField kv(const char *key, unsigned int value);
+KvField kv(const char *key, unsigned long value);
+KvField kv(const char *key, unsigned long long value);
+KvField kv(const char *key, double value);
+KvField kv(const char *key, const char *value);
+KvField kv(const char *key, const char *value, size_t len);
+KvField kv(const char *key, const std::string &value);
+
+/**
+ * @brief Encoders writing structured records directly into a LogStream.
+ * String escaping scans 16 bytes at a time with SSE2 and copies clean runs
+ * in one piece; numbers are rendered without going through iostream.
+ */
+class KvEncoder
+{
+public:
+    /**
+     * @brief Append a JSON string literal (with quotes) to the stream
+     * @param [in] stream : Destination stream
+     * @param [in] str : String source address
+     * @param [in] len : String length
+     */
+    static void json_string(LogStream &stream, const char *str, size_t len);
+
+    /**
+     * @brief Append a logfmt value, quoted only when it contains a space,
+     * '=', a quote or a control character
+     * @param [in] stream : Destination stream
+     * @param [in] str : String source address
+     * @param [in] len : String length
+     */
+    static void logfmt_string(LogStream &stream, const char *str, size_t len);
+
+    /**
+     * @brief Append the decimal representation of an integer
+     */
+    static void int_value(LogStream &stream, int64_t value);
+    static void uint_value(LogStream &stream, uint64_t value);
+
+    /**
+     * @brief Append a floating point value. Non-finite values are written as
+     * null in JSON and as NaN/+Inf/-Inf in logfmt.
+     */
+    static void double_value(LogStream &stream, double value, KvFormat format);
+
+    /**
+     * @brief Append ",key:value" (JSON) or " key=value" (logfmt)
+     * @param [in] stream : Destination stream
+     * @param [in] field : The field to be encoded
+     * @param [in] format : Output format
+     */
+    static void field(LogStream &stream, const KvField &field, KvFormat format);
+};
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_KV_H_
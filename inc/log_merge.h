@@ -0,0 +1,167 @@
+#ifndef _LOGGING_LOG_MERGE_H_
+#define _LOGGING_LOG_MERGE_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "buffer_queue.h"
+
+namespace logging {
+
+/**
+ * @brief Record merge counters
+ */
+struct MergeStats
+{
+    uint64_t records;  // Records merged
+    uint64_t late;     // Records that arrived after later ones had been written
+    uint64_t runs;     // Buffers merged
+    uint64_t early;    // Records written before the window had passed, the merge was holding too much
+    uint64_t merge_ns; // Time spent merging, without writing the output
+};
+
+/**
+ * @brief Consumer side merge of records from several producer streams by
+ * time stamp and sequence number.
+ * Every buffer handed over is a run of records; the records of a run are put
+ * in order when it is added, and the heads of all runs are kept in a min-heap.
+ * A record is written once the watermark (now - reorder window) has passed
+ * its time, assuming that no producer hands over a record later than the
+ * window: the output is in order as long as that holds. Records that arrive
+ * later are written right away and counted as late.
+ * The records of a buffer are copied into a buffer of the merge when it is
+ * added and the lane gets its buffer back at once, so holding records for
+ * the window never starves the lanes. Only a buffer with a record too large
+ * to copy (an extent or a payload) is held, and at most MAX_LANE_RUNS of
+ * those per lane. With more than that, or more than MAX_RUNS buffers held
+ * in all, the earliest records are written before the window has passed.
+ * Only the background thread uses a RecordMerger, the statistics may be read
+ * from anywhere.
+ */
+class RecordMerger
+{
+public:
+    /* Called with an output buffer that is full or at the end of a drain,
+     * or with a buffer holding a record too large for it, and whether it
+     * holds records of the priority lane */
+    using WriteFunc = std::function<void(DataBuffer &out, bool urgent)>;
+    /* Called with a buffer whose records have all been written, and its lane */
+    using ReleaseFunc = std::function<void(DataBuffer_ptr &buffer, bool urgent)>;
+
+    /* Buffers held in all, about 8 MB of records */
+    static const size_t MAX_RUNS = 256;
+    /* Buffers of a lane held (extents and payloads), the priority lane has
+     * only a few */
+    static const size_t MAX_LANE_RUNS = 4;
+
+    RecordMerger(void);
+
+    /**
+     * @brief Add the records of a buffer
+     * @param[in] buffer Buffer with a record index (DataBuffer::note_index),
+     * frames sealed. Data not covered by the index is taken as one record.
+     * @param[in] urgent Whether it comes from the priority lane
+     * @param[in] release Takes back the buffer once its records are copied
+     */
+    void add(DataBuffer_ptr buffer, bool urgent, const ReleaseFunc &release);
+
+    /**
+     * @brief Write the records up to a time in order, and the earliest ones
+     * beyond it while the merge holds too many buffers (see over_limits)
+     * @param[in] watermark_us Records up to this time (microseconds since
+     * epoch) are written, UINT64_MAX for all of them
+     * @param[inout] out Output buffer, empty on entry and exit
+     * @param[in] write Writes the output buffer
+     * @param[in] release Takes back the buffers that have been written
+     */
+    void drain(uint64_t watermark_us, DataBuffer &out, const WriteFunc &write, const ReleaseFunc &release);
+
+    /**
+     * @brief Whether records are waiting
+     */
+    bool pending (void) const
+    {
+        return !_heap.empty();
+    }
+
+    /**
+     * @brief Whether the merge holds more buffers than MAX_RUNS, or more of a
+     * lane than MAX_LANE_RUNS, and drain has to write records early
+     */
+    bool over_limits (void) const
+    {
+        return (_heap.size() > MAX_RUNS) || (_lane_runs[0] > MAX_LANE_RUNS) || (_lane_runs[1] > MAX_LANE_RUNS);
+    }
+
+    /**
+     * @brief Forget the buffers without writing or freeing them, in a forked
+     * child whose parent writes them
+     */
+    void abandon(void);
+
+    MergeStats stats(void) const;
+
+private:
+    /* A record of a run, offset and size in its buffer */
+    struct Entry
+    {
+        uint64_t ts_us;
+        uint64_t seq;
+        uint32_t offset;
+        uint32_t size;
+        uint32_t time_begin;
+        uint32_t time_end;
+        bool     span;
+    };
+
+    struct Run
+    {
+        DataBuffer_ptr     buffer;
+        bool               urgent = false;
+        /* The buffer is a copy owned by the merge, not the buffer of a lane */
+        bool               own    = false;
+        size_t             next   = 0;
+        std::vector<Entry> entries;
+    };
+
+    /* Head of a run in the heap */
+    struct Head
+    {
+        uint64_t ts_us;
+        uint64_t seq;
+        Run     *run;
+    };
+
+    /**
+     * @brief Heap order, the earliest head on top
+     */
+    static bool later (const Head &a, const Head &b)
+    {
+        return (a.ts_us != b.ts_us) ? (a.ts_us > b.ts_us) : (a.seq > b.seq);
+    }
+
+    std::vector<Head>                 _heap;
+    /* Runs being merged and finished runs kept for their entry vectors */
+    std::vector<std::unique_ptr<Run>> _runs;
+    std::vector<std::unique_ptr<Run>> _free_runs;
+    /* Copies that have been written, up to KEEP_FREE_BUFFERS kept for reuse */
+    static const size_t               KEEP_FREE_BUFFERS = 16;
+    std::vector<DataBuffer_ptr>       _free_buffers;
+    /* Runs with records waiting that hold a buffer of the normal and of the
+     * priority lane */
+    size_t                            _lane_runs[2];
+    /* Time of the last record written */
+    uint64_t                          _last_ts_us;
+
+    std::atomic<uint64_t> _records;
+    std::atomic<uint64_t> _late;
+    std::atomic<uint64_t> _num_runs;
+    std::atomic<uint64_t> _early;
+    std::atomic<uint64_t> _merge_ns;
+}; // class RecordMerger
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_MERGE_H_
@@ -0,0 +1,133 @@
+#ifndef _LOGGING_LOG_PAYLOAD_H_
+#define _LOGGING_LOG_PAYLOAD_H_
+
+#include <stddef.h>
+#include <functional>
+#include <memory>
+
+namespace logging {
+
+/**
+ * @brief How the bytes of a payload (LOG_PAYLOAD) appear in the log
+ */
+enum PayloadEncoding
+{
+    PAYLOAD_RAW = 0, // As they are
+    PAYLOAD_HEX,     // Two lowercase hex digits per byte
+    PAYLOAD_BASE64,  // Standard base64 with padding (RFC 4648)
+    PAYLOAD_HEXDUMP, // Offset/hex/ASCII lines (log_hexdump.h), starting on a line of their own
+};
+
+/* Payloads up to this size are cheaper to copy than to hand over, they are
+ * encoded into the record right away and released */
+static const size_t PAYLOAD_INLINE_BYTES = 512;
+
+/**
+ * @brief Whether the encoded payload is a block of whole lines, which starts
+ * on a new line and ends with its own newline
+ */
+inline bool
+payload_multiline (PayloadEncoding encoding)
+{
+    return PAYLOAD_HEXDUMP == encoding;
+}
+
+/**
+ * @brief Called once the payload has been written, or dropped, to hand the
+ * memory back to its owner. It runs on the background thread (on the
+ * calling thread if the record is not queued) and must not log.
+ */
+typedef std::function<void(const char *data, size_t size)> PayloadRelease;
+
+/**
+ * @brief A caller buffer whose ownership passes to the logger until release
+ * is called. The logger writes it in place, without copying it into the
+ * record buffers.
+ */
+struct Payload
+{
+    const char     *data;
+    size_t          size;
+    PayloadEncoding encoding;
+    PayloadRelease  release; // May be empty if nothing has to be done
+};
+
+/**
+ * @brief Hand a payload back to its owner, e.g. when it is dropped. The
+ * release is cleared, so it is called only once.
+ */
+void release_payload(Payload &payload);
+
+/**
+ * @brief Release a payload that is not logged at all, used by LOG_PAYLOAD
+ * below the compile-time minimum level
+ */
+inline void
+payload_drop (const void *data, size_t size, const PayloadRelease &release)
+{
+    if (release)
+    {
+        release(static_cast<const char *>(data), size);
+    }
+}
+
+/**
+ * @brief Size of the payload once encoded
+ */
+size_t payload_encoded_size(size_t size, PayloadEncoding encoding);
+
+/**
+ * @brief Encode bytes as lowercase hex, with AVX2 or SSSE3 where the CPU has
+ * them
+ * @param[in] data Data source address
+ * @param[in] size data size
+ * @param[out] out 2 * size bytes
+ * @retval Number of bytes written to out
+ */
+size_t hex_encode(const void *data, size_t size, char *out);
+
+/**
+ * @brief Encode bytes as base64 with padding, with SSSE3 where the CPU has it
+ * @param[in] data Data source address
+ * @param[in] size data size
+ * @param[out] out payload_encoded_size(size, PAYLOAD_BASE64) bytes
+ * @retval Number of bytes written to out
+ */
+size_t base64_encode(const void *data, size_t size, char *out);
+
+/**
+ * @brief Encode a payload, see PayloadEncoding
+ * @param[out] out payload_encoded_size(size, encoding) bytes
+ * @retval Number of bytes written to out
+ */
+size_t payload_encode(const char *data, size_t size, PayloadEncoding encoding, char *out);
+
+/**
+ * @brief Instruction set used by the encoders on this CPU: "avx2", "ssse3"
+ * or "scalar"
+ */
+const char *payload_encoder_isa(void);
+
+/**
+ * @brief Release for a buffer allocated with new[]
+ */
+inline PayloadRelease
+payload_release_delete (void)
+{
+    return [] (const char *data, size_t) { delete[] data; };
+}
+
+/**
+ * @brief Release for a slice of a refcounted buffer: the reference is held
+ * until the payload has been written
+ */
+template <typename T>
+inline PayloadRelease
+payload_keep (std::shared_ptr<T> owner)
+{
+    return [owner] (const char *, size_t) mutable { owner.reset(); };
+}
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_PAYLOAD_H_
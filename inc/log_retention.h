@@ -0,0 +1,124 @@
+#ifndef _LOGGING_LOG_RETENTION_H_
+#define _LOGGING_LOG_RETENTION_H_
+
+#include <stdint.h>
+#include <ctime>
+#include <deque>
+#include <string>
+
+namespace logging {
+
+/**
+ * @brief Limits applied to rolled log files. A value of 0 disables the
+ * corresponding limit.
+ */
+struct RetentionPolicy
+{
+    RetentionPolicy(void)
+        : max_files(0)
+        , max_total_bytes(0)
+        , max_age_minutes(0)
+    {
+    }
+
+    uint32_t max_files;         // Maximum number of rolled files kept
+    uint64_t max_total_bytes;   // Maximum total size of rolled files
+    uint64_t max_age_minutes;   // Rolled files older than this are removed
+
+    bool enabled(void) const
+    {
+        return (0 != max_files) || (0 != max_total_bytes) || (0 != max_age_minutes);
+    }
+};
+
+/**
+ * @brief Keeps an in-memory index of the rolled files of one log file, oldest
+ * first, and removes the oldest ones when the policy is exceeded.
+ * @note The directory is only scanned once, at startup. Afterwards every roll
+ * registers its file through add(), so cleanup never has to list the
+ * directory again. Not thread safe, it is driven by the LogFile helper thread.
+ */
+class LogRetention
+{
+public:
+    /**
+     * @brief LogRetention constructor
+     * @param[in] file_name Name of the active log file, rolled files are
+     * named "<file_name>.%Y%m%d%H%M%S_<index>"
+     * @param[in] policy Retention limits
+     */
+    LogRetention(const std::string &file_name, const RetentionPolicy &policy);
+
+    /**
+     * @brief Scan the log directory for rolled files left by previous runs
+     * @return The index to use for the next rolled file, one past the largest
+     * index found
+     */
+    uint32_t scan(void);
+
+    /**
+     * @brief Register a newly rolled file
+     * @param[in] name Path of the rolled file
+     * @param[in] index Roll index of the file
+     * @param[in] size File size in bytes
+     * @param[in] roll_time Time at which the file was rolled
+     */
+    void add(const std::string &name, uint32_t index, uint64_t size, std::time_t roll_time);
+
+    /**
+     * @brief Remove the oldest files until the policy is satisfied
+     * @param[in] now Current time
+     * @note At most MAX_REMOVE_PER_PASS files are removed per call so that a
+     * large backlog does not stall the caller, the rest is removed on the
+     * following calls.
+     * @return Number of files removed
+     */
+    uint32_t enforce(std::time_t now);
+
+    /**
+     * @brief Whether more files are waiting to be removed
+     */
+    bool pending(std::time_t now);
+
+    const RetentionPolicy &policy(void) const
+    {
+        return _policy;
+    }
+
+    size_t file_count(void) const
+    {
+        return _files.size();
+    }
+
+    uint64_t total_bytes(void) const
+    {
+        return _total_bytes;
+    }
+
+private:
+    struct RolledFile
+    {
+        std::string name;
+        uint32_t    index;
+        uint64_t    size;
+        std::time_t roll_time;
+    };
+
+    /**
+     * @brief Whether the oldest file violates one of the limits
+     */
+    bool over_limit(std::time_t now);
+
+    std::string             _dir;
+    std::string             _prefix;
+    RetentionPolicy         _policy;
+    std::deque<RolledFile>  _files;
+    uint64_t                _total_bytes;
+
+    static const uint32_t MAX_REMOVE_PER_PASS = 64;
+    static const uint32_t SECONDS_PER_MINUTE  = 60;
+}; // class LogRetention
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_RETENTION_H_
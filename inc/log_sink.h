@@ -0,0 +1,112 @@
+#ifndef _LOGGING_LOG_SINK_H_
+#define _LOGGING_LOG_SINK_H_
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <string>
+#include "log_container.h"
+
+namespace logging {
+
+/**
+ * @brief Destination of the data written by the background thread of
+ * AsyncLogging. LogFile writes to rolling files, SocketSink ships the data to
+ * a log collector.
+ * @note All the methods are called from the background thread only.
+ */
+class LogSink
+{
+public:
+    virtual ~LogSink(void)
+    {
+    }
+
+    /**
+     * @brief Write log data
+     * @param [in] logdata The source address of the data to be written
+     * @param [in] size The size of the data to be written
+     * @param [in] flush_now Whether to flush the buffered data immediately
+     */
+    virtual void write_logdata(const char *logdata, uint32_t size, bool flush_now = false) = 0;
+
+    /**
+     * @brief Write the data of one buffer flush together with the
+     * description of its records. Sinks that have no use for the description
+     * just write the data.
+     * @param [in] logdata The source address of the data to be written
+     * @param [in] size The size of the data to be written
+     * @param [in] meta Time range, record count and sequence range of the data
+     * @param [in] flush_now Whether to flush the buffered data immediately
+     */
+    virtual void write_block (const char *logdata, uint32_t size, const BlockMeta &meta, bool flush_now = false)
+    {
+        (void)meta;
+        write_logdata(logdata, size, flush_now);
+    }
+
+    /**
+     * @brief Write one block given as several pieces, e.g. a record with a
+     * payload that is written in place. Sinks that can not write the pieces
+     * as they are join them and call write_block.
+     * @param [in] pieces Pieces of the data, in order
+     * @param [in] num_pieces Number of pieces
+     * @param [in] meta Time range, record count and sequence range of the data
+     * @param [in] flush_now Whether to flush the buffered data immediately
+     */
+    virtual void write_blockv (const struct iovec *pieces, int num_pieces, const BlockMeta &meta,
+                               bool flush_now = false)
+    {
+        std::string block;
+        for (int i = 0; i < num_pieces; i++)
+        {
+            block.append(static_cast<const char *>(pieces[i].iov_base), pieces[i].iov_len);
+        }
+        write_block(block.data(), static_cast<uint32_t>(block.size()), meta, flush_now);
+    }
+
+    /**
+     * @brief Flush buffered data
+     */
+    virtual void flush(void) = 0;
+
+    /**
+     * @brief Flush buffered data and wait until it is stored durably. Sinks
+     * without a durable store just flush.
+     */
+    virtual void sync(void)
+    {
+        flush();
+    }
+
+    /**
+     * @brief Called before fork() while the background thread is paused.
+     * Buffered data must be written out here, otherwise both processes would
+     * write it.
+     */
+    virtual void prepare_fork(void)
+    {
+        flush();
+    }
+
+    /**
+     * @brief Called in the parent after fork()
+     */
+    virtual void after_fork_parent(void)
+    {
+    }
+
+    /**
+     * @brief Called in the child after fork(), when the sink keeps being used
+     * by the child, before its first record is written. The threads of the
+     * parent do not exist in the child, and this may run on a thread other
+     * than the forking one: locks held across the fork are rebuilt rather
+     * than unlocked.
+     */
+    virtual void after_fork_child(void)
+    {
+    }
+}; // class LogSink
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_SINK_H_
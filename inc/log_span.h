@@ -0,0 +1,128 @@
+#ifndef _LOGGING_LOG_SPAN_H_
+#define _LOGGING_LOG_SPAN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace logging {
+
+/**
+ * @brief Clock of the timing spans (LOG_SCOPE, LOG_SPAN).
+ * On x86 CPUs with an invariant time stamp counter it reads the TSC, a few
+ * nanoseconds per reading, otherwise the steady clock in nanoseconds. The
+ * counter frequency is measured against the steady clock at first use, which
+ * takes about 2 ms once.
+ */
+class SpanClock
+{
+public:
+    SpanClock(void);
+
+    /**
+     * @brief Current time in ticks
+     */
+    uint64_t now (void) const
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        if (_tsc)
+        {
+            return __builtin_ia32_rdtsc();
+        }
+#endif
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    /**
+     * @brief Convert between ticks and nanoseconds
+     */
+    uint64_t to_ns (uint64_t ticks) const
+    {
+        return _tsc ? static_cast<uint64_t>(ticks * _ns_per_tick) : ticks;
+    }
+
+    uint64_t from_ns (uint64_t ns) const
+    {
+        return _tsc ? static_cast<uint64_t>(ns / _ns_per_tick) : ns;
+    }
+
+    /**
+     * @brief Whether the TSC is used
+     */
+    bool tsc (void) const
+    {
+        return _tsc;
+    }
+
+private:
+    bool   _tsc;
+    double _ns_per_tick;
+}; // class SpanClock
+
+/**
+ * @brief The span clock, set up at first use
+ */
+const SpanClock &span_clock(void);
+
+/**
+ * @brief Latency distribution of one span
+ */
+struct SpanStats
+{
+    std::string           name;     // Span path, "outer/inner" for nested spans
+    uint64_t              count;
+    uint64_t              total_ns;
+    uint64_t              min_ns;
+    uint64_t              max_ns;
+    uint64_t              p50_ns;
+    uint64_t              p90_ns;
+    uint64_t              p99_ns;
+    std::vector<uint64_t> histogram; // histogram[i]: spans of 2^i to 2^(i+1)-1 ns, up to the largest
+};
+
+/**
+ * @brief Aggregates the records written by LOG_SCOPE and LOG_SPAN
+ *
+ *     <header> span=<path> ns=<duration> depth=<depth>
+ *
+ * into per-span latency distributions. Other records are skipped, so whole
+ * log files can be fed in, with or without record framing.
+ */
+class SpanSummary
+{
+public:
+    /**
+     * @brief Collect the span records of a piece of data holding whole
+     * records, e.g. a file or a container block
+     * @param[in] data Data source address
+     * @param[in] size Data size
+     */
+    void scan(const char *data, size_t size);
+
+    /**
+     * @brief Number of span records seen so far
+     */
+    uint64_t records (void) const
+    {
+        return _records;
+    }
+
+    /**
+     * @brief The distributions, by total time, largest first
+     * @retval The statistics, the summary starts over afterwards
+     */
+    std::vector<SpanStats> finish(void);
+
+private:
+    std::map<std::string, std::vector<uint64_t>> _durations;
+    uint64_t                                     _records = 0;
+}; // class SpanSummary
+
+} // namespace logging
+
+#endif // _LOGGING_LOG_SPAN_H_
@@ -1,13 +1,34 @@
 #ifndef _LOGGING_LOG_STREAM_H_
 #define _LOGGING_LOG_STREAM_H_
 
+#include <stdarg.h>
+#include <sys/uio.h>
+#include <atomic>
 #include <functional>
 #include <ostream>
 #include <streambuf>
 namespace logging {
+
+/**
+ * @brief Memory held by the LogStream buffers of all threads
+ */
+struct LogStreamMemory
+{
+    size_t streams;             // Number of live LogStream objects
+    size_t total_bytes;         // Buffer bytes held by all of them
+    size_t peak_stream_bytes;   // Largest buffer a single stream has ever held
+};
+
 /**
  * @brief LogStream：Streaming buffer class. Inherit std::ostream to implement
  * c++ streaming output, and inherit std::streambuf to implement buffer.
+ * @note The buffer is a list of chunks. When a record does not fit, a new
+ * chunk as large as all the previous ones together is appended, the data
+ * already written is never copied. A record may not use more than the
+ * process-wide maximum (set_limits), the rest of it is cut off and the
+ * record ends with TRUNCATED_MARK. After each record the chunks beyond the
+ * retain size are released, so that one huge message does not keep every
+ * thread's buffer inflated.
  */
 class LogStream
     : public std::streambuf
@@ -15,13 +36,20 @@ class LogStream
 {
 
 public:
+    typedef std::function<void(const char *, size_t)>        OutputFunc;
+    typedef std::function<void(const struct iovec *, int)> GatherOutputFunc;
+
     /**
      * @brief LogStream constructor
-     * @param[in] buffer_size Output stream internal buffer size
+     * @param[in] buffer_size Size of the first chunk of the buffer, kept for
+     * the lifetime of the stream
      * @param[in] output_func Set the output interface. When the buffer is
      * flushed, this interface will be called to implement data output.
+     * @param[in] gather_func Output interface for records spread over several
+     * chunks, receives all the pieces in one call. If not set, output_func is
+     * called once per chunk.
      */
-    LogStream(size_t buffer_size, std::function<void(const char *, size_t)> output_func);
+    LogStream(size_t buffer_size, OutputFunc output_func, GatherOutputFunc gather_func = nullptr);
 
     /**
      * @note :The internal buffer needs to be released during destruction
@@ -35,9 +63,39 @@ public:
      */
     virtual int overflow(std::streambuf::int_type c);
 
+    /**
+     * @brief printf-style output, formatted straight into the current chunk.
+     * Only output that does not fit is formatted again into a temporary
+     * buffer and then stored like any other, so it may spread over new
+     * chunks and is cut off at the maximum size.
+     * @param [in] fmt : printf format
+     * @param [in] args : Arguments of the format
+     */
+    void vformat(const char *fmt, va_list args);
+
+    /**
+     * @brief Room for size bytes in the current chunk, for output formatted
+     * in place and then accounted with commit
+     * @retval The place to write to, nullptr if the chunk has no such room
+     * (the output is then stored with sputn)
+     */
+    char *reserve (size_t size)
+    {
+        return (static_cast<size_t>(epptr() - pptr()) >= size) ? pptr() : nullptr;
+    }
+
+    /**
+     * @brief Account size bytes written at the place returned by reserve
+     */
+    void commit (size_t size)
+    {
+        pbump(static_cast<int>(size));
+    }
+
     /**
      * @brief Flush the buffer and output the data in the buffer to a file or
-     * device
+     * device, then reset the buffer and release the chunks beyond the retain
+     * size
      */
     void flush_data(void);
 
@@ -46,13 +104,87 @@ public:
      */
     void reset_buffer(void);
 
+    /**
+     * @brief Bytes of the current record written so far
+     */
+    size_t size(void) const;
+
+    /**
+     * @brief Bytes of buffer held by this stream
+     */
+    size_t capacity(void) const
+    {
+        return _capacity;
+    }
+
+    /**
+     * @brief Whether the current record exceeded the maximum record size
+     */
+    bool truncated(void) const
+    {
+        return _truncated;
+    }
+
+    /**
+     * @brief Set the limits applied to the streams of all threads
+     * @param[in] max_bytes Maximum buffer size of a stream, data beyond it is
+     * cut off. 0 means no limit.
+     * @param[in] retain_bytes Buffer size a stream keeps after a record, the
+     * chunks beyond it are released. The first chunk is always kept.
+     */
+    static void set_limits(size_t max_bytes, size_t retain_bytes);
+
+    /**
+     * @brief Memory held by the streams of all threads
+     */
+    static LogStreamMemory memory(void);
+
+    /* The chunk sizes double, 32 chunks are more than any limit needs */
+    static const int MAX_CHUNKS = 32;
+    /* Pieces a record is handed to the gather output in, at most: the chunks
+     * and TRUNCATED_MARK */
+    static const int MAX_PIECES = MAX_CHUNKS + 1;
+
+    static const size_t DEFAULT_MAX_BYTES    = 32 * 1024;
+    static const size_t DEFAULT_RETAIN_BYTES = 1024;
+
+    /* Appended to the records that have been cut off */
+    static const char TRUNCATED_MARK[];
+
 private:
-    char                                     *_buffer;
-    size_t                                    _size;
-    std::function<void(const char *, size_t)> _output_func;
+    struct Chunk
+    {
+        char  *data;
+        size_t size;
+    };
+
+    /**
+     * @brief Make the next chunk current, allocating it if needed
+     * @retval false if the maximum size is reached
+     */
+    bool next_chunk(void);
+
+    /**
+     * @brief Release the chunks beyond the retain size
+     */
+    void shrink(void);
+
+    Chunk            _chunks[MAX_CHUNKS];
+    int              _num_chunks;   // Allocated chunks
+    int              _cur_chunk;    // Chunk being written
+    size_t           _capacity;     // Sum of the chunk sizes
+    bool             _truncated;
+    OutputFunc       _output_func;
+    GatherOutputFunc _gather_func;
+
+    static std::atomic<size_t> _max_bytes;
+    static std::atomic<size_t> _retain_bytes;
+    static std::atomic<size_t> _total_bytes;
+    static std::atomic<size_t> _num_streams;
+    static std::atomic<size_t> _peak_stream_bytes;
 
 }; // class LogStream
 
 } // namespace logging
 
-#endif // _LOGGING_LOG_STREAM_H_
\ No newline at end of file
+#endif // _LOGGING_LOG_STREAM_H_
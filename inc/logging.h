@@ -1,10 +1,20 @@
 #ifndef _LOGGING_LOGGING_H_
 #define _LOGGING_LOGGING_H_
 
+#include <atomic>
 #include <functional>
 #include <ostream>
 #include <streambuf>
 #include <string>
+#include "consumer_options.h"
+#include "flight_recorder.h"
+#include "log_context.h"
+#include "log_dedup.h"
+#include "log_hexdump.h"
+#include "log_kv.h"
+#include "log_merge.h"
+#include "log_payload.h"
+#include "log_span.h"
 #include "log_stream.h"
 
 namespace logging {
@@ -35,6 +45,52 @@ typedef struct LogControl
     std::string logfile;            // The name of the log file
     uint64_t roll_cycle_minutes;    // Log file rolling period, in minutes.
     uint64_t roll_size_kbytes;       // Log File rolling size, in Kbytes
+    KvFormat kv_format = KV_FORMAT_JSON;    // Output format of LOG_KV records
+    uint32_t keep_max_files = 0;            // Keep at most this many rolled files, 0 means no limit
+    uint64_t keep_max_kbytes = 0;           // Keep at most this many Kbytes of rolled files, 0 means no limit
+    uint64_t keep_max_age_minutes = 0;      // Remove rolled files older than this, 0 means no limit
+    bool container_format = false;          // Write the seekable container format (log_container.h) instead of text
+    std::string spill_file = "";            // With a socket logfile (tcp://, udp://, unix://, unixgram://), keeps the
+                                            // data the collector could not take, empty means drop it
+    uint64_t spill_max_kbytes = 0;          // Maximum size of spill_file in Kbytes, 0 means no limit
+    uint64_t shm_ring_kbytes = 4096;        // With a shared ring logfile (shm://<name>, shm_ring.h), size of the ring
+                                            // in Kbytes if this process creates it
+    std::string shm_writer_file = "";       // With a shared ring logfile, this process writes the ring of all the
+                                            // processes to this file, with the rolling and retention settings.
+                                            // Empty leaves it to another process or tinylog-shmd.
+    uint64_t record_max_kbytes = 0;         // Per-thread record buffer cap in Kbytes, longer records are truncated,
+                                            // 0 means no limit. Records longer than a 32 Kbyte buffer are queued as
+                                            // extents, so a cap only guards against runaway records
+    uint64_t record_retain_kbytes = 1;      // Per-thread record buffer kept between records in Kbytes, the rest is
+                                            // released after an oversized record
+    LogLevel priority_level = LOG_WARNING;  // Records at or above this level take the priority lane and are written
+                                            // ahead of queued lower level records, NUM_LOG_LEVELS disables it
+    bool priority_sync = false;             // fdatasync after writing priority records instead of only fflush
+    bool fork_per_pid_file = false;         // A forked child logs to "<logfile>.<pid>" with the same rolling and
+                                            // retention, otherwise it appends to the parent's current file,
+                                            // leaves rolling to the parent and follows its rolls. Container files
+                                            // are always per pid.
+    bool record_framing = false;            // Prefix every record with its sequence number and CRC32C (log_frame.h),
+                                            // checked with tinylog-verify
+    uint32_t dedup_window_ms = 0;           // Collapse repeats of a record (same bytes apart from the time stamp)
+                                            // within this window into one "last message repeated N times" record,
+                                            // 0 disables it. Framed records are never collapsed.
+    LogLevel flight_level = NUM_LOG_LEVELS; // Records from this level up to below level are kept in an in-memory
+                                            // ring (flight recorder) instead of being written, and dumped to
+                                            // flight_file on a trigger. NUM_LOG_LEVELS disables it. They are
+                                            // still formatted in full, only the write is saved.
+    uint64_t flight_kbytes = 4096;          // Size of the flight recorder ring in Kbytes, every capturing thread
+                                            // fills a 32 Kbyte buffer of it of its own
+    std::string flight_file = "";           // File the flight recorder dumps are appended to, empty means
+                                            // "<logfile>.flight" (required with a socket logfile)
+    LogLevel flight_trigger_level = LOG_ERROR;  // A record at or above this level dumps the flight recorder,
+                                                // NUM_LOG_LEVELS leaves it to SIGUSR1 and log_flight_dump
+    bool flight_signal = false;             // SIGUSR1 dumps the flight recorder
+    bool show_context = false;              // Add the thread id, thread name and the LOG_CONTEXT fields of the
+                                            // thread (log_context.h) to every record
+    uint32_t reorder_window_ms = 0;         // Write the records of all threads and both lanes in time stamp order,
+                                            // holding each back for this long (log_merge.h), 0 disables it
+    ConsumerOptions consumer;               // Placement, scheduling and wait strategy of the background thread
 }LogContorl;
 
 
@@ -67,10 +123,181 @@ public:
         return *_stream;
     }
 
+    /**
+     * @brief printf-style output into the streaming buffer, used by LOGF. The
+     * format is checked by the compiler.
+     * @retval The streaming buffer, for more output to the record
+     */
+    LogStream &format(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
 private:
     LogStream *_stream;
 }; // class Logger
 
+/**
+ * @brief Write a structured record, used by LOG_KV.
+ * @param [in] level : The current level of this log message
+ * @param [in] file : The file where this current log message is located
+ * @param [in] func_name : The function where this current log message is
+ * located
+ * @param [in] line : The line number of the current log message
+ * @param [in] msg : Free-form message, stored under the "msg" key
+ * @param [in] fields : Array of key-value fields
+ * @param [in] num_fields : Number of elements in fields
+ */
+void log_kv_record (const LogLevel level, const char *file, const char *func_name, const size_t line,
+                    const char *msg, const KvField *fields, size_t num_fields);
+
+template <typename... Fields>
+inline void
+log_kv (const LogLevel level, const char *file, const char *func_name, const size_t line, const char *msg,
+        const Fields &...fields)
+{
+    /* The trailing empty field keeps the array non-empty when no fields are given */
+    const KvField field_array[] = { fields..., KvField() };
+    log_kv_record(level, file, func_name, line, msg, field_array, sizeof...(Fields));
+}
+
+/**
+ * @brief Write a record whose body is a caller buffer, used by LOG_PAYLOAD.
+ * The record is "<header> <msg> <payload>\n", or "<header> <msg>\n<lines>"
+ * for an encoding made of lines (payload_multiline). The buffer belongs to the
+ * logger until release is called: the background thread writes it in place
+ * (encoded if asked to, see PayloadEncoding) and then releases it. Payloads
+ * up to PAYLOAD_INLINE_BYTES are copied into the record and released before
+ * the call returns.
+ * @param [in] enabled : Whether the level is enabled, otherwise the payload
+ * is only released
+ * @param [in] level, file, func_name, line : As for Logger
+ * @param [in] msg : Text before the payload
+ * @param [in] data, size : The payload
+ * @param [in] encoding : How the payload is written
+ * @param [in] release : Called once the payload is no longer used, may be
+ * empty. See payload_release_delete and payload_keep.
+ */
+void log_payload (bool enabled, const LogLevel level, const char *file, const char *func_name, const size_t line,
+                  const char *msg, const void *data, size_t size, PayloadEncoding encoding, PayloadRelease release);
+
+/**
+ * @brief Write a hex dump record, used by LOG_HEXDUMP:
+ *
+ *     <header> hexdump <size> bytes
+ *     00000000  48 65 6c 6c 6f 2c 20 77  6f 72 6c 64 0a 00 01 02  |Hello, world....|
+ *
+ * The lines (see log_hexdump.h) are formatted straight into the record
+ * buffer, so the record size limit (record_max_kbytes) applies.
+ */
+void log_hexdump (const LogLevel level, const char *file, const char *func_name, const size_t line,
+                  const void *data, size_t size);
+
+/**
+ * @brief Write the same record as log_hexdump, used by LOG_HEXDUMP_DEFERRED:
+ * the bytes are copied and the lines are formatted by the background thread
+ * (a PAYLOAD_HEXDUMP payload), without the record size limit
+ */
+void log_hexdump_deferred (const LogLevel level, const char *file, const char *func_name, const size_t line,
+                           const void *data, size_t size);
+
+/**
+ * @brief Timed scope, used by LOG_SCOPE and LOG_SPAN. Reads the span clock on
+ * construction and destruction and writes one record at the end:
+ *
+ *     <header> span=<path> ns=<duration> depth=<depth>
+ *
+ * Spans of a thread nest, the path names the enclosing spans as well
+ * ("request/parse") and depth is their number. Names must not contain spaces
+ * or '/'. tinylog-spans (SpanSummary) turns the records into per-span latency
+ * distributions.
+ */
+class ScopedSpan
+{
+public:
+    /**
+     * @param [in] enabled : Whether the level is enabled, nothing is done
+     * otherwise
+     * @param [in] level : Level of the record
+     * @param [in] name : Span name, a string that outlives the span
+     * @param [in] min_us : Only write the record if the span took at least
+     * this long, 0 to always write it
+     * @param [in] file, func_name, line : Location of the span
+     */
+    ScopedSpan(bool enabled, const LogLevel level, const char *name, uint64_t min_us, const char *file,
+               const char *func_name, const size_t line)
+        : _name(nullptr)
+    {
+        if (enabled)
+        {
+            begin(level, name, min_us, file, func_name, line);
+        }
+    }
+
+    ~ScopedSpan(void)
+    {
+        if (nullptr != _name)
+        {
+            end();
+        }
+    }
+
+    ScopedSpan(const ScopedSpan &)            = delete;
+    ScopedSpan &operator=(const ScopedSpan &) = delete;
+
+private:
+    void begin(const LogLevel level, const char *name, uint64_t min_us, const char *file, const char *func_name,
+               const size_t line);
+    void end(void);
+
+    const char *_name;
+    const char *_file;
+    const char *_func_name;
+    size_t      _line;
+    LogLevel    _level;
+    uint32_t    _depth;
+    uint64_t    _start;
+    uint64_t    _min_ticks;
+    ScopedSpan *_parent; // Enclosing span of the thread
+}; // class ScopedSpan
+
+/**
+ * @brief Span of a level below the compile-time minimum, does nothing
+ */
+class NullSpan
+{
+public:
+    NullSpan(bool, const LogLevel, const char *, uint64_t, const char *, const char *, const size_t)
+    {
+    }
+
+    NullSpan(const NullSpan &)            = delete;
+    NullSpan &operator=(const NullSpan &) = delete;
+}; // class NullSpan
+
+/**
+ * @brief Span type of LOG_SCOPE and LOG_SPAN, NullSpan if the level is
+ * compiled out
+ */
+template <bool CompiledIn>
+struct SpanOf
+{
+    typedef ScopedSpan type;
+};
+
+template <>
+struct SpanOf<false>
+{
+    typedef NullSpan type;
+};
+
+/**
+ * @brief Memory held by the log stream buffers of all threads
+ */
+LogStreamMemory log_memory (void);
+
+/**
+ * @brief Memory held by the log stream buffer of the calling thread
+ */
+size_t log_thread_memory (void);
+
 /**
  * @brief Log module initialization
  * @param [in] cfg : Log control parameters
@@ -78,29 +305,192 @@ private:
  */
 void log_init (LogContorl cfg);
 
-/* Global log level */
-extern LogLevel _global_log_level;
+/**
+ * @brief Change the configuration of the running logger. Levels, header
+ * options, the record limits and the priority lane settings take effect for
+ * the next record; a changed destination (logfile, rolling, retention,
+ * container_format, spill and shared ring settings) is opened here and
+ * swapped in by the background thread. Producers are never paused.
+ * @param [in] cfg : The new configuration. The consumer thread options can
+ * only be set by log_init and are kept.
+ * @retval false if the logger is not running or the new destination can not
+ * be opened, in which case the old one stays in use
+ */
+bool log_reconfigure (const LogContorl &cfg);
+
+/**
+ * @brief The configuration currently in effect
+ */
+LogContorl log_config (void);
+
+/**
+ * @brief Counters of the duplicate collapsing (LogControl::dedup_window_ms)
+ */
+DedupStats log_dedup_stats (void);
+
+/**
+ * @brief Counters of the record merge (LogControl::reorder_window_ms)
+ */
+MergeStats log_merge_stats (void);
+
+/**
+ * @brief Dump the flight recorder (LogControl::flight_level) to its file now
+ * @retval false if the flight recorder is off or the file can not be written
+ */
+bool log_flight_dump (void);
+
+/**
+ * @brief Counters of the flight recorder
+ */
+FlightStats log_flight_stats (void);
+
+/**
+ * @brief Read a configuration file ("key = value" lines, see log_config.h)
+ * on top of cfg
+ * @retval false if the file can not be read or has errors, cfg is unchanged
+ */
+bool log_load_config (const std::string &path, LogContorl &cfg);
+
+/**
+ * @brief Apply a configuration file now and again whenever it changes, the
+ * file is watched with inotify
+ */
+bool log_watch_config (const std::string &path);
+
+/**
+ * @brief Stop watching the configuration file
+ */
+void log_unwatch_config (void);
+
+/* Global log level, may change at any time through log_reconfigure */
+extern std::atomic<LogLevel> _global_log_level;
 
 } // namespace logging
 
-#ifdef DISABLE_LOG
-    #define _LOG(LEVEL)                                                           \
-        if ((logging::LOG_##LEVEL > logging::NUM_LOG_LEVELS) && (logging::LOG_##LEVEL < logging::NUM_LOG_LEVELS)) \
-        logging::Logger(logging::LOG_##LEVEL, __FILE__, __func__, __LINE__).stream()
-    #define _LOG_RAW(LEVEL)                                                           \
-        if ((logging::LOG_##LEVEL >= NUM_LOG_LEVELS) && (logging::LOG_##LEVEL < logging::NUM_LOG_LEVELS)) \
-        logging::Logger(logging::LOG_##LEVEL, __FILE__, __func__, __LINE__, false).stream()
-#else
-    #define _LOG(LEVEL)                                                           \
-        if ((logging::LOG_##LEVEL >= logging::_global_log_level) && (logging::LOG_##LEVEL < logging::NUM_LOG_LEVELS)) \
-        logging::Logger(logging::LOG_##LEVEL, __FILE__, __func__, __LINE__).stream()
+/*
+ * Compile-time minimum level. LOG statements below it compile to nothing:
+ * their arguments are never evaluated and their strings do not end up in the
+ * binary. Set it for the whole build with -DTINYLOG_MIN_LEVEL=TINYLOG_LEVEL_INFO,
+ * or for one file by defining TINYLOG_TU_MIN_LEVEL in it, which wins over
+ * TINYLOG_MIN_LEVEL. DISABLE_LOG removes every statement. LOG_SCOPE and
+ * LOG_SPAN below it time nothing; LOG_PAYLOAD below it only releases the
+ * payload. Statements at or above the minimum are still filtered by the
+ * runtime level of log_init.
+ */
+#define TINYLOG_LEVEL_INNER_DEBUG 0
+#define TINYLOG_LEVEL_DEBUG 1
+#define TINYLOG_LEVEL_INFO 2
+#define TINYLOG_LEVEL_WARNING 3
+#define TINYLOG_LEVEL_ERROR 4
+#define TINYLOG_LEVEL_OFF 5
 
-    #define _LOG_RAW(LEVEL)                                                           \
-        if ((logging::LOG_##LEVEL >= logging::_global_log_level) && (logging::LOG_##LEVEL < logging::NUM_LOG_LEVELS)) \
-        logging::Logger(logging::LOG_##LEVEL, __FILE__, __func__, __LINE__, false).stream()
+#ifndef TINYLOG_MIN_LEVEL
+    #ifdef DISABLE_LOG
+        #define TINYLOG_MIN_LEVEL TINYLOG_LEVEL_OFF
+    #else
+        #define TINYLOG_MIN_LEVEL TINYLOG_LEVEL_INNER_DEBUG
+    #endif
+#endif
+
+/* Expanded where a statement is used, so a per-file override may come after
+ * the include */
+#ifndef TINYLOG_TU_MIN_LEVEL
+    #define _TINYLOG_EFFECTIVE_MIN_LEVEL TINYLOG_MIN_LEVEL
+#else
+    #define _TINYLOG_EFFECTIVE_MIN_LEVEL TINYLOG_TU_MIN_LEVEL
 #endif
 
+namespace logging {
+
+/**
+ * @brief Whether statements of a level are compiled in, for a given minimum.
+ * The minimum is a template argument rather than a macro read in here, so
+ * files built with different minimums do not break the one definition rule.
+ */
+template <int Level, int MinLevel>
+struct LevelCompiledIn
+{
+    static constexpr bool value = (Level >= MinLevel) && (Level < NUM_LOG_LEVELS);
+};
+
+} // namespace logging
+
+#define _LOG_COMPILED_IN(LEVEL) logging::LevelCompiledIn<logging::LOG_##LEVEL, _TINYLOG_EFFECTIVE_MIN_LEVEL>::value
+
+/* A constant false left operand: the compiler drops the statement even at -O0 */
+#define _LOG_ENABLED(LEVEL)                                                                                  \
+    (_LOG_COMPILED_IN(LEVEL) && (logging::LOG_##LEVEL >= logging::_global_log_level.load(std::memory_order_relaxed)))
+
+/* EXPR if the level is compiled in, otherwise OFF: a constant condition, so
+ * EXPR is not evaluated and its strings are dropped even at -O0 */
+#define _LOG_IF_COMPILED_IN(LEVEL, EXPR, OFF) (_LOG_COMPILED_IN(LEVEL) ? (EXPR) : (OFF))
+
+#define _LOG(LEVEL)                                                           \
+    if (_LOG_ENABLED(LEVEL))                                                  \
+    logging::Logger(logging::LOG_##LEVEL, __FILE__, __func__, __LINE__).stream()
+
+#define _LOG_RAW(LEVEL)                                                       \
+    if (_LOG_ENABLED(LEVEL))                                                  \
+    logging::Logger(logging::LOG_##LEVEL, __FILE__, __func__, __LINE__, false).stream()
+
+#define _LOGF(LEVEL, ...)                                                     \
+    if (_LOG_ENABLED(LEVEL))                                                  \
+    logging::Logger(logging::LOG_##LEVEL, __FILE__, __func__, __LINE__).format(__VA_ARGS__)
+
+#define _LOG_KV(LEVEL, ...)                                                   \
+    if (_LOG_ENABLED(LEVEL))                                                  \
+    logging::log_kv(logging::LOG_##LEVEL, __FILE__, __func__, __LINE__, __VA_ARGS__)
+
+#define _LOG_HEXDUMP(LEVEL, DATA, SIZE)                                        \
+    if (_LOG_ENABLED(LEVEL))                                                  \
+    logging::log_hexdump(logging::LOG_##LEVEL, __FILE__, __func__, __LINE__, DATA, SIZE)
+
+#define _LOG_HEXDUMP_DEFERRED(LEVEL, DATA, SIZE)                               \
+    if (_LOG_ENABLED(LEVEL))                                                  \
+    logging::log_hexdump_deferred(logging::LOG_##LEVEL, __FILE__, __func__, __LINE__, DATA, SIZE)
+
+/* The payload is released even if the level is off, and only released if
+ * the level is compiled out */
+#define _LOG_PAYLOAD(LEVEL, MSG, DATA, SIZE, ENCODING, RELEASE)                                               \
+    if (_LOG_COMPILED_IN(LEVEL))                                                                              \
+        logging::log_payload(_LOG_ENABLED(LEVEL), logging::LOG_##LEVEL, __FILE__, __func__, __LINE__, MSG, DATA, \
+                             SIZE, ENCODING, RELEASE);                                                        \
+    else                                                                                                      \
+        logging::payload_drop(DATA, SIZE, RELEASE)
+
+#define _LOG_SPAN_VAR_CONCAT(LINE) _tinylog_span_##LINE
+#define _LOG_SPAN_VAR(LINE) _LOG_SPAN_VAR_CONCAT(LINE)
+#define _LOG_CONTEXT_VAR_CONCAT(LINE) _tinylog_context_##LINE
+#define _LOG_CONTEXT_VAR(LINE) _LOG_CONTEXT_VAR_CONCAT(LINE)
+#define _LOG_SPAN(LEVEL, NAME, MIN_US)                                                                      \
+    logging::SpanOf<_LOG_COMPILED_IN(LEVEL)>::type _LOG_SPAN_VAR(__LINE__)(                                  \
+        _LOG_ENABLED(LEVEL), logging::LOG_##LEVEL, _LOG_IF_COMPILED_IN(LEVEL, NAME, nullptr),                  \
+        _LOG_IF_COMPILED_IN(LEVEL, MIN_US, 0), _LOG_IF_COMPILED_IN(LEVEL, __FILE__, nullptr),                 \
+        _LOG_IF_COMPILED_IN(LEVEL, __func__, nullptr), __LINE__)
+
 #define LOG(LEVEL) _LOG(LEVEL)
 #define LOG_RAW(LEVEL)  _LOG_RAW(LEVEL)
+/* printf-style record, formatted into the record buffer: LOGF(INFO, "%d bytes\n", n).
+ * Like LOG, the record ends with the newline given in the format. */
+#define LOGF(LEVEL, ...)  _LOGF(LEVEL, __VA_ARGS__)
+/* Structured record: LOG_KV(INFO, "req done", logging::kv("latency_us", x), ...) */
+#define LOG_KV(LEVEL, ...)  _LOG_KV(LEVEL, __VA_ARGS__)
+/* Record with a caller buffer that is written in place and then released:
+ * LOG_PAYLOAD(INFO, "frame", buf, len, logging::PAYLOAD_HEX, logging::payload_release_delete()) */
+#define LOG_PAYLOAD(LEVEL, MSG, DATA, SIZE, ENCODING, RELEASE)  _LOG_PAYLOAD(LEVEL, MSG, DATA, SIZE, ENCODING, RELEASE)
+/* Offset/hex/ASCII dump of binary data: LOG_HEXDUMP(DEBUG, packet, len). The
+ * DEFERRED form copies the bytes and leaves the formatting to the background
+ * thread. */
+#define LOG_HEXDUMP(LEVEL, DATA, SIZE)  _LOG_HEXDUMP(LEVEL, DATA, SIZE)
+#define LOG_HEXDUMP_DEFERRED(LEVEL, DATA, SIZE)  _LOG_HEXDUMP_DEFERRED(LEVEL, DATA, SIZE)
+/* Context field of the calling thread until the end of the scope:
+ * LOG_CONTEXT("request", id), shown with LogControl::show_context */
+#define LOG_CONTEXT(KEY, VALUE)  logging::ScopedLogContext _LOG_CONTEXT_VAR(__LINE__)(KEY, VALUE)
+/* Time the rest of the enclosing scope: LOG_SCOPE(INFO, "parse"). LOG_SPAN only
+ * writes the record if the scope took at least MIN_US microseconds. */
+#define LOG_SCOPE(LEVEL, NAME)  _LOG_SPAN(LEVEL, NAME, 0)
+#define LOG_SPAN(LEVEL, NAME, MIN_US)  _LOG_SPAN(LEVEL, NAME, MIN_US)
+/* Guard for work that only feeds log statements: if (LOG_ENABLED(DEBUG)) {...} */
+#define LOG_ENABLED(LEVEL)  _LOG_ENABLED(LEVEL)
 
 #endif // _LOGGING_LOGGING_H_
\ No newline at end of file
@@ -0,0 +1,367 @@
+#ifndef _LOGGING_SHM_RING_H_
+#define _LOGGING_SHM_RING_H_
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include "log_sink.h"
+
+namespace logging {
+
+struct ShmRingHeader;
+struct ShmProducer;
+
+/**
+ * @brief Counters of a shared ring, kept in the shared memory and summed over
+ * all the processes using it
+ */
+struct ShmRingStats
+{
+    ShmRingStats(void)
+        : capacity(0)
+        , used(0)
+        , entries(0)
+        , bytes(0)
+        , dropped_entries(0)
+        , dropped_bytes(0)
+        , skipped_entries(0)
+        , skipped_bytes(0)
+    {
+    }
+
+    uint64_t capacity;          // Bytes of the data area
+    uint64_t used;              // Bytes reserved and not yet drained
+    uint64_t entries;           // Entries committed by producers
+    uint64_t bytes;             // Data bytes committed by producers
+    uint64_t dropped_entries;   // Entries a producer dropped because the ring stayed full
+    uint64_t dropped_bytes;
+    uint64_t skipped_entries;   // Reservations of crashed producers skipped by the writer
+    uint64_t skipped_bytes;
+};
+
+/**
+ * @brief Ring buffer in POSIX shared memory ("/tinylog.<name>") through which
+ * the processes of a host hand their log data to a single writer.
+ *
+ * Producers reserve space by advancing the shared head with a compare and
+ * swap, copy their entry in and commit it by storing its header word. The
+ * writer reads the committed entries in order, hands them to its sink,
+ * clears the space and advances the tail. An entry never wraps around the end
+ * of the data area, the space up to the end is reserved along with it as
+ * padding.
+ *
+ * A producer that crashes between reserving and committing would stop the
+ * writer at its entry for good. Every producer therefore has a slot in a
+ * table in the shared memory, in which it publishes the reservation it is
+ * about to make before making it. When the entry at the tail stays
+ * uncommitted, the writer looks the reservation up there; if its process has
+ * exited (pid and start time, so a reused pid is not taken for the producer),
+ * the reserved bytes are skipped. The writer role is held the same way, a
+ * writer that has exited is replaced by the next process that asks for the
+ * role. A writer that crashes after writing entries and before advancing the
+ * tail writes them again when restarted, entries are never lost that way.
+ * Since processes are known by their pids, all the users of a ring must be
+ * in the same pid namespace; open refuses a ring created in another one.
+ * The writer checks each entry header against the reserved space and skips
+ * to the next reservation behind one that is damaged.
+ *
+ * When the ring is full a producer waits for the writer for a while and then
+ * drops the entry, it never blocks for good.
+ * @note A ShmRing object is used by one thread at a time. The processes may
+ * use it concurrently, as long as each has a ShmRing object of its own (a
+ * forked child calls after_fork_child).
+ */
+class ShmRing
+{
+public:
+    ShmRing(void);
+
+    /**
+     * @brief ShmRing destructor, detaches from the shared memory
+     */
+    ~ShmRing(void);
+
+    /**
+     * @brief Attach to the ring with the given name, creating it if it does
+     * not exist yet
+     * @param[in] name Ring name, the shared memory object is "/tinylog.<name>"
+     * @param[in] capacity Size of the data area of a new ring in bytes, an
+     * existing ring keeps its size
+     * @retval true on success
+     */
+    bool open(const std::string &name, uint64_t capacity);
+
+    /**
+     * @brief Detach from the ring, giving up the producer slot and the writer
+     * role
+     */
+    void close(void);
+
+    /**
+     * @brief Remove the shared memory object of a ring. Processes attached to
+     * it keep using it, later ones create a new ring.
+     */
+    static bool remove(const std::string &name);
+
+    bool is_open (void) const
+    {
+        return nullptr != _header;
+    }
+
+    /**
+     * @brief Largest entry the ring takes, in data bytes
+     */
+    uint64_t max_entry_size(void) const;
+
+    /**
+     * @brief Reserve space for one entry, to be filled at the returned
+     * address and committed with commit
+     * @param[in] size Data bytes, at most max_entry_size()
+     * @param[in] wait_ms Time to wait for the writer when the ring is full
+     * @param[out] token Passed to commit
+     * @retval Where the data goes, nullptr if the entry was dropped (ring
+     * full, no producer slot, entry too large)
+     */
+    char *reserve(uint64_t size, uint32_t wait_ms, uint64_t &token);
+
+    /**
+     * @brief Commit the entry reserved with reserve and wake the writer
+     */
+    void commit(uint64_t token);
+
+    /**
+     * @brief Copy one entry in, given as pieces
+     * @retval false if it was dropped
+     */
+    bool append(const struct iovec *pieces, int num_pieces, uint32_t wait_ms);
+
+    /**
+     * @brief Take the writer role if nobody holds it or its holder has exited
+     * @retval true if this object is the writer
+     */
+    bool acquire_writer(void);
+
+    /**
+     * @brief Give up the writer role
+     */
+    void release_writer(void);
+
+    bool is_writer (void) const
+    {
+        return _writer;
+    }
+
+    /**
+     * @brief Write the committed entries to the sink, waiting up to wait_ms
+     * for the first one. Reservations of crashed producers are skipped.
+     * Called by the writer only.
+     * @retval Number of entries written
+     */
+    size_t drain(LogSink &sink, uint32_t wait_ms);
+
+    /**
+     * @brief In a forked child: the parent's producer slot and writer role
+     * stay the parent's, the child takes a producer slot of its own
+     */
+    void after_fork_child(void);
+
+    ShmRingStats stats(void) const;
+
+    /* Producers that can use a ring at the same time */
+    static const uint32_t MAX_PRODUCERS = 256;
+    /* An uncommitted entry at the tail is checked for a crashed producer
+     * after this long */
+    static const uint32_t STALL_CHECK_MS = 20;
+
+private:
+    /**
+     * @brief Take a free producer slot, or the slot of a producer that has
+     * exited
+     */
+    bool attach_producer(void);
+
+    /**
+     * @brief If the uncommitted entry at pos belongs to a producer that has
+     * exited, give back its slot
+     * @retval Bytes reserved by it, 0 if it is alive or unknown
+     */
+    uint64_t crashed_reservation(uint64_t pos);
+
+    /**
+     * @brief Where the writer picks up again behind a damaged entry header at
+     * pos
+     */
+    uint64_t next_boundary(uint64_t pos, uint64_t head);
+
+    /**
+     * @brief Clear drained space and hand it back to the producers
+     */
+    void release_space(uint64_t begin, uint64_t end);
+
+    /**
+     * @brief Sleep until a producer commits an entry at pos, or for wait_ms
+     */
+    void wait_entry(uint64_t pos, uint32_t wait_ms);
+
+    std::string    _name;
+    ShmRingHeader *_header;
+    char          *_data;
+    size_t         _map_size;
+    ShmProducer   *_producer;
+    /* This process, pid and start time as kept in the shared memory */
+    uint64_t       _self;
+    bool           _writer;
+
+    /* Writer: where and since when the tail entry is uncommitted */
+    uint64_t                              _stall_pos;
+    std::chrono::steady_clock::time_point _stall_since;
+}; // class ShmRing
+
+/**
+ * @brief Sink that hands the log data of this process to a shared ring
+ * (destination "shm://<name>"), whose writer writes it to the file. Each
+ * buffer flush becomes one entry, so the records of different processes are
+ * never torn or interleaved; only a flush longer than half the ring is split,
+ * at record ends where possible.
+ */
+class ShmRingSink : public LogSink
+{
+public:
+    /**
+     * @brief ShmRingSink constructor, attaches to the ring right away
+     * @param[in] address "shm://<name>"
+     * @param[in] capacity Size of the ring if it has to be created, in bytes
+     */
+    ShmRingSink(const std::string &address, uint64_t capacity);
+
+    /**
+     * @brief Check whether a log destination names a shared ring
+     */
+    static bool is_address(const std::string &destination);
+
+    /**
+     * @brief Name of the ring in a destination, "" if it is none
+     */
+    static std::string ring_name(const std::string &destination);
+
+    /**
+     * @brief Append log data to the ring, dropped if it stays full
+     * @param [in] logdata The source address of the data
+     * @param [in] size The size of the data
+     * @param [in] flush_now Unused, entries are visible once committed
+     */
+    void write_logdata(const char *logdata, uint32_t size, bool flush_now = false) override;
+
+    /**
+     * @brief Gather the pieces into one entry
+     */
+    void write_blockv(const struct iovec *pieces, int num_pieces, const BlockMeta &meta,
+                      bool flush_now = false) override;
+
+    /**
+     * @brief Nothing is buffered
+     */
+    void flush (void) override
+    {
+    }
+
+    /**
+     * @brief In a forked child, take a producer slot of its own
+     */
+    void after_fork_child(void) override;
+
+    bool valid (void) const
+    {
+        return _ring.is_open();
+    }
+
+    ShmRingStats stats (void) const
+    {
+        return _ring.stats();
+    }
+
+    /* Time a flush waits for the writer when the ring is full */
+    static const uint32_t FULL_WAIT_MS = 200;
+
+private:
+    ShmRing _ring;
+}; // class ShmRingSink
+
+/**
+ * @brief The single writer of a shared ring: a thread that holds the writer
+ * role and drains the ring to a sink, usually a LogFile. While another live
+ * process holds the role the thread stands by and takes over once that
+ * process exits. Runs in one of the logging processes (LogControl::
+ * shm_writer_file) or in tinylog-shmd.
+ */
+class ShmRingWriter
+{
+public:
+    ShmRingWriter(void);
+
+    /**
+     * @brief ShmRingWriter destructor, stops the writer
+     */
+    ~ShmRingWriter(void);
+
+    /**
+     * @brief Attach to the ring and start the writer thread
+     * @param[in] name Ring name
+     * @param[in] capacity Size of the ring if it has to be created, in bytes
+     * @param[in] sink Where the data goes, the writer takes ownership
+     * @retval false if the ring can not be opened
+     */
+    bool start(const std::string &name, uint64_t capacity, std::unique_ptr<LogSink> sink);
+
+    /**
+     * @brief Write what has been committed, give up the writer role and stop
+     * the thread
+     */
+    void stop(void);
+
+    bool running (void) const
+    {
+        return _thread.joinable();
+    }
+
+    /**
+     * @brief Whether the thread holds the writer role
+     */
+    bool active (void) const
+    {
+        return _active.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief In a forked child the writer thread does not exist, the parent
+     * stays the writer
+     */
+    void after_fork_child(void);
+
+    ShmRingStats stats (void) const
+    {
+        return _ring.stats();
+    }
+
+    /* Longest wait for an entry, the sink is flushed when idle */
+    static const uint32_t IDLE_WAIT_MS = 100;
+    /* Interval of the checks for the writer role while standing by */
+    static const uint32_t STANDBY_POLL_MS = 100;
+
+private:
+    void writer_thread(void);
+
+    ShmRing                  _ring;
+    std::unique_ptr<LogSink> _sink;
+    std::thread              _thread;
+    std::atomic<bool>        _stop;
+    std::atomic<bool>        _active;
+}; // class ShmRingWriter
+
+} // namespace logging
+
+#endif // _LOGGING_SHM_RING_H_
@@ -0,0 +1,219 @@
+#ifndef _LOGGING_SOCKET_SINK_H_
+#define _LOGGING_SOCKET_SINK_H_
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "log_sink.h"
+
+namespace logging {
+
+/**
+ * @brief Sink that ships log data to a local collector over a socket instead
+ * of writing files.
+ *
+ * Supported addresses:
+ *   tcp://host:port        TCP stream
+ *   udp://host:port        UDP datagrams
+ *   unix:///path/to/sock   Unix domain stream socket
+ *   unixgram:///path/sock  Unix domain datagram socket
+ *
+ * Stream sockets receive the data of a whole buffer with one gathered write.
+ * On datagram sockets the buffer is cut at record boundaries into datagrams of
+ * at most MAX_DATAGRAM_SIZE bytes, which are sent in batches with sendmmsg.
+ *
+ * The socket is non-blocking and a send waits at most SEND_TIMEOUT_MS for the
+ * collector. Data that can not be sent because the collector is slow or gone
+ * is appended to the spill file, if one is configured, and is dropped
+ * otherwise. While the spill file holds data, new data is appended behind it
+ * so that the collector always receives the records in order; the spill file
+ * is replayed as soon as the socket accepts data again and truncated once it
+ * is drained. A spill file left by a previous run is replayed as well.
+ * A lost connection is re-established with exponential backoff, from
+ * MIN_RECONNECT_MS up to MAX_RECONNECT_MS.
+ * @note Like every sink, it is only used by the background thread of
+ * AsyncLogging; the statistics may be read from any thread.
+ */
+class SocketSink : public LogSink
+{
+public:
+    /**
+     * @brief SocketSink constructor, the connection is attempted right away
+     * @param[in] address Collector address, see the class description
+     * @param[in] spill_file File that keeps the data the collector could not
+     * take. If empty, such data is dropped.
+     * @param[in] spill_max_bytes Maximum size of the spill file, data beyond
+     * it is dropped. 0 means no limit.
+     */
+    SocketSink(const std::string &address, const std::string &spill_file = "", uint64_t spill_max_bytes = 0);
+
+    /**
+     * @brief SocketSink destructor, makes a last attempt to deliver the
+     * spilled data
+     */
+    ~SocketSink(void) override;
+
+    /**
+     * @brief Check whether a log destination names a socket address rather
+     * than a file
+     */
+    static bool is_address(const std::string &destination);
+
+    /**
+     * @brief Send log data, spill or drop what the collector does not take
+     * @param [in] logdata The source address of the data to be sent
+     * @param [in] size The size of the data to be sent
+     * @param [in] flush_now Unused, data is never held back
+     */
+    void write_logdata(const char *logdata, uint32_t size, bool flush_now = false) override;
+
+    /**
+     * @brief Reconnect if due and replay the spill file
+     */
+    void flush(void) override;
+
+    /**
+     * @brief In a forked child, open a connection and a spill file of its own
+     * (the spill file name gets the pid appended)
+     */
+    void after_fork_child(void) override;
+
+    /**
+     * @brief Whether the address could be parsed
+     */
+    bool valid(void) const
+    {
+        return _valid;
+    }
+
+    bool connected(void) const
+    {
+        return _fd >= 0;
+    }
+
+    /* Bytes delivered to the socket, including replayed spill data */
+    uint64_t sent_bytes(void) const
+    {
+        return _sent_bytes.load(std::memory_order_relaxed);
+    }
+
+    /* Bytes appended to the spill file */
+    uint64_t spilled_bytes(void) const
+    {
+        return _spilled_bytes.load(std::memory_order_relaxed);
+    }
+
+    /* Bytes lost because there was no spill file or it was full */
+    uint64_t dropped_bytes(void) const
+    {
+        return _dropped_bytes.load(std::memory_order_relaxed);
+    }
+
+    /* Number of connections established after the first one */
+    uint64_t reconnects(void) const
+    {
+        return _reconnects.load(std::memory_order_relaxed);
+    }
+
+    static const uint32_t MAX_DATAGRAM_SIZE = 8192;
+    static const uint32_t SEND_TIMEOUT_MS   = 50;
+    static const uint32_t MIN_RECONNECT_MS  = 100;
+    static const uint32_t MAX_RECONNECT_MS  = 30000;
+
+private:
+    /* Datagrams handed to one sendmmsg call */
+    static const uint32_t DATAGRAM_BATCH = 64;
+    /* Spill data read back per replay step */
+    static const uint32_t REPLAY_CHUNK_SIZE = 64 * 1024;
+
+    /**
+     * @brief Split the address into socket family, type and location
+     */
+    bool parse_address(const std::string &address);
+
+    /**
+     * @brief Open and connect the socket
+     * @retval true if connected
+     */
+    bool connect_socket(void);
+
+    /**
+     * @brief Connect if there is no connection and the backoff has expired
+     * @param[in] force Ignore the backoff
+     */
+    void ensure_connected(bool force = false);
+
+    /**
+     * @brief Close the socket after an error and schedule the reconnection
+     */
+    void close_socket(void);
+
+    /**
+     * @brief Send data on the socket
+     * @retval Number of bytes the socket accepted. On datagram sockets this is
+     * always the end of a record.
+     */
+    size_t send_data(const char *data, size_t size);
+    size_t send_stream(const char *data, size_t size);
+    size_t send_datagrams(const char *data, size_t size);
+
+    /**
+     * @brief Wait until the socket is writable
+     * @retval true if writable, false on timeout or error
+     */
+    bool wait_writable(void);
+
+    /**
+     * @brief Append data to the spill file, or drop it
+     */
+    void spill(const char *data, size_t size);
+
+    /**
+     * @brief Send the pending part of the spill file
+     * @retval true if the spill file has been drained
+     */
+    bool replay_spill(void);
+
+    /**
+     * @brief Bytes of the spill file that have not been sent yet
+     */
+    uint64_t spill_pending(void) const
+    {
+        return _spill_size - _spill_offset;
+    }
+
+    bool        _valid;
+    bool        _datagram;
+    int         _family;
+    std::string _host;
+    std::string _port;
+    std::string _path;
+
+    int  _fd;
+    bool _ever_connected;
+
+    /* Reconnection backoff */
+    uint32_t                              _backoff_ms;
+    std::chrono::steady_clock::time_point _next_connect;
+
+    /* Spill file, the bytes in [_spill_offset, _spill_size) are pending */
+    std::string _spill_file;
+    int         _spill_fd;
+    uint64_t    _spill_max_bytes;
+    uint64_t    _spill_offset;
+    uint64_t    _spill_size;
+
+    std::vector<char> _replay_buffer;
+
+    std::atomic<uint64_t> _sent_bytes;
+    std::atomic<uint64_t> _spilled_bytes;
+    std::atomic<uint64_t> _dropped_bytes;
+    std::atomic<uint64_t> _reconnects;
+}; // class SocketSink
+
+} // namespace logging
+
+#endif // _LOGGING_SOCKET_SINK_H_
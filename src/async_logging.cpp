@@ -1,31 +1,82 @@
 #include "async_logging.h"
+#include <emmintrin.h>      // _mm_pause
+#include <pthread.h>        // pthread_setaffinity_np, pthread_setname_np
+#include <sched.h>          // sched_yield
+#include <sys/resource.h>   // setpriority
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
 #include <cstring>
 #include <iostream>
 #include <new>
+#include "crc32c.h"
+#include "log_frame.h"
 
 namespace logging {
 
+/**
+ * @brief Monotonic time in milliseconds, for the duplicate collapsing windows
+ */
+static uint64_t
+steady_ms (void)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
 /**
  * @brief Asynchronous logger initialization
  * @param [in] file_name: Log file name
  * @param [in] roll_cycle_minutes: Log file rolling period, in minutes.
  * @param [in] roll_size_bytes: File rolling size, in bytes
+ * @param [in] retention: Limits on the rolled log files
+ * @param [in] container: Write the seekable container format instead of plain
+ * text
  * @note  If roll_cycle_minutes is equal to 0, no new log files will be
  * generated based on time rolling. If roll_size_bytes is equal to 0, new log
  * files will not be rolled based on the log file size.
  */
 // FIXME: This work should go into the constructor
 void
-AsyncLogging::init(std::string file_name, uint64_t roll_cycle_minutes, uint64_t roll_size_bytes)
+AsyncLogging::init(std::string file_name, uint64_t roll_cycle_minutes, uint64_t roll_size_bytes,
+                   const RetentionPolicy &retention, bool container)
 {
 
-    _log_file_ptr.reset(new (std::nothrow) LogFile(file_name, roll_cycle_minutes, roll_size_bytes));
-    if (nullptr == _log_file_ptr)
+    std::unique_ptr<LogSink> log_file(new (std::nothrow)
+                                          LogFile(file_name, roll_cycle_minutes, roll_size_bytes, retention, container));
+    if (nullptr == log_file)
     {
         std::cerr << "[AsyncLogging::init] can not create file !!!!!\n";
         return;
     }
+    init(std::move(log_file));
+}
+
+/**
+ * @brief Asynchronous logger initialization with a custom destination
+ * @param [in] sink: Destination of the log data, e.g. a SocketSink. The logger
+ * takes ownership.
+ */
+void
+AsyncLogging::init(std::unique_ptr<LogSink> sink)
+{
+    _sink_ptr = std::move(sink);
+    if (nullptr == _sink_ptr)
+    {
+        std::cerr << "[AsyncLogging::init] sink is null !!!!!\n";
+        return;
+    }
+    create_buffers();
+}
+
+/**
+ * @brief Create the queues and buffers of both lanes
+ */
+void
+AsyncLogging::create_buffers(void)
+{
     /* In the initial state, a total of 11 free buffers are available, and the
      * buffer with data is 0 */
     _input_queue_ptr
@@ -33,8 +84,14 @@ AsyncLogging::init(std::string file_name, uint64_t roll_cycle_minutes, uint64_t
     _output_queue_ptr = std::unique_ptr<BufferQueue>(new (std::nothrow) BufferQueue(0));
     _cur_buffer_ptr   = std::unique_ptr<DataBuffer>(new (std::nothrow) DataBuffer());
 
+    _urgent_input_queue_ptr
+        = std::unique_ptr<BufferQueue>(new (std::nothrow) BufferQueue(NUM_OF_URGENT_BUFFERS));
+    _urgent_output_queue_ptr = std::unique_ptr<BufferQueue>(new (std::nothrow) BufferQueue(0));
+    _urgent_buffer_ptr       = std::unique_ptr<DataBuffer>(new (std::nothrow) DataBuffer());
+
     if ((nullptr == _input_queue_ptr) || (nullptr == _output_queue_ptr)
-        || (nullptr == _cur_buffer_ptr))
+        || (nullptr == _cur_buffer_ptr) || (nullptr == _urgent_input_queue_ptr)
+        || (nullptr == _urgent_output_queue_ptr) || (nullptr == _urgent_buffer_ptr))
     {
         std::cerr << "[AsyncLogging::init] can not create buffer queue !!!!!\n";
     }
@@ -47,164 +104,1255 @@ AsyncLogging::init(std::string file_name, uint64_t roll_cycle_minutes, uint64_t
  */
 AsyncLogging::~AsyncLogging(void)
 {
+    if (_restart_pending)
+    {
+        /* A forked child that never logged, the sink is still the parent's */
+        (void)_sink_ptr.release();
+        return;
+    }
 
     _running = false;
 
-    if (nullptr != _log_file_ptr)
+    /* Stop the consumer first, the remaining data is written from here */
+    if (_background_thread.joinable())
+    {
+        _background_thread.join();
+    }
+
+    if (nullptr != _sink_ptr)
     {
+        write_urgent();
+
         /* Clear the cached data in the output queue */
         while (!_output_queue_ptr->empty())
         {
             auto tmp = _output_queue_ptr->pop_buffer(1);
-            if (nullptr != tmp)
+            if ((nullptr != tmp) && !merge_buffer(tmp, false))
             {
-                _log_file_ptr->write_logdata(tmp->get_buffer(), tmp->get_data_size());
+                write_buffer(*tmp);
                 tmp->reset_buffer();
             }
         }
         /* The currently held buffer may also have data that has not been
          * written. */
         std::unique_lock<std::mutex> lock(_buffer_lock);
-        if(nullptr != _cur_buffer_ptr)
+        DataBuffer_ptr               tmp = nullptr;
+        if ((nullptr != _cur_buffer_ptr) && (_cur_buffer_ptr->get_data_size() > 0))
         {
-            size_t                      data_size = _cur_buffer_ptr->get_data_size();
-            if (data_size > 0)
-            {
-                _log_file_ptr->write_logdata(_cur_buffer_ptr->get_buffer(), data_size);
-                _cur_buffer_ptr->reset_buffer();
-            }
+            tmp             = std::move(_cur_buffer_ptr);
+            _cur_buffer_ptr = _input_queue_ptr->pop_buffer(1);
         }
         lock.unlock();
+        if ((nullptr != tmp) && !merge_buffer(tmp, false))
+        {
+            write_buffer(*tmp);
+            tmp->reset_buffer();
+        }
+        drain_merged(true);
 
-        _log_file_ptr->flush();
-    }
-
-    if (_background_thread.joinable())
-    {
-        _background_thread.join();
+        write_dedup_summaries(true);
+        _sink_ptr->flush();
     }
+    write_flight_dump();
 }
 
 /**
  * @brief Log data writing
  * @param [in] data : Log data source address
  * @param [in] size : Log data length
+ * @param [in] timestamp_us : Record time in microseconds since epoch, 0 if
+ * unknown (the time of the previous record is used)
  */
 void
-AsyncLogging::append_data(const char *data, size_t size)
+AsyncLogging::append_data(const char *data, size_t size, uint64_t timestamp_us, bool urgent, size_t time_begin,
+                          size_t time_end)
 {
+    struct iovec piece;
+    piece.iov_base = const_cast<char *>(data);
+    piece.iov_len  = size;
+    append_datav(&piece, 1, timestamp_us, urgent, time_begin, time_end);
+}
+
+/**
+ * @brief Write one record whose data is split into several pieces, the
+ * pieces are stored back to back in the same buffer
+ * @param [in] pieces : Pieces of the record, in order
+ * @param [in] num_pieces : Number of pieces
+ * @param [in] timestamp_us : Record time in microseconds since epoch, 0 if
+ * unknown (the time of the previous record is used)
+ */
+void
+AsyncLogging::append_datav(const struct iovec *pieces, int num_pieces, uint64_t timestamp_us, bool urgent,
+                           size_t time_begin, size_t time_end)
+{
+    size_t size = 0;
+    for (int i = 0; i < num_pieces; i++)
+    {
+        size += pieces[i].iov_len;
+    }
+
+    if (urgent)
+    {
+        append_urgent(pieces, num_pieces, size, timestamp_us, time_begin, time_end);
+        return;
+    }
 
     std::unique_lock<std::mutex> lock(_buffer_lock);
+    /* The sequence number is taken even if the record is dropped below, so
+     * that drops show up as gaps */
+    uint64_t seq = _next_seq.fetch_add(1, std::memory_order_relaxed);
+    if (0 == timestamp_us)
+    {
+        timestamp_us = _last_timestamp_us;
+    }
+    else
+    {
+        _last_timestamp_us = timestamp_us;
+    }
+
     if (nullptr != _cur_buffer_ptr)
     {
+        /* The checksum of a framed record is filled in by the background
+         * thread, see DataBuffer::seal_frames */
+        char   frame[RECORD_FRAME_SIZE];
+        size_t frame_size = 0;
+        if (_framing.load(std::memory_order_relaxed))
+        {
+            record_frame(seq, static_cast<uint32_t>(size), frame);
+            frame_size = RECORD_FRAME_SIZE;
+        }
+
         size_t data_size = _cur_buffer_ptr->get_data_size();
-        if (data_size + size > _cur_buffer_ptr->get_buffer_size())
+        if (data_size + frame_size + size > _cur_buffer_ptr->get_buffer_size())
         {
-            _output_queue_ptr->push_buffer(_cur_buffer_ptr);
+            /* A record too large for any buffer gets a buffer of its own with
+             * an extent, queued right behind the current one */
+            bool extent = (frame_size + size > _cur_buffer_ptr->get_buffer_size());
+            if (!extent || (0 != data_size))
+            {
+                _output_queue_ptr->push_buffer(_cur_buffer_ptr);
 
-            /* !!! FIXME: The caller should not be blocked due to logging
-             * issues*/
-            _cur_buffer_ptr = _input_queue_ptr->pop_buffer(1);
-            if (nullptr == _cur_buffer_ptr)
+                /* !!! FIXME: The caller should not be blocked due to logging
+                 * issues*/
+                _cur_buffer_ptr = _input_queue_ptr->pop_buffer(1);
+                if (nullptr == _cur_buffer_ptr)
+                {
+                    std::cerr << "\n!!!Log input is too fast!!!\n";
+                    return;
+                }
+            }
+            if (extent
+                && _cur_buffer_ptr->input_extent((0 != frame_size) ? frame : nullptr, frame_size, pieces, num_pieces))
             {
-                std::cerr << "\n!!!Log input is too fast!!!\n";
+                note_stored(*_cur_buffer_ptr, 0, frame_size, timestamp_us, seq, time_begin, time_end);
+                _output_queue_ptr->push_buffer(_cur_buffer_ptr);
+                _cur_buffer_ptr = _input_queue_ptr->pop_buffer(1);
+                if (nullptr == _cur_buffer_ptr)
+                {
+                    std::cerr << "\n!!!Log input is too fast!!!\n";
+                }
                 return;
             }
         }
-        _cur_buffer_ptr->input_data(data, size);
+        size_t start = _cur_buffer_ptr->get_data_size();
+        if (0 != frame_size)
+        {
+            _cur_buffer_ptr->note_frame();
+            _cur_buffer_ptr->input_data(frame, frame_size);
+        }
+        for (int i = 0; i < num_pieces; i++)
+        {
+            _cur_buffer_ptr->input_data(static_cast<const char *>(pieces[i].iov_base), pieces[i].iov_len);
+        }
+        note_stored(*_cur_buffer_ptr, start, frame_size, timestamp_us, seq, time_begin, time_end);
         lock.unlock();
     }
     else
     {
         lock.unlock();
-        std::cerr << "[AsyncLogging::append_data] _cur_buffer_ptr is null" << std::endl;
+        std::cerr << "[AsyncLogging::append_datav] _cur_buffer_ptr is null" << std::endl;
     }
 }
 
 /**
- * @brief Background log consumption thread implementation, responsible for
- * writing log data into log files
+ * @brief Store a record in the priority lane
  */
 void
-AsyncLogging::background_consume_thread(void)
+AsyncLogging::append_urgent(const struct iovec *pieces, int num_pieces, size_t size, uint64_t timestamp_us,
+                            size_t time_begin, size_t time_end)
 {
-    while (_running)
+    if (0 == timestamp_us)
+    {
+        timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+    }
+
+    std::unique_lock<std::mutex> lock(_urgent_lock);
+    size_t frame_size = _framing.load(std::memory_order_relaxed) ? RECORD_FRAME_SIZE : 0;
+    bool   extent     = false;
+    /* The lock is released while waiting for a free buffer, other producers
+     * may have filled some of it in the meantime */
+    for (;;)
     {
-        if (nullptr != _log_file_ptr)
+        if (!wait_urgent_buffer(lock))
         {
-            DataBuffer_ptr buffer_ptr = _output_queue_ptr->pop_buffer(1000);
-            if (nullptr != buffer_ptr)
-            {
-                _log_file_ptr->write_logdata(buffer_ptr->get_buffer(), buffer_ptr->get_data_size());
-                buffer_ptr->reset_buffer();
-                {
-                    std::lock_guard<std::mutex> lock(_buffer_lock);
-                    if(nullptr == _cur_buffer_ptr)
-                    {
-                        _cur_buffer_ptr = std::move(buffer_ptr);
-                        std::cout << "[AsyncLogging::background_consume_thread] reset _cur_buffer_ptr" << std::endl;
-                    }
-                }
+            return;
+        }
+        size_t data_size   = _urgent_buffer_ptr->get_data_size();
+        size_t buffer_size = _urgent_buffer_ptr->get_buffer_size();
+        if (data_size + frame_size + size <= buffer_size)
+        {
+            break;
+        }
+        if ((frame_size + size > buffer_size) && (0 == data_size))
+        {
+            extent = true;
+            break;
+        }
+        hand_over_urgent();
+    }
+    /* Numbered once the buffer is settled, so the lane holds its records in
+     * sequence order */
+    uint64_t seq = _next_seq.fetch_add(1, std::memory_order_relaxed);
+    char     frame[RECORD_FRAME_SIZE];
+    if (0 != frame_size)
+    {
+        record_frame(seq, static_cast<uint32_t>(size), frame);
+    }
 
-                if(nullptr != buffer_ptr)
-                {
-                    _input_queue_ptr->push_buffer(buffer_ptr);
-                }
+    if (extent
+        && _urgent_buffer_ptr->input_extent((0 != frame_size) ? frame : nullptr, frame_size, pieces, num_pieces))
+    {
+        note_stored(*_urgent_buffer_ptr, 0, frame_size, timestamp_us, seq, time_begin, time_end);
+        hand_over_urgent();
+        return;
+    }
+    size_t start = _urgent_buffer_ptr->get_data_size();
+    if (0 != frame_size)
+    {
+        _urgent_buffer_ptr->note_frame();
+        _urgent_buffer_ptr->input_data(frame, frame_size);
+    }
+    for (int i = 0; i < num_pieces; i++)
+    {
+        _urgent_buffer_ptr->input_data(static_cast<const char *>(pieces[i].iov_base), pieces[i].iov_len);
+    }
+    note_stored(*_urgent_buffer_ptr, start, frame_size, timestamp_us, seq, time_begin, time_end);
+    lock.unlock();
+
+    /* Wake the consumer once per batch of urgent records. With the record
+     * merge they wait for the window anyway and are collected with the
+     * current buffer. */
+    if ((0 == _reorder_window_ms.load(std::memory_order_relaxed)) && !_urgent_pending.exchange(true))
+    {
+        _output_queue_ptr->wakeup();
+    }
+}
+
+/**
+ * @brief Write one record whose body is a caller buffer (LOG_PAYLOAD). The
+ * header pieces are copied into a buffer of its own, queued right behind the
+ * current one; the payload is written from where it is by the background
+ * thread, encoded there if asked to, and then released.
+ * @param [in] pieces : Pieces of the header, in order
+ * @param [in] num_pieces : Number of pieces
+ * @param [in] payload : The payload, released once written or dropped
+ * @param [in] timestamp_us : Record time in microseconds since epoch, 0 if
+ * unknown (the time of the previous record is used)
+ */
+void
+AsyncLogging::append_payload(const struct iovec *pieces, int num_pieces, Payload &&payload, uint64_t timestamp_us,
+                             bool urgent, size_t time_begin, size_t time_end)
+{
+    size_t size = 0;
+    for (int i = 0; i < num_pieces; i++)
+    {
+        size += pieces[i].iov_len;
+    }
+    if (urgent && (0 == timestamp_us))
+    {
+        timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+    }
 
+    std::unique_lock<std::mutex> lock(urgent ? _urgent_lock : _buffer_lock);
+    DataBuffer_ptr              &buffer_ptr = urgent ? _urgent_buffer_ptr : _cur_buffer_ptr;
+    if (urgent)
+    {
+        /* The record takes a buffer of its own, the records before it go
+         * first. The lock is released while waiting for a free buffer. */
+        for (;;)
+        {
+            if (!wait_urgent_buffer(lock))
+            {
+                release_payload(payload);
+                return;
             }
-            else
+            if (0 == buffer_ptr->get_data_size())
             {
-                /* If there is no buffer in the output queue, write the data in
-                 * the buffer pointed to by _cur_buffer_ptr to the log file. */
-                DataBuffer_ptr tmp = nullptr;
-                {
-                    std::lock_guard<std::mutex> lock(_buffer_lock);
-                    if (nullptr != _cur_buffer_ptr && _cur_buffer_ptr->get_data_size() > 0)
-                    {
-                        tmp             = std::move(_cur_buffer_ptr);
-                        _cur_buffer_ptr = _input_queue_ptr->pop_buffer(1);
-                    }
-                }
-                if (nullptr == _cur_buffer_ptr)
-                {
-                    std::cerr << "[AsyncLogging::background_consume_thread] cant not get free buffer" << std::endl;
-                }
+                break;
+            }
+            hand_over_urgent();
+        }
+    }
+    else if (nullptr == buffer_ptr)
+    {
+        lock.unlock();
+        std::cerr << "[AsyncLogging::append_payload] no current buffer" << std::endl;
+        release_payload(payload);
+        return;
+    }
+    uint64_t seq = _next_seq.fetch_add(1, std::memory_order_relaxed);
+    if (!urgent)
+    {
+        if (0 == timestamp_us)
+        {
+            timestamp_us = _last_timestamp_us;
+        }
+        else
+        {
+            _last_timestamp_us = timestamp_us;
+        }
 
-                if (nullptr != tmp)
-                {
-                    if (tmp->get_data_size() > 0)
-                    {
-                        _log_file_ptr->write_logdata(tmp->get_buffer(), tmp->get_data_size(), true);
-                    }
-                    tmp->reset_buffer();
-                    _input_queue_ptr->push_buffer(tmp);
-                }
+        /* The record takes a buffer of its own, the records before it go
+         * first */
+        if (0 != buffer_ptr->get_data_size())
+        {
+            _output_queue_ptr->push_buffer(buffer_ptr);
+            buffer_ptr = _input_queue_ptr->pop_buffer(1);
+            if (nullptr == buffer_ptr)
+            {
+                std::cerr << "\n!!!Log input is too fast!!!\n";
+                release_payload(payload);
+                return;
             }
+        }
+    }
 
-            
+    if (size <= buffer_ptr->get_buffer_size())
+    {
+        for (int i = 0; i < num_pieces; i++)
+        {
+            buffer_ptr->input_data(static_cast<const char *>(pieces[i].iov_base), pieces[i].iov_len);
+        }
+    }
+    else if (!buffer_ptr->input_extent(nullptr, 0, pieces, num_pieces))
+    {
+        release_payload(payload);
+        return;
+    }
+    (void)buffer_ptr->set_payload(std::move(payload), _framing.load(std::memory_order_relaxed));
+    /* Written as a whole, never collapsed */
+    if (0 != _reorder_window_ms.load(std::memory_order_relaxed))
+    {
+        buffer_ptr->note_index(0, timestamp_us, seq, false, time_begin, time_end);
+    }
+    buffer_ptr->note_record(timestamp_us, seq);
+
+    if (urgent)
+    {
+        hand_over_urgent();
+        return;
+    }
+    _output_queue_ptr->push_buffer(buffer_ptr);
+    buffer_ptr = _input_queue_ptr->pop_buffer(1);
+    if (nullptr == buffer_ptr)
+    {
+        std::cerr << "\n!!!Log input is too fast!!!\n";
+    }
+}
+
+/**
+ * @brief Queue the current buffer of the priority lane and take a free one if
+ * there is any, called with _urgent_lock held. Otherwise the lane is left
+ * without a current buffer, see wait_urgent_buffer.
+ */
+void
+AsyncLogging::hand_over_urgent(void)
+{
+    _urgent_output_queue_ptr->push_buffer(_urgent_buffer_ptr);
+    _urgent_pending.store(true);
+    _output_queue_ptr->wakeup();
+    _urgent_buffer_ptr = _urgent_input_queue_ptr->try_pop_buffer();
+}
 
+/**
+ * @brief Make sure the priority lane has a current buffer, waiting for the
+ * consumer to hand back a reserved one if need be. The lock is released while
+ * waiting, so the producers of the lane wait side by side on the free queue
+ * rather than one behind the other on the lock.
+ * @param[in] lock Holds _urgent_lock, held again on return
+ * @retval false if the consumer has stopped
+ */
+bool
+AsyncLogging::wait_urgent_buffer(std::unique_lock<std::mutex> &lock)
+{
+    /* Urgent records are never dropped */
+    while (nullptr == _urgent_buffer_ptr)
+    {
+        lock.unlock();
+        DataBuffer_ptr buffer_ptr = _urgent_input_queue_ptr->pop_buffer(URGENT_WAIT_MS);
+        lock.lock();
+        if (nullptr == buffer_ptr)
+        {
+            if (!_running)
+            {
+                std::cerr << "[AsyncLogging::wait_urgent_buffer] consumer stopped, no free buffer" << std::endl;
+                return false;
+            }
+        }
+        else if (nullptr == _urgent_buffer_ptr)
+        {
+            _urgent_buffer_ptr = std::move(buffer_ptr);
         }
         else
         {
-            std::cerr << "[AsyncLogging::background_consume_thread] file is null" << std::endl;
+            /* Another producer has set one up meanwhile */
+            _urgent_input_queue_ptr->push_buffer(buffer_ptr);
         }
     }
+    return true;
 }
 
 /**
- * @brief Start logging
+ * @brief Account a record just stored in a buffer of a lane, called with the
+ * lock of the lane held
+ * @param[in] start Data size before the record and its frame prefix
  */
 void
-AsyncLogging::start()
+AsyncLogging::note_stored(DataBuffer &buffer, size_t start, size_t frame_size, uint64_t timestamp_us, uint64_t seq,
+                          size_t time_begin, size_t time_end)
 {
-    _running = true;
-    std::thread t(&AsyncLogging::background_consume_thread, this);
-    _background_thread = std::move(t);
+    /* Framed records must all reach the file, they are not collapsed */
+    bool span = (0 == frame_size) && (0 != _dedup_window_ms.load(std::memory_order_relaxed));
+    if (0 != _reorder_window_ms.load(std::memory_order_relaxed))
+    {
+        /* The merge copies the span along with the record */
+        buffer.note_index(start, timestamp_us, seq, span, time_begin, time_end);
+    }
+    else if (span)
+    {
+        buffer.note_span(start, time_begin, time_end);
+    }
+    buffer.note_record(timestamp_us, seq);
+}
 
-    /* Wait for the thread to actually start */
-    while (!_background_thread.joinable())
+/**
+ * @brief Write all the data of the priority lane, called by the consumer
+ */
+void
+AsyncLogging::write_urgent(void)
+{
+    _urgent_pending.store(false);
+
+    /* Queue the partly filled current buffer behind the full ones. Buffers
+     * are only queued under the lock of the lane, so they are written in the
+     * order they were filled. A producer holding the lock queues its buffer
+     * itself; with no current buffer the producers are waiting for a free
+     * one, which only this thread can hand back. */
+    bool left = false;
+    {
+        std::unique_lock<std::mutex> lock(_urgent_lock, std::try_to_lock);
+        if (lock.owns_lock() && (nullptr != _urgent_buffer_ptr) && (_urgent_buffer_ptr->get_data_size() > 0))
+        {
+            if (!_urgent_input_queue_ptr->empty())
+            {
+                _urgent_output_queue_ptr->push_buffer(_urgent_buffer_ptr);
+                _urgent_buffer_ptr = _urgent_input_queue_ptr->pop_buffer(1);
+            }
+            else
+            {
+                left = (0 == _reorder_window_ms.load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    bool written = false;
+    while (!_urgent_output_queue_ptr->empty())
+    {
+        DataBuffer_ptr buffer_ptr = _urgent_output_queue_ptr->pop_buffer(1);
+        if ((nullptr != buffer_ptr) && !merge_buffer(buffer_ptr, true))
+        {
+            write_buffer(*buffer_ptr, true);
+            release_buffer(buffer_ptr, true);
+            written = true;
+        }
+    }
+    /* With no free buffer the current one was left with its records, come
+     * round again now that the written ones are back (with the record merge
+     * it is collected with the current buffer) */
+    if (left)
+    {
+        _urgent_pending.store(true);
+    }
+
+    if (written && _urgent_sync)
+    {
+        _sink_ptr->sync();
+    }
+}
+
+/**
+ * @brief Hand a buffer with data to the record merge if it is on, background
+ * thread
+ * @retval false if the merge is off, the caller writes the buffer
+ */
+bool
+AsyncLogging::merge_buffer(DataBuffer_ptr &buffer_ptr, bool urgent)
+{
+    if ((0 == _reorder_window_ms.load(std::memory_order_relaxed)) || (0 == buffer_ptr->get_data_size()))
+    {
+        return false;
+    }
+    buffer_ptr->seal_frames();
+    _merger.add(std::move(buffer_ptr), urgent,
+                [this] (DataBuffer_ptr &buffer, bool buffer_urgent) { release_buffer(buffer, buffer_urgent); });
+    if (_merger.over_limits())
+    {
+        /* Held too much for the window, the earliest records go out now */
+        write_merged(0);
+    }
+    return true;
+}
+
+/**
+ * @brief Write the merged records whose time is past the reorder window,
+ * background thread
+ * @param[in] all Write all of them, e.g. before the logger goes away
+ */
+void
+AsyncLogging::drain_merged(bool all)
+{
+    uint32_t window_ms = _reorder_window_ms.load(std::memory_order_relaxed);
+    if (!all && (0 != window_ms))
+    {
+        /* Records in the current buffers of the lanes must reach the merge
+         * within the window, they are collected twice per window */
+        uint64_t now_ms = steady_ms();
+        if (now_ms - _merge_collect_ms >= std::max<uint32_t>(1, window_ms / 2))
+        {
+            _merge_collect_ms = now_ms;
+            collect_merge_buffers();
+        }
+    }
+    if (!_merger.pending())
+    {
+        return;
+    }
+
+    /* Once the merge is switched off everything held back goes out */
+    uint64_t window_us = window_ms * 1000ULL;
+    uint64_t watermark = UINT64_MAX;
+    if (!all && (0 != window_us))
     {
+        watermark = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::system_clock::now().time_since_epoch())
+                        .count()
+                    - window_us;
     }
+    write_merged(watermark);
+    if (0 == window_ms)
+    {
+        /* Priority records stored while the merge was on did not wake the
+         * consumer */
+        _urgent_pending.store(true);
+    }
+}
+
+/**
+ * @brief Write the merged records up to a time, and more while the merge
+ * holds too many buffers, background thread
+ * @param[in] watermark Records up to this time (microseconds since epoch) are
+ * written
+ */
+void
+AsyncLogging::write_merged(uint64_t watermark)
+{
+    if (nullptr == _merge_out)
+    {
+        _merge_out.reset(new (std::nothrow) DataBuffer());
+        if (nullptr == _merge_out)
+        {
+            std::cerr << "[AsyncLogging::write_merged] can not create output buffer" << std::endl;
+            return;
+        }
+    }
+
+    bool urgent_written = false;
+    _merger.drain(
+        watermark, *_merge_out,
+        [this, &urgent_written] (DataBuffer &buffer, bool urgent) {
+            /* Priority records are flushed as soon as they are written */
+            write_buffer(buffer, urgent);
+            urgent_written |= urgent;
+        },
+        [this] (DataBuffer_ptr &buffer_ptr, bool urgent) { release_buffer(buffer_ptr, urgent); });
+    if (urgent_written && _urgent_sync)
+    {
+        _sink_ptr->sync();
+    }
+}
+
+/**
+ * @brief Hand the partly filled current buffers of both lanes to the record
+ * merge, background thread
+ */
+void
+AsyncLogging::collect_merge_buffers(void)
+{
+    write_urgent();
+
+    DataBuffer_ptr tmp = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(_buffer_lock);
+        if ((nullptr != _cur_buffer_ptr) && (_cur_buffer_ptr->get_data_size() > 0) && !_input_queue_ptr->empty())
+        {
+            tmp             = std::move(_cur_buffer_ptr);
+            _cur_buffer_ptr = _input_queue_ptr->pop_buffer(1);
+        }
+    }
+    if ((nullptr != tmp) && !merge_buffer(tmp, false))
+    {
+        write_buffer(*tmp);
+        release_buffer(tmp, false);
+    }
+}
+
+/**
+ * @brief Return an empty buffer to its lane, background thread
+ */
+void
+AsyncLogging::release_buffer(DataBuffer_ptr &buffer_ptr, bool urgent)
+{
+    buffer_ptr->reset_buffer();
+    if (urgent)
+    {
+        _urgent_input_queue_ptr->push_buffer(buffer_ptr);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_buffer_lock);
+        /* The producers ran out of buffers (and said so), they get this one */
+        if (nullptr == _cur_buffer_ptr)
+        {
+            _cur_buffer_ptr = std::move(buffer_ptr);
+        }
+    }
+    if (nullptr != buffer_ptr)
+    {
+        _input_queue_ptr->push_buffer(buffer_ptr);
+    }
+}
+
+/**
+ * @brief Background log consumption thread implementation, responsible for
+ * writing log data into log files
+ */
+void
+AsyncLogging::background_consume_thread(void)
+{
+    apply_consumer_options();
+
+    while (_running)
+    {
+        /* Step aside while a fork is being prepared */
+        while (_fork_pending.load())
+        {
+            std::this_thread::yield();
+        }
+        std::lock_guard<std::mutex> fork_guard(_fork_lock);
+
+        if (_sink_swap_pending.load())
+        {
+            swap_sink();
+        }
+
+        if (0 != _flight_triggers.load(std::memory_order_relaxed))
+        {
+            write_flight_dump();
+        }
+
+        if (nullptr != _sink_ptr)
+        {
+            /* The priority lane goes first */
+            if (_urgent_pending.load())
+            {
+                write_urgent();
+            }
+            drain_merged(false);
+
+            DataBuffer_ptr buffer_ptr = wait_buffer();
+            if (nullptr != buffer_ptr)
+            {
+                if (!merge_buffer(buffer_ptr, false))
+                {
+                    write_buffer(*buffer_ptr);
+                    release_buffer(buffer_ptr, false);
+                }
+                drain_merged(false);
+            }
+            else if (_urgent_pending.load())
+            {
+                /* Woken up for the priority lane */
+                continue;
+            }
+            else
+            {
+                /* If there is no buffer in the output queue, write the data in
+                 * the buffer pointed to by _cur_buffer_ptr to the log file. */
+                DataBuffer_ptr tmp    = nullptr;
+                size_t         queued = 0;
+                {
+                    std::lock_guard<std::mutex> lock(_buffer_lock);
+                    if (nullptr != _cur_buffer_ptr && _cur_buffer_ptr->get_data_size() > 0)
+                    {
+                        tmp             = std::move(_cur_buffer_ptr);
+                        _cur_buffer_ptr = _input_queue_ptr->pop_buffer(1);
+                        /* Buffers are queued under the lock, those queued
+                         * since the wait timed out are older than tmp */
+                        queued = _output_queue_ptr->size_hint();
+                    }
+                }
+                if (nullptr == _cur_buffer_ptr)
+                {
+                    std::cerr << "[AsyncLogging::background_consume_thread] cant not get free buffer" << std::endl;
+                }
+
+                if (nullptr != tmp)
+                {
+                    for (; queued > 0; queued--)
+                    {
+                        DataBuffer_ptr older = _output_queue_ptr->pop_buffer(1);
+                        if ((nullptr != older) && !merge_buffer(older, false))
+                        {
+                            write_buffer(*older);
+                            release_buffer(older, false);
+                        }
+                    }
+                    if (!merge_buffer(tmp, false))
+                    {
+                        write_buffer(*tmp, true);
+                        release_buffer(tmp, false);
+                    }
+                    drain_merged(false);
+                }
+                else if (_merger.pending())
+                {
+                    drain_merged(false);
+                }
+                else
+                {
+                    /* Idle, let the sink catch up on deferred work such as
+                     * replaying data it could not deliver */
+                    if (_dedup.pending())
+                    {
+                        write_dedup_summaries(0 == _dedup_window_ms.load(std::memory_order_relaxed));
+                    }
+                    _sink_ptr->flush();
+                }
+            }
+
+            
+
+        }
+        else
+        {
+            std::cerr << "[AsyncLogging::background_consume_thread] file is null" << std::endl;
+        }
+    }
+}
+
+/**
+ * @brief Have the background thread dump the flight recorder
+ * @param [in] trigger : FlightRecorder::Trigger value
+ * @param [in] wake : Wake the background thread up, otherwise the dump waits
+ * for its next round (at most IDLE_FLUSH_MS). Without waking the call is
+ * async-signal-safe.
+ */
+void
+AsyncLogging::request_flight_dump(uint32_t trigger, bool wake)
+{
+    /* A storm of trigger records wakes the consumer once per dump */
+    uint32_t pending = _flight_triggers.fetch_or(trigger);
+    if (wake && (0 == pending) && _running)
+    {
+        _output_queue_ptr->wakeup();
+    }
+}
+
+/**
+ * @brief Write the requested flight recorder dump, background thread
+ */
+void
+AsyncLogging::write_flight_dump(void)
+{
+    uint32_t triggers = _flight_triggers.exchange(0);
+    if ((0 != triggers) && (nullptr != _flight) && _flight->enabled())
+    {
+        (void)_flight->dump(triggers);
+    }
+}
+
+/**
+ * @brief Wait for a full buffer with the configured strategy
+ * @retval The buffer, or nullptr after IDLE_FLUSH_MS (half the reorder window
+ * if shorter) or when woken up for the priority lane, a sink swap, a fork or
+ * shutdown
+ */
+DataBuffer_ptr
+AsyncLogging::wait_buffer(void)
+{
+    /* With the record merge the partly filled buffers and the held back
+     * records are looked at twice per window */
+    uint32_t wait_ms   = IDLE_FLUSH_MS;
+    uint32_t window_ms = _reorder_window_ms.load(std::memory_order_relaxed);
+    if (0 != window_ms)
+    {
+        wait_ms = std::min(wait_ms, std::max<uint32_t>(1, window_ms / 2));
+    }
+
+    WaitStrategy strategy = _consumer_options.wait;
+    if (WAIT_BLOCKING == strategy)
+    {
+        return _output_queue_ptr->pop_buffer(wait_ms);
+    }
+
+    auto     start    = std::chrono::steady_clock::now();
+    auto     deadline = start + std::chrono::milliseconds(static_cast<int64_t>(wait_ms));
+    auto     spin_end = start + std::chrono::microseconds(static_cast<int64_t>(_consumer_options.spin_us));
+    bool     yielding = false;
+    uint32_t polls    = 0;
+    while (true)
+    {
+        /* The lock is only taken once the queue is seen non-empty, polling
+         * does not contend with the producers */
+        if (0 != _output_queue_ptr->size_hint())
+        {
+            DataBuffer_ptr buffer_ptr = _output_queue_ptr->try_pop_buffer();
+            if (nullptr != buffer_ptr)
+            {
+                return buffer_ptr;
+            }
+        }
+        if (_urgent_pending.load(std::memory_order_relaxed) || _fork_pending.load(std::memory_order_relaxed)
+            || _sink_swap_pending.load(std::memory_order_relaxed)
+            || (0 != _flight_triggers.load(std::memory_order_relaxed)) || !_running)
+        {
+            return nullptr;
+        }
+
+        /* Read the clock every 64 polls only */
+        if (0 == (++polls & 63))
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+            {
+                return nullptr;
+            }
+            yielding = (WAIT_SPIN_YIELD == strategy) && (now >= spin_end);
+        }
+
+        if (yielding)
+        {
+            sched_yield();
+        }
+        else
+        {
+            _mm_pause();
+        }
+    }
+}
+
+/**
+ * @brief Apply the consumer options to the calling (background) thread
+ */
+void
+AsyncLogging::apply_consumer_options(void)
+{
+    const ConsumerOptions &options = _consumer_options;
+    pthread_t              self    = pthread_self();
+    int                    ret;
+
+    if (!options.name.empty())
+    {
+        /* The kernel keeps 15 characters plus the terminator */
+        std::string name = options.name.substr(0, 15);
+        ret              = pthread_setname_np(self, name.c_str());
+        if (0 != ret)
+        {
+            std::cerr << "[AsyncLogging::apply_consumer_options] setname failed: " << strerror(ret) << std::endl;
+        }
+    }
+
+    if (options.cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(options.cpu, &cpus);
+        ret = pthread_setaffinity_np(self, sizeof(cpus), &cpus);
+        if (0 != ret)
+        {
+            std::cerr << "[AsyncLogging::apply_consumer_options] can not pin to cpu " << options.cpu << ": "
+                      << strerror(ret) << std::endl;
+        }
+    }
+
+    if (options.sched_policy >= 0)
+    {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = options.sched_priority;
+        ret                  = pthread_setschedparam(self, options.sched_policy, &param);
+        if (0 != ret)
+        {
+            std::cerr << "[AsyncLogging::apply_consumer_options] can not set policy " << options.sched_policy
+                      << ": " << strerror(ret) << std::endl;
+        }
+    }
+
+    if (0 != options.nice)
+    {
+        /* On Linux the nice value is per thread */
+        pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+        if (0 != setpriority(PRIO_PROCESS, tid, options.nice))
+        {
+            std::cerr << "[AsyncLogging::apply_consumer_options] can not set nice " << options.nice << ": "
+                      << strerror(errno) << std::endl;
+        }
+    }
+}
+
+/**
+ * @brief fork() support, to be called from the pthread_atfork prepare handler.
+ * Pauses the background thread at a point where it holds no lock and lets the
+ * sink write out its buffered data.
+ */
+void
+AsyncLogging::prepare_fork(void)
+{
+    if (!_running || (nullptr == _sink_ptr))
+    {
+        return;
+    }
+
+    _fork_pending.store(true);
+    _output_queue_ptr->wakeup();
+    _fork_lock.lock();
+    _fork_pending.store(false);
+
+    _sink_ptr->prepare_fork();
+    _fork_prepared = true;
+}
+
+/**
+ * @brief fork() support, pthread_atfork parent handler. Resumes the background
+ * thread.
+ */
+void
+AsyncLogging::after_fork_parent(void)
+{
+    if (!_fork_prepared)
+    {
+        return;
+    }
+    _fork_prepared = false;
+    _sink_ptr->after_fork_parent();
+    _fork_lock.unlock();
+}
+
+/**
+ * @brief fork() support, pthread_atfork child handler. Abandons the queues and
+ * buffers, rebuilds the locks and stops the logger until restart_after_fork.
+ * Nothing is allocated, opened or started here.
+ */
+void
+AsyncLogging::after_fork_child(void)
+{
+    if (!_fork_prepared)
+    {
+        return;
+    }
+    _fork_prepared = false;
+
+    /* Only the forking thread exists in the child. The other threads of the
+     * parent may have stopped anywhere inside the queues and buffers, so these
+     * are abandoned as they are (never touched again, the pages stay shared
+     * with the parent) and rebuilt, together with the locks. */
+    (void)_cur_buffer_ptr.release();
+    (void)_input_queue_ptr.release();
+    (void)_output_queue_ptr.release();
+    (void)_urgent_buffer_ptr.release();
+    (void)_urgent_input_queue_ptr.release();
+    (void)_urgent_output_queue_ptr.release();
+    new (&_buffer_lock) std::mutex();
+    new (&_urgent_lock) std::mutex();
+    new (&_fork_lock) std::mutex();
+    new (&_background_thread) std::thread();
+    _urgent_pending.store(false);
+    /* Dumps requested before the fork are the parent's */
+    _flight_triggers.store(0);
+
+    _running         = false;
+    _restart_pending = true;
+}
+
+/**
+ * @brief Restart the logger of a forked child after after_fork_child, outside
+ * the atfork handler: creates the queues and buffers and starts the background
+ * thread.
+ * @param [in] sink: Destination for the child, e.g. a file of its own. If null,
+ * the child keeps using the inherited sink.
+ * @note Records buffered at fork time belong to the parent, which writes them;
+ * the child starts with empty buffers.
+ */
+void
+AsyncLogging::restart_after_fork(std::unique_ptr<LogSink> sink)
+{
+    if (!_restart_pending)
+    {
+        return;
+    }
+    _restart_pending = false;
+
+    /* Merged records held back at fork time are the parent's too */
+    _merger.abandon();
+    /* The parent writes the repeats it has counted */
+    _dedup.reset();
+    _dedup_summaries.clear();
+
+    if (nullptr != sink)
+    {
+        /* Destroying the inherited sink would close or finish files the
+         * parent is still writing */
+        (void)_sink_ptr.release();
+        _sink_ptr = std::move(sink);
+    }
+    else
+    {
+        _sink_ptr->after_fork_child();
+    }
+
+    create_buffers();
+    start();
+}
+
+/**
+ * @brief Write the data of a buffer, with the description of its records, to
+ * the log file
+ */
+void
+AsyncLogging::write_buffer(DataBuffer &buffer, bool flush_now)
+{
+    buffer.seal_frames();
+
+    uint32_t window_ms = _dedup_window_ms.load(std::memory_order_relaxed);
+    if (0 != window_ms)
+    {
+        /* Records standing for repeats that ended go ahead of the buffer */
+        _dedup.filter(buffer, window_ms, steady_ms(), _dedup_summaries);
+        write_dedup_summaries(false);
+        if (0 == buffer.get_data_size())
+        {
+            return;
+        }
+    }
+    else if (_dedup.pending())
+    {
+        write_dedup_summaries(true);
+    }
+
+    BlockMeta meta;
+    meta.first_ts_us  = buffer.get_first_ts();
+    meta.last_ts_us   = buffer.get_last_ts();
+    meta.record_count = buffer.get_record_count();
+    meta.first_seq    = buffer.get_first_seq();
+    meta.last_seq     = buffer.get_last_seq();
+    if (nullptr != buffer.get_payload())
+    {
+        write_payload(buffer, meta, flush_now);
+        return;
+    }
+    _sink_ptr->write_block(buffer.get_buffer(), buffer.get_data_size(), meta, flush_now);
+}
+
+/**
+ * @brief Write the record of a buffer with a payload: the header from the
+ * buffer, the payload in place (or encoded into _payload_scratch) and the
+ * newline unless the encoding ends with one, in one gather write
+ */
+void
+AsyncLogging::write_payload(DataBuffer &buffer, const BlockMeta &meta, bool flush_now)
+{
+    const Payload *payload = buffer.get_payload();
+    char           frame[RECORD_FRAME_SIZE];
+    struct iovec   pieces[4];
+    int            num_pieces = 0;
+    if (buffer.payload_framed())
+    {
+        pieces[num_pieces].iov_base = frame;
+        pieces[num_pieces].iov_len  = RECORD_FRAME_SIZE;
+        num_pieces++;
+    }
+    pieces[num_pieces].iov_base = const_cast<char *>(buffer.get_buffer());
+    pieces[num_pieces].iov_len  = buffer.get_data_size();
+    num_pieces++;
+
+    if (PAYLOAD_RAW == payload->encoding)
+    {
+        pieces[num_pieces].iov_base = const_cast<char *>(payload->data);
+        pieces[num_pieces].iov_len  = payload->size;
+    }
+    else
+    {
+        size_t encoded_size = payload_encoded_size(payload->size, payload->encoding);
+        if (encoded_size > _payload_scratch_size)
+        {
+            _payload_scratch.reset(new (std::nothrow) char[encoded_size]);
+            _payload_scratch_size = (nullptr != _payload_scratch) ? encoded_size : 0;
+            if (nullptr == _payload_scratch)
+            {
+                std::cerr << "[AsyncLogging::write_payload] can not allocate " << encoded_size << " bytes"
+                          << std::endl;
+                encoded_size = 0;
+            }
+        }
+        if (0 != encoded_size)
+        {
+            encoded_size = payload_encode(payload->data, payload->size, payload->encoding, _payload_scratch.get());
+        }
+        pieces[num_pieces].iov_base = _payload_scratch.get();
+        pieces[num_pieces].iov_len  = encoded_size;
+    }
+    num_pieces++;
+    if (!payload_multiline(payload->encoding))
+    {
+        pieces[num_pieces].iov_base = const_cast<char *>("\n");
+        pieces[num_pieces].iov_len  = 1;
+        num_pieces++;
+    }
+
+    if (buffer.payload_framed())
+    {
+        size_t   size = 0;
+        uint32_t crc  = 0;
+        for (int i = 1; i < num_pieces; i++)
+        {
+            size += pieces[i].iov_len;
+            crc = crc32c(crc, pieces[i].iov_base, pieces[i].iov_len);
+        }
+        record_frame(buffer.get_first_seq(), static_cast<uint32_t>(size), frame);
+        set_frame_crc(frame, crc);
+    }
+    _sink_ptr->write_blockv(pieces, num_pieces, meta, flush_now);
+
+    if (_payload_scratch_size > PAYLOAD_SCRATCH_KEEP)
+    {
+        _payload_scratch.reset();
+        _payload_scratch_size = 0;
+    }
+}
+
+/**
+ * @brief Write the records of the duplicate collapsing for the windows that
+ * have ended, background thread
+ * @param[in] all Close every window, e.g. before the sink goes away
+ */
+void
+AsyncLogging::write_dedup_summaries(bool all)
+{
+    _dedup.expire(all ? UINT64_MAX : steady_ms(), _dedup_summaries);
+    if (_dedup_summaries.empty() || (nullptr == _sink_ptr))
+    {
+        return;
+    }
+
+    BlockMeta meta;
+    meta.first_ts_us  = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+    meta.last_ts_us   = meta.first_ts_us;
+    meta.record_count = 1;
+    _sink_ptr->write_block(_dedup_summaries.data(), _dedup_summaries.size(), meta, false);
+    _dedup_summaries.clear();
+}
+
+/**
+ * @brief Start logging
+ */
+void
+AsyncLogging::start()
+{
+    _output_queue_ptr->set_notify_batch(_consumer_options.notify_batch, _consumer_options.notify_delay_ms);
+    _running = true;
+    std::thread t(&AsyncLogging::background_consume_thread, this);
+    _background_thread = std::move(t);
+
+    /* Wait for the thread to actually start */
+    while (!_background_thread.joinable())
+    {
+    }
+}
+
+/**
+ * @brief Switch to another destination while running. The background thread
+ * installs the new sink between two buffers and destroys the old one,
+ * producers are not paused.
+ * @note Records still queued at that point go to the new sink.
+ */
+void
+AsyncLogging::replace_sink(std::unique_ptr<LogSink> sink)
+{
+    if (nullptr == sink)
+    {
+        std::cerr << "[AsyncLogging::replace_sink] null sink" << std::endl;
+        return;
+    }
+    if (!_running)
+    {
+        _sink_ptr = std::move(sink);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_sink_swap_lock);
+        _pending_sink = std::move(sink);
+        _sink_swap_pending.store(true);
+    }
+    _output_queue_ptr->wakeup();
+}
+
+/**
+ * @brief Install the sink handed over by replace_sink, background thread
+ */
+void
+AsyncLogging::swap_sink(void)
+{
+    std::unique_ptr<LogSink> sink;
+    {
+        std::lock_guard<std::mutex> lock(_sink_swap_lock);
+        sink = std::move(_pending_sink);
+        _sink_swap_pending.store(false);
+    }
+    if (nullptr != sink)
+    {
+        /* The old sink writes out what it buffers and closes when destroyed */
+        write_dedup_summaries(true);
+        std::unique_ptr<LogSink> old_sink = std::move(_sink_ptr);
+        _sink_ptr                         = std::move(sink);
+        old_sink.reset();
+    }
+}
+
+/**
+ * @brief Buffer hand-offs between the producers and the background thread, and
+ * how many of them had to wake a waiting thread
+ */
+void
+AsyncLogging::notify_stats(uint64_t &pushes, uint64_t &notifies)
+{
+    pushes   = _output_queue_ptr->push_count() + _input_queue_ptr->push_count();
+    notifies = _output_queue_ptr->notify_count() + _input_queue_ptr->notify_count();
 }
 
 } // namespace logging
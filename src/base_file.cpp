@@ -1,6 +1,9 @@
 #include "base_file.h"
 #include <stdio.h>  //fopen, rename
 #include <string.h> // setvbuf
+#include <unistd.h> // fdatasync
+#include <sys/stat.h> // stat, fstat
+#include <sys/uio.h> // writev
 #include <cerrno>   // errno
 #include <chrono>
 #include <iostream>
@@ -136,6 +139,72 @@ BaseFile::append_data(const char *data, size_t size, bool flush_now)
     }
 }
 
+/**
+ * @brief Append data given as several pieces to the file with writev,
+ * bypassing the stdio buffer, which is flushed first
+ * @param[in] pieces Pieces of the data, in order
+ * @param[in] num_pieces Number of pieces, written MAX_PIECES at a time
+ */
+void
+BaseFile::append_datav(const struct iovec *pieces, int num_pieces)
+{
+    if (NULL == _file)
+    {
+        std::cerr << "[BaseFile::append_datav] failed in "
+                     "logging::BaseFile::append_datav, file is NULL."
+                  << std::endl;
+        return;
+    }
+
+    /* The data buffered so far goes first */
+    fflush(_file);
+
+    /* Up to MAX_PIECES pieces at a time, copied so that they can be advanced
+     * over partial writes */
+    int next = 0;
+    while (next < num_pieces)
+    {
+        struct iovec rest[MAX_PIECES];
+        int          num_rest = 0;
+        for (; (next < num_pieces) && (num_rest < MAX_PIECES); next++)
+        {
+            if (0 != pieces[next].iov_len)
+            {
+                rest[num_rest++] = pieces[next];
+            }
+        }
+
+        struct iovec *iov = rest;
+        while (num_rest > 0)
+        {
+            ssize_t n = ::writev(fileno(_file), iov, num_rest);
+            if (n < 0)
+            {
+                if (EINTR == errno)
+                {
+                    continue;
+                }
+                std::cerr << "[BaseFile::append_datav] failed in "
+                             "logging::BaseFile::append_datav, error info:"
+                          << error_to_str(errno) << std::endl;
+                return;
+            }
+            _written_bytes += n;
+            while ((num_rest > 0) && (static_cast<size_t>(n) >= iov->iov_len))
+            {
+                n -= iov->iov_len;
+                iov++;
+                num_rest--;
+            }
+            if (num_rest > 0)
+            {
+                iov->iov_base = static_cast<char *>(iov->iov_base) + n;
+                iov->iov_len -= n;
+            }
+        }
+    }
+}
+
 /**
  * @brief Get the amount of data written to the current file
  * @return Number of bytes
@@ -146,6 +215,23 @@ BaseFile::get_written_bytes(void)
     return _written_bytes;
 }
 
+/**
+ * @brief Whether another file has taken the given name since this file was
+ * opened under it, e.g. after another process rolled it
+ * @param[in] file_name The name the file was opened under
+ * @return false if no file has the name
+ */
+bool
+BaseFile::replaced(const std::string &file_name)
+{
+    struct stat opened, named;
+    if ((NULL == _file) || (0 != ::fstat(fileno(_file), &opened)) || (0 != ::stat(file_name.c_str(), &named)))
+    {
+        return false;
+    }
+    return (opened.st_ino != named.st_ino) || (opened.st_dev != named.st_dev);
+}
+
 /**
  * @brief Flush file buffer
  */
@@ -158,4 +244,20 @@ BaseFile::flush(void)
     }
 }
 
-} // namespace logging
\ No newline at end of file
+/**
+ * @brief Flush file buffer and wait until the data reaches the disk
+ */
+void
+BaseFile::sync(void)
+{
+    if (NULL != _file)
+    {
+        fflush(_file);
+        if (0 != fdatasync(fileno(_file)))
+        {
+            std::cerr << "[BaseFile::sync] fdatasync failed, error info:" << error_to_str(errno) << std::endl;
+        }
+    }
+}
+
+} // namespace logging
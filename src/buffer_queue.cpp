@@ -1,9 +1,12 @@
 #include "buffer_queue.h"
 #include <chrono>
 #include <condition_variable>
+#include <cstring>
+#include <iostream>
 #include <memory>
 #include <new>
 #include <utility>
+#include "crc32c.h"
 #include "fast_memcpy.h"
 
 namespace logging {
@@ -22,13 +25,188 @@ DataBuffer::input_data(const char *data, size_t size)
     _cur_size += copy_size;
 }
 
+/**
+ * @brief Store a record too large for the buffer in an extent of its own. The
+ * buffer must be empty and holds only this record until it is reset.
+ * @param[in] frame Frame prefix of the record (note_frame is implied), nullptr
+ * if none
+ * @param[in] frame_size Size of the frame prefix
+ * @param[in] pieces Pieces of the record, gathered into the extent
+ * @param[in] num_pieces Number of pieces
+ * @retval false if the extent can not be allocated
+ */
+bool
+DataBuffer::input_extent(const char *frame, size_t frame_size, const struct iovec *pieces, int num_pieces)
+{
+    size_t size = frame_size;
+    for (int i = 0; i < num_pieces; i++)
+    {
+        size += pieces[i].iov_len;
+    }
+    _extent.reset(new (std::nothrow) char[size]);
+    if (nullptr == _extent)
+    {
+        std::cerr << "[DataBuffer::input_extent] can not allocate " << size << " bytes" << std::endl;
+        return false;
+    }
+
+    _data     = _extent.get();
+    _cur_size = 0;
+    if (nullptr != frame)
+    {
+        note_frame();
+        memcpy(_data, frame, frame_size);
+        _cur_size = frame_size;
+    }
+    /* The producer does not touch the record again and the consumer reads it
+     * from another core, so large pieces are streamed past the cache instead
+     * of evicting the producer's working set */
+    for (int i = 0; i < num_pieces; i++)
+    {
+        memcpy_fast(_data + _cur_size, pieces[i].iov_base, pieces[i].iov_len, COPY_READ_LATER);
+        _cur_size += pieces[i].iov_len;
+    }
+    return true;
+}
+
+/**
+ * @brief Attach a payload (LOG_PAYLOAD) to the record stored in the buffer,
+ * which holds only that record until it is reset. The consumer writes the
+ * payload in place after the data, see get_payload.
+ * @param[in] payload The payload, its release is called by reset_buffer
+ * @param[in] framed Frame the record, the consumer builds the frame prefix
+ * @retval false if the payload can not be stored, it is released
+ */
+bool
+DataBuffer::set_payload(Payload &&payload, bool framed)
+{
+    release_payload();
+    _payload.reset(new (std::nothrow) Payload(std::move(payload)));
+    if (nullptr == _payload)
+    {
+        std::cerr << "[DataBuffer::set_payload] can not allocate the payload" << std::endl;
+        logging::release_payload(payload);
+        return false;
+    }
+    payload.release = nullptr;
+    _payload_framed = framed;
+    return true;
+}
+
+/**
+ * @brief Hand the payload back to its owner
+ */
+void
+DataBuffer::release_payload(void)
+{
+    if (nullptr != _payload)
+    {
+        logging::release_payload(*_payload);
+        _payload.reset();
+    }
+}
+
 /**
  * @brief reset buffer
  */
 void
 DataBuffer::reset_buffer(void)
 {
-    _cur_size = 0;
+    release_payload();
+    if (_data != _buffer)
+    {
+        _data = _buffer;
+        _extent.reset();
+    }
+    _cur_size     = 0;
+    _record_count = 0;
+    _frame_count  = 0;
+    _span_count   = 0;
+    _index.clear();
+}
+
+/**
+ * @brief Note where the record just stored with input_data lies, records
+ * without a span are passed through by the duplicate collapsing
+ * @param[in] offset Data size before the record was stored
+ * @param[in] time_begin Start of the time stamp in the record
+ * @param[in] time_end End of the time stamp in the record
+ */
+void
+DataBuffer::note_span(size_t offset, size_t time_begin, size_t time_end)
+{
+    if (_span_count >= _MAX_SPANS)
+    {
+        return;
+    }
+    if (nullptr == _spans)
+    {
+        _spans.reset(new (std::nothrow) RecordSpan[_MAX_SPANS]);
+        if (nullptr == _spans)
+        {
+            return;
+        }
+    }
+    size_t size = _cur_size - offset;
+    if ((time_end > size) || (time_begin > time_end))
+    {
+        /* The record has been truncated inside its header */
+        time_begin = 0;
+        time_end   = 0;
+    }
+    RecordSpan &span = _spans[_span_count++];
+    span.offset      = static_cast<uint32_t>(offset);
+    span.size        = static_cast<uint32_t>(size);
+    span.time_begin  = static_cast<uint32_t>(time_begin);
+    span.time_end    = static_cast<uint32_t>(time_end);
+}
+
+/**
+ * @brief Account a frame prefix (see log_frame.h) about to be stored with
+ * input_data, its checksum is filled in by seal_frames
+ */
+void
+DataBuffer::note_frame(void)
+{
+    if (_frame_count >= _MAX_FRAMES)
+    {
+        return;
+    }
+    if (nullptr == _frame_offsets)
+    {
+        _frame_offsets.reset(new (std::nothrow) uint32_t[_MAX_FRAMES]);
+        if (nullptr == _frame_offsets)
+        {
+            std::cerr << "[DataBuffer::note_frame] can not allocate the frame offsets" << std::endl;
+            return;
+        }
+    }
+    _frame_offsets[_frame_count++] = static_cast<uint32_t>(_cur_size);
+}
+
+/**
+ * @brief Fill in the checksums of the framed records, called by the consumer
+ * before the data is written
+ */
+void
+DataBuffer::seal_frames(void)
+{
+    for (uint32_t i = 0; i < _frame_count; i++)
+    {
+        size_t   offset = _frame_offsets[i];
+        uint64_t seq;
+        uint32_t crc, size;
+        if (!parse_record_frame(_data + offset, _cur_size - offset, seq, crc, size))
+        {
+            continue;
+        }
+        /* A record truncated by input_data is checked as stored, the reader
+         * sees it cut short */
+        size_t body   = offset + RECORD_FRAME_SIZE;
+        size_t stored = (_cur_size - body < size) ? (_cur_size - body) : size;
+        set_frame_crc(_data + offset, crc32c(0, _data + body, stored));
+    }
+    _frame_count = 0;
 }
 
 /**
@@ -36,11 +214,15 @@ DataBuffer::reset_buffer(void)
  * @param[in] size The number of elements that can be stored in the queue
  */
 BufferQueue::BufferQueue(size_t size)
+    : _count(0)
+    , _pushes(0)
+    , _notifies(0)
 {
     for (uint32_t i = 0; i < size; i++)
     {
         _buffer_queue.emplace(new (std::nothrow) DataBuffer());
     }
+    _count.store(_buffer_queue.size(), std::memory_order_release);
 }
 
 /**
@@ -52,31 +234,83 @@ BufferQueue::BufferQueue(size_t size)
 DataBuffer_ptr
 BufferQueue::pop_buffer(uint32_t timeout_ms)
 {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
     std::unique_lock<std::mutex> lk(_mutex);
     while (_buffer_queue.empty())
     {
-        if (0 == timeout_ms)
+        if (_wakeup)
+        {
+            _wakeup = false;
+            return nullptr;
+        }
+
+        /* While buffers keep coming, a partial batch is not notified and the
+         * wait is cut into slices of _batch_delay_ms to pick it up. Once a
+         * slice passes without any, the waiter is idle and the next push wakes
+         * it right away. */
+        bool sliced = (_notify_batch > 1) && !_batch_idle;
+        _waiters++;
+        if ((0 == timeout_ms) && !sliced)
         {
             _cv.wait(lk);
         }
         else
         {
-            auto ret = _cv.wait_for(lk, std::chrono::milliseconds(timeout_ms));
-            if (std::cv_status::timeout == ret)
+            auto until = deadline;
+            if (sliced)
             {
-                return nullptr;
+                auto slice_end = std::chrono::steady_clock::now()
+                                 + std::chrono::milliseconds(static_cast<int64_t>(_batch_delay_ms));
+                if ((0 == timeout_ms) || (slice_end < deadline))
+                {
+                    until = slice_end;
+                }
             }
+            _cv.wait_until(lk, until);
+        }
+        _waiters--;
+        if (sliced && _buffer_queue.empty())
+        {
+            _batch_idle = true;
+        }
+
+        if ((0 != timeout_ms) && _buffer_queue.empty() && !_wakeup
+            && (std::chrono::steady_clock::now() >= deadline))
+        {
+            return nullptr;
         }
     }
     DataBuffer_ptr buffer = std::move(_buffer_queue.front());
     /* The element is still in the queue, but the content has been moved away */
     _buffer_queue.pop();
+    _count.store(_buffer_queue.size(), std::memory_order_release);
+    _batch_idle = false;
 
     lk.unlock();
 
     return buffer;
 }
 
+/**
+ * @brief Get a buffer from the buffer queue without waiting
+ * @retval a pointer to the data buffer, nullptr if the queue is empty
+ */
+DataBuffer_ptr
+BufferQueue::try_pop_buffer(void)
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    if (_buffer_queue.empty())
+    {
+        return nullptr;
+    }
+    DataBuffer_ptr buffer = std::move(_buffer_queue.front());
+    _buffer_queue.pop();
+    _count.store(_buffer_queue.size(), std::memory_order_release);
+
+    return buffer;
+}
+
 /**
  * @brief Push a buffer into the queue
  * @param [in] DataBuffer_ptr pointer to buffer
@@ -86,11 +320,22 @@ BufferQueue::push_buffer(DataBuffer_ptr &buffer_ptr)
 {
     if (nullptr != buffer_ptr)
     {
+        bool notify = false;
         {
             std::lock_guard<std::mutex> lk(_mutex);
             _buffer_queue.push(std::move(buffer_ptr));
+            _count.store(_buffer_queue.size(), std::memory_order_release);
+            /* Nobody waiting, nothing to wake: this is the common case for the
+             * free queue and for a busy consumer */
+            notify = (0 != _waiters) && (_batch_idle || (_buffer_queue.size() >= _notify_batch));
+        }
+        _pushes.fetch_add(1, std::memory_order_relaxed);
+        if (notify)
+        {
+            _notifies.fetch_add(1, std::memory_order_relaxed);
+            /* Each push adds one buffer, one waiter can take it */
+            _cv.notify_one();
         }
-        _cv.notify_all();
     }
 }
 
@@ -108,4 +353,34 @@ BufferQueue::empty(void)
     return ret;
 }
 
+/**
+ * @brief Make a waiting (or the next) pop_buffer return nullptr immediately,
+ * used to wake up the consumer for other work
+ */
+void
+BufferQueue::wakeup(void)
+{
+    {
+        std::lock_guard<std::mutex> lk(_mutex);
+        _wakeup = true;
+    }
+    _cv.notify_all();
+}
+
+/**
+ * @brief Batch the notifications of a waiting pop_buffer: the waiter is only
+ * woken once batch buffers are queued, and picks up a smaller number of
+ * buffers after at most max_delay_ms.
+ * @param [in] batch: Buffers per wakeup, 1 wakes the waiter on every push
+ * @param [in] max_delay_ms: Longest time a queued buffer waits for the rest of
+ * its batch
+ */
+void
+BufferQueue::set_notify_batch(size_t batch, uint32_t max_delay_ms)
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    _notify_batch   = (0 == batch) ? 1 : batch;
+    _batch_delay_ms = (0 == max_delay_ms) ? 1 : max_delay_ms;
+}
+
 } // namespace logging
\ No newline at end of file
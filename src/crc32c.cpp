@@ -0,0 +1,170 @@
+#include "crc32c.h"
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#include <string.h>
+#define LOGGING_CRC32C_X86 1
+#endif
+
+namespace logging {
+
+/* Reflected Castagnoli polynomial */
+static const uint32_t CRC32C_POLY = 0x82F63B78;
+
+/**
+ * @brief Slicing-by-8 lookup tables, built once on first use
+ */
+struct Crc32cTables
+{
+    Crc32cTables(void)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc & 1) ? ((crc >> 1) ^ CRC32C_POLY) : (crc >> 1);
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            for (int k = 1; k < 8; k++)
+            {
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+            }
+        }
+    }
+
+    uint32_t table[8][256];
+};
+
+static const Crc32cTables &
+crc32c_tables (void)
+{
+    static const Crc32cTables tables;
+    return tables;
+}
+
+/**
+ * @brief Table driven checksum, for CPUs without SSE4.2
+ */
+static uint32_t
+crc32c_software (uint32_t crc, const uint8_t *p, size_t size)
+{
+    const uint32_t(*t)[256] = crc32c_tables().table;
+
+    crc = ~crc;
+    while (size >= 8)
+    {
+        uint32_t lo = (static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+                       | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24))
+                      ^ crc;
+        uint32_t hi = static_cast<uint32_t>(p[4]) | (static_cast<uint32_t>(p[5]) << 8)
+                      | (static_cast<uint32_t>(p[6]) << 16) | (static_cast<uint32_t>(p[7]) << 24);
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+              ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+    while (size > 0)
+    {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+        p++;
+        size--;
+    }
+    return ~crc;
+}
+
+#ifdef LOGGING_CRC32C_X86
+/**
+ * @brief Checksum with the SSE4.2 crc32 instruction, 8 bytes per step
+ */
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_sse42 (uint32_t crc, const uint8_t *p, size_t size)
+{
+    uint64_t crc64 = ~crc;
+    while (size >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        size -= 8;
+    }
+    uint32_t crc32 = static_cast<uint32_t>(crc64);
+    if (size >= 4)
+    {
+        uint32_t word;
+        memcpy(&word, p, 4);
+        crc32 = _mm_crc32_u32(crc32, word);
+        p += 4;
+        size -= 4;
+    }
+    while (size > 0)
+    {
+        crc32 = _mm_crc32_u8(crc32, *p);
+        p++;
+        size--;
+    }
+    return ~crc32;
+}
+#endif
+
+using Crc32cFunc = uint32_t (*)(uint32_t crc, const uint8_t *p, size_t size);
+
+/**
+ * @brief Checksum routine for this CPU, selected once on first use
+ */
+struct Crc32cImpl
+{
+    Crc32cImpl(void)
+        : func(crc32c_software)
+    {
+#ifdef LOGGING_CRC32C_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2"))
+        {
+            func = crc32c_sse42;
+        }
+#endif
+    }
+
+    Crc32cFunc func;
+};
+
+static const Crc32cImpl &
+crc32c_impl (void)
+{
+    static const Crc32cImpl impl;
+    return impl;
+}
+
+/**
+ * @brief Compute the CRC32C (Castagnoli) checksum of a memory block, with the
+ * SSE4.2 crc32 instruction where the CPU has it
+ * @param[in] crc Initial value, 0 to start a new checksum or the result of a
+ * previous call to continue it
+ * @param[in] data Data source address
+ * @param[in] size data size
+ * @retval The updated checksum
+ */
+uint32_t
+crc32c (uint32_t crc, const void *data, size_t size)
+{
+    return crc32c_impl().func(crc, static_cast<const uint8_t *>(data), size);
+}
+
+/**
+ * @brief Whether crc32c uses the SSE4.2 instruction on this CPU
+ */
+bool
+crc32c_hardware(void)
+{
+#ifdef LOGGING_CRC32C_X86
+    return crc32c_sse42 == crc32c_impl().func;
+#else
+    return false;
+#endif
+}
+
+} // namespace logging
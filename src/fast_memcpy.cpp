@@ -0,0 +1,200 @@
+#include "fast_memcpy.h"
+#ifdef LOGGING_FAST_MEMCPY_X86
+#include <immintrin.h>
+#endif
+
+namespace logging {
+
+#ifdef LOGGING_FAST_MEMCPY_X86
+
+using StreamFunc = void (*)(char *dst, const char *src, size_t size);
+
+/**
+ * @brief SSE2 non-temporal loop, 64 bytes per step and an overlapping tail
+ */
+static void
+stream_sse2 (char *dst, const char *src, size_t size)
+{
+    const char *end_src = src + size;
+    char       *end_dst = dst + size;
+    /* The last 64 bytes are stored after the loop, overlapping its final
+     * step, so the loop needs no remainder handling */
+    __m128i t0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(end_src - 64));
+    __m128i t1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(end_src - 48));
+    __m128i t2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(end_src - 32));
+    __m128i t3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(end_src - 16));
+
+    /* Streaming stores need an aligned destination */
+    size_t head = (16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15;
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+    dst += head;
+    src += head;
+    size -= head;
+    while (size > 64)
+    {
+        __m128i m0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        __m128i m1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+        __m128i m2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+        __m128i m3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst), m0);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 16), m1);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 32), m2);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 48), m3);
+        src += 64;
+        dst += 64;
+        size -= 64;
+    }
+    _mm_sfence();
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(end_dst - 64), t0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(end_dst - 48), t1);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(end_dst - 32), t2);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(end_dst - 16), t3);
+}
+
+/**
+ * @brief AVX2 non-temporal loop, 128 bytes per step and an overlapping tail
+ */
+__attribute__((target("avx2"))) static void
+stream_avx2 (char *dst, const char *src, size_t size)
+{
+    const char *end_src = src + size;
+    char       *end_dst = dst + size;
+    __m256i     t0      = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(end_src - 128));
+    __m256i     t1      = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(end_src - 96));
+    __m256i     t2      = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(end_src - 64));
+    __m256i     t3      = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(end_src - 32));
+
+    size_t head = (32 - (reinterpret_cast<uintptr_t>(dst) & 31)) & 31;
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)));
+    dst += head;
+    src += head;
+    size -= head;
+    while (size > 128)
+    {
+        __m256i m0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+        __m256i m1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 32));
+        __m256i m2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 64));
+        __m256i m3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 96));
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(dst), m0);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 32), m1);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 64), m2);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 96), m3);
+        src += 128;
+        dst += 128;
+        size -= 128;
+    }
+    _mm_sfence();
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(end_dst - 128), t0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(end_dst - 96), t1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(end_dst - 64), t2);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(end_dst - 32), t3);
+    /* The callers use legacy SSE code, which stalls on dirty upper halves */
+    _mm256_zeroupper();
+}
+
+/**
+ * @brief AVX-512 non-temporal loop, 256 bytes per step and an overlapping tail
+ */
+__attribute__((target("avx512f"))) static void
+stream_avx512 (char *dst, const char *src, size_t size)
+{
+    const char *end_src = src + size;
+    char       *end_dst = dst + size;
+    __m512i     t0      = _mm512_loadu_si512(end_src - 256);
+    __m512i     t1      = _mm512_loadu_si512(end_src - 192);
+    __m512i     t2      = _mm512_loadu_si512(end_src - 128);
+    __m512i     t3      = _mm512_loadu_si512(end_src - 64);
+
+    size_t head = (64 - (reinterpret_cast<uintptr_t>(dst) & 63)) & 63;
+    _mm512_storeu_si512(dst, _mm512_loadu_si512(src));
+    dst += head;
+    src += head;
+    size -= head;
+    while (size > 256)
+    {
+        __m512i m0 = _mm512_loadu_si512(src);
+        __m512i m1 = _mm512_loadu_si512(src + 64);
+        __m512i m2 = _mm512_loadu_si512(src + 128);
+        __m512i m3 = _mm512_loadu_si512(src + 192);
+        _mm512_stream_si512(reinterpret_cast<__m512i *>(dst), m0);
+        _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + 64), m1);
+        _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + 128), m2);
+        _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + 192), m3);
+        src += 256;
+        dst += 256;
+        size -= 256;
+    }
+    _mm_sfence();
+    _mm512_storeu_si512(end_dst - 256, t0);
+    _mm512_storeu_si512(end_dst - 192, t1);
+    _mm512_storeu_si512(end_dst - 128, t2);
+    _mm512_storeu_si512(end_dst - 64, t3);
+    _mm256_zeroupper();
+}
+
+/**
+ * @brief Non-temporal copy routine for this CPU, selected once on first use
+ */
+struct StreamImpl
+{
+    StreamImpl(void)
+        : copy(stream_sse2)
+        , name("sse2 stream")
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            copy = stream_avx512;
+            name = "avx512 stream";
+        }
+        else if (__builtin_cpu_supports("avx2"))
+        {
+            copy = stream_avx2;
+            name = "avx2 stream";
+        }
+    }
+
+    StreamFunc  copy;
+    const char *name;
+};
+
+static const StreamImpl &
+stream_impl (void)
+{
+    static const StreamImpl impl;
+    return impl;
+}
+
+#endif // LOGGING_FAST_MEMCPY_X86
+
+/**
+ * @brief Large COPY_READ_LATER copies with non-temporal stores, selected once
+ * for the CPU at first use: an AVX-512, AVX2 or SSE2 loop
+ * @param[in] dst Destination address
+ * @param[in] src Source address, must not overlap dst
+ * @param[in] size Data size, at least MEMCPY_STREAM_MIN
+ */
+void
+memcpy_fast_stream(void *dst, const void *src, size_t size)
+{
+#ifdef LOGGING_FAST_MEMCPY_X86
+    stream_impl().copy(static_cast<char *>(dst), static_cast<const char *>(src), size);
+#else
+    memcpy(dst, src, size);
+#endif
+}
+
+/**
+ * @brief Name of the routine memcpy_fast_stream uses on this CPU
+ */
+const char *
+memcpy_fast_impl(void)
+{
+#ifdef LOGGING_FAST_MEMCPY_X86
+    return stream_impl().name;
+#else
+    return "memcpy";
+#endif
+}
+
+} // namespace logging
@@ -0,0 +1,435 @@
+#include "flight_recorder.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+#include <new>
+
+namespace logging {
+
+thread_local FlightRecorder::ThreadSlots FlightRecorder::_thread_slots;
+
+FlightRecorder::FlightRecorder(void)
+    : _restart_pending(false)
+    , _fork_slot(nullptr)
+    , _enabled(false)
+    , _records(0)
+    , _overwritten(0)
+    , _dumps(0)
+    , _dumped_bytes(0)
+{
+}
+
+/**
+ * @brief Size the ring and set the side file, the records held so far are
+ * kept if the size does not change
+ * @param[in] bytes Ring size, rounded up to whole buffers, 0 disables the
+ * recorder and releases the ring
+ * @param[in] file Side file the dumps are appended to
+ * @retval false if the ring can not be allocated, the recorder is disabled
+ */
+bool
+FlightRecorder::configure(size_t bytes, const std::string &file)
+{
+    std::lock_guard<std::mutex> slots_lock(_slots_lock);
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _file = file;
+    }
+
+    size_t buffer_size = DataBuffer::get_buffer_size();
+    size_t num_buffers = (bytes + buffer_size - 1) / buffer_size;
+    /* Two buffers at least, the current one and a full one */
+    num_buffers = ((0 != bytes) && (num_buffers < 2)) ? 2 : num_buffers;
+    if (num_buffers == _ring.size())
+    {
+        _enabled = (0 != num_buffers);
+        return true;
+    }
+
+    bool                        ok = true;
+    std::vector<DataBuffer_ptr> ring;
+    for (size_t i = 0; i < num_buffers; i++)
+    {
+        DataBuffer_ptr buffer(new (std::nothrow) DataBuffer());
+        if (nullptr == buffer)
+        {
+            std::cerr << "[FlightRecorder::configure] out of memory, flight recorder disabled" << std::endl;
+            ok = false;
+            ring.clear();
+            break;
+        }
+        ring.push_back(std::move(buffer));
+    }
+
+    /* The threads give up the buffers of the old ring */
+    for (std::unique_ptr<Slot> &slot : _slots)
+    {
+        std::lock_guard<std::mutex> slot_lock(slot->lock);
+        slot->buffer = nullptr;
+    }
+    std::lock_guard<std::mutex> lock(_lock);
+    _ring.swap(ring);
+    _filled.clear();
+    _free.clear();
+    for (DataBuffer_ptr &buffer : _ring)
+    {
+        _free.push_back(buffer.get());
+    }
+    _enabled = !_ring.empty();
+    return ok;
+}
+
+/**
+ * @brief The slots of a thread, released when it exits
+ */
+FlightRecorder::ThreadSlots::~ThreadSlots(void)
+{
+    for (auto &entry : slots)
+    {
+        entry.first->release_slot(entry.second);
+    }
+}
+
+/**
+ * @brief The slot of the calling thread, registered on first use
+ * @retval nullptr if it can not be allocated
+ */
+FlightRecorder::Slot *
+FlightRecorder::thread_slot(void)
+{
+    for (auto &entry : _thread_slots.slots)
+    {
+        if (this == entry.first)
+        {
+            return entry.second;
+        }
+    }
+    std::unique_ptr<Slot> slot(new (std::nothrow) Slot());
+    if (nullptr == slot)
+    {
+        return nullptr;
+    }
+    Slot *raw = slot.get();
+    {
+        std::lock_guard<std::mutex> slots_lock(_slots_lock);
+        _slots.push_back(std::move(slot));
+    }
+    _thread_slots.slots.emplace_back(this, raw);
+    return raw;
+}
+
+/**
+ * @brief Hand the buffer of an exiting thread to the ring and forget the slot
+ */
+void
+FlightRecorder::release_slot(Slot *slot)
+{
+    std::lock_guard<std::mutex> slots_lock(_slots_lock);
+    for (size_t i = 0; i < _slots.size(); i++)
+    {
+        if (slot == _slots[i].get())
+        {
+            {
+                std::lock_guard<std::mutex> slot_lock(slot->lock);
+                std::lock_guard<std::mutex> lock(_lock);
+                detach_buffer(*slot);
+            }
+            _slots.erase(_slots.begin() + i);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Queue the buffer of a slot as filled, or as free if it is empty.
+ * Called with the slot lock and _lock held.
+ */
+void
+FlightRecorder::detach_buffer(Slot &slot)
+{
+    if (nullptr != slot.buffer)
+    {
+        if (0 != slot.buffer->get_data_size())
+        {
+            _filled.push_back(slot.buffer);
+        }
+        else
+        {
+            _free.push_back(slot.buffer);
+        }
+        slot.buffer = nullptr;
+    }
+}
+
+/**
+ * @brief A free buffer, or the oldest filled one with its records dropped.
+ * Called with _lock held.
+ * @retval nullptr if every buffer is held by a thread or the ring is empty
+ */
+DataBuffer *
+FlightRecorder::take_buffer(void)
+{
+    DataBuffer *buffer = nullptr;
+    if (!_free.empty())
+    {
+        buffer = _free.back();
+        _free.pop_back();
+    }
+    else if (!_filled.empty())
+    {
+        buffer = _filled.front();
+        _filled.pop_front();
+        _overwritten.fetch_add(buffer->get_data_size(), std::memory_order_relaxed);
+        buffer->reset_buffer();
+    }
+    return buffer;
+}
+
+/**
+ * @brief Capture a record
+ * @param[in] pieces Pieces of the record, in order
+ * @param[in] num_pieces Number of pieces
+ */
+void
+FlightRecorder::append(const struct iovec *pieces, int num_pieces)
+{
+    size_t size = 0;
+    for (int i = 0; i < num_pieces; i++)
+    {
+        size += pieces[i].iov_len;
+    }
+
+    Slot *slot = thread_slot();
+    if (nullptr == slot)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> slot_lock(slot->lock);
+    /* A record is not split between buffers, longer ones are cut to one
+     * buffer */
+    DataBuffer *buffer = slot->buffer;
+    if ((nullptr == buffer)
+        || ((0 != buffer->get_data_size()) && (buffer->get_data_size() + size > buffer->get_buffer_size())))
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        detach_buffer(*slot);
+        buffer       = take_buffer();
+        slot->buffer = buffer;
+        if (nullptr == buffer)
+        {
+            /* More capturing threads than buffers */
+            if (!_ring.empty())
+            {
+                _overwritten.fetch_add(size, std::memory_order_relaxed);
+            }
+            return;
+        }
+    }
+    for (int i = 0; i < num_pieces; i++)
+    {
+        buffer->input_data(static_cast<const char *>(pieces[i].iov_base), pieces[i].iov_len);
+    }
+    _records.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Bytes held by the ring
+ */
+size_t
+FlightRecorder::held_bytes(void)
+{
+    std::lock_guard<std::mutex> slots_lock(_slots_lock);
+    size_t                      bytes = 0;
+    for (std::unique_ptr<Slot> &slot : _slots)
+    {
+        std::lock_guard<std::mutex> slot_lock(slot->lock);
+        bytes += (nullptr != slot->buffer) ? slot->buffer->get_data_size() : 0;
+    }
+    std::lock_guard<std::mutex> lock(_lock);
+    for (DataBuffer *buffer : _filled)
+    {
+        bytes += buffer->get_data_size();
+    }
+    return bytes;
+}
+
+/**
+ * @brief Write all of data to fd
+ */
+static bool
+write_all (int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t ret = ::write(fd, data, size);
+        if (ret < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+/**
+ * @brief Append the records held by the ring to the side file and empty the
+ * ring
+ * @param[in] triggers Trigger values, named in the dump header
+ * @retval false if the side file can not be written
+ */
+bool
+FlightRecorder::dump(uint32_t triggers)
+{
+    std::string data;
+    std::string file;
+    {
+        /* The threads give up their buffers, which are copied out after the
+         * filled ones. The file is written without the locks. */
+        std::lock_guard<std::mutex> slots_lock(_slots_lock);
+        for (std::unique_ptr<Slot> &slot : _slots)
+        {
+            std::lock_guard<std::mutex> slot_lock(slot->lock);
+            std::lock_guard<std::mutex> lock(_lock);
+            detach_buffer(*slot);
+        }
+        std::lock_guard<std::mutex> lock(_lock);
+        file = _file;
+        for (DataBuffer *buffer : _filled)
+        {
+            data.append(buffer->get_buffer(), buffer->get_data_size());
+            buffer->reset_buffer();
+            _free.push_back(buffer);
+        }
+        _filled.clear();
+    }
+    if (data.empty() || file.empty())
+    {
+        return !file.empty();
+    }
+
+    std::string reasons;
+    reasons += (triggers & TRIGGER_RECORD) ? " record" : "";
+    reasons += (triggers & TRIGGER_SIGNAL) ? " signal" : "";
+    reasons += (triggers & TRIGGER_API) ? " api" : "";
+    char      time_str[32];
+    time_t    now = time(nullptr);
+    struct tm tm_data;
+    localtime_r(&now, &tm_data);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &tm_data);
+    std::string header = "==== flight recorder dump: pid " + std::to_string(::getpid()) + ", " + time_str
+                         + ", trigger" + reasons + ", " + std::to_string(data.size()) + " bytes ====\n";
+    if ('\n' != data.back())
+    {
+        data.push_back('\n');
+    }
+    data.append("==== end of flight recorder dump ====\n");
+
+    std::lock_guard<std::mutex> lock(_file_lock);
+    int fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "[FlightRecorder::dump] can not open " << file << std::endl;
+        return false;
+    }
+    bool ok = write_all(fd, header.data(), header.size()) && write_all(fd, data.data(), data.size());
+    ::close(fd);
+    if (!ok)
+    {
+        std::cerr << "[FlightRecorder::dump] can not write " << file << std::endl;
+        return false;
+    }
+    _dumps.fetch_add(1, std::memory_order_relaxed);
+    _dumped_bytes.fetch_add(header.size() + data.size(), std::memory_order_relaxed);
+    return true;
+}
+
+FlightStats
+FlightRecorder::stats(void) const
+{
+    FlightStats stats;
+    stats.records      = _records.load(std::memory_order_relaxed);
+    stats.overwritten  = _overwritten.load(std::memory_order_relaxed);
+    stats.dumps        = _dumps.load(std::memory_order_relaxed);
+    stats.dumped_bytes = _dumped_bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void
+FlightRecorder::prepare_fork(void)
+{
+    _slots_lock.lock();
+    _lock.lock();
+}
+
+void
+FlightRecorder::after_fork_parent(void)
+{
+    _lock.unlock();
+    _slots_lock.unlock();
+}
+
+/**
+ * @brief In the child handler only the slot of the forking thread is noted,
+ * restart_after_fork does the rest outside the handler
+ */
+void
+FlightRecorder::after_fork_child(void)
+{
+    new (&_file_lock) std::mutex();
+
+    _fork_slot = nullptr;
+    for (auto &entry : _thread_slots.slots)
+    {
+        _fork_slot = (this == entry.first) ? entry.second : _fork_slot;
+    }
+    _restart_pending = true;
+    _lock.unlock();
+    _slots_lock.unlock();
+}
+
+/**
+ * @brief The records held at fork time belong to the parent and the other
+ * threads do not exist in the child, only the slot of the forking thread is
+ * kept. The slot locks of the other threads may have been held, they are
+ * rebuilt.
+ */
+void
+FlightRecorder::restart_after_fork(void)
+{
+    std::lock_guard<std::mutex> slots_lock(_slots_lock);
+    if (!_restart_pending)
+    {
+        return;
+    }
+    _restart_pending = false;
+
+    std::vector<std::unique_ptr<Slot>> slots;
+    for (std::unique_ptr<Slot> &slot : _slots)
+    {
+        new (&slot->lock) std::mutex();
+        slot->buffer = nullptr;
+        if (_fork_slot == slot.get())
+        {
+            slots.push_back(std::move(slot));
+        }
+    }
+    _slots.swap(slots);
+
+    std::lock_guard<std::mutex> lock(_lock);
+    _filled.clear();
+    _free.clear();
+    for (DataBuffer_ptr &buffer : _ring)
+    {
+        buffer->reset_buffer();
+        _free.push_back(buffer.get());
+    }
+}
+
+} // namespace logging
@@ -0,0 +1,409 @@
+#include "log_config.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <iostream>
+
+namespace logging {
+
+/**
+ * @brief Strip leading and trailing white space
+ */
+static std::string
+trim (const std::string &text)
+{
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (std::string::npos == begin)
+    {
+        return "";
+    }
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+static bool
+parse_bool (const std::string &value, bool &out)
+{
+    if (("true" == value) || ("yes" == value) || ("on" == value) || ("1" == value))
+    {
+        out = true;
+        return true;
+    }
+    if (("false" == value) || ("no" == value) || ("off" == value) || ("0" == value))
+    {
+        out = false;
+        return true;
+    }
+    return false;
+}
+
+template <typename T>
+static bool
+parse_number (const std::string &value, T &out)
+{
+    if (value.empty() || ('-' == value[0]))
+    {
+        return false;
+    }
+    char              *end    = nullptr;
+    unsigned long long number = strtoull(value.c_str(), &end, 10);
+    if ((nullptr == end) || ('\0' != *end) || (static_cast<unsigned long long>(static_cast<T>(number)) != number))
+    {
+        return false;
+    }
+    out = static_cast<T>(number);
+    return true;
+}
+
+/**
+ * @brief Level names as in the LOG macros, "off" only where allowed
+ */
+static bool
+parse_level (const std::string &value, LogLevel &out, bool allow_off)
+{
+    static const char *names[NUM_LOG_LEVELS] = {"inner_debug", "debug", "info", "warning", "error"};
+    for (int level = 0; level < NUM_LOG_LEVELS; level++)
+    {
+        if (value == names[level])
+        {
+            out = static_cast<LogLevel>(level);
+            return true;
+        }
+    }
+    if ("warn" == value)
+    {
+        out = LOG_WARNING;
+        return true;
+    }
+    if (allow_off && ("off" == value))
+    {
+        out = NUM_LOG_LEVELS;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Set one field of the configuration
+ * @retval false if the key is unknown or the value invalid
+ */
+static bool
+set_field (LogContorl &cfg, const std::string &key, const std::string &value, std::string &error)
+{
+    bool ok    = true;
+    bool known = true;
+
+    if ("level" == key)
+    {
+        ok = parse_level(value, cfg.level, false);
+    }
+    else if ("priority_level" == key)
+    {
+        ok = parse_level(value, cfg.priority_level, true);
+    }
+    else if ("flight_level" == key)
+    {
+        ok = parse_level(value, cfg.flight_level, true);
+    }
+    else if ("flight_trigger_level" == key)
+    {
+        ok = parse_level(value, cfg.flight_trigger_level, true);
+    }
+    else if ("use_ms" == key)
+    {
+        ok = parse_bool(value, cfg.use_ms);
+    }
+    else if ("show_path" == key)
+    {
+        ok = parse_bool(value, cfg.show_path);
+    }
+    else if ("show_func" == key)
+    {
+        ok = parse_bool(value, cfg.show_func);
+    }
+    else if ("show_context" == key)
+    {
+        ok = parse_bool(value, cfg.show_context);
+    }
+    else if ("priority_sync" == key)
+    {
+        ok = parse_bool(value, cfg.priority_sync);
+    }
+    else if ("container_format" == key)
+    {
+        ok = parse_bool(value, cfg.container_format);
+    }
+    else if ("fork_per_pid_file" == key)
+    {
+        ok = parse_bool(value, cfg.fork_per_pid_file);
+    }
+    else if ("record_framing" == key)
+    {
+        ok = parse_bool(value, cfg.record_framing);
+    }
+    else if ("flight_signal" == key)
+    {
+        ok = parse_bool(value, cfg.flight_signal);
+    }
+    else if ("kv_format" == key)
+    {
+        ok = ("json" == value) || ("logfmt" == value);
+        if (ok)
+        {
+            cfg.kv_format = ("json" == value) ? KV_FORMAT_JSON : KV_FORMAT_LOGFMT;
+        }
+    }
+    else if ("logfile" == key)
+    {
+        ok          = !value.empty();
+        cfg.logfile = ok ? value : cfg.logfile;
+    }
+    else if ("spill_file" == key)
+    {
+        cfg.spill_file = value;
+    }
+    else if ("flight_file" == key)
+    {
+        cfg.flight_file = value;
+    }
+    else if ("shm_writer_file" == key)
+    {
+        cfg.shm_writer_file = value;
+    }
+    else if ("roll_cycle_minutes" == key)
+    {
+        ok = parse_number(value, cfg.roll_cycle_minutes);
+    }
+    else if ("roll_size_kbytes" == key)
+    {
+        ok = parse_number(value, cfg.roll_size_kbytes);
+    }
+    else if ("keep_max_files" == key)
+    {
+        ok = parse_number(value, cfg.keep_max_files);
+    }
+    else if ("keep_max_kbytes" == key)
+    {
+        ok = parse_number(value, cfg.keep_max_kbytes);
+    }
+    else if ("keep_max_age_minutes" == key)
+    {
+        ok = parse_number(value, cfg.keep_max_age_minutes);
+    }
+    else if ("spill_max_kbytes" == key)
+    {
+        ok = parse_number(value, cfg.spill_max_kbytes);
+    }
+    else if ("shm_ring_kbytes" == key)
+    {
+        ok = parse_number(value, cfg.shm_ring_kbytes);
+    }
+    else if ("record_max_kbytes" == key)
+    {
+        ok = parse_number(value, cfg.record_max_kbytes);
+    }
+    else if ("dedup_window_ms" == key)
+    {
+        ok = parse_number(value, cfg.dedup_window_ms);
+    }
+    else if ("reorder_window_ms" == key)
+    {
+        ok = parse_number(value, cfg.reorder_window_ms);
+    }
+    else if ("flight_kbytes" == key)
+    {
+        ok = parse_number(value, cfg.flight_kbytes);
+    }
+    else if ("record_retain_kbytes" == key)
+    {
+        ok = parse_number(value, cfg.record_retain_kbytes);
+    }
+    else
+    {
+        known = false;
+    }
+
+    if (!known)
+    {
+        error = "unknown key \"" + key + "\"";
+        return false;
+    }
+    if (!ok)
+    {
+        error = "invalid value \"" + value + "\" for " + key;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Read "key = value" lines into a configuration. Keys are the field
+ * names of LogControl; '#' starts a comment. Fields that are not mentioned
+ * keep their value.
+ * @param[in] in Configuration text
+ * @param[inout] cfg Configuration to update, left untouched on error
+ * @param[out] error Description of the first error
+ * @retval true on success
+ */
+bool
+parse_log_config(std::istream &in, LogContorl &cfg, std::string &error)
+{
+    LogContorl  parsed = cfg;
+    std::string line;
+    int         line_number = 0;
+    while (std::getline(in, line))
+    {
+        line_number++;
+        size_t comment = line.find('#');
+        if (std::string::npos != comment)
+        {
+            line.resize(comment);
+        }
+        line = trim(line);
+        if (line.empty())
+        {
+            continue;
+        }
+
+        size_t equal = line.find('=');
+        if (std::string::npos == equal)
+        {
+            error = "line " + std::to_string(line_number) + ": expected key = value";
+            return false;
+        }
+        std::string field_error;
+        if (!set_field(parsed, trim(line.substr(0, equal)), trim(line.substr(equal + 1)), field_error))
+        {
+            error = "line " + std::to_string(line_number) + ": " + field_error;
+            return false;
+        }
+    }
+    cfg = parsed;
+    return true;
+}
+
+ConfigWatcher::ConfigWatcher(void)
+    : _inotify_fd(-1)
+    , _stop_fd(-1)
+{
+}
+
+/**
+ * @brief ConfigWatcher destructor, stops watching
+ */
+ConfigWatcher::~ConfigWatcher(void)
+{
+    stop();
+}
+
+/**
+ * @brief Start watching
+ * @param[in] path Configuration file
+ * @param[in] on_change Called from the watcher thread after a change
+ * @retval true if the watch could be set up
+ */
+bool
+ConfigWatcher::start(const std::string &path, std::function<void(void)> on_change)
+{
+    stop();
+
+    size_t      slash = path.rfind('/');
+    std::string dir   = (std::string::npos == slash) ? "." : ((0 == slash) ? "/" : path.substr(0, slash));
+    _name             = (std::string::npos == slash) ? path : path.substr(slash + 1);
+    _on_change        = on_change;
+
+    _inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    _stop_fd    = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if ((_inotify_fd < 0) || (_stop_fd < 0)
+        || (inotify_add_watch(_inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0))
+    {
+        std::cerr << "[ConfigWatcher::start] can not watch " << dir << ": " << strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+
+    _thread = std::thread(&ConfigWatcher::watch_thread, this);
+    return true;
+}
+
+/**
+ * @brief Stop watching and wait for the watcher thread
+ */
+void
+ConfigWatcher::stop(void)
+{
+    if (_thread.joinable())
+    {
+        uint64_t one = 1;
+        (void)write(_stop_fd, &one, sizeof(one));
+        _thread.join();
+    }
+    if (_inotify_fd >= 0)
+    {
+        close(_inotify_fd);
+        _inotify_fd = -1;
+    }
+    if (_stop_fd >= 0)
+    {
+        close(_stop_fd);
+        _stop_fd = -1;
+    }
+}
+
+/**
+ * @brief Watcher thread, waits for inotify events or the stop request
+ */
+void
+ConfigWatcher::watch_thread(void)
+{
+    /* Room for a batch of events with their names */
+    alignas(struct inotify_event) char events[4096];
+
+    while (true)
+    {
+        struct pollfd fds[2];
+        fds[0].fd     = _inotify_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd     = _stop_fd;
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            std::cerr << "[ConfigWatcher::watch_thread] poll failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        if (0 != (fds[1].revents & POLLIN))
+        {
+            return;
+        }
+
+        /* Several events of one save are handled with one reload */
+        bool    changed = false;
+        ssize_t len;
+        while ((len = read(_inotify_fd, events, sizeof(events))) > 0)
+        {
+            for (char *p = events; p < events + len;)
+            {
+                struct inotify_event *event = reinterpret_cast<struct inotify_event *>(p);
+                if ((event->len > 0) && (_name == event->name))
+                {
+                    changed = true;
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        if (changed && _on_change)
+        {
+            _on_change();
+        }
+    }
+}
+
+} // namespace logging
@@ -0,0 +1,426 @@
+#include "log_container.h"
+#include <fcntl.h>    // open
+#include <string.h>   // memcpy
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close
+#include <algorithm>
+#include <iostream>
+#include "crc32c.h"
+
+namespace logging {
+
+static void
+put_varint (std::string &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static bool
+get_varint (const char *&p, const char *end, uint64_t &value)
+{
+    value         = 0;
+    uint32_t shift = 0;
+    while ((p < end) && (shift < 64))
+    {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (0 == (byte & 0x80))
+        {
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+/* Signed deltas are zigzag encoded so that small negative values stay short */
+static uint64_t
+zigzag (uint64_t now, uint64_t prev)
+{
+    int64_t delta = static_cast<int64_t>(now - prev);
+    return (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+}
+
+static uint64_t
+unzigzag (uint64_t value, uint64_t prev)
+{
+    int64_t delta = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    return prev + static_cast<uint64_t>(delta);
+}
+
+/**
+ * @brief Fill in a block header for a payload
+ * @param[in] meta Description of the records in the payload
+ * @param[in] payload Payload source address
+ * @param[in] size Payload size
+ * @param[out] header The header to be written in front of the payload
+ */
+void
+container_block_header(const BlockMeta &meta, const char *payload, uint32_t size, ContainerBlockHeader &header)
+{
+    uint64_t last_ts = (meta.last_ts_us > meta.first_ts_us) ? meta.last_ts_us : meta.first_ts_us;
+    uint64_t ts_span = last_ts - meta.first_ts_us;
+    uint64_t seq_span = (meta.last_seq > meta.first_seq) ? (meta.last_seq - meta.first_seq) : 0;
+
+    header.magic            = CONTAINER_BLOCK_MAGIC;
+    header.payload_size     = size;
+    header.first_ts_us      = meta.first_ts_us;
+    header.last_ts_delta_us = (ts_span > UINT32_MAX) ? UINT32_MAX : static_cast<uint32_t>(ts_span);
+    header.record_count     = meta.record_count;
+    header.first_seq        = meta.first_seq;
+    header.seq_span         = (seq_span > UINT32_MAX) ? UINT32_MAX : static_cast<uint32_t>(seq_span);
+    header.payload_crc      = crc32c(0, payload, size);
+    header.header_crc       = crc32c(0, &header, offsetof(ContainerBlockHeader, header_crc));
+    header.reserved         = 0;
+}
+
+/**
+ * @brief Fill in a container file header
+ */
+void
+container_file_header(ContainerFileHeader &header)
+{
+    header.magic       = CONTAINER_FILE_MAGIC;
+    header.version     = CONTAINER_VERSION;
+    header.header_size = sizeof(ContainerFileHeader);
+    header.reserved    = 0;
+}
+
+/**
+ * @brief Register a block that has been written
+ * @param[in] offset File offset of the block header
+ * @param[in] payload_size Payload size of the block
+ * @param[in] meta Description of the records in the block
+ */
+void
+ContainerIndex::add(uint64_t offset, uint32_t payload_size, const BlockMeta &meta)
+{
+    ContainerBlock block;
+    block.offset       = offset;
+    block.payload_size = payload_size;
+    block.payload_crc  = 0;
+    block.meta         = meta;
+    _blocks.push_back(block);
+}
+
+/**
+ * @brief Serialize the index block (header, entries and trailer)
+ * @param[in] index_offset File offset at which the index block is written
+ * @param[out] out Bytes to append to the file
+ */
+void
+ContainerIndex::encode(uint64_t index_offset, std::string &out) const
+{
+    std::string payload;
+    BlockMeta   summary;
+    uint64_t    prev_offset = 0;
+    uint64_t    prev_ts     = 0;
+    uint64_t    prev_seq    = 0;
+
+    payload.reserve(_blocks.size() * 12 + sizeof(ContainerTrailer));
+    for (size_t i = 0; i < _blocks.size(); i++)
+    {
+        const ContainerBlock &block = _blocks[i];
+        const BlockMeta      &meta  = block.meta;
+
+        put_varint(payload, block.offset - prev_offset);
+        put_varint(payload, block.payload_size);
+        put_varint(payload, zigzag(meta.first_ts_us, prev_ts));
+        put_varint(payload, (meta.last_ts_us > meta.first_ts_us) ? (meta.last_ts_us - meta.first_ts_us) : 0);
+        put_varint(payload, meta.record_count);
+        put_varint(payload, zigzag(meta.first_seq, prev_seq));
+        put_varint(payload, (meta.last_seq > meta.first_seq) ? (meta.last_seq - meta.first_seq) : 0);
+
+        prev_offset = block.offset;
+        prev_ts     = meta.first_ts_us;
+        prev_seq    = meta.first_seq;
+
+        if ((0 == i) || (meta.first_ts_us < summary.first_ts_us))
+        {
+            summary.first_ts_us = meta.first_ts_us;
+        }
+        if (meta.last_ts_us > summary.last_ts_us)
+        {
+            summary.last_ts_us = meta.last_ts_us;
+        }
+        if (0 == i)
+        {
+            summary.first_seq = meta.first_seq;
+        }
+        summary.last_seq = meta.last_seq;
+        summary.record_count += meta.record_count;
+    }
+
+    ContainerTrailer trailer;
+    trailer.index_offset = index_offset;
+    trailer.block_count  = static_cast<uint32_t>(_blocks.size());
+    trailer.magic        = CONTAINER_TRAILER_MAGIC;
+    payload.append(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+
+    ContainerBlockHeader header;
+    container_block_header(summary, payload.data(), static_cast<uint32_t>(payload.size()), header);
+    header.magic      = CONTAINER_INDEX_MAGIC;
+    header.header_crc = crc32c(0, &header, offsetof(ContainerBlockHeader, header_crc));
+
+    out.assign(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.append(payload);
+}
+
+ContainerReader::ContainerReader(void)
+    : _map(nullptr)
+    , _size(0)
+    , _has_index(false)
+{
+}
+
+ContainerReader::~ContainerReader(void)
+{
+    close();
+}
+
+/**
+ * @brief Check whether a memory block starts with a container file header
+ */
+bool
+ContainerReader::is_container(const char *data, size_t size)
+{
+    ContainerFileHeader header;
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    return (CONTAINER_FILE_MAGIC == header.magic) && (sizeof(header) == header.header_size);
+}
+
+/**
+ * @brief Open a container file
+ * @param[in] path Path of the file
+ * @retval true on success, false if the file can not be mapped or is not a
+ * container file
+ */
+bool
+ContainerReader::open(const std::string &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        std::cerr << "[ContainerReader::open] can not open " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if ((0 != fstat(fd, &st)) || (static_cast<size_t>(st.st_size) < sizeof(ContainerFileHeader)))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (MAP_FAILED == map)
+    {
+        std::cerr << "[ContainerReader::open] mmap failed for " << path << std::endl;
+        return false;
+    }
+    _map  = static_cast<const char *>(map);
+    _size = st.st_size;
+
+    if (!is_container(_map, _size))
+    {
+        close();
+        return false;
+    }
+
+    _has_index = load_index();
+    if (!_has_index)
+    {
+        scan_blocks();
+    }
+
+    _max_last_ts.resize(_blocks.size());
+    uint64_t max_ts = 0;
+    for (size_t i = 0; i < _blocks.size(); i++)
+    {
+        max_ts          = std::max(max_ts, _blocks[i].meta.last_ts_us);
+        _max_last_ts[i] = max_ts;
+    }
+    return true;
+}
+
+/**
+ * @brief Unmap the file
+ */
+void
+ContainerReader::close(void)
+{
+    if (nullptr != _map)
+    {
+        munmap(const_cast<char *>(_map), _size);
+    }
+    _map       = nullptr;
+    _size      = 0;
+    _has_index = false;
+    _blocks.clear();
+    _max_last_ts.clear();
+}
+
+/**
+ * @brief Validate the block header at an offset
+ */
+bool
+ContainerReader::read_header(uint64_t offset, ContainerBlockHeader &header) const
+{
+    if ((offset > _size) || (_size - offset < sizeof(header)))
+    {
+        return false;
+    }
+    memcpy(&header, _map + offset, sizeof(header));
+    if ((CONTAINER_BLOCK_MAGIC != header.magic) && (CONTAINER_INDEX_MAGIC != header.magic))
+    {
+        return false;
+    }
+    if (header.header_crc != crc32c(0, &header, offsetof(ContainerBlockHeader, header_crc)))
+    {
+        return false;
+    }
+    return (_size - offset - sizeof(header)) >= header.payload_size;
+}
+
+/**
+ * @brief Load the block list from the index block located by the trailer
+ */
+bool
+ContainerReader::load_index(void)
+{
+    ContainerTrailer     trailer;
+    ContainerBlockHeader header;
+
+    if (_size < sizeof(ContainerFileHeader) + sizeof(header) + sizeof(trailer))
+    {
+        return false;
+    }
+    memcpy(&trailer, _map + _size - sizeof(trailer), sizeof(trailer));
+    if ((CONTAINER_TRAILER_MAGIC != trailer.magic) || !read_header(trailer.index_offset, header)
+        || (CONTAINER_INDEX_MAGIC != header.magic)
+        || (trailer.index_offset + sizeof(header) + header.payload_size != _size))
+    {
+        return false;
+    }
+
+    const char *p   = _map + trailer.index_offset + sizeof(header);
+    const char *end = p + header.payload_size - sizeof(trailer);
+    if (header.payload_crc != crc32c(0, p, header.payload_size))
+    {
+        return false;
+    }
+
+    uint64_t prev_offset = 0;
+    uint64_t prev_ts     = 0;
+    uint64_t prev_seq    = 0;
+    _blocks.clear();
+    _blocks.reserve(trailer.block_count);
+    for (uint32_t i = 0; i < trailer.block_count; i++)
+    {
+        uint64_t       fields[7];
+        ContainerBlock block;
+        for (int k = 0; k < 7; k++)
+        {
+            if (!get_varint(p, end, fields[k]))
+            {
+                _blocks.clear();
+                return false;
+            }
+        }
+        block.offset            = prev_offset + fields[0];
+        block.payload_size      = static_cast<uint32_t>(fields[1]);
+        block.meta.first_ts_us  = unzigzag(fields[2], prev_ts);
+        block.meta.last_ts_us   = block.meta.first_ts_us + fields[3];
+        block.meta.record_count = static_cast<uint32_t>(fields[4]);
+        block.meta.first_seq    = unzigzag(fields[5], prev_seq);
+        block.meta.last_seq     = block.meta.first_seq + fields[6];
+
+        ContainerBlockHeader block_header;
+        if (!read_header(block.offset, block_header) || (block_header.payload_size != block.payload_size))
+        {
+            _blocks.clear();
+            return false;
+        }
+        block.payload_crc = block_header.payload_crc;
+
+        prev_offset = block.offset;
+        prev_ts     = block.meta.first_ts_us;
+        prev_seq    = block.meta.first_seq;
+        _blocks.push_back(block);
+    }
+    return true;
+}
+
+/**
+ * @brief Rebuild the block list by walking the block headers
+ */
+void
+ContainerReader::scan_blocks(void)
+{
+    uint64_t             offset = sizeof(ContainerFileHeader);
+    ContainerBlockHeader header;
+
+    _blocks.clear();
+    while (read_header(offset, header))
+    {
+        if (CONTAINER_BLOCK_MAGIC == header.magic)
+        {
+            ContainerBlock block;
+            block.offset            = offset;
+            block.payload_size      = header.payload_size;
+            block.payload_crc       = header.payload_crc;
+            block.meta.first_ts_us  = header.first_ts_us;
+            block.meta.last_ts_us   = header.first_ts_us + header.last_ts_delta_us;
+            block.meta.record_count = header.record_count;
+            block.meta.first_seq    = header.first_seq;
+            block.meta.last_seq     = header.first_seq + header.seq_span;
+            _blocks.push_back(block);
+        }
+        /* Index blocks of earlier runs are skipped like data blocks */
+        offset += sizeof(header) + header.payload_size;
+    }
+}
+
+/**
+ * @brief Payload of a block, valid until close()
+ */
+const char *
+ContainerReader::payload(size_t i) const
+{
+    return _map + _blocks[i].offset + sizeof(ContainerBlockHeader);
+}
+
+/**
+ * @brief Check the payload checksum of a block
+ */
+bool
+ContainerReader::verify(size_t i) const
+{
+    return _blocks[i].payload_crc == crc32c(0, payload(i), _blocks[i].payload_size);
+}
+
+/**
+ * @brief Binary search for the first block that may hold records at or after
+ * a time
+ * @param[in] ts_us Time in microseconds since epoch
+ * @retval Block number, block_count() if no block has such records
+ */
+size_t
+ContainerReader::find_block(uint64_t ts_us) const
+{
+    return std::lower_bound(_max_last_ts.begin(), _max_last_ts.end(), ts_us) - _max_last_ts.begin();
+}
+
+} // namespace logging
@@ -0,0 +1,188 @@
+#include "log_context.h"
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+#include "log_stream.h"
+
+namespace logging {
+
+/**
+ * @brief A field set with ScopedLogContext
+ */
+struct ContextField
+{
+    const char   *key;
+    KvField::Type type;
+    std::string   str;
+    int64_t       i;
+    uint64_t      u;
+};
+
+/**
+ * @brief Context of a thread with its rendered forms
+ */
+struct ThreadContext
+{
+    uint32_t                  tid = 0;
+    std::string               name;
+    bool                      named = false; // Set with log_set_thread_name
+    /* Innermost last, an inner field hides outer ones of the same key */
+    std::vector<ContextField> fields;
+    bool                      dirty      = true;
+    uint32_t                  generation = 0;
+    std::string               rendered[2]; // By KvFormat
+};
+
+/* Bumped in forked children, whose threads have new ids */
+static std::atomic<uint32_t> _context_generation(1);
+thread_local ThreadContext   global_thread_context;
+
+/**
+ * @brief Name the calling thread in its records, the name given to
+ * pthread_setname_np (or the process name) is used otherwise
+ */
+void
+log_set_thread_name (const char *name)
+{
+    ThreadContext &context = global_thread_context;
+    context.name           = (nullptr != name) ? name : "";
+    context.named          = true;
+    context.dirty          = true;
+}
+
+/**
+ * @brief Re-read the thread ids in a forked child, called by the fork handler
+ */
+void
+log_context_after_fork (void)
+{
+    _context_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Render the context in both formats
+ */
+static void
+render_context (ThreadContext &context)
+{
+    if (!context.named)
+    {
+        char name[16] = {0};
+        (void)pthread_getname_np(pthread_self(), name, sizeof(name));
+        context.name = name;
+    }
+
+    for (int format = KV_FORMAT_JSON; format <= KV_FORMAT_LOGFMT; format++)
+    {
+        std::string &out = context.rendered[format];
+        out.clear();
+        LogStream stream(128, [&out] (const char *data, size_t size) { out.append(data, size); });
+        KvFormat  kv_format = static_cast<KvFormat>(format);
+        KvEncoder::field(stream, kv("tid", static_cast<unsigned long long>(context.tid)), kv_format);
+        KvEncoder::field(stream, kv("thread", context.name), kv_format);
+        for (size_t i = 0; i < context.fields.size(); i++)
+        {
+            const ContextField &field  = context.fields[i];
+            bool                hidden = false;
+            for (size_t j = i + 1; (j < context.fields.size()) && !hidden; j++)
+            {
+                hidden = (0 == strcmp(field.key, context.fields[j].key));
+            }
+            if (hidden)
+            {
+                continue;
+            }
+            if (KvField::KV_STRING == field.type)
+            {
+                KvEncoder::field(stream, kv(field.key, field.str), kv_format);
+            }
+            else if (KvField::KV_INT == field.type)
+            {
+                KvEncoder::field(stream, kv(field.key, static_cast<long long>(field.i)), kv_format);
+            }
+            else
+            {
+                KvEncoder::field(stream, kv(field.key, static_cast<unsigned long long>(field.u)), kv_format);
+            }
+        }
+        stream.flush_data();
+    }
+    context.dirty = false;
+}
+
+/**
+ * @brief The rendered context of the calling thread: " tid=.. thread=..
+ * key=value" for text headers and logfmt records, ",\"tid\":..,..." for JSON
+ * records
+ */
+const std::string &
+log_context_rendered (KvFormat format)
+{
+    ThreadContext &context    = global_thread_context;
+    uint32_t       generation = _context_generation.load(std::memory_order_relaxed);
+    if (context.generation != generation)
+    {
+        context.tid        = static_cast<uint32_t>(::syscall(SYS_gettid));
+        context.generation = generation;
+        context.dirty      = true;
+    }
+    if (context.dirty)
+    {
+        render_context(context);
+    }
+    return context.rendered[format];
+}
+
+/**
+ * @brief Push a field on the context of the calling thread
+ * @retval Its position
+ */
+static size_t
+push_field (const char *key, KvField::Type type)
+{
+    ThreadContext &context = global_thread_context;
+    ContextField   field;
+    field.key  = key;
+    field.type = type;
+    field.i    = 0;
+    field.u    = 0;
+    context.fields.push_back(std::move(field));
+    context.dirty = true;
+    return context.fields.size() - 1;
+}
+
+ScopedLogContext::ScopedLogContext(const char *key, const std::string &value)
+    : _index(push_field(key, KvField::KV_STRING))
+{
+    global_thread_context.fields[_index].str = value;
+}
+
+ScopedLogContext::ScopedLogContext(const char *key, const char *value)
+    : _index(push_field(key, KvField::KV_STRING))
+{
+    global_thread_context.fields[_index].str = (nullptr != value) ? value : "";
+}
+
+ScopedLogContext::ScopedLogContext(const char *key, long long value)
+    : _index(push_field(key, KvField::KV_INT))
+{
+    global_thread_context.fields[_index].i = value;
+}
+
+ScopedLogContext::ScopedLogContext(const char *key, unsigned long long value)
+    : _index(push_field(key, KvField::KV_UINT))
+{
+    global_thread_context.fields[_index].u = value;
+}
+
+ScopedLogContext::~ScopedLogContext(void)
+{
+    ThreadContext &context = global_thread_context;
+    context.fields.resize(_index);
+    context.dirty = true;
+}
+
+} // namespace logging
@@ -0,0 +1,236 @@
+#include "log_dedup.h"
+#include <string.h>
+#include "crc32c.h"
+
+namespace logging {
+
+LogDedup::LogDedup(void)
+    : _table(TABLE_SIZE)
+    , _live(0)
+    , _next_expiry_ms(UINT64_MAX)
+    , _records(0)
+    , _collapsed(0)
+    , _summaries(0)
+    , _bytes_saved(0)
+{
+}
+
+/**
+ * @brief Find the slot of a record, or the free slot it would take
+ */
+LogDedup::Entry *
+LogDedup::lookup(uint64_t hash, const char *record, const RecordSpan &span)
+{
+    size_t head = span.time_begin;
+    size_t tail = span.size - span.time_end;
+    for (size_t i = hash & (TABLE_SIZE - 1);; i = (i + 1) & (TABLE_SIZE - 1))
+    {
+        Entry &entry = _table[i];
+        if (0 == entry.expires_ms)
+        {
+            return &entry;
+        }
+        /* The hash only picks the candidates, the bytes decide */
+        if ((entry.hash == hash) && (entry.time_begin == head) && (entry.record.size() - entry.time_end == tail)
+            && (0 == memcmp(entry.record.data(), record, head))
+            && (0 == memcmp(entry.record.data() + entry.time_end, record + span.time_end, tail)))
+        {
+            return &entry;
+        }
+    }
+}
+
+/**
+ * @brief Drop the repeats from a buffer, moving the remaining data together
+ * @param[inout] buffer Buffer about to be written
+ * @param[in] window_ms Length of the window
+ * @param[in] now_ms Current time in milliseconds, monotonic
+ * @param[out] summaries Appended with the records for windows that ended, to
+ * be written before the buffer
+ */
+void
+LogDedup::filter(DataBuffer &buffer, uint32_t window_ms, uint64_t now_ms, std::string &summaries)
+{
+    expire(now_ms, summaries);
+
+    const RecordSpan *spans     = buffer.get_spans();
+    uint32_t          num_spans = buffer.get_span_count();
+    if ((nullptr == spans) || (0 == num_spans))
+    {
+        return;
+    }
+
+    char    *data      = buffer.get_data();
+    size_t   size      = buffer.get_data_size();
+    size_t   read_pos  = spans[0].offset;
+    size_t   write_pos = read_pos;
+    uint64_t collapsed = 0;
+    uint64_t saved     = 0;
+    for (uint32_t i = 0; i < num_spans; i++)
+    {
+        const RecordSpan &span   = spans[i];
+        const char       *record = data + span.offset;
+
+        /* Data between the records, e.g. records stored without a span */
+        if (span.offset > read_pos)
+        {
+            memmove(data + write_pos, data + read_pos, span.offset - read_pos);
+            write_pos += span.offset - read_pos;
+        }
+        read_pos = span.offset + span.size;
+
+        uint64_t hash  = crc32c(crc32c(0, record, span.time_begin), record + span.time_end, span.size - span.time_end);
+        Entry   *entry = lookup(hash, record, span);
+        if (0 != entry->expires_ms)
+        {
+            /* A repeat within the window */
+            entry->count++;
+            entry->last_time.assign(record + span.time_begin, span.time_end - span.time_begin);
+            collapsed++;
+            saved += span.size;
+            continue;
+        }
+
+        /* First occurrence, opens a window unless too many are open */
+        if (_live < MAX_LIVE)
+        {
+            entry->hash       = hash;
+            entry->expires_ms = now_ms + window_ms;
+            entry->count      = 0;
+            entry->time_begin = span.time_begin;
+            entry->time_end   = span.time_end;
+            entry->record.assign(record, span.size);
+            _live++;
+            _next_expiry_ms = (entry->expires_ms < _next_expiry_ms) ? entry->expires_ms : _next_expiry_ms;
+        }
+        if (write_pos != span.offset)
+        {
+            memmove(data + write_pos, record, span.size);
+        }
+        write_pos += span.size;
+    }
+    if (size > read_pos)
+    {
+        memmove(data + write_pos, data + read_pos, size - read_pos);
+        write_pos += size - read_pos;
+    }
+    buffer.set_data_size(write_pos);
+
+    _records.fetch_add(num_spans, std::memory_order_relaxed);
+    _collapsed.fetch_add(collapsed, std::memory_order_relaxed);
+    _bytes_saved.fetch_add(saved, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Append the record that stands for the repeats of an entry
+ */
+void
+LogDedup::summarize(const Entry &entry, std::string &summaries)
+{
+    if (0 == entry.count)
+    {
+        return;
+    }
+
+    /* The last repeat: the first occurrence with the last time stamp */
+    size_t start = summaries.size();
+    summaries.append(entry.record, 0, entry.time_begin);
+    summaries.append(entry.last_time);
+    summaries.append(entry.record, entry.time_end, std::string::npos);
+    if (1 == entry.count)
+    {
+        return;
+    }
+
+    bool newline = ('\n' == summaries.back());
+    if (newline)
+    {
+        summaries.pop_back();
+    }
+    std::string count = std::to_string(entry.count);
+    if (('{' == summaries[start]) && ('}' == summaries.back()))
+    {
+        summaries.pop_back();
+        summaries.append(",\"repeated\":").append(count).append("}");
+    }
+    else if (0 == summaries.compare(start, 6, "level="))
+    {
+        summaries.append(" repeated=").append(count);
+    }
+    else
+    {
+        summaries.append(" [last message repeated ").append(count).append(" times]");
+    }
+    if (newline)
+    {
+        summaries.push_back('\n');
+    }
+    _summaries.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Close the windows that have ended
+ * @param[in] now_ms Current time in milliseconds, monotonic, UINT64_MAX to
+ * close all of them
+ * @param[out] summaries Appended with their records
+ */
+void
+LogDedup::expire(uint64_t now_ms, std::string &summaries)
+{
+    if ((0 == _live) || (now_ms < _next_expiry_ms))
+    {
+        return;
+    }
+
+    /* Freeing slots would break the probe sequences, the open windows are
+     * put into a fresh table instead */
+    std::vector<Entry> old(TABLE_SIZE);
+    old.swap(_table);
+    _live           = 0;
+    _next_expiry_ms = UINT64_MAX;
+    for (Entry &entry : old)
+    {
+        if (0 == entry.expires_ms)
+        {
+            continue;
+        }
+        if (entry.expires_ms <= now_ms)
+        {
+            summarize(entry, summaries);
+            continue;
+        }
+        size_t i = entry.hash & (TABLE_SIZE - 1);
+        while (0 != _table[i].expires_ms)
+        {
+            i = (i + 1) & (TABLE_SIZE - 1);
+        }
+        _table[i] = std::move(entry);
+        _live++;
+        _next_expiry_ms = (_table[i].expires_ms < _next_expiry_ms) ? _table[i].expires_ms : _next_expiry_ms;
+    }
+}
+
+/**
+ * @brief Forget every window without writing anything, e.g. in a forked child
+ * whose parent writes them
+ */
+void
+LogDedup::reset(void)
+{
+    std::vector<Entry>(TABLE_SIZE).swap(_table);
+    _live           = 0;
+    _next_expiry_ms = UINT64_MAX;
+}
+
+DedupStats
+LogDedup::stats(void) const
+{
+    DedupStats stats;
+    stats.records     = _records.load(std::memory_order_relaxed);
+    stats.collapsed   = _collapsed.load(std::memory_order_relaxed);
+    stats.summaries   = _summaries.load(std::memory_order_relaxed);
+    stats.bytes_saved = _bytes_saved.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace logging
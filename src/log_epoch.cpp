@@ -0,0 +1,124 @@
+#include "log_epoch.h"
+#include <new>
+
+namespace logging {
+
+/**
+ * @brief EpochDomain destructor, frees everything still retired
+ */
+EpochDomain::~EpochDomain(void)
+{
+    for (Retired &retired : _retired)
+    {
+        retired.deleter(retired.object);
+    }
+    Slot *slot = _slots.load(std::memory_order_acquire);
+    while (nullptr != slot)
+    {
+        Slot *next = slot->next;
+        delete slot;
+        slot = next;
+    }
+}
+
+/**
+ * @brief Get a reader slot for the calling thread, lock free
+ */
+EpochDomain::Slot *
+EpochDomain::acquire_slot(void)
+{
+    /* Reuse the slot of a thread that has exited */
+    for (Slot *slot = _slots.load(std::memory_order_acquire); nullptr != slot; slot = slot->next)
+    {
+        bool expected = false;
+        if (!slot->in_use.load(std::memory_order_relaxed)
+            && slot->in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+        {
+            return slot;
+        }
+    }
+
+    Slot *slot = new (std::nothrow) Slot();
+    if (nullptr == slot)
+    {
+        return nullptr;
+    }
+    Slot *head = _slots.load(std::memory_order_relaxed);
+    do
+    {
+        slot->next = head;
+    } while (!_slots.compare_exchange_weak(head, slot, std::memory_order_release, std::memory_order_relaxed));
+    return slot;
+}
+
+/**
+ * @brief Hand over an object that has been unpublished, it is deleted once no
+ * reader can hold it any more
+ */
+void
+EpochDomain::retire(void *object, void (*deleter)(void *))
+{
+    /* Readers entering from now on are in the new epoch and can only see the
+     * replacement; the seq_cst increment orders the publication of the
+     * replacement before the slots are scanned in reclaim */
+    uint64_t epoch = _epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+
+    std::lock_guard<std::mutex> lock(_retired_lock);
+    _retired.push_back(Retired{object, deleter, epoch});
+}
+
+/**
+ * @brief Oldest epoch a reader is currently in, UINT64_MAX if none
+ */
+uint64_t
+EpochDomain::min_reader_epoch(void)
+{
+    uint64_t min_epoch = UINT64_MAX;
+    for (Slot *slot = _slots.load(std::memory_order_acquire); nullptr != slot; slot = slot->next)
+    {
+        uint64_t epoch = slot->epoch.load(std::memory_order_seq_cst);
+        if ((0 != epoch) && (epoch < min_epoch))
+        {
+            min_epoch = epoch;
+        }
+    }
+    return min_epoch;
+}
+
+/**
+ * @brief Free the retired objects no reader can hold any more
+ * @retval Number of objects still waiting
+ */
+size_t
+EpochDomain::reclaim(void)
+{
+    std::vector<Retired> ready;
+    size_t               waiting;
+    {
+        std::lock_guard<std::mutex> lock(_retired_lock);
+        uint64_t                    min_epoch = min_reader_epoch();
+        size_t                      kept      = 0;
+        for (Retired &retired : _retired)
+        {
+            /* A reader still in an epoch before the retirement may hold it */
+            if (retired.epoch <= min_epoch)
+            {
+                ready.push_back(retired);
+            }
+            else
+            {
+                _retired[kept++] = retired;
+            }
+        }
+        _retired.resize(kept);
+        waiting = kept;
+    }
+
+    for (Retired &retired : ready)
+    {
+        retired.deleter(retired.object);
+    }
+    return waiting;
+}
+
+} // namespace logging
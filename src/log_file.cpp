@@ -1,7 +1,10 @@
 #include "log_file.h"
-#include <time.h> // strftime localtime_r
+#include <stdio.h>    // rename, remove
+#include <sys/stat.h> // stat
+#include <time.h>     // strftime localtime_r
 #include <chrono>
 #include <iostream>
+#include <new>
 #include <string>
 
 namespace logging {
@@ -13,46 +16,297 @@ namespace logging {
  * is 0, no new files will be generated based on time rolling.
  * @param[in] roll_size_bytes File rolling size, in bytes. If the value is 0,
  * new log files will not be rolled based on the log file size.
+ * @param[in] retention Limits on the number, total size and age of rolled
+ * files. By default rolled files are never removed.
+ * @param[in] container Whether to write the seekable container format instead
+ * of plain text
  */
-LogFile::LogFile(std::string file_name, uint64_t roll_cycle_minutes, uint64_t roll_size_bytes)
-    : _roll_size_bytes(roll_size_bytes)
+LogFile::LogFile(std::string file_name, uint64_t roll_cycle_minutes, uint64_t roll_size_bytes,
+                 const RetentionPolicy &retention, bool container)
+    : _file_name(file_name)
+    , _next_file_name(file_name + ".next")
     , _roll_cycle_minutes(roll_cycle_minutes)
-    , _file_name(file_name)
+    , _roll_size_bytes(roll_size_bytes)
+    , _roll_index(0)
+    , _retention(file_name, retention)
+    , _container(container)
+    , _file_offset(0)
+    , _time_roll_due(false)
+    , _roll_running(false)
+    , _forked_child(false)
+    , _shared(false)
 {
 
     _file_create_time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
+    /* Continue numbering after the files left by previous runs so that the
+     * names never collide */
+    _roll_index = _retention.scan();
+
+    /* A non-empty leftover "next" file means the previous process stopped in
+     * the middle of a roll, keep its data as a rolled file. */
+    struct stat st;
+    if (0 == ::stat(_next_file_name.c_str(), &st))
+    {
+        if (st.st_size > 0)
+        {
+            uint32_t    index = _roll_index++;
+            std::string name  = rolled_file_name(st.st_mtime, index);
+            if (0 == ::rename(_next_file_name.c_str(), name.c_str()))
+            {
+                _retention.add(name, index, st.st_size, st.st_mtime);
+            }
+        }
+        else
+        {
+            (void)::remove(_next_file_name.c_str());
+        }
+    }
+
     /* create log file*/
     _log_file.reset(new (std::nothrow) BaseFile(_file_name));
+
+    if (_container && (nullptr != _log_file))
+    {
+        if ((0 != ::stat(_file_name.c_str(), &st)) || (0 == st.st_size))
+        {
+            ContainerFileHeader header;
+            container_file_header(header);
+            _log_file->append_data(reinterpret_cast<const char *>(&header), sizeof(header));
+            _file_offset = sizeof(header);
+        }
+        else
+        {
+            /* Appending to the file of a previous run, pick up its blocks so
+             * that the next index covers the whole file */
+            _log_file->flush();
+            ContainerReader reader;
+            if (reader.open(_file_name))
+            {
+                _blocks.assign(reader.blocks());
+            }
+            else
+            {
+                std::cerr << "[LogFile::LogFile] " << _file_name << " is not a container file" << std::endl;
+            }
+            _file_offset = st.st_size;
+        }
+    }
+
+    if ((0 != _roll_cycle_minutes) || (0 != _roll_size_bytes) || retention.enabled())
+    {
+        _roll_running = true;
+        _roll_thread  = std::thread(&LogFile::roll_thread, this);
+    }
+}
+
+/**
+ * @brief LogFile destructor, finishes pending rolls and stops the helper
+ * thread
+ */
+LogFile::~LogFile(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_roll_lock);
+        _roll_running = false;
+    }
+    _roll_cv.notify_all();
+    if (_roll_thread.joinable())
+    {
+        _roll_thread.join();
+    }
+
+    /* The index of a shared file is written by the parent */
+    if (_container && (nullptr != _log_file) && !_forked_child)
+    {
+        write_index(*_log_file, _blocks, _file_offset);
+    }
+
+    /* The pre-opened file has never been written, remove it */
+    if (nullptr != _next_file)
+    {
+        _next_file->close();
+        _next_file.reset();
+        (void)::remove(_next_file_name.c_str());
+    }
+}
+
+/**
+ * @brief Build the name of a rolled file
+ */
+std::string
+LogFile::rolled_file_name(std::time_t create_time, uint32_t index)
+{
+    char    new_file_name[MAX_FILENAME_SIZE] = { 0 };
+    std::tm tm_data;
+    /* localtime not safe */
+    localtime_r(&create_time, &tm_data);
+
+    std::string file_name_format = _file_name + ".%Y%m%d%H%M%S_" + std::to_string(index);
+    std::strftime(new_file_name, sizeof(new_file_name), file_name_format.c_str(), &tm_data);
+
+    return new_file_name;
 }
 
 /**
  * @brief The current log file is saved in the format of logfile.YMDH. A new log
  * file is also generated.
+ * @note Only swaps in the pre-opened file, the old file is handed over to the
+ * helper thread.
  */
 void
 LogFile::roll_log_file(void)
 {
-    char new_file_name[MAX_FILENAME_SIZE] = { 0 };
-    static uint32_t index = 0;
+    std::unique_lock<std::mutex> lock(_roll_lock);
+    if (nullptr == _next_file)
+    {
+        /* The helper thread has not finished the previous roll yet, keep
+         * writing to the current file and try again on the next write. */
+        return;
+    }
 
-    if (nullptr != _log_file)
+    RollTask task;
+    task.file        = std::move(_log_file);
+    task.create_time = _file_create_time;
+    task.index       = _roll_index++;
+    task.end_offset  = _file_offset;
+    if (_container)
     {
-        std::tm tm_data;
-        /* localtime not safe */
-        localtime_r(&_file_create_time, &tm_data);
+        std::swap(task.blocks, _blocks);
+        _blocks.clear();
+        /* The helper thread writes the file header when pre-opening */
+        _file_offset = sizeof(ContainerFileHeader);
+    }
+
+    _log_file         = std::move(_next_file);
+    _file_create_time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    _time_roll_due.store(false, std::memory_order_relaxed);
 
-        /* close and rename */
-        std::string file_name_format = _file_name + ".%Y%m%d%H%M%S_" + std::to_string(index);
-        index += 1;
+    _roll_tasks.push_back(std::move(task));
+    lock.unlock();
+    _roll_cv.notify_one();
+}
 
-        std::strftime(new_file_name, sizeof(new_file_name), file_name_format.c_str(), &tm_data);
-        _log_file->flush();
-        _log_file->close();
-        _log_file->rename(_file_name.c_str(), new_file_name);
+/**
+ * @brief Close, sync and rename a swapped out file, then move the pre-opened
+ * file to the active file name. Runs on the helper thread.
+ */
+void
+LogFile::finish_roll(RollTask &task)
+{
+    std::string new_file_name = rolled_file_name(task.create_time, task.index);
+
+    if (nullptr != task.file)
+    {
+        if (_container)
+        {
+            write_index(*task.file, task.blocks, task.end_offset);
+        }
+        task.file->sync();
+        task.file->close();
+        task.file->rename(_file_name.c_str(), new_file_name.c_str());
+
+        struct stat st;
+        if (0 == ::stat(new_file_name.c_str(), &st))
+        {
+            _retention.add(new_file_name, task.index, st.st_size, st.st_mtime);
+        }
+    }
+    /* The writer is already appending to the pre-opened file, renaming it
+     * does not disturb the open descriptor. */
+    if (0 != ::rename(_next_file_name.c_str(), _file_name.c_str()))
+    {
+        std::cerr << "[LogFile::finish_roll] failed to rename " << _next_file_name << std::endl;
+    }
+}
+
+/**
+ * @brief Helper thread: closes and renames rolled files, pre-opens the next
+ * file and raises the time based roll flag.
+ */
+void
+LogFile::roll_thread(void)
+{
+    std::unique_lock<std::mutex> lock(_roll_lock);
+    while (true)
+    {
+        while (!_roll_tasks.empty())
+        {
+            RollTask task = std::move(_roll_tasks.front());
+            _roll_tasks.pop_front();
+            lock.unlock();
+            finish_roll(task);
+            lock.lock();
+        }
+
+        if (!_roll_running)
+        {
+            break;
+        }
+
+        bool more_to_remove = false;
+        if (_retention.policy().enabled())
+        {
+            lock.unlock();
+            std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+            _retention.enforce(now);
+            more_to_remove = _retention.pending(now);
+            lock.lock();
+        }
+
+        if (nullptr == _next_file)
+        {
+            lock.unlock();
+            std::unique_ptr<BaseFile> next(new (std::nothrow) BaseFile(_next_file_name));
+            if (_container && (nullptr != next))
+            {
+                ContainerFileHeader header;
+                container_file_header(header);
+                next->append_data(reinterpret_cast<const char *>(&header), sizeof(header));
+            }
+            lock.lock();
+            _next_file = std::move(next);
+        }
+
+        if (more_to_remove)
+        {
+            /* Bounded passes, go round again after serving pending rolls */
+            continue;
+        }
+
+        auto now       = std::chrono::system_clock::now();
+        auto wake_time = std::chrono::system_clock::time_point::max();
+        if (0 != _roll_cycle_minutes)
+        {
+            uint64_t    create_minute = _file_create_time / SECONDS_PER_MINUTE;
+            std::time_t deadline      = (create_minute + _roll_cycle_minutes) * SECONDS_PER_MINUTE;
+            wake_time                 = std::chrono::system_clock::from_time_t(deadline);
+
+            if (now >= wake_time)
+            {
+                _time_roll_due.store(true, std::memory_order_relaxed);
+                /* Wait for the writer to pick the flag up */
+                wake_time = now + std::chrono::seconds(1);
+            }
+        }
+        if (0 != _retention.policy().max_age_minutes)
+        {
+            auto check_time = now + std::chrono::seconds(static_cast<int64_t>(RETENTION_CHECK_SECONDS));
+            if (check_time < wake_time)
+            {
+                wake_time = check_time;
+            }
+        }
+
+        if (std::chrono::system_clock::time_point::max() == wake_time)
+        {
+            _roll_cv.wait(lock);
+        }
+        else
+        {
+            _roll_cv.wait_until(lock, wake_time);
+        }
     }
-    _log_file.reset(new (std::nothrow) BaseFile(_file_name));
-    _file_create_time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 }
 
 /**
@@ -65,40 +319,159 @@ LogFile::roll_log_file(void)
 void
 LogFile::write_logdata(const char *logdata, uint32_t size, bool flush_now)
 {
-
-    size_t written_bytes = 0;
-    bool   need_roll     = false;
+    if (_container)
+    {
+        BlockMeta meta;
+        write_block(logdata, size, meta, flush_now);
+        return;
+    }
 
     if (nullptr != _log_file)
     {
-        _log_file->append_data(logdata, size, flush_now);
-
-        written_bytes = _log_file->get_written_bytes();
+        follow_roll();
+        _log_file->append_data(logdata, size, flush_now || _shared);
+        check_roll();
+    }
+    else
+    {
+        std::cerr << "[LogFile::write_logdata] file is NULL" << std::endl;
+    }
+}
 
-        std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-        uint64_t    create_minute = _file_create_time / SECONDS_PER_MINUTE;
-        uint64_t    now_minute    = now / SECONDS_PER_MINUTE;
+/**
+ * @brief Write the data of one buffer flush together with the description of
+ * its records. In text mode the description is ignored.
+ * @param [in] logdata The source address of the data to be written
+ * @param [in] size The size of the data to be written
+ * @param [in] meta Time range, record count and sequence range of the data
+ * @param [in] flush_now Whether to flush the buffer data to the file
+ * immediately
+ */
+void
+LogFile::write_block(const char *logdata, uint32_t size, const BlockMeta &meta, bool flush_now)
+{
+    if (!_container)
+    {
+        write_logdata(logdata, size, flush_now);
+        return;
+    }
 
-        if ((0 != _roll_size_bytes) && (written_bytes >= _roll_size_bytes))
-        {
-            need_roll = true;
-        }
-        if ((0 != _roll_cycle_minutes) && ((now_minute - create_minute) >= _roll_cycle_minutes))
+    if (nullptr != _log_file)
+    {
+        BlockMeta block_meta = meta;
+        if (0 == block_meta.first_ts_us)
         {
-            need_roll = true;
+            /* Data without record times, stamp it with the write time */
+            block_meta.first_ts_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                         std::chrono::system_clock::now().time_since_epoch())
+                                         .count();
+            block_meta.last_ts_us  = block_meta.first_ts_us;
         }
 
-        if (need_roll)
-        {
-            roll_log_file();
-        }
+        ContainerBlockHeader header;
+        container_block_header(block_meta, logdata, size, header);
+        _log_file->append_data(reinterpret_cast<const char *>(&header), sizeof(header));
+        _log_file->append_data(logdata, size, flush_now);
+
+        _blocks.add(_file_offset, size, block_meta);
+        _file_offset += sizeof(header) + size;
+        check_roll();
     }
     else
     {
-        std::cerr << "[LogFile::write_logdata] file is NULL" << std::endl;
+        std::cerr << "[LogFile::write_block] file is NULL" << std::endl;
+    }
+}
+
+/**
+ * @brief Write one block given as several pieces. In text mode they go to the
+ * file with writev, without being copied; the container format joins them
+ * into one block.
+ * @param [in] pieces Pieces of the data, in order
+ * @param [in] num_pieces Number of pieces
+ * @param [in] meta Time range, record count and sequence range of the data
+ * @param [in] flush_now Whether to flush the buffer data to the file
+ * immediately
+ */
+void
+LogFile::write_blockv(const struct iovec *pieces, int num_pieces, const BlockMeta &meta, bool flush_now)
+{
+    if (_container)
+    {
+        LogSink::write_blockv(pieces, num_pieces, meta, flush_now);
+        return;
+    }
+
+    /* writev leaves nothing buffered */
+    (void)flush_now;
+    if (nullptr != _log_file)
+    {
+        follow_roll();
+        _log_file->append_datav(pieces, num_pieces);
+        check_roll();
+    }
+    else
+    {
+        std::cerr << "[LogFile::write_blockv] file is NULL" << std::endl;
+    }
+}
+
+/**
+ * @brief Roll the file if the size limit is reached or the helper thread has
+ * signalled the end of the rolling cycle
+ */
+void
+LogFile::check_roll(void)
+{
+    bool need_roll = false;
+
+    if ((0 != _roll_size_bytes) && (_log_file->get_written_bytes() >= _roll_size_bytes))
+    {
+        need_roll = true;
+    }
+    /* Raised by the helper thread, no clock read on the write path */
+    if (_time_roll_due.load(std::memory_order_relaxed))
+    {
+        need_roll = true;
+    }
+
+    if (need_roll)
+    {
+        roll_log_file();
+    }
+}
+
+/**
+ * @brief Forked child sharing the file: reopen the file name once the parent
+ * has rolled the file away from it
+ */
+void
+LogFile::follow_roll(void)
+{
+    /* The parent renames the rolled file and then moves the pre-opened file
+     * to the name. Until then the name is missing or still the open file, and
+     * the data goes to the file being rolled, so nothing is lost. */
+    if (_forked_child && _log_file->replaced(_file_name))
+    {
+        std::unique_ptr<BaseFile> file(new (std::nothrow) BaseFile(_file_name));
+        if (nullptr != file)
+        {
+            _log_file = std::move(file);
+        }
     }
 }
 
+/**
+ * @brief Container mode: append the index block of a file
+ */
+void
+LogFile::write_index(BaseFile &file, const ContainerIndex &blocks, uint64_t end_offset)
+{
+    std::string index;
+    blocks.encode(end_offset, index);
+    file.append_data(index.data(), index.size());
+}
+
 /**
  * @brief Flush buffer data to file
  */
@@ -111,4 +484,72 @@ LogFile::flush(void)
     }
 }
 
-} // namespace logging
\ No newline at end of file
+/**
+ * @brief Flush buffer data to file and wait until it reaches the disk
+ */
+void
+LogFile::sync(void)
+{
+    if (nullptr != _log_file)
+    {
+        _log_file->sync();
+    }
+}
+
+/**
+ * @brief Flush the file and hold the roll lock across fork()
+ */
+void
+LogFile::prepare_fork(void)
+{
+    flush();
+    /* The helper thread only changes the roll state under this lock */
+    _roll_lock.lock();
+}
+
+/**
+ * @brief Release the roll lock in the parent
+ */
+void
+LogFile::after_fork_parent(void)
+{
+    _shared = true;
+    _roll_lock.unlock();
+}
+
+/**
+ * @brief The child keeps appending to the current file and leaves rolling and
+ * retention to the parent, which owns the helper thread. It reopens the file
+ * name once the parent has rolled the file.
+ */
+void
+LogFile::after_fork_child(void)
+{
+    /* The swapped out files and the pre-opened file belong to the parent.
+     * Closing them here would flush their buffers a second time, so they are
+     * released without being closed. */
+    for (auto &task : _roll_tasks)
+    {
+        (void)task.file.release();
+    }
+    _roll_tasks.clear();
+    (void)_next_file.release();
+
+    /* The helper thread does not exist in the child. It was waiting on the
+     * condition variable, which would keep a notify in the child waiting for
+     * it, so that is rebuilt as well. */
+    new (&_roll_thread) std::thread();
+    new (&_roll_cv) std::condition_variable();
+    _roll_running       = false;
+    _roll_cycle_minutes = 0;
+    _roll_size_bytes    = 0;
+    _time_roll_due.store(false, std::memory_order_relaxed);
+    _forked_child = true;
+    _shared       = true;
+
+    /* Held since prepare_fork by the forking thread, which need not be the
+     * one running this */
+    new (&_roll_lock) std::mutex();
+}
+
+} // namespace logging
@@ -0,0 +1,265 @@
+#include "log_frame.h"
+#include <string.h>
+#include <algorithm>
+#include "crc32c.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define LOGGING_LOG_FRAME_X86 1
+#endif
+
+namespace logging {
+
+/* Offsets of the fields in the prefix "@<seq 16>:<crc 8>:<size 8> " */
+static const size_t FRAME_SEQ_POS  = 1;
+static const size_t FRAME_CRC_POS  = 18;
+static const size_t FRAME_SIZE_POS = 27;
+
+static void
+put_hex (uint64_t value, int digits, char *out)
+{
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    for (int i = digits - 1; i >= 0; i--)
+    {
+        out[i] = HEX_DIGITS[value & 0xF];
+        value >>= 4;
+    }
+}
+
+/**
+ * @brief Format the frame prefix of a record, with a zero checksum
+ * @param[in] seq Record sequence number
+ * @param[in] size Record size
+ * @param[out] out RECORD_FRAME_SIZE bytes, not terminated
+ */
+void
+record_frame(uint64_t seq, uint32_t size, char *out)
+{
+    out[0]                     = '@';
+    out[FRAME_CRC_POS - 1]     = ':';
+    out[FRAME_SIZE_POS - 1]    = ':';
+    out[RECORD_FRAME_SIZE - 1] = ' ';
+#ifdef LOGGING_LOG_FRAME_X86
+    /* The 16 bytes of the three fields, most significant first, become 32 hex
+     * digits at once: split into nibbles, interleave, and add '0' or 'a' - 10 */
+    __m128i bytes = _mm_set_epi64x(static_cast<long long>(static_cast<uint64_t>(__builtin_bswap32(size)) << 32),
+                                   static_cast<long long>(__builtin_bswap64(seq)));
+    const __m128i low_mask = _mm_set1_epi8(0x0F);
+    __m128i       high     = _mm_and_si128(_mm_srli_epi16(bytes, 4), low_mask);
+    __m128i       low      = _mm_and_si128(bytes, low_mask);
+    __m128i       first    = _mm_unpacklo_epi8(high, low);
+    __m128i       second   = _mm_unpackhi_epi8(high, low);
+    const __m128i nine     = _mm_set1_epi8(9);
+    const __m128i zero     = _mm_set1_epi8('0');
+    const __m128i letters  = _mm_set1_epi8('a' - '0' - 10);
+    first  = _mm_add_epi8(_mm_add_epi8(first, zero), _mm_and_si128(_mm_cmpgt_epi8(first, nine), letters));
+    second = _mm_add_epi8(_mm_add_epi8(second, zero), _mm_and_si128(_mm_cmpgt_epi8(second, nine), letters));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + FRAME_SEQ_POS), first);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(out + FRAME_CRC_POS), second);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(out + FRAME_SIZE_POS), _mm_srli_si128(second, 8));
+#else
+    put_hex(seq, 16, out + FRAME_SEQ_POS);
+    put_hex(0, 8, out + FRAME_CRC_POS);
+    put_hex(size, 8, out + FRAME_SIZE_POS);
+#endif
+}
+
+/**
+ * @brief Fill in the checksum of a frame prefix
+ * @param[inout] frame Prefix written by record_frame
+ * @param[in] crc CRC32C of the record bytes
+ */
+void
+set_frame_crc(char *frame, uint32_t crc)
+{
+    put_hex(crc, 8, frame + FRAME_CRC_POS);
+}
+
+/**
+ * @brief Parse digits written by record_frame (lower case hex)
+ */
+static bool
+get_hex (const char *p, int digits, uint64_t &value)
+{
+    value = 0;
+    for (int i = 0; i < digits; i++)
+    {
+        char c = p[i];
+        if (('0' <= c) && ('9' >= c))
+        {
+            value = (value << 4) | static_cast<uint64_t>(c - '0');
+        }
+        else if (('a' <= c) && ('f' >= c))
+        {
+            value = (value << 4) | static_cast<uint64_t>(c - 'a' + 10);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Parse a frame prefix
+ * @param[in] p Data that may start with a frame prefix
+ * @param[in] avail Bytes available at p
+ * @param[out] seq Record sequence number
+ * @param[out] crc CRC32C of the record bytes
+ * @param[out] size Record size
+ * @retval true if p starts with a well formed prefix
+ */
+bool
+parse_record_frame(const char *p, size_t avail, uint64_t &seq, uint32_t &crc, uint32_t &size)
+{
+    if ((avail < RECORD_FRAME_SIZE) || ('@' != p[0]) || (':' != p[FRAME_CRC_POS - 1])
+        || (':' != p[FRAME_SIZE_POS - 1]) || (' ' != p[RECORD_FRAME_SIZE - 1]))
+    {
+        return false;
+    }
+    uint64_t crc_value  = 0;
+    uint64_t size_value = 0;
+    if (!get_hex(p + FRAME_SEQ_POS, 16, seq) || !get_hex(p + FRAME_CRC_POS, 8, crc_value)
+        || !get_hex(p + FRAME_SIZE_POS, 8, size_value))
+    {
+        return false;
+    }
+    crc  = static_cast<uint32_t>(crc_value);
+    size = static_cast<uint32_t>(size_value);
+    return true;
+}
+
+/**
+ * @brief Offset of the next frame prefix after pos, size if there is none.
+ * Records need not end with a new line, so any '@' may start one.
+ */
+size_t
+FrameVerifier::next_frame(const char *data, size_t size, size_t pos)
+{
+    uint64_t seq;
+    uint32_t crc, len;
+    while (pos < size)
+    {
+        const char *at = static_cast<const char *>(memchr(data + pos + 1, '@', size - pos - 1));
+        if (nullptr == at)
+        {
+            return size;
+        }
+        pos = at - data;
+        if (parse_record_frame(data + pos, size - pos, seq, crc, len))
+        {
+            return pos;
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief Check a piece of data that holds whole records, e.g. a file or a
+ * container block
+ * @param[in] data Data source address
+ * @param[in] size Data size
+ */
+void
+FrameVerifier::scan(const char *data, size_t size)
+{
+    size_t pos = 0;
+    while (pos < size)
+    {
+        uint64_t seq;
+        uint32_t crc, len;
+        if (!parse_record_frame(data + pos, size - pos, seq, crc, len))
+        {
+            size_t next = next_frame(data, size, pos);
+            _report.unframed += next - pos;
+            pos = next;
+            continue;
+        }
+
+        /* A new run starts when the numbering starts over */
+        if (0 == seq)
+        {
+            if (_has_zero)
+            {
+                end_run();
+            }
+            _has_zero = true;
+        }
+        _seqs.push_back(seq);
+
+        size_t body  = pos + RECORD_FRAME_SIZE;
+        size_t avail = size - body;
+        if ((len <= avail) && (crc == crc32c(0, data + body, len)))
+        {
+            _report.records++;
+            pos = body + len;
+            continue;
+        }
+
+        /* The record is damaged. If the data ends or another record starts
+         * before its end, it was cut short; otherwise its bytes were changed */
+        size_t end  = (len <= avail) ? body + len : size;
+        size_t next = next_frame(data, size, pos);
+        if ((len > avail) || (next < end))
+        {
+            _report.torn++;
+            pos = next;
+        }
+        else
+        {
+            _report.corrupt++;
+            pos = ((end == size) || parse_record_frame(data + end, size - end, seq, crc, len)) ? end : next;
+        }
+    }
+}
+
+/**
+ * @brief Close the current run and account its gaps
+ */
+void
+FrameVerifier::end_run(void)
+{
+    if (_seqs.empty())
+    {
+        return;
+    }
+    _report.runs++;
+
+    /* The two lanes interleave in the file, order the numbers first */
+    std::sort(_seqs.begin(), _seqs.end());
+    for (size_t i = 1; i < _seqs.size(); i++)
+    {
+        uint64_t prev = _seqs[i - 1];
+        uint64_t cur  = _seqs[i];
+        if (cur == prev)
+        {
+            _report.duplicates++;
+        }
+        else if (cur > prev + 1)
+        {
+            _report.missing += cur - prev - 1;
+            if (_report.gaps.size() < FrameReport::MAX_GAPS)
+            {
+                FrameReport::Gap gap = {_report.runs - 1, prev + 1, cur - 1};
+                _report.gaps.push_back(gap);
+            }
+        }
+    }
+    _seqs.clear();
+    _has_zero = false;
+}
+
+/**
+ * @brief Look for gaps in the sequence numbers seen so far
+ * @retval The report, the verifier starts over afterwards
+ */
+FrameReport
+FrameVerifier::finish(void)
+{
+    end_run();
+    FrameReport report = _report;
+    _report            = FrameReport();
+    return report;
+}
+
+} // namespace logging
@@ -0,0 +1,233 @@
+#include "log_hexdump.h"
+#include <stdint.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LOGGING_HEXDUMP_X86 1
+#endif
+
+namespace logging {
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+/* Columns of a line, see log_hexdump.h */
+static const size_t HEX_COLUMN   = 10; // First hex digit, after the offset and two spaces
+static const size_t GROUP_SIZE   = 25; // 8 bytes as "hh " and the space between the groups
+static const size_t ASCII_COLUMN = 61; // After the hex column, a space and '|'
+
+/**
+ * @brief The offset column and the separators up to the ASCII column
+ */
+static inline void
+line_frame (size_t offset, char *o)
+{
+    uint32_t value = static_cast<uint32_t>(offset);
+    for (int i = 7; i >= 0; i--)
+    {
+        o[i] = HEX_DIGITS[value & 0x0f];
+        value >>= 4;
+    }
+    o[8]                           = ' ';
+    o[9]                           = ' ';
+    o[HEX_COLUMN + GROUP_SIZE - 1] = ' ';
+    o[ASCII_COLUMN - 2]            = ' ';
+    o[ASCII_COLUMN - 1]            = '|';
+}
+
+/**
+ * @brief One line of up to 16 bytes, a byte at a time
+ * @retval Size of the line
+ */
+static size_t
+hexdump_line_scalar (const uint8_t *p, size_t n, size_t offset, char *o)
+{
+    line_frame(offset, o);
+    for (size_t i = 0; i < HEXDUMP_BYTES_PER_LINE; i++)
+    {
+        char *hex = o + HEX_COLUMN + 3 * i + ((i >= 8) ? 1 : 0);
+        if (i < n)
+        {
+            hex[0] = HEX_DIGITS[p[i] >> 4];
+            hex[1] = HEX_DIGITS[p[i] & 0x0f];
+        }
+        else
+        {
+            hex[0] = ' ';
+            hex[1] = ' ';
+        }
+        hex[2] = ' ';
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        o[ASCII_COLUMN + i] = ((p[i] >= 0x20) && (p[i] < 0x7f)) ? static_cast<char>(p[i]) : '.';
+    }
+    o[ASCII_COLUMN + n]     = '|';
+    o[ASCII_COLUMN + n + 1] = '\n';
+    return ASCII_COLUMN + n + 2;
+}
+
+static size_t
+hexdump_scalar (const uint8_t *p, size_t size, size_t offset, char *out)
+{
+    char *o = out;
+    for (size_t i = 0; i < size; i += HEXDUMP_BYTES_PER_LINE)
+    {
+        size_t n = (size - i < HEXDUMP_BYTES_PER_LINE) ? size - i : HEXDUMP_BYTES_PER_LINE;
+        o += hexdump_line_scalar(p + i, n, offset + i, o);
+    }
+    return o - out;
+}
+
+#ifdef LOGGING_HEXDUMP_X86
+/* Spread the 16 digits of 8 bytes into "hh hh ...": 16 and then 8 output
+ * bytes, -1 (0x80) gives the zero that the space is or'ed into */
+#define HEXDUMP_SPREAD_HEAD 0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7, -1, 8, 9, -1, 10
+#define HEXDUMP_SPREAD_TAIL 11, -1, 12, 13, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1
+#define HEXDUMP_SPACES_HEAD 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0
+#define HEXDUMP_SPACES_TAIL 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, 0, 0, 0, 0, 0, 0
+
+/**
+ * @brief Store the hex and ASCII columns and the end of a full line: the
+ * digits of bytes 0-7 and 8-15 in order (from unpacklo/unpackhi of the high
+ * and low nibble digits), and the printable bytes
+ */
+__attribute__((target("ssse3"))) static inline void
+store_line (__m128i first, __m128i second, __m128i ascii, char *o)
+{
+    const __m128i head        = _mm_setr_epi8(HEXDUMP_SPREAD_HEAD);
+    const __m128i tail        = _mm_setr_epi8(HEXDUMP_SPREAD_TAIL);
+    const __m128i spaces_head = _mm_setr_epi8(HEXDUMP_SPACES_HEAD);
+    const __m128i spaces_tail = _mm_setr_epi8(HEXDUMP_SPACES_TAIL);
+    char         *group       = o + HEX_COLUMN;
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(group), _mm_or_si128(_mm_shuffle_epi8(first, head), spaces_head));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(group + 16), _mm_or_si128(_mm_shuffle_epi8(first, tail), spaces_tail));
+    group += GROUP_SIZE;
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(group), _mm_or_si128(_mm_shuffle_epi8(second, head), spaces_head));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(group + 16),
+                     _mm_or_si128(_mm_shuffle_epi8(second, tail), spaces_tail));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(o + ASCII_COLUMN), ascii);
+    o[ASCII_COLUMN + HEXDUMP_BYTES_PER_LINE]     = '|';
+    o[ASCII_COLUMN + HEXDUMP_BYTES_PER_LINE + 1] = '\n';
+}
+
+/**
+ * @brief 16 bytes per line: pshufb looks the nibbles up in a digit table and
+ * spreads the digits into their columns, compares pick the printable bytes
+ */
+__attribute__((target("ssse3"))) static size_t
+hexdump_ssse3 (const uint8_t *p, size_t size, size_t offset, char *out)
+{
+    const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m128i mask   = _mm_set1_epi8(0x0f);
+    char         *o      = out;
+    size_t        i      = 0;
+    for (; i + HEXDUMP_BYTES_PER_LINE <= size; i += HEXDUMP_BYTES_PER_LINE, o += HEXDUMP_LINE_SIZE)
+    {
+        __m128i in        = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i hi        = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+        __m128i lo        = _mm_shuffle_epi8(digits, _mm_and_si128(in, mask));
+        /* Signed compares: 0x80 and up are negative */
+        __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8(0x1f)),
+                                          _mm_cmpgt_epi8(_mm_set1_epi8(0x7f), in));
+        __m128i ascii = _mm_or_si128(_mm_and_si128(printable, in), _mm_andnot_si128(printable, _mm_set1_epi8('.')));
+        line_frame(offset + i, o);
+        store_line(_mm_unpacklo_epi8(hi, lo), _mm_unpackhi_epi8(hi, lo), ascii, o);
+    }
+    return (o - out) + hexdump_scalar(p + i, size - i, offset + i, o);
+}
+
+/**
+ * @brief Two lines per step, each 128 bit lane works on one of them as in
+ * hexdump_ssse3
+ */
+__attribute__((target("avx2"))) static size_t
+hexdump_avx2 (const uint8_t *p, size_t size, size_t offset, char *out)
+{
+    const __m256i digits = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e',
+                                            'f', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd',
+                                            'e', 'f');
+    const __m256i mask   = _mm256_set1_epi8(0x0f);
+    char         *o      = out;
+    size_t        i      = 0;
+    for (; i + 2 * HEXDUMP_BYTES_PER_LINE <= size; i += 2 * HEXDUMP_BYTES_PER_LINE, o += 2 * HEXDUMP_LINE_SIZE)
+    {
+        __m256i in        = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        __m256i hi        = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(in, 4), mask));
+        __m256i lo        = _mm256_shuffle_epi8(digits, _mm256_and_si256(in, mask));
+        __m256i printable = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8(0x1f)),
+                                             _mm256_cmpgt_epi8(_mm256_set1_epi8(0x7f), in));
+        __m256i ascii
+            = _mm256_or_si256(_mm256_and_si256(printable, in), _mm256_andnot_si256(printable, _mm256_set1_epi8('.')));
+        __m256i first  = _mm256_unpacklo_epi8(hi, lo);
+        __m256i second = _mm256_unpackhi_epi8(hi, lo);
+        line_frame(offset + i, o);
+        store_line(_mm256_castsi256_si128(first), _mm256_castsi256_si128(second), _mm256_castsi256_si128(ascii), o);
+        line_frame(offset + i + HEXDUMP_BYTES_PER_LINE, o + HEXDUMP_LINE_SIZE);
+        store_line(_mm256_extracti128_si256(first, 1), _mm256_extracti128_si256(second, 1),
+                   _mm256_extracti128_si256(ascii, 1), o + HEXDUMP_LINE_SIZE);
+    }
+    return (o - out) + hexdump_ssse3(p + i, size - i, offset + i, o);
+}
+#endif
+
+using HexdumpFunc = size_t (*)(const uint8_t *p, size_t size, size_t offset, char *out);
+
+/**
+ * @brief Formatter for this CPU, selected once on first use
+ */
+struct HexdumpImpl
+{
+    HexdumpImpl(void)
+        : func(hexdump_scalar)
+        , isa("scalar")
+    {
+#ifdef LOGGING_HEXDUMP_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            func = hexdump_avx2;
+            isa  = "avx2";
+        }
+        else if (__builtin_cpu_supports("ssse3"))
+        {
+            func = hexdump_ssse3;
+            isa  = "ssse3";
+        }
+#endif
+    }
+
+    HexdumpFunc func;
+    const char *isa;
+};
+
+static const HexdumpImpl &
+hexdump_impl (void)
+{
+    static const HexdumpImpl impl;
+    return impl;
+}
+
+/**
+ * @brief Format a hex dump, with AVX2 or SSSE3 where the CPU has them
+ * @param[in] data Data source address
+ * @param[in] size data size
+ * @param[in] offset Offset shown for the first byte
+ * @param[out] out hexdump_size(size) bytes
+ * @retval Number of bytes written to out
+ */
+size_t
+hexdump_format(const void *data, size_t size, size_t offset, char *out)
+{
+    return hexdump_impl().func(static_cast<const uint8_t *>(data), size, offset, out);
+}
+
+/**
+ * @brief Instruction set used by hexdump_format on this CPU: "avx2", "ssse3"
+ * or "scalar"
+ */
+const char *
+hexdump_isa(void)
+{
+    return hexdump_impl().isa;
+}
+
+} // namespace logging
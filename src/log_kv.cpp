@@ -0,0 +1,398 @@
+#include "log_kv.h"
+#include <emmintrin.h>
+#include <cmath>
+#include <stdio.h>  // snprintf
+#include <string.h> // strlen
+
+namespace logging {
+
+/* Two ASCII digits for every value in [0, 100) */
+static const char DIGIT_PAIRS[201] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+static KvField
+make_field (const char *key, KvField::Type type)
+{
+    KvField field;
+    field.key     = key;
+    field.key_len = (nullptr == key) ? 0 : strlen(key);
+    field.type    = type;
+    return field;
+}
+
+KvField
+kv (const char *key, bool value)
+{
+    KvField field = make_field(key, KvField::KV_BOOL);
+    field.value.b = value;
+    return field;
+}
+
+KvField
+kv (const char *key, int value)
+{
+    return kv(key, static_cast<long long>(value));
+}
+
+KvField
+kv (const char *key, long value)
+{
+    return kv(key, static_cast<long long>(value));
+}
+
+KvField
+kv (const char *key, long long value)
+{
+    KvField field = make_field(key, KvField::KV_INT);
+    field.value.i = value;
+    return field;
+}
+
+KvField
+kv (const char *key, unsigned int value)
+{
+    return kv(key, static_cast<unsigned long long>(value));
+}
+
+KvField
+kv (const char *key, unsigned long value)
+{
+    return kv(key, static_cast<unsigned long long>(value));
+}
+
+KvField
+kv (const char *key, unsigned long long value)
+{
+    KvField field = make_field(key, KvField::KV_UINT);
+    field.value.u = value;
+    return field;
+}
+
+KvField
+kv (const char *key, double value)
+{
+    KvField field = make_field(key, KvField::KV_DOUBLE);
+    field.value.d = value;
+    return field;
+}
+
+KvField
+kv (const char *key, const char *value, size_t len)
+{
+    KvField field = make_field(key, KvField::KV_STRING);
+    field.value.s = (nullptr == value) ? "" : value;
+    field.str_len = (nullptr == value) ? 0 : len;
+    return field;
+}
+
+KvField
+kv (const char *key, const char *value)
+{
+    return kv(key, value, (nullptr == value) ? 0 : strlen(value));
+}
+
+KvField
+kv (const char *key, const std::string &value)
+{
+    return kv(key, value.data(), value.size());
+}
+
+/**
+ * @brief Returns the offset of the first byte that needs special treatment:
+ * control characters (<= limit), '"', '\\' and optionally '='.
+ * @param [in] limit : 0x1F for JSON, 0x20 for logfmt (space must be quoted)
+ * @param [in] check_equal : Whether '=' is a special character
+ */
+static size_t
+scan_special (const char *str, size_t len, uint8_t limit, bool check_equal)
+{
+    size_t        pos     = 0;
+    const __m128i v_limit = _mm_set1_epi8(static_cast<char>(limit));
+    const __m128i v_quote = _mm_set1_epi8('"');
+    const __m128i v_slash = _mm_set1_epi8('\\');
+    const __m128i v_equal = _mm_set1_epi8(check_equal ? '=' : '"');
+
+    while (pos + 16 <= len)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + pos));
+        /* unsigned chunk <= limit  <=>  min(chunk, limit) == chunk */
+        __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(chunk, v_limit), chunk);
+        __m128i hit  = _mm_or_si128(ctrl, _mm_cmpeq_epi8(chunk, v_quote));
+        hit          = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, v_slash));
+        hit          = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, v_equal));
+        int mask     = _mm_movemask_epi8(hit);
+        if (0 != mask)
+        {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    for (; pos < len; pos++)
+    {
+        uint8_t c = static_cast<uint8_t>(str[pos]);
+        if ((c <= limit) || ('"' == c) || ('\\' == c) || (check_equal && ('=' == c)))
+        {
+            return pos;
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief Write str with JSON escaping, without the surrounding quotes
+ */
+static void
+escape_into (LogStream &stream, const char *str, size_t len)
+{
+    size_t pos = 0;
+    while (pos < len)
+    {
+        size_t run = scan_special(str + pos, len - pos, 0x1F, false);
+        if (run > 0)
+        {
+            stream.sputn(str + pos, run);
+            pos += run;
+            if (pos >= len)
+            {
+                break;
+            }
+        }
+
+        char    esc[6] = { '\\', 0, 0, 0, 0, 0 };
+        size_t  n      = 2;
+        uint8_t c      = static_cast<uint8_t>(str[pos]);
+        switch (c)
+        {
+            case '"':  esc[1] = '"';  break;
+            case '\\': esc[1] = '\\'; break;
+            case '\n': esc[1] = 'n';  break;
+            case '\r': esc[1] = 'r';  break;
+            case '\t': esc[1] = 't';  break;
+            case '\b': esc[1] = 'b';  break;
+            case '\f': esc[1] = 'f';  break;
+            default:
+                esc[1] = 'u';
+                esc[2] = '0';
+                esc[3] = '0';
+                esc[4] = HEX_DIGITS[c >> 4];
+                esc[5] = HEX_DIGITS[c & 0x0F];
+                n      = 6;
+                break;
+        }
+        stream.sputn(esc, n);
+        pos += 1;
+    }
+}
+
+/**
+ * @brief Append a JSON string literal (with quotes) to the stream
+ * @param [in] stream : Destination stream
+ * @param [in] str : String source address
+ * @param [in] len : String length
+ */
+void
+KvEncoder::json_string(LogStream &stream, const char *str, size_t len)
+{
+    stream.sputc('"');
+    escape_into(stream, str, len);
+    stream.sputc('"');
+}
+
+/**
+ * @brief Append a logfmt value, quoted only when it contains a space, '=', a
+ * quote or a control character
+ * @param [in] stream : Destination stream
+ * @param [in] str : String source address
+ * @param [in] len : String length
+ */
+void
+KvEncoder::logfmt_string(LogStream &stream, const char *str, size_t len)
+{
+    if ((len > 0) && (scan_special(str, len, 0x20, true) == len))
+    {
+        stream.sputn(str, len);
+    }
+    else
+    {
+        json_string(stream, str, len);
+    }
+}
+
+/**
+ * @brief Append the decimal representation of an unsigned integer
+ */
+void
+KvEncoder::uint_value(LogStream &stream, uint64_t value)
+{
+    char  digits[24];
+    char *end = digits + sizeof(digits);
+    char *p   = end;
+
+    while (value >= 100)
+    {
+        size_t idx = static_cast<size_t>(value % 100) * 2;
+        value /= 100;
+        p -= 2;
+        p[0] = DIGIT_PAIRS[idx];
+        p[1] = DIGIT_PAIRS[idx + 1];
+    }
+    if (value >= 10)
+    {
+        size_t idx = static_cast<size_t>(value) * 2;
+        p -= 2;
+        p[0] = DIGIT_PAIRS[idx];
+        p[1] = DIGIT_PAIRS[idx + 1];
+    }
+    else
+    {
+        *--p = static_cast<char>('0' + value);
+    }
+    stream.sputn(p, end - p);
+}
+
+/**
+ * @brief Append the decimal representation of a signed integer
+ */
+void
+KvEncoder::int_value(LogStream &stream, int64_t value)
+{
+    if (value < 0)
+    {
+        stream.sputc('-');
+        /* Negate in unsigned arithmetic so that INT64_MIN is handled */
+        uint_value(stream, 0 - static_cast<uint64_t>(value));
+    }
+    else
+    {
+        uint_value(stream, static_cast<uint64_t>(value));
+    }
+}
+
+/**
+ * @brief Append a floating point value. Non-finite values are written as null
+ * in JSON and as NaN/+Inf/-Inf in logfmt.
+ */
+void
+KvEncoder::double_value(LogStream &stream, double value, KvFormat format)
+{
+    if (!std::isfinite(value))
+    {
+        if (KV_FORMAT_JSON == format)
+        {
+            stream.sputn("null", 4);
+        }
+        else if (std::isnan(value))
+        {
+            stream.sputn("NaN", 3);
+        }
+        else
+        {
+            stream.sputn((value > 0) ? "+Inf" : "-Inf", 4);
+        }
+        return;
+    }
+
+    /* Integral values within the exact range of a double skip printf */
+    if ((value >= -9007199254740992.0) && (value <= 9007199254740992.0)
+        && (static_cast<double>(static_cast<int64_t>(value)) == value))
+    {
+        int_value(stream, static_cast<int64_t>(value));
+        return;
+    }
+
+    char buf[32];
+    int  n = snprintf(buf, sizeof(buf), "%.17g", value);
+    if (n > 0)
+    {
+        stream.sputn(buf, (static_cast<size_t>(n) < sizeof(buf)) ? n : sizeof(buf) - 1);
+    }
+}
+
+/**
+ * @brief Append ",key:value" (JSON) or " key=value" (logfmt)
+ * @param [in] stream : Destination stream
+ * @param [in] field : The field to be encoded
+ * @param [in] format : Output format
+ */
+void
+KvEncoder::field(LogStream &stream, const KvField &field, KvFormat format)
+{
+    if (KvField::KV_NONE == field.type)
+    {
+        return;
+    }
+
+    if (KV_FORMAT_JSON == format)
+    {
+        stream.sputc(',');
+        json_string(stream, field.key, field.key_len);
+        stream.sputc(':');
+    }
+    else
+    {
+        stream.sputc(' ');
+        /* Keys are identifiers in logfmt, drop anything that would break
+         * the key=value syntax */
+        if (scan_special(field.key, field.key_len, 0x20, true) == field.key_len)
+        {
+            stream.sputn(field.key, field.key_len);
+        }
+        else
+        {
+            for (size_t i = 0; i < field.key_len; i++)
+            {
+                uint8_t c = static_cast<uint8_t>(field.key[i]);
+                bool special = (c <= 0x20) || ('"' == c) || ('\\' == c) || ('=' == c);
+                stream.sputc(special ? '_' : field.key[i]);
+            }
+        }
+        stream.sputc('=');
+    }
+
+    switch (field.type)
+    {
+        case KvField::KV_INT:
+            int_value(stream, field.value.i);
+            break;
+        case KvField::KV_UINT:
+            uint_value(stream, field.value.u);
+            break;
+        case KvField::KV_DOUBLE:
+            double_value(stream, field.value.d, format);
+            break;
+        case KvField::KV_BOOL:
+            if (field.value.b)
+            {
+                stream.sputn("true", 4);
+            }
+            else
+            {
+                stream.sputn("false", 5);
+            }
+            break;
+        case KvField::KV_STRING:
+            if (KV_FORMAT_JSON == format)
+            {
+                json_string(stream, field.value.s, field.str_len);
+            }
+            else
+            {
+                logfmt_string(stream, field.value.s, field.str_len);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+} // namespace logging
@@ -0,0 +1,284 @@
+#include "log_merge.h"
+#include <algorithm>
+#include <chrono>
+#include <new>
+
+namespace logging {
+
+static uint64_t
+steady_ns (void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+RecordMerger::RecordMerger(void)
+    : _last_ts_us(0)
+    , _records(0)
+    , _late(0)
+    , _num_runs(0)
+    , _early(0)
+    , _merge_ns(0)
+{
+    _lane_runs[0] = 0;
+    _lane_runs[1] = 0;
+}
+
+/**
+ * @brief Add the records of a buffer
+ * @param[in] buffer Buffer with a record index (DataBuffer::note_index),
+ * frames sealed. Data not covered by the index is taken as one record.
+ * @param[in] urgent Whether it comes from the priority lane
+ * @param[in] release Takes back the buffer once its records are copied
+ */
+void
+RecordMerger::add(DataBuffer_ptr buffer, bool urgent, const ReleaseFunc &release)
+{
+    uint64_t start = steady_ns();
+
+    std::unique_ptr<Run> run;
+    if (_free_runs.empty())
+    {
+        run.reset(new (std::nothrow) Run());
+        if (nullptr == run)
+        {
+            return;
+        }
+    }
+    else
+    {
+        run = std::move(_free_runs.back());
+        _free_runs.pop_back();
+    }
+    run->urgent = urgent;
+    run->next   = 0;
+    run->entries.clear();
+
+    /* Data outside the index, e.g. stored before the merge was switched on,
+     * goes with the time of the record before it */
+    const std::vector<RecordIndex> &index = buffer->get_index();
+    size_t                          size  = buffer->get_data_size();
+    size_t                          pos   = 0;
+    Entry                           gap   = {buffer->get_first_ts(), buffer->get_first_seq(), 0, 0, 0, 0, false};
+    for (const RecordIndex &record : index)
+    {
+        if (record.offset > pos)
+        {
+            gap.offset = static_cast<uint32_t>(pos);
+            gap.size   = static_cast<uint32_t>(record.offset - pos);
+            run->entries.push_back(gap);
+        }
+        Entry entry = {record.ts_us,      record.seq,      record.offset, record.size,
+                       record.time_begin, record.time_end, record.span};
+        run->entries.push_back(entry);
+        pos       = record.offset + record.size;
+        gap.ts_us = record.ts_us;
+        gap.seq   = record.seq;
+    }
+    if (size > pos)
+    {
+        gap.offset = static_cast<uint32_t>(pos);
+        gap.size   = static_cast<uint32_t>(size - pos);
+        run->entries.push_back(gap);
+    }
+
+    /* The sequence numbers are taken under the lock of the lane, the time
+     * stamps before it, so a run is almost in order already: insertion sort */
+    std::vector<Entry> &entries = run->entries;
+    for (size_t i = 1; i < entries.size(); i++)
+    {
+        Entry  entry = entries[i];
+        size_t j     = i;
+        while ((j > 0)
+               && ((entries[j - 1].ts_us > entry.ts_us)
+                   || ((entries[j - 1].ts_us == entry.ts_us) && (entries[j - 1].seq > entry.seq))))
+        {
+            entries[j] = entries[j - 1];
+            j--;
+        }
+        entries[j] = entry;
+    }
+
+    /* The records are copied at their offsets and the lane gets its buffer
+     * back. An extent or a payload is written from the buffer it is in. */
+    run->own = false;
+    if ((size <= buffer->get_buffer_size()) && (nullptr == buffer->get_payload()))
+    {
+        DataBuffer_ptr copy;
+        if (_free_buffers.empty())
+        {
+            copy.reset(new (std::nothrow) DataBuffer());
+        }
+        else
+        {
+            copy = std::move(_free_buffers.back());
+            _free_buffers.pop_back();
+        }
+        if (nullptr != copy)
+        {
+            copy->input_data(buffer->get_buffer(), size);
+            release(buffer, urgent);
+            buffer   = std::move(copy);
+            run->own = true;
+        }
+    }
+    if (!run->own && !entries.empty())
+    {
+        _lane_runs[urgent ? 1 : 0]++;
+    }
+
+    run->buffer = std::move(buffer);
+    if (!entries.empty())
+    {
+        Head head = {entries[0].ts_us, entries[0].seq, run.get()};
+        _heap.push_back(head);
+        std::push_heap(_heap.begin(), _heap.end(), later);
+    }
+    _runs.push_back(std::move(run));
+    _num_runs.fetch_add(1, std::memory_order_relaxed);
+    _merge_ns.fetch_add(steady_ns() - start, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Write the records up to a time in order
+ * @param[in] watermark_us Records up to this time (microseconds since epoch)
+ * are written, UINT64_MAX for all of them
+ * @param[inout] out Output buffer, empty on entry and exit
+ * @param[in] write Writes the output buffer
+ * @param[in] release Takes back the buffers that have been written
+ */
+void
+RecordMerger::drain(uint64_t watermark_us, DataBuffer &out, const WriteFunc &write, const ReleaseFunc &release)
+{
+    uint64_t start      = steady_ns();
+    uint64_t write_ns   = 0;
+    uint64_t records    = 0;
+    uint64_t late       = 0;
+    uint64_t early      = 0;
+    bool     out_urgent = false;
+    while (!_heap.empty() && ((_heap.front().ts_us <= watermark_us) || over_limits()))
+    {
+        early += (_heap.front().ts_us > watermark_us) ? 1 : 0;
+        std::pop_heap(_heap.begin(), _heap.end(), later);
+        Run *run = _heap.back().run;
+        _heap.pop_back();
+
+        const Entry &entry = run->entries[run->next++];
+        bool         whole = (entry.size > out.get_buffer_size()) || (nullptr != run->buffer->get_payload());
+        if ((out.get_data_size() > 0) && (whole || (out.get_data_size() + entry.size > out.get_buffer_size())))
+        {
+            uint64_t write_start = steady_ns();
+            write(out, out_urgent);
+            write_ns += steady_ns() - write_start;
+            out.reset_buffer();
+            out_urgent = false;
+        }
+        if (whole)
+        {
+            /* Only an extent (DataBuffer::input_extent) holds a record larger
+             * than the output buffer, alone in its buffer like a record with
+             * a payload: written from there */
+            uint64_t write_start = steady_ns();
+            write(*run->buffer, run->urgent);
+            write_ns += steady_ns() - write_start;
+        }
+        else
+        {
+            size_t offset = out.get_data_size();
+            out.input_data(run->buffer->get_buffer() + entry.offset, entry.size);
+            if (entry.span)
+            {
+                out.note_span(offset, entry.time_begin, entry.time_end);
+            }
+            out.note_record(entry.ts_us, entry.seq);
+            out_urgent |= run->urgent;
+        }
+        records++;
+        if (entry.ts_us < _last_ts_us)
+        {
+            late++;
+        }
+        else
+        {
+            _last_ts_us = entry.ts_us;
+        }
+
+        if (run->next < run->entries.size())
+        {
+            Head head = {run->entries[run->next].ts_us, run->entries[run->next].seq, run};
+            _heap.push_back(head);
+            std::push_heap(_heap.begin(), _heap.end(), later);
+        }
+        else if (!run->own)
+        {
+            _lane_runs[run->urgent ? 1 : 0]--;
+        }
+    }
+    if (out.get_data_size() > 0)
+    {
+        uint64_t write_start = steady_ns();
+        write(out, out_urgent);
+        write_ns += steady_ns() - write_start;
+        out.reset_buffer();
+    }
+
+    /* Hand back the buffers that have been written */
+    for (size_t i = 0; i < _runs.size();)
+    {
+        Run *run = _runs[i].get();
+        if (run->next < run->entries.size())
+        {
+            i++;
+            continue;
+        }
+        if (!run->own)
+        {
+            release(run->buffer, run->urgent);
+        }
+        else if (_free_buffers.size() < KEEP_FREE_BUFFERS)
+        {
+            run->buffer->reset_buffer();
+            _free_buffers.push_back(std::move(run->buffer));
+        }
+        run->buffer = nullptr;
+        _free_runs.push_back(std::move(_runs[i]));
+        _runs[i] = std::move(_runs.back());
+        _runs.pop_back();
+    }
+
+    _records.fetch_add(records, std::memory_order_relaxed);
+    _late.fetch_add(late, std::memory_order_relaxed);
+    _early.fetch_add(early, std::memory_order_relaxed);
+    _merge_ns.fetch_add(steady_ns() - start - write_ns, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Forget the buffers without writing or freeing them, in a forked child
+ * whose parent writes them
+ */
+void
+RecordMerger::abandon(void)
+{
+    for (std::unique_ptr<Run> &run : _runs)
+    {
+        (void)run->buffer.release();
+    }
+    _runs.clear();
+    _heap.clear();
+    _lane_runs[0] = 0;
+    _lane_runs[1] = 0;
+}
+
+MergeStats
+RecordMerger::stats(void) const
+{
+    MergeStats stats;
+    stats.records  = _records.load(std::memory_order_relaxed);
+    stats.late     = _late.load(std::memory_order_relaxed);
+    stats.runs     = _num_runs.load(std::memory_order_relaxed);
+    stats.early    = _early.load(std::memory_order_relaxed);
+    stats.merge_ns = _merge_ns.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace logging
@@ -0,0 +1,276 @@
+#include "log_payload.h"
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+#include "log_hexdump.h"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LOGGING_PAYLOAD_X86 1
+#endif
+
+namespace logging {
+
+static const char HEX_DIGITS[]    = "0123456789abcdef";
+static const char BASE64_DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * @brief Hand a payload back to its owner, e.g. when it is dropped. The
+ * release is cleared, so it is called only once.
+ */
+void
+release_payload(Payload &payload)
+{
+    if (payload.release)
+    {
+        PayloadRelease release = std::move(payload.release);
+        payload.release        = nullptr;
+        release(payload.data, payload.size);
+    }
+}
+
+/**
+ * @brief Size of the payload once encoded
+ */
+size_t
+payload_encoded_size(size_t size, PayloadEncoding encoding)
+{
+    switch (encoding)
+    {
+    case PAYLOAD_HEX:
+        return 2 * size;
+    case PAYLOAD_BASE64:
+        return (size + 2) / 3 * 4;
+    case PAYLOAD_HEXDUMP:
+        return hexdump_size(size);
+    default:
+        return size;
+    }
+}
+
+/**
+ * @brief Hex digits of a byte at a time
+ */
+static size_t
+hex_encode_scalar (const uint8_t *p, size_t size, char *out)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        out[2 * i]     = HEX_DIGITS[p[i] >> 4];
+        out[2 * i + 1] = HEX_DIGITS[p[i] & 0x0f];
+    }
+    return 2 * size;
+}
+
+/**
+ * @brief Base64 of three bytes at a time, the tail padded with '='
+ */
+static size_t
+base64_encode_scalar (const uint8_t *p, size_t size, char *out)
+{
+    char *o = out;
+    while (size >= 3)
+    {
+        uint32_t v = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+        o[0]       = BASE64_DIGITS[v >> 18];
+        o[1]       = BASE64_DIGITS[(v >> 12) & 0x3f];
+        o[2]       = BASE64_DIGITS[(v >> 6) & 0x3f];
+        o[3]       = BASE64_DIGITS[v & 0x3f];
+        p += 3;
+        size -= 3;
+        o += 4;
+    }
+    if (size > 0)
+    {
+        uint32_t v = static_cast<uint32_t>(p[0]) << 16;
+        if (size > 1)
+        {
+            v |= static_cast<uint32_t>(p[1]) << 8;
+        }
+        o[0] = BASE64_DIGITS[v >> 18];
+        o[1] = BASE64_DIGITS[(v >> 12) & 0x3f];
+        o[2] = (size > 1) ? BASE64_DIGITS[(v >> 6) & 0x3f] : '=';
+        o[3] = '=';
+        o += 4;
+    }
+    return o - out;
+}
+
+#ifdef LOGGING_PAYLOAD_X86
+/**
+ * @brief Hex of 16 bytes per step: the nibbles index a digit table with pshufb
+ */
+__attribute__((target("ssse3"))) static size_t
+hex_encode_ssse3 (const uint8_t *p, size_t size, char *out)
+{
+    const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m128i mask   = _mm_set1_epi8(0x0f);
+    size_t        i      = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+        __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i * 2 + hex_encode_scalar(p + i, size - i, out + 2 * i);
+}
+
+/**
+ * @brief Hex of 32 bytes per step. The unpacks work within the 128 bit
+ * lanes, the halves are put back in order with permute2x128.
+ */
+__attribute__((target("avx2"))) static size_t
+hex_encode_avx2 (const uint8_t *p, size_t size, char *out)
+{
+    const __m256i digits = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e',
+                                            'f', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd',
+                                            'e', 'f');
+    const __m256i mask   = _mm256_set1_epi8(0x0f);
+    size_t        i      = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i in    = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        __m256i hi    = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(in, 4), mask));
+        __m256i lo    = _mm256_shuffle_epi8(digits, _mm256_and_si256(in, mask));
+        __m256i first = _mm256_unpacklo_epi8(hi, lo);
+        __m256i last  = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i), _mm256_permute2x128_si256(first, last, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i + 32),
+                            _mm256_permute2x128_si256(first, last, 0x31));
+    }
+    return i * 2 + hex_encode_ssse3(p + i, size - i, out + 2 * i);
+}
+
+/**
+ * @brief Base64 of 12 bytes per step (Muła and Lemire): pshufb spreads the
+ * bytes so that every 32 bit lane holds one 24 bit group, the multiplies
+ * move the four 6 bit indices to their bytes, and a second pshufb turns the
+ * indices into the offsets of their character ranges. Loads 16 bytes, so
+ * the last 4 or more bytes go to the scalar loop.
+ */
+__attribute__((target("ssse3"))) static size_t
+base64_encode_ssse3 (const uint8_t *p, size_t size, char *out)
+{
+    const __m128i spread = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i offsets
+        = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                        '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    size_t o = 0;
+    for (; i + 16 <= size; i += 12, o += 16)
+    {
+        __m128i in      = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i)), spread);
+        __m128i a       = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i b       = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        __m128i indices = _mm_or_si128(a, b);
+        /* 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12 */
+        __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + o),
+                         _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range)));
+    }
+    return o + base64_encode_scalar(p + i, size - i, out + o);
+}
+#endif
+
+using EncodeFunc = size_t (*)(const uint8_t *p, size_t size, char *out);
+
+/**
+ * @brief Encoders for this CPU, selected once on first use
+ */
+struct PayloadEncodeImpl
+{
+    PayloadEncodeImpl(void)
+        : hex(hex_encode_scalar)
+        , base64(base64_encode_scalar)
+        , isa("scalar")
+    {
+#ifdef LOGGING_PAYLOAD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("ssse3"))
+        {
+            hex    = hex_encode_ssse3;
+            base64 = base64_encode_ssse3;
+            isa    = "ssse3";
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            hex = hex_encode_avx2;
+            isa = "avx2";
+        }
+#endif
+    }
+
+    EncodeFunc  hex;
+    EncodeFunc  base64;
+    const char *isa;
+};
+
+static const PayloadEncodeImpl &
+payload_encode_impl (void)
+{
+    static const PayloadEncodeImpl impl;
+    return impl;
+}
+
+/**
+ * @brief Encode bytes as lowercase hex, with AVX2 or SSSE3 where the CPU has
+ * them
+ * @param[in] data Data source address
+ * @param[in] size data size
+ * @param[out] out 2 * size bytes
+ * @retval Number of bytes written to out
+ */
+size_t
+hex_encode(const void *data, size_t size, char *out)
+{
+    return payload_encode_impl().hex(static_cast<const uint8_t *>(data), size, out);
+}
+
+/**
+ * @brief Encode bytes as base64 with padding, with SSSE3 where the CPU has it
+ * @param[in] data Data source address
+ * @param[in] size data size
+ * @param[out] out payload_encoded_size(size, PAYLOAD_BASE64) bytes
+ * @retval Number of bytes written to out
+ */
+size_t
+base64_encode(const void *data, size_t size, char *out)
+{
+    return payload_encode_impl().base64(static_cast<const uint8_t *>(data), size, out);
+}
+
+/**
+ * @brief Encode a payload, see PayloadEncoding
+ * @param[out] out payload_encoded_size(size, encoding) bytes
+ * @retval Number of bytes written to out
+ */
+size_t
+payload_encode(const char *data, size_t size, PayloadEncoding encoding, char *out)
+{
+    switch (encoding)
+    {
+    case PAYLOAD_HEX:
+        return hex_encode(data, size, out);
+    case PAYLOAD_BASE64:
+        return base64_encode(data, size, out);
+    case PAYLOAD_HEXDUMP:
+        return hexdump_format(data, size, 0, out);
+    default:
+        memcpy(out, data, size);
+        return size;
+    }
+}
+
+/**
+ * @brief Instruction set used by the encoders on this CPU: "avx2", "ssse3"
+ * or "scalar"
+ */
+const char *
+payload_encoder_isa(void)
+{
+    return payload_encode_impl().isa;
+}
+
+} // namespace logging
@@ -0,0 +1,242 @@
+#include "log_retention.h"
+#include <dirent.h>   // opendir readdir
+#include <fcntl.h>    // AT_SYMLINK_NOFOLLOW
+#include <stdio.h>    // remove
+#include <string.h>   // strncmp
+#include <sys/stat.h> // fstatat
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <vector>
+
+namespace logging {
+
+/**
+ * @brief LogRetention constructor
+ * @param[in] file_name Name of the active log file, rolled files are named
+ * "<file_name>.%Y%m%d%H%M%S_<index>"
+ * @param[in] policy Retention limits
+ */
+LogRetention::LogRetention(const std::string &file_name, const RetentionPolicy &policy)
+    : _policy(policy)
+    , _total_bytes(0)
+{
+    size_t slash = file_name.rfind('/');
+    if (std::string::npos == slash)
+    {
+        _dir    = ".";
+        _prefix = file_name + ".";
+    }
+    else
+    {
+        _dir    = (0 == slash) ? "/" : file_name.substr(0, slash);
+        _prefix = file_name.substr(slash + 1) + ".";
+    }
+}
+
+/**
+ * @brief Parse the "%Y%m%d%H%M%S_<index>" suffix of a rolled file name
+ * @param[out] stamp The 14 timestamp digits as a number, used for ordering
+ * @param[out] index The roll index
+ * @retval true if the suffix has the expected layout
+ */
+static bool
+parse_rolled_suffix (const char *suffix, uint64_t &stamp, uint32_t &index)
+{
+    stamp = 0;
+    for (int i = 0; i < 14; i++)
+    {
+        if ((suffix[i] < '0') || (suffix[i] > '9'))
+        {
+            return false;
+        }
+        stamp = stamp * 10 + (suffix[i] - '0');
+    }
+    if ('_' != suffix[14] || ('\0' == suffix[15]))
+    {
+        return false;
+    }
+
+    uint64_t value = 0;
+    for (const char *p = suffix + 15; '\0' != *p; p++)
+    {
+        if ((*p < '0') || (*p > '9') || (value > UINT32_MAX))
+        {
+            return false;
+        }
+        value = value * 10 + (*p - '0');
+    }
+    if (value > UINT32_MAX)
+    {
+        return false;
+    }
+    index = static_cast<uint32_t>(value);
+    return true;
+}
+
+/**
+ * @brief Scan the log directory for rolled files left by previous runs
+ * @return The index to use for the next rolled file, one past the largest
+ * index found
+ */
+uint32_t
+LogRetention::scan(void)
+{
+    struct Entry
+    {
+        uint64_t   stamp;
+        RolledFile file;
+    };
+
+    std::vector<Entry> entries;
+    uint32_t           next_index = 0;
+
+    DIR *dir = opendir(_dir.c_str());
+    if (NULL == dir)
+    {
+        std::cerr << "[LogRetention::scan] can not open directory " << _dir << std::endl;
+        return next_index;
+    }
+
+    int            dir_fd = dirfd(dir);
+    struct dirent *ent    = NULL;
+    while (NULL != (ent = readdir(dir)))
+    {
+        if (0 != strncmp(ent->d_name, _prefix.c_str(), _prefix.size()))
+        {
+            continue;
+        }
+        if ((DT_REG != ent->d_type) && (DT_UNKNOWN != ent->d_type))
+        {
+            continue;
+        }
+
+        Entry entry;
+        if (!parse_rolled_suffix(ent->d_name + _prefix.size(), entry.stamp, entry.file.index))
+        {
+            continue;
+        }
+
+        /* stat relative to the open directory, no path lookups */
+        struct stat st;
+        if ((0 != fstatat(dir_fd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW)) || !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+        entry.file.name      = (_dir == ".") ? std::string(ent->d_name) : (_dir + "/" + ent->d_name);
+        entry.file.size      = st.st_size;
+        entry.file.roll_time = st.st_mtime;
+
+        if (entry.file.index >= next_index)
+        {
+            next_index = entry.file.index + 1;
+        }
+        entries.push_back(std::move(entry));
+    }
+    closedir(dir);
+
+    /* Oldest first. The index breaks ties between files created in the same
+     * second. */
+    std::sort(entries.begin(), entries.end(), [] (const Entry &a, const Entry &b) {
+        if (a.stamp != b.stamp)
+        {
+            return a.stamp < b.stamp;
+        }
+        return a.file.index < b.file.index;
+    });
+
+    _files.clear();
+    _total_bytes = 0;
+    for (auto &entry : entries)
+    {
+        _total_bytes += entry.file.size;
+        _files.push_back(std::move(entry.file));
+    }
+
+    return next_index;
+}
+
+/**
+ * @brief Register a newly rolled file
+ * @param[in] name Path of the rolled file
+ * @param[in] index Roll index of the file
+ * @param[in] size File size in bytes
+ * @param[in] roll_time Time at which the file was rolled
+ */
+void
+LogRetention::add(const std::string &name, uint32_t index, uint64_t size, std::time_t roll_time)
+{
+    RolledFile file;
+    file.name      = name;
+    file.index     = index;
+    file.size      = size;
+    file.roll_time = roll_time;
+
+    _total_bytes += size;
+    _files.push_back(std::move(file));
+}
+
+/**
+ * @brief Whether the oldest file violates one of the limits
+ */
+bool
+LogRetention::over_limit(std::time_t now)
+{
+    if (_files.empty())
+    {
+        return false;
+    }
+    if ((0 != _policy.max_files) && (_files.size() > _policy.max_files))
+    {
+        return true;
+    }
+    if ((0 != _policy.max_total_bytes) && (_total_bytes > _policy.max_total_bytes))
+    {
+        return true;
+    }
+    if ((0 != _policy.max_age_minutes)
+        && (now - _files.front().roll_time) > static_cast<std::time_t>(_policy.max_age_minutes * SECONDS_PER_MINUTE))
+    {
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Whether more files are waiting to be removed
+ */
+bool
+LogRetention::pending(std::time_t now)
+{
+    return over_limit(now);
+}
+
+/**
+ * @brief Remove the oldest files until the policy is satisfied
+ * @param[in] now Current time
+ * @note At most MAX_REMOVE_PER_PASS files are removed per call so that a large
+ * backlog does not stall the caller, the rest is removed on the following
+ * calls.
+ * @return Number of files removed
+ */
+uint32_t
+LogRetention::enforce(std::time_t now)
+{
+    uint32_t removed = 0;
+
+    while ((removed < MAX_REMOVE_PER_PASS) && over_limit(now))
+    {
+        RolledFile &oldest = _files.front();
+        if ((0 != ::remove(oldest.name.c_str())) && (ENOENT != errno))
+        {
+            std::cerr << "[LogRetention::enforce] failed to remove " << oldest.name << std::endl;
+        }
+        _total_bytes -= oldest.size;
+        _files.pop_front();
+        removed++;
+    }
+
+    return removed;
+}
+
+} // namespace logging
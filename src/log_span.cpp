@@ -0,0 +1,156 @@
+#include "log_span.h"
+#include <string.h>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define LOGGING_LOG_SPAN_X86 1
+#endif
+
+namespace logging {
+
+/* Length of the counter frequency measurement */
+static const uint64_t CALIBRATION_NS = 2000000;
+
+static uint64_t
+steady_ns (void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+SpanClock::SpanClock(void)
+    : _tsc(false)
+    , _ns_per_tick(1.0)
+{
+#ifdef LOGGING_LOG_SPAN_X86
+    /* Leaf 0x80000007, EDX bit 8: the TSC runs at a constant rate in every
+     * power state and is synchronized between the cores */
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8)))
+    {
+        return;
+    }
+
+    uint64_t begin_ns    = steady_ns();
+    uint64_t begin_ticks = __builtin_ia32_rdtsc();
+    uint64_t end_ns      = begin_ns;
+    while (end_ns - begin_ns < CALIBRATION_NS)
+    {
+        end_ns = steady_ns();
+    }
+    uint64_t end_ticks = __builtin_ia32_rdtsc();
+    if (end_ticks > begin_ticks)
+    {
+        _ns_per_tick = static_cast<double>(end_ns - begin_ns) / (end_ticks - begin_ticks);
+        _tsc         = true;
+    }
+#endif
+}
+
+/**
+ * @brief The span clock, set up at first use
+ */
+const SpanClock &
+span_clock (void)
+{
+    static const SpanClock clock;
+    return clock;
+}
+
+/**
+ * @brief Parse the decimal number at p
+ */
+static bool
+parse_number (const char *p, const char *end, uint64_t &value)
+{
+    value = 0;
+    if ((p >= end) || (*p < '0') || (*p > '9'))
+    {
+        return false;
+    }
+    while ((p < end) && (*p >= '0') && (*p <= '9'))
+    {
+        value = value * 10 + static_cast<uint64_t>(*p - '0');
+        p++;
+    }
+    return true;
+}
+
+/**
+ * @brief Collect the span records of a piece of data holding whole records,
+ * e.g. a file or a container block
+ * @param[in] data Data source address
+ * @param[in] size Data size
+ */
+void
+SpanSummary::scan(const char *data, size_t size)
+{
+    static const char SPAN_KEY[] = "] span=";
+    static const char NS_KEY[]   = " ns=";
+
+    const char *end = data + size;
+    const char *p   = data;
+    while (p < end)
+    {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        eol             = (nullptr == eol) ? end : eol;
+
+        const char *key = static_cast<const char *>(memmem(p, eol - p, SPAN_KEY, sizeof(SPAN_KEY) - 1));
+        if (nullptr != key)
+        {
+            const char *name = key + sizeof(SPAN_KEY) - 1;
+            const char *ns   = static_cast<const char *>(memmem(name, eol - name, NS_KEY, sizeof(NS_KEY) - 1));
+            uint64_t    duration;
+            if ((nullptr != ns) && (ns > name) && parse_number(ns + sizeof(NS_KEY) - 1, eol, duration))
+            {
+                _durations[std::string(name, ns - name)].push_back(duration);
+                _records++;
+            }
+        }
+        p = eol + 1;
+    }
+}
+
+/**
+ * @brief The distributions, by total time, largest first
+ * @retval The statistics, the summary starts over afterwards
+ */
+std::vector<SpanStats>
+SpanSummary::finish(void)
+{
+    std::vector<SpanStats> result;
+    for (auto &item : _durations)
+    {
+        std::vector<uint64_t> &durations = item.second;
+        std::sort(durations.begin(), durations.end());
+
+        SpanStats stats;
+        stats.name     = item.first;
+        stats.count    = durations.size();
+        stats.total_ns = 0;
+        for (uint64_t ns : durations)
+        {
+            stats.total_ns += ns;
+            size_t bucket = (0 == ns) ? 0 : 63 - __builtin_clzll(ns);
+            if (stats.histogram.size() <= bucket)
+            {
+                stats.histogram.resize(bucket + 1, 0);
+            }
+            stats.histogram[bucket]++;
+        }
+        stats.min_ns = durations.front();
+        stats.max_ns = durations.back();
+        stats.p50_ns = durations[(stats.count - 1) * 50 / 100];
+        stats.p90_ns = durations[(stats.count - 1) * 90 / 100];
+        stats.p99_ns = durations[(stats.count - 1) * 99 / 100];
+        result.push_back(std::move(stats));
+    }
+    std::sort(result.begin(), result.end(),
+              [] (const SpanStats &a, const SpanStats &b) { return a.total_ns > b.total_ns; });
+
+    _durations.clear();
+    _records = 0;
+    return result;
+}
+
+} // namespace logging
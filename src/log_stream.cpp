@@ -1,31 +1,72 @@
 #include "log_stream.h"
+#include <stdio.h> // vsnprintf
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <new>
 #include <streambuf>
-#include "fast_memcpy.h"
 
 namespace logging {
+
+const char LogStream::TRUNCATED_MARK[] = " ...[truncated]\n";
+const int  LogStream::MAX_PIECES;
+
+std::atomic<size_t> LogStream::_max_bytes(LogStream::DEFAULT_MAX_BYTES);
+std::atomic<size_t> LogStream::_retain_bytes(LogStream::DEFAULT_RETAIN_BYTES);
+std::atomic<size_t> LogStream::_total_bytes(0);
+std::atomic<size_t> LogStream::_num_streams(0);
+std::atomic<size_t> LogStream::_peak_stream_bytes(0);
+
+/**
+ * @brief Raise the peak stream size to a new capacity
+ */
+static void
+note_peak (std::atomic<size_t> &peak, size_t capacity)
+{
+    size_t cur = peak.load(std::memory_order_relaxed);
+    while ((capacity > cur) && !peak.compare_exchange_weak(cur, capacity, std::memory_order_relaxed))
+    {
+    }
+}
+
 /**
  * @brief LogStream constructor
- * @param[in] buffer_size Output stream internal buffer size
+ * @param[in] buffer_size Size of the first chunk of the buffer, kept for the
+ * lifetime of the stream
  * @param[in] output_func Set the output interface. When the buffer is flushed,
  * this interface will be called to implement data output.
+ * @param[in] gather_func Output interface for records spread over several
+ * chunks, receives all the pieces in one call. If not set, output_func is
+ * called once per chunk.
  */
-LogStream::LogStream(size_t buffer_size, std::function<void(const char *, size_t)> output_func)
+LogStream::LogStream(size_t buffer_size, OutputFunc output_func, GatherOutputFunc gather_func)
     : std::ostream(this)
+    , _num_chunks(0)
+    , _cur_chunk(-1)
+    , _capacity(0)
+    , _truncated(false)
+    , _output_func(output_func)
+    , _gather_func(gather_func)
 {
+    _num_streams.fetch_add(1, std::memory_order_relaxed);
+
     // 设置 streambuf
-    _buffer = new (std::nothrow) char[buffer_size];
-    if (nullptr == _buffer)
+    char *buffer = new (std::nothrow) char[buffer_size];
+    if (nullptr == buffer)
     {
         setp(nullptr, nullptr);
-        _size = 0;
     }
     else
     {
-        _size = buffer_size;
-        setp(_buffer, _buffer + _size);
+        _chunks[0].data = buffer;
+        _chunks[0].size = buffer_size;
+        _num_chunks     = 1;
+        _cur_chunk      = 0;
+        _capacity       = buffer_size;
+        _total_bytes.fetch_add(buffer_size, std::memory_order_relaxed);
+        note_peak(_peak_stream_bytes, _capacity);
+        setp(buffer, buffer + buffer_size);
     }
-    _output_func = output_func;
 }
 
 /**
@@ -33,13 +74,67 @@ LogStream::LogStream(size_t buffer_size, std::function<void(const char *, size_t
  */
 LogStream::~LogStream(void)
 {
-    /* FIXME: Manage with smart pointer */
-    delete[] _buffer;
+    for (int i = 0; i < _num_chunks; i++)
+    {
+        delete[] _chunks[i].data;
+    }
+    _total_bytes.fetch_sub(_capacity, std::memory_order_relaxed);
+    _num_streams.fetch_sub(1, std::memory_order_relaxed);
+    _num_chunks = 0;
+    _capacity   = 0;
     // reset pointer
-    _buffer = nullptr;
     setp(nullptr, nullptr);
 }
 
+/**
+ * @brief Make the next chunk current, allocating it if needed
+ * @retval false if the maximum size is reached
+ */
+bool
+LogStream::next_chunk(void)
+{
+    /* A chunk kept from an earlier record */
+    if (_cur_chunk + 1 < _num_chunks)
+    {
+        _cur_chunk++;
+        setp(_chunks[_cur_chunk].data, _chunks[_cur_chunk].data + _chunks[_cur_chunk].size);
+        return true;
+    }
+
+    if (MAX_CHUNKS == _num_chunks)
+    {
+        return false;
+    }
+
+    /* Double the buffer without moving what has been written */
+    size_t size      = (_capacity > 0) ? _capacity : 256;
+    size_t max_bytes = _max_bytes.load(std::memory_order_relaxed);
+    if (0 != max_bytes)
+    {
+        if (_capacity >= max_bytes)
+        {
+            return false;
+        }
+        size = std::min(size, max_bytes - _capacity);
+    }
+
+    char *data = new (std::nothrow) char[size];
+    if (nullptr == data)
+    {
+        std::cerr << "[LogStream::next_chunk] Failed to expand buffer" << std::endl;
+        return false;
+    }
+    _chunks[_num_chunks].data = data;
+    _chunks[_num_chunks].size = size;
+    _cur_chunk                = _num_chunks++;
+    _capacity += size;
+    _total_bytes.fetch_add(size, std::memory_order_relaxed);
+    note_peak(_peak_stream_bytes, _capacity);
+
+    setp(data, data + size);
+    return true;
+}
+
 /**
  * @brief The sputc() and sputn() call this function in case of an overflow
  * (pptr() == nullptr or pptr() >= epptr()).
@@ -48,42 +143,149 @@ LogStream::~LogStream(void)
 std::streambuf::int_type
 LogStream::overflow(std::streambuf::int_type c)
 {
-    // std::cerr << "overflow" << std::endl;
-    /* The currently used streambuf is not enough, expand the buffer */
-    size_t new_size   = (_size + 1) * 3 / 2;
-    char  *new_buffer = new (std::nothrow) char[new_size];
-    if (nullptr == new_buffer)
-    {
-        delete[] _buffer;
-        _buffer = nullptr;
-        setp(NULL, NULL);
-        std::cerr << "[LogStream::overflow] Failed to expand buffer" << std::endl;
+    if (std::streambuf::traits_type::eq_int_type(c, std::streambuf::traits_type::eof()))
+    {
+        return std::streambuf::traits_type::not_eof(c);
+    }
+
+    /* The current chunk is full, continue in the next one. Past the maximum
+     * size the rest of the record is dropped. */
+    if (_truncated || !next_chunk())
+    {
+        _truncated = true;
         return std::streambuf::traits_type::eof();
     }
-    /* Copy data to new buffer */
-    memcpy_fast(new_buffer, _buffer, _size);
-    delete[] _buffer;
-    _buffer = new_buffer;
 
-    /* Set the data range of the new buffer */
-    setp(_buffer, _buffer + new_size);
-    // reset put pointer
-    pbump(_size);
-    _size = new_size;
+    *pptr() = std::streambuf::traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
 
-    /* The overflowed character is written to the new buffer. */
-    return sputc(c);
+/**
+ * @brief Bytes of the current record written so far
+ */
+size_t
+LogStream::size(void) const
+{
+    size_t size = pptr() - pbase();
+    for (int i = 0; i < _cur_chunk; i++)
+    {
+        size += _chunks[i].size;
+    }
+    return size;
 }
 
 /**
- * @brief Flush the buffer and output the data in the buffer to a file or device
+ * @brief printf-style output, formatted straight into the current chunk. Only
+ * output that does not fit is formatted again into a temporary buffer and
+ * then stored like any other, so it may spread over new chunks and is cut off
+ * at the maximum size.
+ * @param [in] fmt : printf format
+ * @param [in] args : Arguments of the format
+ */
+void
+LogStream::vformat(const char *fmt, va_list args)
+{
+    if (_truncated)
+    {
+        return;
+    }
+
+    va_list retry;
+    va_copy(retry, args);
+    size_t space = epptr() - pptr();
+    int    size  = vsnprintf(pptr(), space, fmt, args);
+    if ((size >= 0) && (static_cast<size_t>(size) < space))
+    {
+        pbump(size);
+    }
+    else if (size > 0)
+    {
+        /* The chunk holds a cut off copy ending in a null, which is written
+         * over by the full one */
+        char                    stack_buffer[512];
+        std::unique_ptr<char[]> heap_buffer;
+        char                   *buffer = stack_buffer;
+        if (static_cast<size_t>(size) >= sizeof(stack_buffer))
+        {
+            heap_buffer.reset(new (std::nothrow) char[size + 1]);
+            buffer = heap_buffer.get();
+        }
+        if (nullptr != buffer)
+        {
+            vsnprintf(buffer, size + 1, fmt, retry);
+            sputn(buffer, size);
+        }
+        else
+        {
+            std::cerr << "[LogStream::vformat] can not allocate " << size + 1 << " bytes" << std::endl;
+        }
+    }
+    va_end(retry);
+}
+
+/**
+ * @brief Flush the buffer and output the data in the buffer to a file or
+ * device, then reset the buffer and release the chunks beyond the retain size
  */
 void
 LogStream::flush_data(void)
 {
-    if (pbase() != pptr() && (nullptr != _output_func))
+    struct iovec pieces[MAX_PIECES];
+    int          num_pieces = 0;
+
+    for (int i = 0; i <= _cur_chunk; i++)
+    {
+        /* Only the current chunk may be partly filled */
+        size_t len = (i == _cur_chunk) ? static_cast<size_t>(pptr() - pbase()) : _chunks[i].size;
+        if (len > 0)
+        {
+            pieces[num_pieces].iov_base = _chunks[i].data;
+            pieces[num_pieces].iov_len  = len;
+            num_pieces++;
+        }
+    }
+    if (_truncated && (num_pieces > 0))
+    {
+        pieces[num_pieces].iov_base = const_cast<char *>(TRUNCATED_MARK);
+        pieces[num_pieces].iov_len  = sizeof(TRUNCATED_MARK) - 1;
+        num_pieces++;
+    }
+
+    if ((1 == num_pieces) && (nullptr != _output_func))
+    {
+        _output_func(static_cast<const char *>(pieces[0].iov_base), pieces[0].iov_len);
+    }
+    else if ((num_pieces > 1) && (nullptr != _gather_func))
+    {
+        _gather_func(pieces, num_pieces);
+    }
+    else if (nullptr != _output_func)
+    {
+        for (int i = 0; i < num_pieces; i++)
+        {
+            _output_func(static_cast<const char *>(pieces[i].iov_base), pieces[i].iov_len);
+        }
+    }
+
+    reset_buffer();
+}
+
+/**
+ * @brief Release the chunks beyond the retain size
+ */
+void
+LogStream::shrink(void)
+{
+    size_t retain_bytes = _retain_bytes.load(std::memory_order_relaxed);
+    while ((_num_chunks > 1) && (_capacity > retain_bytes))
     {
-        _output_func(pbase(), pptr() - pbase());
+        Chunk &chunk = _chunks[--_num_chunks];
+        _capacity -= chunk.size;
+        _total_bytes.fetch_sub(chunk.size, std::memory_order_relaxed);
+        delete[] chunk.data;
+        chunk.data = nullptr;
+        chunk.size = 0;
     }
 }
 
@@ -93,15 +295,55 @@ LogStream::flush_data(void)
 void
 LogStream::reset_buffer(void)
 {
-    if (nullptr == _buffer)
+    if (_cur_chunk > 0)
     {
+        shrink();
+    }
+
+    if (0 == _num_chunks)
+    {
+        _cur_chunk = -1;
         setp(nullptr, nullptr);
-        _size = 0;
     }
     else
     {
-        setp(_buffer, _buffer + _size);
+        _cur_chunk = 0;
+        setp(_chunks[0].data, _chunks[0].data + _chunks[0].size);
+    }
+
+    /* A truncated record leaves the stream in the bad state */
+    _truncated = false;
+    if (!good())
+    {
+        clear();
     }
 }
 
-} // namespace logging
\ No newline at end of file
+/**
+ * @brief Set the limits applied to the streams of all threads
+ * @param[in] max_bytes Maximum buffer size of a stream, data beyond it is cut
+ * off. 0 means no limit.
+ * @param[in] retain_bytes Buffer size a stream keeps after a record, the
+ * chunks beyond it are released. The first chunk is always kept.
+ */
+void
+LogStream::set_limits(size_t max_bytes, size_t retain_bytes)
+{
+    _max_bytes.store(max_bytes, std::memory_order_relaxed);
+    _retain_bytes.store(retain_bytes, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Memory held by the streams of all threads
+ */
+LogStreamMemory
+LogStream::memory(void)
+{
+    LogStreamMemory mem;
+    mem.streams           = _num_streams.load(std::memory_order_relaxed);
+    mem.total_bytes       = _total_bytes.load(std::memory_order_relaxed);
+    mem.peak_stream_bytes = _peak_stream_bytes.load(std::memory_order_relaxed);
+    return mem;
+}
+
+} // namespace logging
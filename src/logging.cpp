@@ -1,29 +1,160 @@
 #include "logging.h"
+#include <pthread.h> // pthread_atfork
+#include <signal.h>  // sigaction
+#include <stdarg.h>  // va_list
+#include <stdio.h>   // snprintf
 #include <sys/time.h>
+#include <unistd.h>  // getpid
+#include <string.h> // strlen, memcpy
+#include <algorithm>
 #include <functional>
 #include <ios> // std::streamsize
 #include <iostream>
 #include <sstream>
+#include <fstream>
 #include <iomanip>
+#include <mutex>
+#include <new>
 #include "async_logging.h"
 #include "fast_memcpy.h"
+#include "log_config.h"
+#include "log_epoch.h"
+#include "shm_ring.h"
+#include "socket_sink.h"
 
 namespace logging {
 
 void async_output(const char *data, size_t size);
+void async_outputv(const struct iovec *pieces, int num_pieces);
+static void restart_after_fork(void);
 
-/* Global log level */
-LogLevel     _global_log_level = LOG_INNER_DEBUG;
-AsyncLogging _global_async_logging;
-bool         _global_use_ms_precision = false; // By default, seconds precision is used
-bool         _global_show_path = false;
-bool         _global_show_func = false;
+/**
+ * @brief The part of the configuration read while a record is built. A
+ * published snapshot is never modified, log_reconfigure publishes a new one.
+ */
+struct RecordConfig
+{
+    bool     use_ms_precision = false; // By default, seconds precision is used
+    bool     show_path        = false;
+    bool     show_func        = false;
+    bool     show_context     = false;
+    KvFormat kv_format        = KV_FORMAT_JSON;
+    /* Records at or above this level take the priority lane */
+    LogLevel priority_level   = LOG_WARNING;
+    /* Records below this level go to the flight recorder */
+    LogLevel write_level      = LOG_INNER_DEBUG;
+    /* Records at or above this level dump the flight recorder */
+    LogLevel flight_trigger_level = NUM_LOG_LEVELS;
+};
+
+/* Global log level, the lowest level captured by the flight recorder while
+ * it is on */
+std::atomic<LogLevel> _global_log_level(LOG_INNER_DEBUG);
+/* Defined before the logger, which writes its dumps until it is destroyed */
+FlightRecorder        _global_flight_recorder;
+/* Writer of a shared ring (LogControl::shm_writer_file), defined before the
+ * logger so that it drains the last records the logger hands to the ring */
+ShmRingWriter         _global_shm_writer;
+AsyncLogging          _global_async_logging;
+
+/* Current record configuration, read under _global_config_epoch */
+const RecordConfig                _default_record_config;
+std::atomic<const RecordConfig *> _global_record_config(&_default_record_config);
+EpochDomain                       _global_config_epoch;
+
+/* Serializes log_init, log_reconfigure and fork against each other */
+std::mutex _global_config_lock;
+/* Configuration in effect, also used to set up forked children */
+LogContorl _global_log_control;
+/* Set by the fork child handler, the child restarts the logger before it
+ * writes its first record (restart_after_fork) */
+std::atomic<bool> _global_fork_restart(false);
+std::mutex        _global_fork_restart_lock;
+/* Watches the file given to log_watch_config, stopped before the logger is
+ * destroyed */
+ConfigWatcher _global_config_watcher;
 
 
 /* Use thread local variables, multi-thread safe */
 thread_local std::time_t global_last_second = 0;
 thread_local char        global_time_str[32]  = {0};
-thread_local LogStream   global_log_stream(256, async_output);
+/* Time of the record being built, microseconds since epoch, 0 if unknown */
+thread_local uint64_t    global_record_time_us = 0;
+/* Whether the record being built takes the priority lane */
+thread_local bool        global_record_urgent = false;
+/* Whether the record being built goes to the flight recorder, or dumps it */
+thread_local bool        global_record_flight  = false;
+thread_local bool        global_record_trigger = false;
+/* Where the time stamp lies in the record being built, both 0 if it has none */
+thread_local size_t      global_record_time_begin = 0;
+thread_local size_t      global_record_time_end   = 0;
+thread_local LogStream   global_log_stream(256, async_output, async_outputv);
+/* Payload of the record being written by log_payload */
+thread_local Payload    *global_record_payload = nullptr;
+/* Innermost open ScopedSpan of the thread */
+thread_local ScopedSpan *global_span_top = nullptr;
+
+/**
+ * @brief The reader slot of a thread in _global_config_epoch, given back when
+ * the thread exits
+ */
+struct ConfigReaderSlot
+{
+    ~ConfigReaderSlot(void)
+    {
+        if (nullptr != slot)
+        {
+            _global_config_epoch.release_slot(slot);
+        }
+    }
+
+    EpochDomain::Slot *slot = nullptr;
+};
+thread_local ConfigReaderSlot global_config_slot;
+
+/**
+ * @brief Consistent view of the record configuration for the lifetime of the
+ * object, without locking
+ */
+class RecordConfigSnapshot
+{
+public:
+    RecordConfigSnapshot(void)
+    {
+        _slot = global_config_slot.slot;
+        if (nullptr == _slot)
+        {
+            _slot = global_config_slot.slot = _global_config_epoch.acquire_slot();
+        }
+        if (nullptr != _slot)
+        {
+            _global_config_epoch.read_lock(_slot);
+            _config = _global_record_config.load(std::memory_order_acquire);
+        }
+        else
+        {
+            /* Out of memory for a slot, the defaults are never reclaimed */
+            _config = &_default_record_config;
+        }
+    }
+
+    ~RecordConfigSnapshot(void)
+    {
+        if (nullptr != _slot)
+        {
+            _global_config_epoch.read_unlock(_slot);
+        }
+    }
+
+    const RecordConfig *operator-> (void) const
+    {
+        return _config;
+    }
+
+private:
+    EpochDomain::Slot  *_slot;
+    const RecordConfig *_config;
+};
 
 const char *LogLevelName[NUM_LOG_LEVELS] = {
     "IDEBUG:",
@@ -33,6 +164,33 @@ const char *LogLevelName[NUM_LOG_LEVELS] = {
     "ERROR: ",
 };
 
+/* Level names used by structured records */
+const char *LogLevelKey[NUM_LOG_LEVELS] = {
+    "idebug",
+    "debug",
+    "info",
+    "warn",
+    "error",
+};
+
+/**
+ * @brief Returns the "%Y-%m-%d %H:%M:%S" representation of now, the string is
+ * cached per thread and only re-rendered when the second changes.
+ */
+static const char *
+cached_time_str (std::chrono::system_clock::time_point now)
+{
+    auto time_t_now = std::chrono::system_clock::to_time_t(now);
+    if (time_t_now != global_last_second) {
+        global_last_second = time_t_now;
+        std::tm tm_data;
+
+        localtime_r(&time_t_now, &tm_data);
+        std::strftime(global_time_str, sizeof(global_time_str), "%Y-%m-%d %H:%M:%S", &tm_data);
+    }
+    return global_time_str;
+}
+
 /**
  * @brief Logger constructor, each message instantiates a logger
  * @param [in] level : The current level of this log message
@@ -44,40 +202,49 @@ const char *LogLevelName[NUM_LOG_LEVELS] = {
 Logger::Logger(const LogLevel level, const char *file, const char *func_name, const size_t line, bool show_header)
 {
 
+    RecordConfigSnapshot config;
+
     _stream = &global_log_stream;
     _stream->reset_buffer();
+    global_record_urgent     = (level >= config->priority_level);
+    global_record_flight     = (level < config->write_level);
+    global_record_trigger    = (level >= config->flight_trigger_level);
+    global_record_time_begin = 0;
+    global_record_time_end   = 0;
 
     if (show_header)
     {
         (*_stream) << LogLevelName[level] << "[ ";
         auto now = std::chrono::system_clock::now();
-        auto time_t_now = std::chrono::system_clock::to_time_t(now);
-        if (time_t_now != global_last_second) {
-            global_last_second = time_t_now;
-            std::tm tm_data;
-
-            localtime_r(&time_t_now, &tm_data);
-            std::strftime(global_time_str, sizeof(global_time_str), "%Y-%m-%d %H:%M:%S", &tm_data);
-        }
-        (*_stream) << global_time_str;
+        global_record_time_us
+            = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+        global_record_time_begin = _stream->size();
+        (*_stream) << cached_time_str(now);
 
-        if (_global_use_ms_precision)
+        if (config->use_ms_precision)
         {
             auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
             std::ostringstream oss;
             oss << '.' << std::setfill('0') << std::setw(3) << ms.count();
             (*_stream) << oss.str();
         }
+        global_record_time_end = _stream->size();
 
-        if (_global_show_path)
+        if (config->show_path)
         {
             (*_stream) << " " << file << ":" << line;
         }
 
-        if (_global_show_func)
+        if (config->show_func)
         {
             (*_stream) << " " << func_name;
         }
+
+        if (config->show_context)
+        {
+            const std::string &context = log_context_rendered(KV_FORMAT_LOGFMT);
+            _stream->sputn(context.data(), context.size());
+        }
         (*_stream) << " ] ";
     }
 }
@@ -94,12 +261,368 @@ Logger::~Logger()
     }
 }
 
+/**
+ * @brief printf-style output into the streaming buffer, used by LOGF. The
+ * format is checked by the compiler.
+ * @retval The streaming buffer, for more output to the record
+ */
+LogStream &
+Logger::format(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    _stream->vformat(fmt, args);
+    va_end(args);
+    return *_stream;
+}
+
+/**
+ * @brief Write a structured record, used by LOG_KV.
+ * @note The header options (use_ms, show_path, show_func) select which of the
+ * time, file/line and func fields are emitted.
+ */
+void
+log_kv_record (const LogLevel level, const char *file, const char *func_name, const size_t line,
+               const char *msg, const KvField *fields, size_t num_fields)
+{
+    RecordConfigSnapshot config;
+    LogStream           &stream = global_log_stream;
+    KvFormat             format = config->kv_format;
+    bool                 json   = (KV_FORMAT_JSON == format);
+
+    stream.reset_buffer();
+    global_record_urgent  = (level >= config->priority_level);
+    global_record_flight  = (level < config->write_level);
+    global_record_trigger = (level >= config->flight_trigger_level);
+
+    auto        now      = std::chrono::system_clock::now();
+    const char *time_str = cached_time_str(now);
+    global_record_time_us = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+    char        time_buf[40];
+    size_t      time_len = strlen(time_str);
+    memcpy(time_buf, time_str, time_len);
+    if (config->use_ms_precision)
+    {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+        time_buf[time_len++] = '.';
+        time_buf[time_len++] = static_cast<char>('0' + ms / 100);
+        time_buf[time_len++] = static_cast<char>('0' + (ms / 10) % 10);
+        time_buf[time_len++] = static_cast<char>('0' + ms % 10);
+    }
+
+    const char *level_key = LogLevelKey[level];
+    if (json)
+    {
+        stream.sputn("{\"level\":\"", 10);
+        stream.sputn(level_key, strlen(level_key));
+        stream.sputn("\",\"time\":", 9);
+        global_record_time_begin = stream.size();
+        KvEncoder::json_string(stream, time_buf, time_len);
+    }
+    else
+    {
+        stream.sputn("level=", 6);
+        stream.sputn(level_key, strlen(level_key));
+        stream.sputn(" time=", 6);
+        global_record_time_begin = stream.size();
+        KvEncoder::logfmt_string(stream, time_buf, time_len);
+    }
+    global_record_time_end = stream.size();
+
+    if (config->show_path)
+    {
+        KvEncoder::field(stream, kv("file", file), format);
+        KvEncoder::field(stream, kv("line", static_cast<unsigned long long>(line)), format);
+    }
+    if (config->show_func)
+    {
+        KvEncoder::field(stream, kv("func", func_name), format);
+    }
+    if (config->show_context)
+    {
+        const std::string &context = log_context_rendered(format);
+        stream.sputn(context.data(), context.size());
+    }
+    KvEncoder::field(stream, kv("msg", msg), format);
+
+    for (size_t i = 0; i < num_fields; i++)
+    {
+        KvEncoder::field(stream, fields[i], format);
+    }
+
+    if (json)
+    {
+        stream.sputn("}\n", 2);
+    }
+    else
+    {
+        stream.sputc('\n');
+    }
+    stream.flush_data();
+}
+
+/**
+ * @brief Write a record whose body is a caller buffer, used by LOG_PAYLOAD.
+ * The record is "<header> <msg> <payload>\n" (the payload on lines of its
+ * own if it is encoded as such), the payload is handed over to
+ * the background thread, which writes it in place (encoded if asked to) and
+ * then calls release. Payloads up to PAYLOAD_INLINE_BYTES and records that
+ * are not queued (below the level, flight recorder, logger not running) have
+ * the payload copied and released here.
+ */
+void
+log_payload (bool enabled, const LogLevel level, const char *file, const char *func_name, const size_t line,
+             const char *msg, const void *data, size_t size, PayloadEncoding encoding, PayloadRelease release)
+{
+    Payload payload = {static_cast<const char *>(data), size, encoding, std::move(release)};
+    if (enabled)
+    {
+        Logger     logger(level, file, func_name, line);
+        LogStream &stream = logger.stream();
+        stream.sputn(msg, strlen(msg));
+        stream.sputc(payload_multiline(encoding) ? '\n' : ' ');
+        global_record_payload = &payload;
+    }
+    /* Taken by the output of the record unless it was dropped */
+    global_record_payload = nullptr;
+    release_payload(payload);
+}
+
+/* Hex dump lines formatted at a time by log_hexdump */
+static const size_t HEXDUMP_BLOCK_LINES = 32;
+
+/**
+ * @brief Write a hex dump record, used by LOG_HEXDUMP. The lines are
+ * formatted straight into the record buffer, so the record size limit
+ * (record_max_kbytes) applies.
+ */
+void
+log_hexdump (const LogLevel level, const char *file, const char *func_name, const size_t line, const void *data,
+             size_t size)
+{
+    Logger      logger(level, file, func_name, line);
+    LogStream  &stream = logger.stream();
+    const char *p      = static_cast<const char *>(data);
+    stream << "hexdump " << size << " bytes\n";
+
+    size_t offset = 0;
+    while ((offset < size) && !stream.truncated())
+    {
+        size_t n   = std::min(size - offset, HEXDUMP_BLOCK_LINES * HEXDUMP_BYTES_PER_LINE);
+        char  *out = stream.reserve(hexdump_size(n));
+        if (nullptr != out)
+        {
+            stream.commit(hexdump_format(p + offset, n, offset, out));
+        }
+        else
+        {
+            /* Not enough room left in the chunk, stored across chunks */
+            char block[HEXDUMP_BLOCK_LINES * HEXDUMP_LINE_SIZE];
+            stream.sputn(block, hexdump_format(p + offset, n, offset, block));
+        }
+        offset += n;
+    }
+}
+
+/**
+ * @brief Write the same record as log_hexdump, used by LOG_HEXDUMP_DEFERRED:
+ * the bytes are copied and the lines are formatted by the background thread
+ * (a PAYLOAD_HEXDUMP payload), without the record size limit
+ */
+void
+log_hexdump_deferred (const LogLevel level, const char *file, const char *func_name, const size_t line,
+                      const void *data, size_t size)
+{
+    char *copy = new (std::nothrow) char[size];
+    if (nullptr == copy)
+    {
+        std::cerr << "[log_hexdump_deferred] can not allocate " << size << " bytes" << std::endl;
+        return;
+    }
+    memcpy(copy, data, size);
+    char msg[48];
+    snprintf(msg, sizeof(msg), "hexdump %zu bytes", size);
+    log_payload(true, level, file, func_name, line, msg, copy, size, PAYLOAD_HEXDUMP, payload_release_delete());
+}
+
+/* Enclosing spans named in a span record, deeper ones keep the innermost */
+static const size_t MAX_SPAN_PATH = 16;
+
+/**
+ * @brief Start timing, the span becomes the innermost one of the thread
+ */
+void
+ScopedSpan::begin(const LogLevel level, const char *name, uint64_t min_us, const char *file, const char *func_name,
+                  const size_t line)
+{
+    const SpanClock &clock = span_clock();
+    _name                  = name;
+    _file                  = file;
+    _func_name             = func_name;
+    _line                  = line;
+    _level                 = level;
+    _parent                = global_span_top;
+    _depth                 = (nullptr != _parent) ? _parent->_depth + 1 : 0;
+    _min_ticks             = (0 != min_us) ? clock.from_ns(min_us * 1000) : 0;
+    global_span_top        = this;
+    _start                 = clock.now();
+}
+
+/**
+ * @brief Write the span record, unless the span was shorter than its
+ * threshold. Only the clock is read for those.
+ */
+void
+ScopedSpan::end(void)
+{
+    const SpanClock &clock   = span_clock();
+    uint64_t         elapsed = clock.now() - _start;
+    global_span_top          = _parent;
+    if (elapsed < _min_ticks)
+    {
+        return;
+    }
+
+    const char *names[MAX_SPAN_PATH];
+    size_t      num_names = 0;
+    for (const ScopedSpan *span = this; (nullptr != span) && (num_names < MAX_SPAN_PATH); span = span->_parent)
+    {
+        names[num_names++] = span->_name;
+    }
+
+    Logger     logger(_level, _file, _func_name, _line);
+    LogStream &stream = logger.stream();
+    stream.sputn("span=", 5);
+    for (size_t i = num_names; i > 0; i--)
+    {
+        stream.sputn(names[i - 1], strlen(names[i - 1]));
+        if (i > 1)
+        {
+            stream.sputc('/');
+        }
+    }
+    stream.sputn(" ns=", 4);
+    KvEncoder::uint_value(stream, clock.to_ns(elapsed));
+    stream.sputn(" depth=", 7);
+    KvEncoder::uint_value(stream, _depth);
+    stream.sputc('\n');
+}
+
+/**
+ * @brief Restart the logger first if this is a forked child that has not yet
+ * done so
+ */
+static inline void
+check_fork_restart (void)
+{
+    if (_global_fork_restart.load(std::memory_order_acquire))
+    {
+        restart_after_fork();
+    }
+}
+
+/**
+ * @brief Hand a record below the log level to the flight recorder
+ */
+static void
+flight_output (const struct iovec *pieces, int num_pieces)
+{
+    _global_flight_recorder.append(pieces, num_pieces);
+    global_record_flight     = false;
+    global_record_time_us    = 0;
+    global_record_urgent     = false;
+    global_record_trigger    = false;
+    global_record_time_begin = 0;
+    global_record_time_end   = 0;
+}
+
+/**
+ * @brief Request a flight recorder dump if the record just written triggers
+ * one
+ */
+static void
+flight_trigger (void)
+{
+    if (global_record_trigger)
+    {
+        _global_async_logging.request_flight_dump(FlightRecorder::TRIGGER_RECORD);
+        global_record_trigger = false;
+    }
+}
+
+/**
+ * @brief Output of a log_payload record: the header pieces go to the logger
+ * with the payload, or are output as a record together with a copy of it
+ * (small payloads, flight recorder, logger not running)
+ */
+static void
+payload_output (const struct iovec *pieces, int num_pieces)
+{
+    Payload &payload      = *global_record_payload;
+    global_record_payload = nullptr;
+    if ((payload.size > PAYLOAD_INLINE_BYTES) && !global_record_flight && _global_async_logging.is_running())
+    {
+        _global_async_logging.append_payload(pieces, num_pieces, std::move(payload), global_record_time_us,
+                                             global_record_urgent, global_record_time_begin, global_record_time_end);
+        flight_trigger();
+        global_record_time_us    = 0;
+        global_record_urgent     = false;
+        global_record_time_begin = 0;
+        global_record_time_end   = 0;
+        return;
+    }
+
+    char                    stack_body[4096];
+    std::unique_ptr<char[]> heap_body;
+    char                   *body      = stack_body;
+    size_t                  body_size = payload_encoded_size(payload.size, payload.encoding) + 1;
+    if (body_size > sizeof(stack_body))
+    {
+        heap_body.reset(new (std::nothrow) char[body_size]);
+        body = heap_body.get();
+        if (nullptr == body)
+        {
+            return;
+        }
+    }
+    body_size = payload_encode(payload.data, payload.size, payload.encoding, body);
+    if (!payload_multiline(payload.encoding))
+    {
+        body[body_size++] = '\n';
+    }
+    struct iovec record[LogStream::MAX_PIECES + 1];
+    int          num_record = std::min(num_pieces, LogStream::MAX_PIECES);
+    std::copy(pieces, pieces + num_record, record);
+    record[num_record].iov_base = body;
+    record[num_record].iov_len  = body_size;
+    async_outputv(record, num_record + 1);
+}
+
 void
 async_output (const char *data, size_t size)
 {
+    check_fork_restart();
+    if (nullptr != global_record_payload)
+    {
+        struct iovec piece = {const_cast<char *>(data), size};
+        payload_output(&piece, 1);
+        return;
+    }
+    if (global_record_flight)
+    {
+        struct iovec piece = {const_cast<char *>(data), size};
+        flight_output(&piece, 1);
+        return;
+    }
     if (_global_async_logging.is_running())
     {
-        _global_async_logging.append_data(data, size);
+        _global_async_logging.append_data(data, size, global_record_time_us, global_record_urgent,
+                                          global_record_time_begin, global_record_time_end);
+        flight_trigger();
+        global_record_time_us    = 0;
+        global_record_urgent     = false;
+        global_record_time_begin = 0;
+        global_record_time_end   = 0;
     }
     else
     {
@@ -107,6 +630,297 @@ async_output (const char *data, size_t size)
     }
 }
 
+/**
+ * @brief Output of a record that spans several chunks of the stream buffer
+ */
+void
+async_outputv (const struct iovec *pieces, int num_pieces)
+{
+    check_fork_restart();
+    if (nullptr != global_record_payload)
+    {
+        payload_output(pieces, num_pieces);
+        return;
+    }
+    if (global_record_flight)
+    {
+        flight_output(pieces, num_pieces);
+        return;
+    }
+    if (_global_async_logging.is_running())
+    {
+        _global_async_logging.append_datav(pieces, num_pieces, global_record_time_us, global_record_urgent,
+                                           global_record_time_begin, global_record_time_end);
+        flight_trigger();
+        global_record_time_us    = 0;
+        global_record_urgent     = false;
+        global_record_time_begin = 0;
+        global_record_time_end   = 0;
+    }
+    else
+    {
+        for (int i = 0; i < num_pieces; i++)
+        {
+            (void)fwrite(pieces[i].iov_base, 1, pieces[i].iov_len, stdout);
+        }
+    }
+}
+
+/**
+ * @brief Memory held by the log stream buffers of all threads
+ */
+LogStreamMemory
+log_memory (void)
+{
+    return LogStream::memory();
+}
+
+/**
+ * @brief Memory held by the log stream buffer of the calling thread
+ */
+size_t
+log_thread_memory (void)
+{
+    return global_log_stream.capacity();
+}
+
+/**
+ * @brief Build the rolling log file described by the configuration
+ */
+static std::unique_ptr<LogSink>
+create_log_file (const LogContorl &cfg, const std::string &file_name)
+{
+    RetentionPolicy retention;
+    retention.max_files       = cfg.keep_max_files;
+    retention.max_total_bytes = cfg.keep_max_kbytes * 1024;
+    retention.max_age_minutes = cfg.keep_max_age_minutes;
+    return std::unique_ptr<LogSink>(new (std::nothrow) LogFile(file_name, cfg.roll_cycle_minutes,
+                                                               cfg.roll_size_kbytes * 1024, retention,
+                                                               cfg.container_format));
+}
+
+/**
+ * @brief Build the destination described by the configuration, a socket, a
+ * shared ring or a rolling log file
+ */
+static std::unique_ptr<LogSink>
+create_sink (const LogContorl &cfg)
+{
+    if (SocketSink::is_address(cfg.logfile))
+    {
+        return std::unique_ptr<LogSink>(new (std::nothrow)
+                                            SocketSink(cfg.logfile, cfg.spill_file, cfg.spill_max_kbytes * 1024));
+    }
+    if (ShmRingSink::is_address(cfg.logfile))
+    {
+        return std::unique_ptr<LogSink>(new (std::nothrow) ShmRingSink(cfg.logfile, cfg.shm_ring_kbytes * 1024));
+    }
+    return create_log_file(cfg, cfg.logfile);
+}
+
+/**
+ * @brief Whether the logfile names a file rather than a socket or a shared
+ * ring
+ */
+static bool
+logfile_is_file (const LogContorl &cfg)
+{
+    return !SocketSink::is_address(cfg.logfile) && !ShmRingSink::is_address(cfg.logfile);
+}
+
+/**
+ * @brief Start the writer of the shared ring if this process is to run it,
+ * or stop it. Called with _global_config_lock held.
+ */
+static void
+configure_shm_writer (const LogContorl &cfg)
+{
+    _global_shm_writer.stop();
+    if (ShmRingSink::is_address(cfg.logfile) && !cfg.shm_writer_file.empty())
+    {
+        (void)_global_shm_writer.start(ShmRingSink::ring_name(cfg.logfile), cfg.shm_ring_kbytes * 1024,
+                                       create_log_file(cfg, cfg.shm_writer_file));
+    }
+}
+
+/**
+ * @brief Whether two configurations describe different destinations
+ */
+static bool
+sink_changed (const LogContorl &a, const LogContorl &b)
+{
+    return (a.logfile != b.logfile) || (a.roll_cycle_minutes != b.roll_cycle_minutes)
+           || (a.roll_size_kbytes != b.roll_size_kbytes) || (a.keep_max_files != b.keep_max_files)
+           || (a.keep_max_kbytes != b.keep_max_kbytes) || (a.keep_max_age_minutes != b.keep_max_age_minutes)
+           || (a.container_format != b.container_format) || (a.spill_file != b.spill_file)
+           || (a.spill_max_kbytes != b.spill_max_kbytes) || (a.shm_ring_kbytes != b.shm_ring_kbytes);
+}
+
+static void
+flight_signal_handler (int)
+{
+    _global_async_logging.request_flight_dump(FlightRecorder::TRIGGER_SIGNAL, false);
+}
+
+/**
+ * @brief Install the SIGUSR1 handler of the flight recorder, or put the
+ * previous handler back
+ */
+static void
+set_flight_signal (bool on)
+{
+    static bool             installed = false;
+    static struct sigaction previous;
+    if (on && !installed)
+    {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = flight_signal_handler;
+        action.sa_flags   = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        installed = (0 == sigaction(SIGUSR1, &action, &previous));
+    }
+    else if (!on && installed)
+    {
+        (void)sigaction(SIGUSR1, &previous, nullptr);
+        installed = false;
+    }
+}
+
+/**
+ * @brief Size the flight recorder ring for the configuration, called with
+ * _global_config_lock held
+ * @retval Whether the flight recorder is on
+ */
+static bool
+configure_flight_recorder (const LogContorl &cfg)
+{
+    bool        flight = (cfg.flight_level < cfg.level) && (0 != cfg.flight_kbytes);
+    std::string file   = cfg.flight_file;
+    if (flight && file.empty())
+    {
+        if (!logfile_is_file(cfg))
+        {
+            std::cerr << "[configure_flight_recorder] a socket or shared ring logfile needs a flight_file, flight "
+                         "recorder off"
+                      << std::endl;
+            flight = false;
+        }
+        file = cfg.logfile + ".flight";
+    }
+    flight = _global_flight_recorder.configure(flight ? cfg.flight_kbytes * 1024 : 0, file) && flight;
+    set_flight_signal(flight && cfg.flight_signal);
+    return flight;
+}
+
+/**
+ * @brief Apply the settings read on the hot path: publish a new record
+ * configuration and retire the old one. Called with _global_config_lock held.
+ */
+static void
+apply_record_settings (const LogContorl &cfg)
+{
+    bool flight = configure_flight_recorder(cfg);
+
+    RecordConfig *config = new (std::nothrow) RecordConfig();
+    if (nullptr != config)
+    {
+        config->use_ms_precision     = cfg.use_ms;
+        config->show_path            = cfg.show_path;
+        config->show_func            = cfg.show_func;
+        config->show_context         = cfg.show_context;
+        config->kv_format            = cfg.kv_format;
+        config->priority_level       = cfg.priority_level;
+        config->write_level          = cfg.level;
+        config->flight_trigger_level = flight ? cfg.flight_trigger_level : NUM_LOG_LEVELS;
+
+        const RecordConfig *old = _global_record_config.exchange(config, std::memory_order_seq_cst);
+        if (&_default_record_config != old)
+        {
+            _global_config_epoch.retire(old);
+        }
+        _global_config_epoch.reclaim();
+    }
+    else
+    {
+        std::cerr << "[apply_record_settings] out of memory, header settings unchanged" << std::endl;
+        flight = false;
+    }
+
+    /* The flight recorder needs the records below the log level */
+    _global_log_level.store(flight ? cfg.flight_level : cfg.level, std::memory_order_relaxed);
+    LogStream::set_limits(cfg.record_max_kbytes * 1024, cfg.record_retain_kbytes * 1024);
+    _global_async_logging.set_urgent_sync(cfg.priority_sync);
+    _global_async_logging.set_record_framing(cfg.record_framing);
+    _global_async_logging.set_dedup_window(cfg.dedup_window_ms);
+    _global_async_logging.set_reorder_window(cfg.reorder_window_ms);
+}
+
+static void
+fork_prepare (void)
+{
+    /* No configuration change half done in the child */
+    _global_config_lock.lock();
+    _global_async_logging.prepare_fork();
+    _global_flight_recorder.prepare_fork();
+}
+
+static void
+fork_parent (void)
+{
+    _global_flight_recorder.after_fork_parent();
+    _global_async_logging.after_fork_parent();
+    _global_config_lock.unlock();
+}
+
+/**
+ * @brief Stop asynchronous logging in a forked child until its first record.
+ * An atfork child handler may not allocate, open files or start threads (the
+ * other threads of the parent may have held the allocator's locks), so it
+ * only resets the state; restart_after_fork does the rest.
+ */
+static void
+fork_child (void)
+{
+    /* The parent stays the writer of a shared ring */
+    _global_shm_writer.after_fork_child();
+    _global_flight_recorder.after_fork_child();
+    log_context_after_fork();
+    _global_async_logging.after_fork_child();
+    new (&_global_fork_restart_lock) std::mutex();
+    _global_fork_restart.store(true);
+    _global_config_lock.unlock();
+}
+
+/**
+ * @brief Restart asynchronous logging in a forked child, with a log file of
+ * its own if configured. Called before the first record of the child and by
+ * the calls that change the logger.
+ */
+static void
+restart_after_fork (void)
+{
+    std::lock_guard<std::mutex> lock(_global_fork_restart_lock);
+    if (!_global_fork_restart.load())
+    {
+        return;
+    }
+
+    /* _global_log_control only changes after a restart */
+    const LogContorl        &cfg = _global_log_control;
+    std::unique_ptr<LogSink> sink;
+    /* A container file can not be shared, every block must be written by the
+     * process that indexes it */
+    if (_global_async_logging.restart_pending() && logfile_is_file(cfg)
+        && (cfg.fork_per_pid_file || cfg.container_format))
+    {
+        sink = create_log_file(cfg, cfg.logfile + "." + std::to_string(::getpid()));
+    }
+    _global_flight_recorder.restart_after_fork();
+    _global_async_logging.restart_after_fork(std::move(sink));
+    _global_fork_restart.store(false);
+}
+
 /**
  * @brief Log module initialization
  * @param [in] conf_file : Log configuration file path
@@ -114,14 +928,190 @@ async_output (const char *data, size_t size)
 void
 log_init (LogContorl cfg)
 {
+    check_fork_restart();
+    std::lock_guard<std::mutex> lock(_global_config_lock);
 
-    _global_use_ms_precision = cfg.use_ms; 
-    _global_show_path = cfg.show_path;
-    _global_show_func = cfg.show_func;
-    _global_log_level = cfg.level;
-    _global_async_logging.init(cfg.logfile, cfg.roll_cycle_minutes, cfg.roll_size_kbytes*1024);
+    apply_record_settings(cfg);
+    _global_log_control = cfg;
+    configure_shm_writer(cfg);
+    _global_async_logging.init(create_sink(cfg));
 
+    _global_async_logging.set_consumer_options(cfg.consumer);
+    _global_async_logging.set_flight_recorder(&_global_flight_recorder);
     _global_async_logging.start();
+
+    /* Keep logging in the children of pre-fork servers */
+    static bool fork_handlers_registered = false;
+    if (!fork_handlers_registered)
+    {
+        fork_handlers_registered = (0 == pthread_atfork(fork_prepare, fork_parent, fork_child));
+    }
+}
+
+/**
+ * @brief Change the configuration of the running logger. Levels, header
+ * options, the record limits and the priority lane settings take effect for the
+ * next record; a changed destination (logfile, rolling, retention,
+ * container_format, spill and shared ring settings) is opened here and
+ * swapped in by the background thread. Producers are never paused.
+ * @param [in] cfg : The new configuration. The consumer thread options can only
+ * be set by log_init and are kept.
+ * @retval false if the logger is not running or the new destination can not be
+ * opened, in which case the old one stays in use
+ */
+bool
+log_reconfigure (const LogContorl &cfg)
+{
+    check_fork_restart();
+    std::lock_guard<std::mutex> lock(_global_config_lock);
+    if (!_global_async_logging.is_running())
+    {
+        std::cerr << "[log_reconfigure] log_init has not been called" << std::endl;
+        return false;
+    }
+
+    LogContorl applied = cfg;
+    applied.consumer   = _global_log_control.consumer;
+    bool ok            = true;
+    if (sink_changed(_global_log_control, applied))
+    {
+        /* The new destination is opened here, the background thread only
+         * swaps the pointer */
+        std::unique_ptr<LogSink> sink = create_sink(applied);
+        if (nullptr != sink)
+        {
+            _global_async_logging.replace_sink(std::move(sink));
+        }
+        else
+        {
+            std::cerr << "[log_reconfigure] can not open " << applied.logfile << ", keeping "
+                      << _global_log_control.logfile << std::endl;
+            const LogContorl &old = _global_log_control;
+            applied.logfile              = old.logfile;
+            applied.roll_cycle_minutes   = old.roll_cycle_minutes;
+            applied.roll_size_kbytes     = old.roll_size_kbytes;
+            applied.keep_max_files       = old.keep_max_files;
+            applied.keep_max_kbytes      = old.keep_max_kbytes;
+            applied.keep_max_age_minutes = old.keep_max_age_minutes;
+            applied.container_format     = old.container_format;
+            applied.spill_file           = old.spill_file;
+            applied.spill_max_kbytes     = old.spill_max_kbytes;
+            applied.shm_ring_kbytes      = old.shm_ring_kbytes;
+            ok                           = false;
+        }
+    }
+    if (sink_changed(_global_log_control, applied) || (_global_log_control.shm_writer_file != applied.shm_writer_file))
+    {
+        configure_shm_writer(applied);
+    }
+
+    apply_record_settings(applied);
+    _global_log_control = applied;
+    return ok;
+}
+
+/**
+ * @brief The configuration currently in effect
+ */
+LogContorl
+log_config (void)
+{
+    std::lock_guard<std::mutex> lock(_global_config_lock);
+    return _global_log_control;
+}
+
+/**
+ * @brief Counters of the duplicate collapsing (LogControl::dedup_window_ms)
+ */
+DedupStats
+log_dedup_stats (void)
+{
+    return _global_async_logging.dedup_stats();
+}
+
+/**
+ * @brief Counters of the record merge (LogControl::reorder_window_ms)
+ */
+MergeStats
+log_merge_stats (void)
+{
+    return _global_async_logging.merge_stats();
+}
+
+/**
+ * @brief Dump the flight recorder (LogControl::flight_level) to its file now
+ * @retval false if the flight recorder is off or the file can not be written
+ */
+bool
+log_flight_dump (void)
+{
+    check_fork_restart();
+    return _global_flight_recorder.enabled() && _global_flight_recorder.dump(FlightRecorder::TRIGGER_API);
+}
+
+/**
+ * @brief Counters of the flight recorder
+ */
+FlightStats
+log_flight_stats (void)
+{
+    return _global_flight_recorder.stats();
+}
+
+/**
+ * @brief Read a configuration file ("key = value" lines, see log_config.h) on
+ * top of cfg
+ * @retval false if the file can not be read or has errors, cfg is unchanged
+ */
+bool
+log_load_config (const std::string &path, LogContorl &cfg)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "[log_load_config] can not open " << path << std::endl;
+        return false;
+    }
+    std::string error;
+    if (!parse_log_config(in, cfg, error))
+    {
+        std::cerr << "[log_load_config] " << path << ": " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Apply a configuration file on top of the current configuration
+ */
+static void
+reload_config_file (const std::string &path)
+{
+    LogContorl cfg = log_config();
+    if (log_load_config(path, cfg))
+    {
+        (void)log_reconfigure(cfg);
+    }
+}
+
+/**
+ * @brief Apply a configuration file now and again whenever it changes, the
+ * file is watched with inotify
+ */
+bool
+log_watch_config (const std::string &path)
+{
+    reload_config_file(path);
+    return _global_config_watcher.start(path, [path] () { reload_config_file(path); });
+}
+
+/**
+ * @brief Stop watching the configuration file
+ */
+void
+log_unwatch_config (void)
+{
+    _global_config_watcher.stop();
 }
 
 } // namespace logging
\ No newline at end of file
@@ -0,0 +1,1010 @@
+#include "shm_ring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdio.h>      // snprintf
+#include <stdlib.h>     // strtoull
+#include <string.h>     // memset, memcpy, memrchr, strrchr
+#include <sys/mman.h>   // shm_open, mmap
+#include <sys/stat.h>   // fstat
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+namespace logging {
+
+/* "TLR1" */
+static const uint32_t SHM_RING_MAGIC   = 0x31524C54;
+static const uint32_t SHM_RING_VERSION = 1;
+
+/* Header word of an entry: flags and the data size. The data follows the
+ * word, the entry is padded to a multiple of 8 bytes. */
+static const uint64_t ENTRY_COMMITTED   = 1ULL << 63;
+static const uint64_t ENTRY_PADDING     = 1ULL << 62;
+static const uint64_t ENTRY_SIZE_MASK   = 0xffffffffULL;
+static const uint64_t ENTRY_HEADER_SIZE = 8;
+
+/* Smallest data area, a new ring is rounded up to a multiple of this */
+static const uint64_t MIN_CAPACITY = 64 * 1024;
+/* Time given to the creator of a ring to set it up */
+static const uint32_t OPEN_WAIT_MS = 1000;
+/* Poll interval of a producer waiting for space */
+static const uint32_t FULL_POLL_US = 100;
+/* Entries and bytes handed to the sink at a time, the space is given back
+ * after each batch */
+static const int      DRAIN_PIECES    = 64;
+static const uint64_t DRAIN_MAX_SHARE = 4;
+
+enum ProducerState
+{
+    PRODUCER_IDLE = 0,
+    PRODUCER_INTENT,    // About to reserve [pos, pos + size), may lose the race for it
+    PRODUCER_RESERVED,  // Holds [pos, pos + size) until the entry is committed
+};
+
+/**
+ * @brief Slot of a producer process in the shared memory, see the
+ * description of ShmRing
+ */
+struct ShmProducer
+{
+    std::atomic<uint64_t> owner;  // Identity of the process, 0 if free
+    std::atomic<uint64_t> pos;
+    std::atomic<uint64_t> size;   // With the padding in front of the entry
+    std::atomic<uint32_t> state;
+    uint32_t              reserved;
+};
+
+struct ShmRingHeader
+{
+    std::atomic<uint32_t> magic;   // Stored last by the creator
+    uint32_t              version;
+    uint64_t              capacity;
+    uint64_t              data_offset;
+    uint64_t              pid_namespace; // Of the creator, all users share it
+    std::atomic<uint64_t> writer;  // Identity of the writer process, 0 if none
+
+    /* Reserved up to here (producers) */
+    alignas(64) std::atomic<uint64_t> head;
+    /* Drained and cleared up to here (writer) */
+    alignas(64) std::atomic<uint64_t> tail;
+    /* Drained up to here, clearing in progress */
+    std::atomic<uint64_t> tail_pending;
+    /* The writer sleeps on wake_seq */
+    std::atomic<uint32_t> writer_waiting;
+    std::atomic<uint32_t> wake_seq;
+
+    alignas(64) std::atomic<uint64_t> entries;
+    std::atomic<uint64_t>             bytes;
+    std::atomic<uint64_t>             dropped_entries;
+    std::atomic<uint64_t>             dropped_bytes;
+    std::atomic<uint64_t>             skipped_entries;
+    std::atomic<uint64_t>             skipped_bytes;
+
+    alignas(64) ShmProducer producers[ShmRing::MAX_PRODUCERS];
+};
+
+const uint32_t ShmRing::MAX_PRODUCERS;
+const uint32_t ShmRing::STALL_CHECK_MS;
+const uint32_t ShmRingSink::FULL_WAIT_MS;
+const uint32_t ShmRingWriter::IDLE_WAIT_MS;
+const uint32_t ShmRingWriter::STANDBY_POLL_MS;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the shared ring needs lock-free 64 bit atomics");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "the futex word must be a plain 32 bit word");
+
+static inline uint64_t
+entry_size (uint64_t size)
+{
+    return (ENTRY_HEADER_SIZE + size + 7) & ~7ULL;
+}
+
+/**
+ * @brief Check the committed header word of the entry at pos against the
+ * layout producers keep to. A word written by anything else (a producer
+ * taken for crashed that commits after all, a stray writer to the shared
+ * memory) must not make the writer read outside the reserved space.
+ */
+static bool
+entry_valid (uint64_t word, uint64_t pos, uint64_t head, uint64_t capacity)
+{
+    uint64_t size   = entry_size(word & ENTRY_SIZE_MASK);
+    uint64_t offset = pos % capacity;
+    if ((0 != (word & ~(ENTRY_COMMITTED | ENTRY_PADDING | ENTRY_SIZE_MASK))) || (size > capacity / 2)
+        || (pos + size > head) || (offset + size > capacity))
+    {
+        return false;
+    }
+    /* Padding always fills the data area up to its end */
+    return (0 == (word & ENTRY_PADDING)) || (offset + size == capacity);
+}
+
+/**
+ * @brief Identity of a process as kept in the shared memory: the pid and the
+ * low bits of its start time, so that a reused pid is not taken for the
+ * process. Pids are only meaningful within a pid namespace, open refuses a
+ * ring created in another one (see pid_namespace).
+ * @retval 0 if there is no such process or it has exited (zombie)
+ */
+static uint64_t
+process_identity (pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    char    stat[512];
+    ssize_t len = ::read(fd, stat, sizeof(stat) - 1);
+    ::close(fd);
+    if (len <= 0)
+    {
+        return 0;
+    }
+    stat[len] = '\0';
+
+    /* "pid (comm) state ppid ...", the start time is field 22. The command
+     * may contain anything, the fields are counted from its closing
+     * parenthesis. */
+    const char *p = strrchr(stat, ')');
+    if ((nullptr == p) || ('\0' == p[1]) || ('\0' == p[2]) || ('Z' == p[2]) || ('X' == p[2]))
+    {
+        return 0;
+    }
+    p += 2;
+    for (int field = 3; (field < 22) && (nullptr != p); field++)
+    {
+        p = strchr(p, ' ');
+        p = (nullptr != p) ? p + 1 : nullptr;
+    }
+    if (nullptr == p)
+    {
+        return 0;
+    }
+    uint64_t start = strtoull(p, nullptr, 10);
+    return (static_cast<uint64_t>(pid) << 32) | (start & 0xffffffffULL);
+}
+
+/**
+ * @brief Inode of the pid namespace of this process, 0 if the kernel does
+ * not show it
+ */
+static uint64_t
+pid_namespace (void)
+{
+    struct stat st;
+    return (0 == stat("/proc/self/ns/pid", &st)) ? static_cast<uint64_t>(st.st_ino) : 0;
+}
+
+static bool
+process_alive (uint64_t identity)
+{
+    return (0 != identity) && (process_identity(static_cast<pid_t>(identity >> 32)) == identity);
+}
+
+static void
+futex_wait (std::atomic<uint32_t> *word, uint32_t value, uint32_t wait_ms)
+{
+    struct timespec timeout;
+    timeout.tv_sec  = wait_ms / 1000;
+    timeout.tv_nsec = (wait_ms % 1000) * 1000000L;
+    /* Not FUTEX_PRIVATE_FLAG, the word is shared between processes */
+    (void)syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, value, &timeout, nullptr, 0);
+}
+
+static void
+futex_wake (std::atomic<uint32_t> *word)
+{
+    (void)syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+ShmRing::ShmRing(void)
+    : _header(nullptr)
+    , _data(nullptr)
+    , _map_size(0)
+    , _producer(nullptr)
+    , _self(0)
+    , _writer(false)
+    , _stall_pos(~0ULL)
+{
+}
+
+/**
+ * @brief ShmRing destructor, detaches from the shared memory
+ */
+ShmRing::~ShmRing(void)
+{
+    close();
+}
+
+/**
+ * @brief Attach to the ring with the given name, creating it if it does not
+ * exist yet
+ * @param[in] name Ring name, the shared memory object is "/tinylog.<name>"
+ * @param[in] capacity Size of the data area of a new ring in bytes, an
+ * existing ring keeps its size
+ * @retval true on success
+ */
+bool
+ShmRing::open(const std::string &name, uint64_t capacity)
+{
+    close();
+    _name                     = name;
+    std::string shm_name      = "/tinylog." + name;
+    uint64_t    data_offset   = (sizeof(ShmRingHeader) + 4095) & ~4095ULL;
+    bool        created       = true;
+    int         fd            = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if ((fd < 0) && (EEXIST == errno))
+    {
+        created = false;
+        fd      = shm_open(shm_name.c_str(), O_RDWR | O_CLOEXEC, 0666);
+    }
+    if (fd < 0)
+    {
+        std::cerr << "[ShmRing::open] can not open " << shm_name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    uint64_t size = 0;
+    if (created)
+    {
+        capacity = std::max((capacity + MIN_CAPACITY - 1) / MIN_CAPACITY * MIN_CAPACITY, MIN_CAPACITY);
+        size     = data_offset + capacity;
+        if (0 != ftruncate(fd, static_cast<off_t>(size)))
+        {
+            std::cerr << "[ShmRing::open] can not size " << shm_name << ": " << strerror(errno) << std::endl;
+            ::close(fd);
+            (void)shm_unlink(shm_name.c_str());
+            return false;
+        }
+    }
+    else
+    {
+        /* Wait for the creator to size the object */
+        struct stat st;
+        for (uint32_t waited = 0; waited < OPEN_WAIT_MS; waited++)
+        {
+            if ((0 == fstat(fd, &st)) && (static_cast<uint64_t>(st.st_size) >= data_offset))
+            {
+                size = st.st_size;
+                break;
+            }
+            usleep(1000);
+        }
+    }
+    void *map = (0 != size) ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (MAP_FAILED == map)
+    {
+        std::cerr << "[ShmRing::open] can not map " << shm_name << std::endl;
+        return false;
+    }
+
+    ShmRingHeader *header = static_cast<ShmRingHeader *>(map);
+    if (created)
+    {
+        /* The object is zero filled, which is an empty ring */
+        header->version       = SHM_RING_VERSION;
+        header->capacity      = capacity;
+        header->data_offset   = data_offset;
+        header->pid_namespace = pid_namespace();
+        header->magic.store(SHM_RING_MAGIC, std::memory_order_release);
+    }
+    else
+    {
+        for (uint32_t waited = 0; (waited < OPEN_WAIT_MS) && (SHM_RING_MAGIC != header->magic.load()); waited++)
+        {
+            usleep(1000);
+        }
+        if ((SHM_RING_MAGIC != header->magic.load(std::memory_order_acquire)) || (SHM_RING_VERSION != header->version)
+            || (header->data_offset + header->capacity != size))
+        {
+            std::cerr << "[ShmRing::open] " << shm_name << " is not a ring of this version, remove it" << std::endl;
+            munmap(map, size);
+            return false;
+        }
+        /* The processes using the ring are known by their pids, which other
+         * pid namespaces do not see */
+        if (header->pid_namespace != pid_namespace())
+        {
+            std::cerr << "[ShmRing::open] " << shm_name << " is used from another pid namespace" << std::endl;
+            munmap(map, size);
+            return false;
+        }
+    }
+
+    /* Crashed processes are told apart by their pid and start time */
+    _self = process_identity(getpid());
+    if (0 == _self)
+    {
+        std::cerr << "[ShmRing::open] /proc is not available, can not use " << shm_name << std::endl;
+        munmap(map, size);
+        return false;
+    }
+    _header    = header;
+    _data      = static_cast<char *>(map) + header->data_offset;
+    _map_size  = size;
+    _stall_pos = ~0ULL;
+    return true;
+}
+
+/**
+ * @brief Detach from the ring, giving up the producer slot and the writer
+ * role
+ */
+void
+ShmRing::close(void)
+{
+    if (nullptr == _header)
+    {
+        return;
+    }
+    release_writer();
+    if (nullptr != _producer)
+    {
+        _producer->state.store(PRODUCER_IDLE, std::memory_order_relaxed);
+        _producer->owner.store(0, std::memory_order_release);
+        _producer = nullptr;
+    }
+    munmap(_header, _map_size);
+    _header = nullptr;
+    _data   = nullptr;
+}
+
+/**
+ * @brief Remove the shared memory object of a ring. Processes attached to it
+ * keep using it, later ones create a new ring.
+ */
+bool
+ShmRing::remove(const std::string &name)
+{
+    return 0 == shm_unlink(("/tinylog." + name).c_str());
+}
+
+/**
+ * @brief Largest entry the ring takes, in data bytes
+ */
+uint64_t
+ShmRing::max_entry_size(void) const
+{
+    /* With the padding an entry takes at most twice its size */
+    return (nullptr != _header) ? std::min(_header->capacity / 2 - ENTRY_HEADER_SIZE, ENTRY_SIZE_MASK) : 0;
+}
+
+/**
+ * @brief Take a free producer slot, or the slot of a producer that has exited
+ */
+bool
+ShmRing::attach_producer(void)
+{
+    for (uint32_t i = 0; i < MAX_PRODUCERS; i++)
+    {
+        uint64_t free = 0;
+        if (_header->producers[i].owner.compare_exchange_strong(free, _self))
+        {
+            _producer = &_header->producers[i];
+            _producer->state.store(PRODUCER_IDLE, std::memory_order_release);
+            return true;
+        }
+    }
+
+    /* The slot of an exited producer is only taken once the writer is past
+     * anything it may have reserved */
+    uint64_t tail = _header->tail.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < MAX_PRODUCERS; i++)
+    {
+        ShmProducer &producer = _header->producers[i];
+        uint64_t     owner    = producer.owner.load(std::memory_order_acquire);
+        if (process_alive(owner)
+            || ((PRODUCER_IDLE != producer.state.load(std::memory_order_acquire))
+                && (producer.pos.load(std::memory_order_relaxed) + producer.size.load(std::memory_order_relaxed)
+                    > tail)))
+        {
+            continue;
+        }
+        if (producer.owner.compare_exchange_strong(owner, _self))
+        {
+            _producer = &producer;
+            _producer->state.store(PRODUCER_IDLE, std::memory_order_release);
+            return true;
+        }
+    }
+    std::cerr << "[ShmRing::attach_producer] all " << MAX_PRODUCERS << " producer slots of " << _name << " are in use"
+              << std::endl;
+    return false;
+}
+
+/**
+ * @brief Reserve space for one entry, to be filled at the returned address and
+ * committed with commit
+ * @param[in] size Data bytes, at most max_entry_size()
+ * @param[in] wait_ms Time to wait for the writer when the ring is full
+ * @param[out] token Passed to commit
+ * @retval Where the data goes, nullptr if the entry was dropped (ring full, no
+ * producer slot, entry too large)
+ */
+char *
+ShmRing::reserve(uint64_t size, uint32_t wait_ms, uint64_t &token)
+{
+    if (nullptr == _header)
+    {
+        return nullptr;
+    }
+    if ((size > max_entry_size()) || ((nullptr == _producer) && !attach_producer()))
+    {
+        _header->dropped_entries.fetch_add(1, std::memory_order_relaxed);
+        _header->dropped_bytes.fetch_add(size, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    uint64_t                              capacity = _header->capacity;
+    uint64_t                              need     = entry_size(size);
+    bool                                  waiting  = false;
+    std::chrono::steady_clock::time_point deadline;
+    uint64_t                              head = _header->head.load(std::memory_order_acquire);
+    uint64_t                              pad  = 0;
+    while (true)
+    {
+        uint64_t offset = head % capacity;
+        pad             = (offset + need > capacity) ? capacity - offset : 0;
+        if (head + pad + need - _header->tail.load(std::memory_order_acquire) > capacity)
+        {
+            /* Full: wait for a live writer, for a while. An intent left from
+             * a lost race names space another producer reserved, it would
+             * keep the writer from skipping that space if its producer
+             * crashed. */
+            _producer->state.store(PRODUCER_IDLE, std::memory_order_release);
+            if (!waiting)
+            {
+                waiting  = true;
+                deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait_ms);
+            }
+            if ((std::chrono::steady_clock::now() >= deadline)
+                || !process_alive(_header->writer.load(std::memory_order_relaxed)))
+            {
+                _header->dropped_entries.fetch_add(1, std::memory_order_relaxed);
+                _header->dropped_bytes.fetch_add(size, std::memory_order_relaxed);
+                return nullptr;
+            }
+            usleep(FULL_POLL_US);
+            head = _header->head.load(std::memory_order_acquire);
+            continue;
+        }
+
+        /* Published before the reservation is made, so that the writer finds
+         * the owner of the space if this process dies right after */
+        _producer->state.store(PRODUCER_IDLE, std::memory_order_relaxed);
+        _producer->pos.store(head, std::memory_order_relaxed);
+        _producer->size.store(pad + need, std::memory_order_relaxed);
+        _producer->state.store(PRODUCER_INTENT, std::memory_order_seq_cst);
+        if (_header->head.compare_exchange_weak(head, head + pad + need, std::memory_order_seq_cst))
+        {
+            break;
+        }
+    }
+    _producer->state.store(PRODUCER_RESERVED, std::memory_order_relaxed);
+
+    if (0 != pad)
+    {
+        reinterpret_cast<std::atomic<uint64_t> *>(_data + head % capacity)
+            ->store(ENTRY_COMMITTED | ENTRY_PADDING | (pad - ENTRY_HEADER_SIZE), std::memory_order_release);
+    }
+    token = head + pad;
+    reinterpret_cast<std::atomic<uint64_t> *>(_data + token % capacity)->store(size, std::memory_order_relaxed);
+    return _data + token % capacity + ENTRY_HEADER_SIZE;
+}
+
+/**
+ * @brief Commit the entry reserved with reserve and wake the writer
+ */
+void
+ShmRing::commit(uint64_t token)
+{
+    std::atomic<uint64_t> *word = reinterpret_cast<std::atomic<uint64_t> *>(_data + token % _header->capacity);
+    uint64_t               size = word->load(std::memory_order_relaxed);
+    word->store(size | ENTRY_COMMITTED, std::memory_order_seq_cst);
+    _producer->state.store(PRODUCER_IDLE, std::memory_order_release);
+    _header->entries.fetch_add(1, std::memory_order_relaxed);
+    _header->bytes.fetch_add(size, std::memory_order_relaxed);
+
+    /* Pairs with wait_entry: either the writer sees the entry or it has
+     * announced its sleep */
+    if (0 != _header->writer_waiting.load(std::memory_order_seq_cst))
+    {
+        _header->wake_seq.fetch_add(1, std::memory_order_release);
+        futex_wake(&_header->wake_seq);
+    }
+}
+
+/**
+ * @brief Copy one entry in, given as pieces
+ * @retval false if it was dropped
+ */
+bool
+ShmRing::append(const struct iovec *pieces, int num_pieces, uint32_t wait_ms)
+{
+    uint64_t size = 0;
+    for (int i = 0; i < num_pieces; i++)
+    {
+        size += pieces[i].iov_len;
+    }
+    uint64_t token = 0;
+    char    *out   = reserve(size, wait_ms, token);
+    if (nullptr == out)
+    {
+        return false;
+    }
+    for (int i = 0; i < num_pieces; i++)
+    {
+        memcpy(out, pieces[i].iov_base, pieces[i].iov_len);
+        out += pieces[i].iov_len;
+    }
+    commit(token);
+    return true;
+}
+
+/**
+ * @brief Take the writer role if nobody holds it or its holder has exited
+ * @retval true if this object is the writer
+ */
+bool
+ShmRing::acquire_writer(void)
+{
+    if ((nullptr == _header) || _writer)
+    {
+        return _writer;
+    }
+    uint64_t holder = _header->writer.load(std::memory_order_acquire);
+    if (((0 != holder) && process_alive(holder)) || !_header->writer.compare_exchange_strong(holder, _self))
+    {
+        return false;
+    }
+    _writer    = true;
+    _stall_pos = ~0ULL;
+
+    /* A writer that died while clearing drained space left it to us */
+    uint64_t tail    = _header->tail.load(std::memory_order_acquire);
+    uint64_t pending = _header->tail_pending.load(std::memory_order_acquire);
+    if (pending > tail)
+    {
+        release_space(tail, pending);
+    }
+    return true;
+}
+
+/**
+ * @brief Give up the writer role
+ */
+void
+ShmRing::release_writer(void)
+{
+    if (_writer)
+    {
+        uint64_t self = _self;
+        (void)_header->writer.compare_exchange_strong(self, 0);
+        _writer = false;
+    }
+}
+
+/**
+ * @brief If the uncommitted entry at pos belongs to a producer that has
+ * exited, give back its slot
+ * @retval Bytes reserved by it, 0 if it is alive or unknown
+ */
+uint64_t
+ShmRing::crashed_reservation(uint64_t pos)
+{
+    ShmProducer *crashed = nullptr;
+    uint32_t     state   = PRODUCER_IDLE;
+    uint64_t     end     = 0;
+    for (uint32_t i = 0; i < MAX_PRODUCERS; i++)
+    {
+        ShmProducer &producer = _header->producers[i];
+        uint32_t     s        = producer.state.load(std::memory_order_acquire);
+        uint64_t     begin    = producer.pos.load(std::memory_order_relaxed);
+        uint64_t     size     = producer.size.load(std::memory_order_relaxed);
+        if ((PRODUCER_IDLE == s) || (pos < begin) || (pos >= begin + size))
+        {
+            continue;
+        }
+        /* A live producer is still writing its entry, or about to retry
+         * somewhere else */
+        if (process_alive(producer.owner.load(std::memory_order_acquire)))
+        {
+            return 0;
+        }
+        /* A producer that lost the race for the space and died before
+         * retrying claims it too, the one that made the reservation wins */
+        if ((nullptr == crashed) || ((PRODUCER_RESERVED == s) && (PRODUCER_RESERVED != state)))
+        {
+            crashed = &producer;
+            state   = s;
+            end     = begin + size;
+        }
+    }
+    if (nullptr == crashed)
+    {
+        return 0;
+    }
+    crashed->state.store(PRODUCER_IDLE, std::memory_order_release);
+    return end - pos;
+}
+
+/**
+ * @brief Where the writer picks up again behind a damaged entry header at pos:
+ * the first reservation still held or announced by a producer, each starts
+ * at a former head. Without one, everything up to head has been committed.
+ */
+uint64_t
+ShmRing::next_boundary(uint64_t pos, uint64_t head)
+{
+    uint64_t next = head;
+    for (uint32_t i = 0; i < MAX_PRODUCERS; i++)
+    {
+        ShmProducer &producer = _header->producers[i];
+        uint64_t     begin    = producer.pos.load(std::memory_order_relaxed);
+        if ((PRODUCER_IDLE != producer.state.load(std::memory_order_acquire)) && (begin > pos) && (begin < next))
+        {
+            next = begin;
+        }
+    }
+    return next;
+}
+
+/**
+ * @brief Clear drained space and hand it back to the producers
+ */
+void
+ShmRing::release_space(uint64_t begin, uint64_t end)
+{
+    /* A writer taking over after a crash finishes the clearing */
+    _header->tail_pending.store(end, std::memory_order_release);
+    uint64_t capacity = _header->capacity;
+    uint64_t offset   = begin % capacity;
+    uint64_t size     = end - begin;
+    uint64_t first    = std::min(size, capacity - offset);
+    memset(_data + offset, 0, first);
+    if (size > first)
+    {
+        memset(_data, 0, size - first);
+    }
+    _header->tail.store(end, std::memory_order_release);
+}
+
+/**
+ * @brief Sleep until a producer commits an entry at pos, or for wait_ms
+ */
+void
+ShmRing::wait_entry(uint64_t pos, uint32_t wait_ms)
+{
+    if (0 == wait_ms)
+    {
+        return;
+    }
+    std::atomic<uint64_t> *word = reinterpret_cast<std::atomic<uint64_t> *>(_data + pos % _header->capacity);
+    uint32_t               seq  = _header->wake_seq.load(std::memory_order_acquire);
+    _header->writer_waiting.store(1, std::memory_order_seq_cst);
+    if (0 == (word->load(std::memory_order_seq_cst) & ENTRY_COMMITTED))
+    {
+        futex_wait(&_header->wake_seq, seq, wait_ms);
+    }
+    _header->writer_waiting.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Write the committed entries to the sink, waiting up to wait_ms for
+ * the first one. Reservations of crashed producers are skipped. Called by the
+ * writer only.
+ * @retval Number of entries written
+ */
+size_t
+ShmRing::drain(LogSink &sink, uint32_t wait_ms)
+{
+    if (!_writer)
+    {
+        return 0;
+    }
+    uint64_t capacity = _header->capacity;
+    uint64_t tail     = _header->tail.load(std::memory_order_relaxed);
+    uint64_t head     = _header->head.load(std::memory_order_acquire);
+    if ((tail == head)
+        || (0 == (reinterpret_cast<std::atomic<uint64_t> *>(_data + tail % capacity)->load(std::memory_order_acquire)
+                  & ENTRY_COMMITTED)))
+    {
+        /* A pending reservation is checked for a crashed producer soon */
+        wait_entry(tail, (tail == head) ? wait_ms : std::min(wait_ms, STALL_CHECK_MS));
+        head = _header->head.load(std::memory_order_acquire);
+    }
+
+    struct iovec pieces[DRAIN_PIECES];
+    int          num_pieces = 0;
+    uint64_t     pos        = tail;
+    while ((pos < head) && (num_pieces < DRAIN_PIECES) && (pos - tail < capacity / DRAIN_MAX_SHARE))
+    {
+        uint64_t word
+            = reinterpret_cast<std::atomic<uint64_t> *>(_data + pos % capacity)->load(std::memory_order_acquire);
+        if (0 == (word & ENTRY_COMMITTED))
+        {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (pos != _stall_pos)
+            {
+                _stall_pos   = pos;
+                _stall_since = now;
+                break;
+            }
+            if (now - _stall_since < std::chrono::milliseconds(STALL_CHECK_MS))
+            {
+                break;
+            }
+            _stall_since  = now;
+            uint64_t skip = crashed_reservation(pos);
+            if (0 == skip)
+            {
+                break;
+            }
+            _header->skipped_entries.fetch_add(1, std::memory_order_relaxed);
+            _header->skipped_bytes.fetch_add(skip, std::memory_order_relaxed);
+            std::cerr << "[ShmRing::drain] skipped " << skip << " bytes reserved by a crashed producer" << std::endl;
+            pos += skip;
+            continue;
+        }
+        if (!entry_valid(word, pos, head, capacity))
+        {
+            uint64_t next = next_boundary(pos, head);
+            _header->skipped_entries.fetch_add(1, std::memory_order_relaxed);
+            _header->skipped_bytes.fetch_add(next - pos, std::memory_order_relaxed);
+            std::cerr << "[ShmRing::drain] skipped " << next - pos << " bytes behind a damaged entry header"
+                      << std::endl;
+            pos = next;
+            continue;
+        }
+        uint64_t size = word & ENTRY_SIZE_MASK;
+        if (0 == (word & ENTRY_PADDING))
+        {
+            pieces[num_pieces].iov_base = _data + pos % capacity + ENTRY_HEADER_SIZE;
+            pieces[num_pieces].iov_len  = size;
+            num_pieces++;
+        }
+        pos += entry_size(size);
+    }
+
+    if (0 != num_pieces)
+    {
+        sink.write_blockv(pieces, num_pieces, BlockMeta(), false);
+    }
+    if (pos != tail)
+    {
+        release_space(tail, pos);
+    }
+    return num_pieces;
+}
+
+/**
+ * @brief In a forked child: the parent's producer slot and writer role stay
+ * the parent's, the child takes a producer slot of its own
+ */
+void
+ShmRing::after_fork_child(void)
+{
+    _producer = nullptr;
+    _writer   = false;
+    _self     = process_identity(getpid());
+}
+
+ShmRingStats
+ShmRing::stats(void) const
+{
+    ShmRingStats stats;
+    if (nullptr != _header)
+    {
+        stats.capacity        = _header->capacity;
+        stats.used            = _header->head.load() - _header->tail.load();
+        stats.entries         = _header->entries.load(std::memory_order_relaxed);
+        stats.bytes           = _header->bytes.load(std::memory_order_relaxed);
+        stats.dropped_entries = _header->dropped_entries.load(std::memory_order_relaxed);
+        stats.dropped_bytes   = _header->dropped_bytes.load(std::memory_order_relaxed);
+        stats.skipped_entries = _header->skipped_entries.load(std::memory_order_relaxed);
+        stats.skipped_bytes   = _header->skipped_bytes.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+/**
+ * @brief ShmRingSink constructor, attaches to the ring right away
+ * @param[in] address "shm://<name>"
+ * @param[in] capacity Size of the ring if it has to be created, in bytes
+ */
+ShmRingSink::ShmRingSink(const std::string &address, uint64_t capacity)
+{
+    std::string name = ring_name(address);
+    if (name.empty() || !_ring.open(name, capacity))
+    {
+        std::cerr << "[ShmRingSink::ShmRingSink] can not attach to " << address << ", log data is dropped"
+                  << std::endl;
+    }
+}
+
+/**
+ * @brief Check whether a log destination names a shared ring
+ */
+bool
+ShmRingSink::is_address(const std::string &destination)
+{
+    return 0 == destination.compare(0, 6, "shm://");
+}
+
+/**
+ * @brief Name of the ring in a destination, "" if it is none
+ */
+std::string
+ShmRingSink::ring_name(const std::string &destination)
+{
+    return is_address(destination) ? destination.substr(6) : std::string();
+}
+
+/**
+ * @brief Append log data to the ring, dropped if it stays full
+ * @param [in] logdata The source address of the data
+ * @param [in] size The size of the data
+ * @param [in] flush_now Unused, entries are visible once committed
+ */
+void
+ShmRingSink::write_logdata(const char *logdata, uint32_t size, bool flush_now)
+{
+    (void)flush_now;
+    uint64_t limit = _ring.max_entry_size();
+    while ((0 != limit) && (size > 0))
+    {
+        /* Longer data is cut after the last record that fits */
+        uint32_t n = size;
+        if (n > limit)
+        {
+            const char *end = static_cast<const char *>(memrchr(logdata, '\n', limit));
+            n               = (nullptr != end) ? static_cast<uint32_t>(end - logdata + 1) : static_cast<uint32_t>(limit);
+        }
+        struct iovec piece;
+        piece.iov_base = const_cast<char *>(logdata);
+        piece.iov_len  = n;
+        (void)_ring.append(&piece, 1, FULL_WAIT_MS);
+        logdata += n;
+        size -= n;
+    }
+}
+
+/**
+ * @brief Gather the pieces into one entry
+ */
+void
+ShmRingSink::write_blockv(const struct iovec *pieces, int num_pieces, const BlockMeta &meta, bool flush_now)
+{
+    uint64_t size = 0;
+    for (int i = 0; i < num_pieces; i++)
+    {
+        size += pieces[i].iov_len;
+    }
+    if (size > _ring.max_entry_size())
+    {
+        LogSink::write_blockv(pieces, num_pieces, meta, flush_now);
+        return;
+    }
+    (void)_ring.append(pieces, num_pieces, FULL_WAIT_MS);
+}
+
+/**
+ * @brief In a forked child, take a producer slot of its own
+ */
+void
+ShmRingSink::after_fork_child(void)
+{
+    _ring.after_fork_child();
+}
+
+ShmRingWriter::ShmRingWriter(void)
+    : _stop(false)
+    , _active(false)
+{
+}
+
+/**
+ * @brief ShmRingWriter destructor, stops the writer
+ */
+ShmRingWriter::~ShmRingWriter(void)
+{
+    stop();
+}
+
+/**
+ * @brief Attach to the ring and start the writer thread
+ * @param[in] name Ring name
+ * @param[in] capacity Size of the ring if it has to be created, in bytes
+ * @param[in] sink Where the data goes, the writer takes ownership
+ * @retval false if the ring can not be opened
+ */
+bool
+ShmRingWriter::start(const std::string &name, uint64_t capacity, std::unique_ptr<LogSink> sink)
+{
+    stop();
+    if ((nullptr == sink) || !_ring.open(name, capacity))
+    {
+        std::cerr << "[ShmRingWriter::start] can not write ring " << name << std::endl;
+        return false;
+    }
+    _sink = std::move(sink);
+    _stop.store(false);
+    _thread = std::thread(&ShmRingWriter::writer_thread, this);
+    return true;
+}
+
+/**
+ * @brief Write what has been committed, give up the writer role and stop the
+ * thread
+ */
+void
+ShmRingWriter::stop(void)
+{
+    if (_thread.joinable())
+    {
+        _stop.store(true);
+        _thread.join();
+    }
+    _ring.close();
+    _sink.reset();
+}
+
+/**
+ * @brief In a forked child the writer thread does not exist, the parent stays
+ * the writer
+ */
+void
+ShmRingWriter::after_fork_child(void)
+{
+    /* The thread and the open file are the parent's, abandoned as they are */
+    new (&_thread) std::thread();
+    (void)_sink.release();
+    _ring.after_fork_child();
+    _active.store(false);
+}
+
+void
+ShmRingWriter::writer_thread(void)
+{
+    bool unflushed = false;
+    while (!_stop.load(std::memory_order_relaxed))
+    {
+        if (!_ring.is_writer())
+        {
+            if (!_ring.acquire_writer())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(STANDBY_POLL_MS));
+                continue;
+            }
+            _active.store(true);
+        }
+        if (0 != _ring.drain(*_sink, IDLE_WAIT_MS))
+        {
+            unflushed = true;
+        }
+        else if (unflushed)
+        {
+            _sink->flush();
+            unflushed = false;
+        }
+    }
+
+    if (_ring.is_writer())
+    {
+        while (0 != _ring.drain(*_sink, 0))
+        {
+        }
+        _sink->flush();
+        _ring.release_writer();
+    }
+    _active.store(false);
+}
+
+} // namespace logging
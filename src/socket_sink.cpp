@@ -0,0 +1,584 @@
+#include "socket_sink.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>      // getaddrinfo
+#include <poll.h>
+#include <string.h>     // memset, memcpy, memrchr
+#include <sys/stat.h>   // fstat
+#include <sys/uio.h>    // iovec
+#include <sys/un.h>     // sockaddr_un
+#include <unistd.h>     // close, pread, ftruncate
+#include <algorithm>
+#include <iostream>
+
+namespace logging {
+
+/**
+ * @brief SocketSink constructor, the connection is attempted right away
+ * @param[in] address Collector address, see the class description
+ * @param[in] spill_file File that keeps the data the collector could not take.
+ * If empty, such data is dropped.
+ * @param[in] spill_max_bytes Maximum size of the spill file, data beyond it is
+ * dropped. 0 means no limit.
+ */
+SocketSink::SocketSink(const std::string &address, const std::string &spill_file, uint64_t spill_max_bytes)
+    : _valid(false)
+    , _datagram(false)
+    , _family(AF_UNSPEC)
+    , _fd(-1)
+    , _ever_connected(false)
+    , _backoff_ms(MIN_RECONNECT_MS)
+    , _next_connect(std::chrono::steady_clock::now())
+    , _spill_file(spill_file)
+    , _spill_fd(-1)
+    , _spill_max_bytes(spill_max_bytes)
+    , _spill_offset(0)
+    , _spill_size(0)
+    , _sent_bytes(0)
+    , _spilled_bytes(0)
+    , _dropped_bytes(0)
+    , _reconnects(0)
+{
+    _valid = parse_address(address);
+    if (!_valid)
+    {
+        std::cerr << "[SocketSink::SocketSink] invalid address " << address << std::endl;
+    }
+
+    if (!_spill_file.empty())
+    {
+        _spill_fd = ::open(_spill_file.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (_spill_fd < 0)
+        {
+            std::cerr << "[SocketSink::SocketSink] can not open spill file " << _spill_file << std::endl;
+        }
+        else
+        {
+            /* Data spilled by a previous run is sent first */
+            struct stat st;
+            if (0 == ::fstat(_spill_fd, &st))
+            {
+                _spill_size = st.st_size;
+            }
+        }
+    }
+
+    ensure_connected(true);
+}
+
+/**
+ * @brief SocketSink destructor, makes a last attempt to deliver the spilled
+ * data
+ */
+SocketSink::~SocketSink(void)
+{
+    if (spill_pending() > 0)
+    {
+        ensure_connected(true);
+        (void)replay_spill();
+    }
+
+    if (_fd >= 0)
+    {
+        ::close(_fd);
+        _fd = -1;
+    }
+    if (_spill_fd >= 0)
+    {
+        ::close(_spill_fd);
+        _spill_fd = -1;
+    }
+}
+
+/**
+ * @brief Check whether a log destination names a socket address rather than a
+ * file
+ */
+bool
+SocketSink::is_address(const std::string &destination)
+{
+    static const char *schemes[] = { "tcp://", "udp://", "unix://", "unixgram://" };
+    for (const char *scheme : schemes)
+    {
+        if (0 == destination.compare(0, strlen(scheme), scheme))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Split the address into socket family, type and location
+ */
+bool
+SocketSink::parse_address(const std::string &address)
+{
+    size_t pos = address.find("://");
+    if (std::string::npos == pos)
+    {
+        return false;
+    }
+    std::string scheme = address.substr(0, pos);
+    std::string rest   = address.substr(pos + 3);
+
+    if (("unix" == scheme) || ("unixgram" == scheme))
+    {
+        _family   = AF_UNIX;
+        _datagram = ("unixgram" == scheme);
+        _path     = rest;
+        return !_path.empty() && (_path.size() < sizeof(((struct sockaddr_un *)0)->sun_path));
+    }
+
+    if (("tcp" == scheme) || ("udp" == scheme))
+    {
+        _datagram = ("udp" == scheme);
+        /* host:port, the host may be a bracketed IPv6 address */
+        size_t colon = rest.rfind(':');
+        if ((std::string::npos == colon) || (colon + 1 == rest.size()))
+        {
+            return false;
+        }
+        _host = rest.substr(0, colon);
+        _port = rest.substr(colon + 1);
+        if ((_host.size() >= 2) && ('[' == _host.front()) && (']' == _host.back()))
+        {
+            _host = _host.substr(1, _host.size() - 2);
+        }
+        return !_host.empty();
+    }
+
+    return false;
+}
+
+/**
+ * @brief Open and connect the socket
+ * @retval true if connected
+ */
+bool
+SocketSink::connect_socket(void)
+{
+    int type = (_datagram ? SOCK_DGRAM : SOCK_STREAM) | SOCK_NONBLOCK | SOCK_CLOEXEC;
+
+    if (AF_UNIX == _family)
+    {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, _path.c_str(), _path.size());
+
+        int fd = ::socket(AF_UNIX, type, 0);
+        if (fd < 0)
+        {
+            return false;
+        }
+        /* A local connect either completes or fails immediately */
+        if (0 != ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)))
+        {
+            ::close(fd);
+            return false;
+        }
+        _fd = fd;
+        return true;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = _datagram ? SOCK_DGRAM : SOCK_STREAM;
+
+    struct addrinfo *result = nullptr;
+    if (0 != ::getaddrinfo(_host.c_str(), _port.c_str(), &hints, &result))
+    {
+        return false;
+    }
+
+    for (struct addrinfo *ai = result; (nullptr != ai) && (_fd < 0); ai = ai->ai_next)
+    {
+        int fd = ::socket(ai->ai_family, type, ai->ai_protocol);
+        if (fd < 0)
+        {
+            continue;
+        }
+        int ret = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if ((0 != ret) && (EINPROGRESS == errno))
+        {
+            /* Non-blocking TCP connect, wait for the handshake */
+            struct pollfd pfd;
+            pfd.fd     = fd;
+            pfd.events = POLLOUT;
+            int err    = ETIMEDOUT;
+            if (1 == ::poll(&pfd, 1, static_cast<int>(SEND_TIMEOUT_MS)))
+            {
+                socklen_t len = sizeof(err);
+                (void)::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            }
+            ret = (0 == err) ? 0 : -1;
+        }
+        if (0 == ret)
+        {
+            _fd = fd;
+        }
+        else
+        {
+            ::close(fd);
+        }
+    }
+    ::freeaddrinfo(result);
+
+    return _fd >= 0;
+}
+
+/**
+ * @brief Connect if there is no connection and the backoff has expired
+ * @param[in] force Ignore the backoff
+ */
+void
+SocketSink::ensure_connected(bool force)
+{
+    if (!_valid || (_fd >= 0))
+    {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (!force && (now < _next_connect))
+    {
+        return;
+    }
+
+    if (connect_socket())
+    {
+        if (_ever_connected)
+        {
+            _reconnects.fetch_add(1, std::memory_order_relaxed);
+        }
+        _ever_connected = true;
+        _backoff_ms     = MIN_RECONNECT_MS;
+    }
+    else
+    {
+        _next_connect = now + std::chrono::milliseconds(static_cast<int64_t>(_backoff_ms));
+        _backoff_ms   = std::min(_backoff_ms * 2, static_cast<uint32_t>(MAX_RECONNECT_MS));
+    }
+}
+
+/**
+ * @brief Close the socket after an error and schedule the reconnection
+ */
+void
+SocketSink::close_socket(void)
+{
+    if (_fd >= 0)
+    {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _next_connect = std::chrono::steady_clock::now() + std::chrono::milliseconds(static_cast<int64_t>(_backoff_ms));
+}
+
+/**
+ * @brief Wait until the socket is writable
+ * @retval true if writable, false on timeout or error
+ */
+bool
+SocketSink::wait_writable(void)
+{
+    struct pollfd pfd;
+    pfd.fd     = _fd;
+    pfd.events = POLLOUT;
+    int ret;
+    do
+    {
+        ret = ::poll(&pfd, 1, static_cast<int>(SEND_TIMEOUT_MS));
+    } while ((ret < 0) && (EINTR == errno));
+
+    if ((1 == ret) && (0 != (pfd.revents & (POLLERR | POLLHUP))))
+    {
+        close_socket();
+        return false;
+    }
+    return 1 == ret;
+}
+
+/**
+ * @brief Send data on the socket
+ * @retval Number of bytes the socket accepted. On datagram sockets this is
+ * always the end of a record.
+ */
+size_t
+SocketSink::send_data(const char *data, size_t size)
+{
+    size_t sent = _datagram ? send_datagrams(data, size) : send_stream(data, size);
+    _sent_bytes.fetch_add(sent, std::memory_order_relaxed);
+    return sent;
+}
+
+size_t
+SocketSink::send_stream(const char *data, size_t size)
+{
+    size_t sent = 0;
+    while ((sent < size) && (_fd >= 0))
+    {
+        struct iovec iov;
+        iov.iov_base = const_cast<char *>(data + sent);
+        iov.iov_len  = size - sent;
+
+        /* sendmsg is writev with MSG_NOSIGNAL, a closed peer must not raise
+         * SIGPIPE in the application */
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = &iov;
+        msg.msg_iovlen = 1;
+
+        ssize_t ret = ::sendmsg(_fd, &msg, MSG_NOSIGNAL);
+        if (ret > 0)
+        {
+            sent += ret;
+        }
+        else if ((ret < 0) && (EINTR == errno))
+        {
+            continue;
+        }
+        else if ((ret < 0) && ((EAGAIN == errno) || (EWOULDBLOCK == errno)))
+        {
+            if (!wait_writable())
+            {
+                break;
+            }
+        }
+        else
+        {
+            close_socket();
+        }
+    }
+    return sent;
+}
+
+size_t
+SocketSink::send_datagrams(const char *data, size_t size)
+{
+    struct mmsghdr msgs[DATAGRAM_BATCH];
+    struct iovec   iovs[DATAGRAM_BATCH];
+    size_t         sent = 0;
+
+    while ((sent < size) && (_fd >= 0))
+    {
+        /* Cut the next datagrams at record boundaries */
+        uint32_t count = 0;
+        size_t   pos   = sent;
+        while ((pos < size) && (count < DATAGRAM_BATCH))
+        {
+            size_t len = std::min(size - pos, static_cast<size_t>(MAX_DATAGRAM_SIZE));
+            if (pos + len < size)
+            {
+                const void *nl = memrchr(data + pos, '\n', len);
+                /* A record longer than a datagram is cut where it has to */
+                if (nullptr != nl)
+                {
+                    len = static_cast<const char *>(nl) - (data + pos) + 1;
+                }
+            }
+            iovs[count].iov_base = const_cast<char *>(data + pos);
+            iovs[count].iov_len  = len;
+            memset(&msgs[count].msg_hdr, 0, sizeof(msgs[count].msg_hdr));
+            msgs[count].msg_hdr.msg_iov    = &iovs[count];
+            msgs[count].msg_hdr.msg_iovlen = 1;
+            pos += len;
+            count++;
+        }
+
+        int ret = ::sendmmsg(_fd, msgs, count, MSG_NOSIGNAL);
+        if (ret > 0)
+        {
+            for (int i = 0; i < ret; i++)
+            {
+                sent += iovs[i].iov_len;
+            }
+        }
+        else if ((ret < 0) && (EINTR == errno))
+        {
+            continue;
+        }
+        else if ((ret < 0) && ((EAGAIN == errno) || (EWOULDBLOCK == errno) || (ENOBUFS == errno)))
+        {
+            if (!wait_writable())
+            {
+                break;
+            }
+        }
+        else
+        {
+            close_socket();
+        }
+    }
+    return sent;
+}
+
+/**
+ * @brief Append data to the spill file, or drop it
+ */
+void
+SocketSink::spill(const char *data, size_t size)
+{
+    if ((_spill_fd < 0) || ((0 != _spill_max_bytes) && (_spill_size + size > _spill_max_bytes)))
+    {
+        _dropped_bytes.fetch_add(size, std::memory_order_relaxed);
+        return;
+    }
+
+    size_t written = 0;
+    while (written < size)
+    {
+        ssize_t ret = ::write(_spill_fd, data + written, size - written);
+        if (ret > 0)
+        {
+            written += ret;
+        }
+        else if ((ret < 0) && (EINTR == errno))
+        {
+            continue;
+        }
+        else
+        {
+            std::cerr << "[SocketSink::spill] write spill file failed, errno " << errno << std::endl;
+            break;
+        }
+    }
+    _spill_size += written;
+    _spilled_bytes.fetch_add(written, std::memory_order_relaxed);
+    _dropped_bytes.fetch_add(size - written, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Send the pending part of the spill file
+ * @retval true if the spill file has been drained
+ */
+bool
+SocketSink::replay_spill(void)
+{
+    if (_replay_buffer.empty())
+    {
+        _replay_buffer.resize(REPLAY_CHUNK_SIZE);
+    }
+
+    while ((spill_pending() > 0) && (_fd >= 0))
+    {
+        size_t  want = std::min(spill_pending(), static_cast<uint64_t>(REPLAY_CHUNK_SIZE));
+        ssize_t got  = ::pread(_spill_fd, _replay_buffer.data(), want, _spill_offset);
+        if (got <= 0)
+        {
+            if ((got < 0) && (EINTR == errno))
+            {
+                continue;
+            }
+            std::cerr << "[SocketSink::replay_spill] read spill file failed" << std::endl;
+            /* Give up on the unreadable part rather than looping forever */
+            _dropped_bytes.fetch_add(spill_pending(), std::memory_order_relaxed);
+            _spill_offset = _spill_size;
+            break;
+        }
+
+        size_t len = got;
+        if (_datagram && (static_cast<uint64_t>(got) < spill_pending()))
+        {
+            /* Keep datagrams on record boundaries, the rest of the last
+             * record is sent with the next chunk */
+            const void *nl = memrchr(_replay_buffer.data(), '\n', len);
+            if (nullptr != nl)
+            {
+                len = static_cast<const char *>(nl) - _replay_buffer.data() + 1;
+            }
+        }
+
+        size_t sent = send_data(_replay_buffer.data(), len);
+        _spill_offset += sent;
+        if (sent < len)
+        {
+            break;
+        }
+    }
+
+    if (0 == spill_pending())
+    {
+        if ((_spill_size > 0) && (0 != ::ftruncate(_spill_fd, 0)))
+        {
+            std::cerr << "[SocketSink::replay_spill] truncate spill file failed" << std::endl;
+        }
+        _spill_offset = 0;
+        _spill_size   = 0;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Send log data, spill or drop what the collector does not take
+ * @param [in] logdata The source address of the data to be sent
+ * @param [in] size The size of the data to be sent
+ * @param [in] flush_now Unused, data is never held back
+ */
+void
+SocketSink::write_logdata(const char *logdata, uint32_t size, bool flush_now)
+{
+    (void)flush_now;
+
+    ensure_connected();
+
+    size_t sent = 0;
+    if ((_fd >= 0) && ((0 == spill_pending()) || replay_spill()))
+    {
+        sent = send_data(logdata, size);
+    }
+    if (sent < size)
+    {
+        spill(logdata + sent, size - sent);
+    }
+}
+
+/**
+ * @brief In a forked child, open a connection and a spill file of its own (the
+ * spill file name gets the pid appended)
+ */
+void
+SocketSink::after_fork_child(void)
+{
+    /* Sharing a stream with the parent would interleave the data */
+    if (_fd >= 0)
+    {
+        ::close(_fd);
+        _fd = -1;
+    }
+
+    /* The pending spill data is replayed by the parent */
+    if (_spill_fd >= 0)
+    {
+        ::close(_spill_fd);
+        _spill_file += "." + std::to_string(::getpid());
+        _spill_fd = ::open(_spill_file.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+    _spill_offset   = 0;
+    _spill_size     = 0;
+    _ever_connected = false;
+    _backoff_ms     = MIN_RECONNECT_MS;
+
+    ensure_connected(true);
+}
+
+/**
+ * @brief Reconnect if due and replay the spill file
+ */
+void
+SocketSink::flush(void)
+{
+    if (spill_pending() > 0)
+    {
+        ensure_connected();
+        if (_fd >= 0)
+        {
+            (void)replay_spill();
+        }
+    }
+}
+
+} // namespace logging
@@ -0,0 +1,105 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+bool
+contains (const std::string &text, const std::string &needle)
+{
+    if (std::string::npos != text.find(needle))
+    {
+        return true;
+    }
+    std::cout << "missing: " << needle << std::endl;
+    return false;
+}
+
+std::string
+tid_str (void)
+{
+    return std::to_string(::syscall(SYS_gettid));
+}
+
+int
+main (void)
+{
+    const char *name = "test_context.log";
+    remove(name);
+    LogContorl cfg;
+    cfg.use_ms             = false;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    cfg.show_context       = true;
+    log_init(cfg);
+
+    log_set_thread_name("main");
+    std::string main_tid = tid_str();
+    LOG(INFO) << "no fields\n";
+    {
+        LOG_CONTEXT("request", "abc-1");
+        LOG_CONTEXT("shard", 7);
+        LOG(INFO) << "outer request\n";
+        {
+            LOG_CONTEXT("request", "inner request");
+            LOG(INFO) << "inner request\n";
+            LOG_KV(INFO, "kv record");
+        }
+        LOG(INFO) << "outer again\n";
+    }
+    LOG(INFO) << "fields gone\n";
+
+    std::string worker_tid;
+    std::thread worker([&worker_tid] () {
+        pthread_setname_np(pthread_self(), "worker-1");
+        worker_tid = tid_str();
+        LOG_CONTEXT("request", "from-worker");
+        LOG(INFO) << "worker record\n";
+    });
+    worker.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    std::string text = read_file(name);
+    std::string main_ctx = " tid=" + main_tid + " thread=main";
+    check(contains(text, main_ctx + " ] no fields"), "thread fields");
+    check(contains(text, main_ctx + " request=abc-1 shard=7 ] outer request"), "context fields");
+    check(contains(text, main_ctx + " shard=7 request=\"inner request\" ] inner request"), "inner field hides outer");
+    check(contains(text, main_ctx + " request=abc-1 shard=7 ] outer again"), "outer field restored");
+    check(contains(text, main_ctx + " ] fields gone"), "fields removed");
+    check(contains(text, "\"tid\":" + main_tid + ",\"thread\":\"main\",\"shard\":7,\"request\":\"inner request\""),
+          "json record");
+    check(contains(text, " tid=" + worker_tid + " thread=worker-1 request=from-worker ] worker record"),
+          "thread name and fields of another thread");
+
+    /* Cost of the context, which is rendered once and copied per record */
+    const int ROUNDS = 200000;
+    double    cost[2];
+    for (int pass = 0; pass < 2; pass++)
+    {
+        cfg.show_context = (0 == pass);
+        log_reconfigure(cfg);
+        LOG_CONTEXT("request", "0123456789abcdef");
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < ROUNDS; i++)
+        {
+            LOG(INFO) << "record " << i << "\n";
+        }
+        cost[pass] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / ROUNDS;
+    }
+    std::cout << "with context: " << cost[0] << " ns/record, without: " << cost[1] << " ns/record" << std::endl;
+
+    remove(name);
+    std::cout << (failures ? "test_context FAILED" : "test_context PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log_dedup.h"
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+int
+count (const std::string &text, const std::string &needle)
+{
+    int    n   = 0;
+    size_t pos = 0;
+    while (std::string::npos != (pos = text.find(needle, pos)))
+    {
+        n++;
+        pos += needle.size();
+    }
+    return n;
+}
+
+/**
+ * @brief Store a record the way AsyncLogging does, the time stamp is the
+ * first time_len bytes after a 9 byte level prefix
+ */
+void
+add_record (DataBuffer &buffer, const std::string &record, size_t time_len = 12)
+{
+    size_t offset = buffer.get_data_size();
+    buffer.input_data(record.data(), record.size());
+    buffer.note_span(offset, 9, 9 + time_len);
+}
+
+std::string
+contents (DataBuffer &buffer)
+{
+    return std::string(buffer.get_buffer(), buffer.get_data_size());
+}
+
+int
+main (void)
+{
+    /* Repeats within the window are dropped, the rest moves together */
+    {
+        LogDedup    dedup;
+        DataBuffer  buffer;
+        std::string summaries;
+        add_record(buffer, "ERROR: [ 12:00:00.001 ] retry failed\n");
+        add_record(buffer, "INFO : [ 12:00:00.002 ] other\n");
+        add_record(buffer, "ERROR: [ 12:00:00.003 ] retry failed\n");
+        buffer.input_data("raw\n", 4);
+        add_record(buffer, "ERROR: [ 12:00:00.004 ] retry failed\n");
+        add_record(buffer, "ERROR: [ 12:00:00.005 ] retry FAILED\n");
+        dedup.filter(buffer, 100, 1000, summaries);
+        check(contents(buffer)
+                  == "ERROR: [ 12:00:00.001 ] retry failed\nINFO : [ 12:00:00.002 ] other\nraw\n"
+                     "ERROR: [ 12:00:00.005 ] retry FAILED\n",
+              "filtered buffer: " + contents(buffer));
+        check(summaries.empty() && dedup.pending(), "window open");
+
+        /* The window ends: the last repeat stands for all of them */
+        dedup.expire(1050, summaries);
+        check(summaries.empty(), "window still open");
+        dedup.expire(1100, summaries);
+        check("ERROR: [ 12:00:00.004 ] retry failed [last message repeated 2 times]\n" == summaries,
+              "summary: " + summaries);
+        check(!dedup.pending(), "windows closed");
+
+        DedupStats stats = dedup.stats();
+        check((5 == stats.records) && (2 == stats.collapsed) && (1 == stats.summaries), "stats");
+
+        /* A single repeat is written as it is, later occurrences open a new window */
+        buffer.reset_buffer();
+        summaries.clear();
+        add_record(buffer, "INFO : [ 12:00:01.000 ] again\n");
+        add_record(buffer, "INFO : [ 12:00:01.001 ] again\n");
+        dedup.filter(buffer, 100, 2000, summaries);
+        buffer.reset_buffer();
+        add_record(buffer, "INFO : [ 12:00:01.500 ] again\n");
+        dedup.filter(buffer, 100, 2200, summaries);
+        check("INFO : [ 12:00:01.001 ] again\n" == summaries, "single repeat: " + summaries);
+        check("INFO : [ 12:00:01.500 ] again\n" == contents(buffer), "new window");
+
+        /* Structured records get a field */
+        buffer.reset_buffer();
+        summaries.clear();
+        for (int i = 0; i < 3; i++)
+        {
+            std::string time = "\"12:00:0" + std::to_string(i) + "\"";
+            std::string json = "{\"level\":\"error\",\"time\":" + time + ",\"msg\":\"x\"}\n";
+            size_t      offset = buffer.get_data_size();
+            buffer.input_data(json.data(), json.size());
+            buffer.note_span(offset, 25, 25 + time.size());
+        }
+        dedup.filter(buffer, 100, 3000, summaries);
+        dedup.expire(UINT64_MAX, summaries);
+        check("{\"level\":\"error\",\"time\":\"12:00:02\",\"msg\":\"x\",\"repeated\":2}\n" == summaries,
+              "json summary: " + summaries);
+    }
+
+    /* Through the logger: a retry loop in the priority lane next to normal records */
+    const char *name = "test_dedup.log";
+    remove(name);
+    LogContorl cfg;
+    cfg.use_ms             = true;
+    cfg.show_path          = true;
+    cfg.show_func          = true;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    cfg.dedup_window_ms    = 300;
+    log_init(cfg);
+
+    const int REPEATS = 20000;
+    for (int i = 0; i < REPEATS; i++)
+    {
+        LOG(ERROR) << "connect to 10.0.0.1:80 failed, retrying\n";
+        if (0 == i % 100)
+        {
+            LOG(INFO) << "progress " << i << "\n";
+        }
+    }
+    /* The window ends, the idle background thread writes the summary */
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    LOG(ERROR) << "connect to 10.0.0.1:80 failed, retrying\n";
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    std::string text  = read_file(name);
+    int         lines = count(text, "failed, retrying");
+    /* The summary line is the last repeat, its count covers it */
+    int         total = lines - 1;
+    size_t      mark  = text.find("[last message repeated ");
+    if (std::string::npos != mark)
+    {
+        total += atoi(text.c_str() + mark + 23);
+    }
+    check(REPEATS + 1 == total, "records accounted for: " + std::to_string(total));
+    check(lines < 10, "repeats collapsed, lines " + std::to_string(lines));
+    check(REPEATS / 100 == count(text, "progress "), "other records kept");
+
+    DedupStats stats = log_dedup_stats();
+    std::cout << "records:" << stats.records << " collapsed:" << stats.collapsed << " summaries:" << stats.summaries
+              << " bytes saved:" << stats.bytes_saved << std::endl;
+    check(stats.collapsed + lines - 1 == static_cast<uint64_t>(REPEATS + 1), "logger stats");
+
+    /* Throughput of the filter on distinct records, the worst case */
+    {
+        LogDedup                 dedup;
+        DataBuffer               buffer;
+        std::string              summaries;
+        std::vector<std::string> records;
+        for (int i = 0; i < 4096; i++)
+        {
+            records.push_back("INFO : [ 12:00:00.000 ] /src/server.cpp:120 handle request " + std::to_string(i)
+                              + " done in 12 us\n");
+        }
+        size_t bytes = 0;
+        auto   begin = std::chrono::steady_clock::now();
+        for (int round = 0; round < 50; round++)
+        {
+            for (size_t r = 0; r < records.size();)
+            {
+                buffer.reset_buffer();
+                while ((r < records.size()) && (buffer.get_data_size() + records[r].size() <= buffer.get_buffer_size()))
+                {
+                    add_record(buffer, records[r++]);
+                }
+                dedup.filter(buffer, 1, round * 10, summaries);
+                bytes += buffer.get_data_size();
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << "filter: " << bytes / seconds / (1 << 20) << " MB/s" << std::endl;
+    }
+
+    remove(name);
+    std::cout << (failures ? "test_dedup FAILED" : "test_dedup PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+#include <signal.h>
+#include <stdio.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+bool
+contains (const std::string &text, const std::string &needle)
+{
+    return std::string::npos != text.find(needle);
+}
+
+int
+count (const std::string &text, const std::string &needle)
+{
+    int    n   = 0;
+    size_t pos = 0;
+    while (std::string::npos != (pos = text.find(needle, pos)))
+    {
+        n++;
+        pos += needle.size();
+    }
+    return n;
+}
+
+int
+main (void)
+{
+    const char *name   = "test_flight.log";
+    const char *flight = "test_flight.log.flight";
+    remove(name);
+    remove(flight);
+
+    LogContorl cfg;
+    cfg.use_ms             = true;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    cfg.flight_level       = LOG_DEBUG;
+    cfg.flight_kbytes      = 64;
+    cfg.flight_signal      = true;
+    log_init(cfg);
+
+    check(LOG_ENABLED(DEBUG), "debug records are built");
+    check(!LOG_ENABLED(INNER_DEBUG), "below the flight level");
+
+    /* An error dumps the context that led to it */
+    for (int i = 0; i < 100; i++)
+    {
+        LOG(DEBUG) << "context " << i << "\n";
+        if (0 == i % 10)
+        {
+            LOG(INFO) << "progress " << i << "\n";
+        }
+    }
+    LOG(ERROR) << "request failed\n";
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    std::string text  = read_file(name);
+    std::string dumps = read_file(flight);
+    check(contains(text, "request failed") && (10 == count(text, "progress ")), "records at the level written");
+    check(!contains(text, "context "), "records below the level not written");
+    check(1 == count(dumps, "==== flight recorder dump"), "one dump");
+    check(contains(dumps, "trigger record"), "dump trigger");
+    check((100 == count(dumps, "context ")) && contains(dumps, "context 0\n") && contains(dumps, "context 99\n"),
+          "dump holds the context");
+    check(!contains(dumps, "progress "), "dump holds only the captured records");
+    check(0 == log_flight_stats().overwritten, "nothing overwritten yet");
+
+    /* The ring keeps the most recent records, a dump empties it */
+    const int MANY = 20000;
+    for (int i = 0; i < MANY; i++)
+    {
+        LOG(DEBUG) << "burst " << i << " with some padding to make the record longer\n";
+    }
+    check(log_flight_dump(), "dump through the api");
+    dumps = read_file(flight);
+    int kept = count(dumps, "burst ");
+    check(contains(dumps, "burst " + std::to_string(MANY - 1) + " "), "most recent record kept");
+    check(!contains(dumps, "burst 0 "), "oldest records dropped");
+    check((kept > 0) && (kept * 60 <= 64 * 1024), "ring size kept: " + std::to_string(kept));
+    check(contains(dumps, "trigger api"), "api trigger");
+    check(log_flight_stats().overwritten > 0, "overwritten bytes counted");
+
+    /* SIGUSR1, written by the background thread within a second */
+    LOG(DEBUG) << "before the signal\n";
+    raise(SIGUSR1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    dumps = read_file(flight);
+    check(contains(dumps, "trigger signal") && contains(dumps, "before the signal"), "signal trigger");
+    check(1 == count(dumps, "before the signal"), "records dumped once");
+
+    FlightStats stats = log_flight_stats();
+    std::cout << "captured:" << stats.records << " overwritten:" << stats.overwritten << " dumps:" << stats.dumps
+              << " dumped bytes:" << stats.dumped_bytes << std::endl;
+    check(3 == stats.dumps, "dump count");
+
+    /* Cost of a captured record next to a written one */
+    const int ROUNDS = 200000;
+    auto      begin  = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        LOG(DEBUG) << "captured record " << i << "\n";
+    }
+    double captured = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / ROUNDS;
+    begin           = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        LOG(INFO) << "written record " << i << "\n";
+    }
+    double written = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / ROUNDS;
+    std::cout << "captured: " << captured << " ns/record, written: " << written << " ns/record" << std::endl;
+
+    /* Threads capture into buffers of their own; those that have exited
+     * hand theirs to the ring. Every record of every thread is dumped once,
+     * the records of a thread in order. */
+    const int THREADS = 4;
+    const int RECORDS = 5000;
+    cfg.flight_kbytes = 4096;
+    check(log_reconfigure(cfg), "ring resized");
+    check(log_flight_dump(), "ring emptied");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+    {
+        threads.emplace_back([t] () {
+            for (int i = 0; i < RECORDS; i++)
+            {
+                LOG(DEBUG) << "thread " << t << " capture " << i << "\n";
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    LOG(DEBUG) << "main capture\n";
+    uint64_t overwritten = log_flight_stats().overwritten;
+    check(log_flight_dump(), "dump of the threads");
+    dumps = read_file(flight);
+    dumps = dumps.substr(dumps.rfind("==== flight recorder dump"));
+    check(contains(dumps, "main capture\n"), "buffer of the dumping thread");
+    for (int t = 0; t < THREADS; t++)
+    {
+        std::string tag  = "thread " + std::to_string(t) + " capture ";
+        size_t      pos  = 0;
+        int         next = 0;
+        while (std::string::npos != (pos = dumps.find(tag, pos)))
+        {
+            pos += tag.size();
+            if (std::stoi(dumps.substr(pos)) != next)
+            {
+                break;
+            }
+            next++;
+        }
+        check(RECORDS == next, tag + "records in order " + std::to_string(next));
+    }
+    check(overwritten == log_flight_stats().overwritten, "nothing overwritten by the threads");
+
+    /* Switched off: nothing below the level is built any more */
+    cfg.flight_level = NUM_LOG_LEVELS;
+    check(log_reconfigure(cfg), "reconfigure");
+    check(!LOG_ENABLED(DEBUG), "debug records skipped");
+    check(!log_flight_dump(), "no dump when off");
+
+    remove(name);
+    remove(flight);
+    std::cout << (failures ? "test_flight FAILED" : "test_flight PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,326 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+const char *file_name         = "test_fork.log";
+const int   num_children      = 4;
+const int   records_per_child = 20000;
+
+/**
+ * @brief Count the records of a file by kind, and check that no parent record
+ * shows up twice
+ */
+void
+scan_file (const std::string &name, int &parent_records, int &child_records, bool &duplicates)
+{
+    std::ifstream         in(name);
+    std::string           line;
+    std::set<std::string> seen;
+    parent_records = child_records = 0;
+    duplicates                     = false;
+    while (std::getline(in, line))
+    {
+        size_t pos = line.find("] ");
+        std::string body = (std::string::npos == pos) ? line : line.substr(pos + 2);
+        if (0 == body.compare(0, 6, "parent"))
+        {
+            parent_records++;
+            duplicates |= !seen.insert(body).second;
+        }
+        else if (0 == body.compare(0, 5, "child"))
+        {
+            child_records++;
+        }
+    }
+}
+
+void
+child_main (void)
+{
+    /* Full speed logging from several threads of the child */
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; t++)
+    {
+        threads.push_back(std::thread([t] () {
+            for (int i = 0; i < records_per_child / 2; i++)
+            {
+                LOG(INFO) << "child " << getpid() << " thread " << t << " record " << i << "\n";
+            }
+        }));
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+}
+
+/**
+ * @brief The child handler leaves opening the child's file and starting its
+ * background thread to the first record, which may come from a thread of the
+ * child other than the forking one. A child that never logs creates nothing.
+ */
+void
+test_lazy_restart (void)
+{
+    pid_t quiet = fork();
+    if (0 == quiet)
+    {
+        exit(0);
+    }
+    pid_t lazy = fork();
+    if (0 == lazy)
+    {
+        std::string own     = std::string(file_name) + "." + std::to_string(getpid());
+        bool        early   = (0 == access(own.c_str(), F_OK));
+        std::thread logger([] () { LOG(INFO) << "lazy child record\n"; });
+        logger.join();
+        bool        created = (0 == access(own.c_str(), F_OK));
+        exit(early ? 2 : (created ? 0 : 3));
+    }
+
+    int status = 0;
+    waitpid(quiet, &status, 0);
+    std::string quiet_name = std::string(file_name) + "." + std::to_string(quiet);
+    check(WIFEXITED(status) && (0 == WEXITSTATUS(status)), "quiet child exit status");
+    check(0 != access(quiet_name.c_str(), F_OK), "no file for a child that did not log");
+
+    waitpid(lazy, &status, 0);
+    std::string lazy_name = std::string(file_name) + "." + std::to_string(lazy);
+    check(WIFEXITED(status) && (0 == WEXITSTATUS(status)),
+          "lazy child file opened on its first record, status " + std::to_string(WEXITSTATUS(status)));
+    check(read_file(lazy_name).find("lazy child record\n") != std::string::npos, "lazy child record written");
+    remove(quiet_name.c_str());
+    remove(lazy_name.c_str());
+}
+
+/**
+ * @brief Names of the rolled files of a log file in the current directory
+ */
+std::vector<std::string>
+rolled_files (const std::string &base)
+{
+    std::vector<std::string> files;
+    std::string              prefix = base + ".";
+    DIR                     *dir    = opendir(".");
+    struct dirent           *ent    = nullptr;
+    while ((nullptr != dir) && (nullptr != (ent = readdir(dir))))
+    {
+        std::string name = ent->d_name;
+        if ((0 == name.compare(0, prefix.size(), prefix)) && (std::string::npos != name.find('_', prefix.size())))
+        {
+            files.push_back(name);
+        }
+    }
+    if (nullptr != dir)
+    {
+        closedir(dir);
+    }
+    return files;
+}
+
+/**
+ * @brief Count the lines of a file that start with tag after the header
+ */
+int
+count_records (const std::string &name, const std::string &tag)
+{
+    std::ifstream in(name);
+    std::string   line;
+    int           count = 0;
+    while (std::getline(in, line))
+    {
+        size_t pos = line.find("] ");
+        if ((std::string::npos != pos) && (0 == line.compare(pos + 2, tag.size(), tag)))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief A child sharing the file with its parent: once the parent has rolled
+ * the file, the child's records go to the new file and not to the rolled one
+ */
+void
+test_shared_roll (void)
+{
+    const char *shared_name = "test_fork_shared.log";
+    const int   records     = 2000;
+    remove(shared_name);
+    for (const std::string &name : rolled_files(shared_name))
+    {
+        remove(name.c_str());
+    }
+
+    LogContorl cfg;
+    cfg.use_ms             = false;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_DEBUG;
+    cfg.logfile            = shared_name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 64;
+    cfg.fork_per_pid_file  = false;
+    check(log_reconfigure(cfg), "switched to the shared file");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    int to_child[2], to_parent[2];
+    check((0 == pipe(to_child)) && (0 == pipe(to_parent)), "pipes");
+    pid_t pid = fork();
+    if (0 == pid)
+    {
+        char go = 0;
+        for (int i = 0; i < records; i++)
+        {
+            LOG(INFO) << "before roll " << i << "\n";
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        (void)!write(to_parent[1], &go, 1);
+        (void)!read(to_child[0], &go, 1);
+        for (int i = 0; i < records; i++)
+        {
+            LOG(INFO) << "after roll " << i << "\n";
+        }
+        exit(0);
+    }
+
+    /* The parent rolls the file a few times while the child waits */
+    char go = 0;
+    (void)!read(to_parent[0], &go, 1);
+    for (int i = 0; i < 4000; i++)
+    {
+        LOG(INFO) << "parent record " << i << " " << std::string(64, 'p') << "\n";
+        if (0 == i % 500)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    std::vector<std::string> rolled = rolled_files(shared_name);
+    check(rolled.size() >= 2, "parent rolled the shared file " + std::to_string(rolled.size()) + " times");
+    (void)!write(to_child[1], &go, 1);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    check(WIFEXITED(status) && (0 == WEXITSTATUS(status)), "shared child exit status");
+
+    int before = 0, after_rolled = 0;
+    for (const std::string &name : rolled_files(shared_name))
+    {
+        before += count_records(name, "before roll");
+        after_rolled += count_records(name, "after roll");
+    }
+    before += count_records(shared_name, "before roll");
+    int after = count_records(shared_name, "after roll");
+    check(records == before, "child records before the roll " + std::to_string(before));
+    check(records == after, "child records after the roll in the new file " + std::to_string(after));
+    check(0 == after_rolled, "child records after the roll in rolled files " + std::to_string(after_rolled));
+
+    for (const std::string &name : rolled_files(shared_name))
+    {
+        remove(name.c_str());
+    }
+    remove(shared_name);
+}
+
+int
+main (void)
+{
+    remove(file_name);
+
+    LogContorl cfg;
+    cfg.use_ms             = false;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_DEBUG;
+    cfg.logfile            = file_name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    cfg.fork_per_pid_file  = true;
+    log_init(cfg);
+
+    /* The parent keeps logging from other threads while it forks, so the
+     * locks and buffers are in use at fork time */
+    std::atomic<bool>        running(true);
+    std::atomic<int>         parent_records(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; t++)
+    {
+        threads.push_back(std::thread([&running, &parent_records, t] () {
+            int i = 0;
+            while (running)
+            {
+                LOG(INFO) << "parent thread " << t << " record " << i++ << "\n";
+                parent_records++;
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+        }));
+    }
+
+    std::vector<pid_t> children;
+    for (int c = 0; c < num_children; c++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        pid_t pid = fork();
+        if (0 == pid)
+        {
+            child_main();
+            /* The static AsyncLogging of the child writes the rest on exit */
+            exit(0);
+        }
+        children.push_back(pid);
+    }
+
+    for (pid_t pid : children)
+    {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        check(WIFEXITED(status) && (0 == WEXITSTATUS(status)), "child exit status");
+
+        std::string name = std::string(file_name) + "." + std::to_string(pid);
+        int         parent_lines, child_lines;
+        bool        duplicates;
+        scan_file(name, parent_lines, child_lines, duplicates);
+        check(records_per_child == child_lines, name + " child records " + std::to_string(child_lines));
+        check(0 == parent_lines, name + " has no parent records");
+        remove(name.c_str());
+    }
+
+    test_lazy_restart();
+
+    running = false;
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    /* The idle background thread writes the last buffer within a second */
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    int  parent_lines, child_lines;
+    bool duplicates;
+    scan_file(file_name, parent_lines, child_lines, duplicates);
+    check(parent_records == parent_lines,
+          "parent records " + std::to_string(parent_lines) + " of " + std::to_string(parent_records));
+    check(0 == child_lines, "no child records in the parent file");
+    check(!duplicates, "no parent record written twice");
+    remove(file_name);
+
+    test_shared_roll();
+
+    std::cout << (failures ? "test_fork FAILED" : "test_fork PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "crc32c.h"
+#include "log_frame.h"
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+FrameReport
+verify (const std::string &data)
+{
+    FrameVerifier verifier;
+    verifier.scan(data.data(), data.size());
+    return verifier.finish();
+}
+
+int
+main (void)
+{
+    /* Checksum: the standard check value, and pieces chain like one block */
+    const char *digits = "123456789";
+    check(0xE3069283u == crc32c(0, digits, 9), "crc32c check value");
+    check(crc32c(0, digits, 9) == crc32c(crc32c(0, digits, 4), digits + 4, 5), "crc32c in pieces");
+    std::cout << "crc32c hardware: " << (crc32c_hardware() ? "yes" : "no") << std::endl;
+
+    /* Frame prefix round trip */
+    char     frame[RECORD_FRAME_SIZE + 1] = {0};
+    uint64_t seq;
+    uint32_t crc, size;
+    record_frame(0x0123456789abcdefull, 0x1a2b, frame);
+    check(std::string("@0123456789abcdef:00000000:00001a2b ") == frame, std::string("frame text ") + frame);
+    set_frame_crc(frame, 0xdeadbeef);
+    check(std::string("@0123456789abcdef:deadbeef:00001a2b ") == frame, std::string("frame text ") + frame);
+    check(parse_record_frame(frame, RECORD_FRAME_SIZE, seq, crc, size) && (0x0123456789abcdefull == seq)
+              && (0xdeadbeef == crc) && (0x1a2b == size),
+          "frame parse");
+    check(!parse_record_frame(frame, RECORD_FRAME_SIZE - 1, seq, crc, size), "short frame rejected");
+
+    const char *name = "test_framing.log";
+    remove(name);
+    LogContorl cfg;
+    cfg.use_ms             = true;
+    cfg.show_path          = true;
+    cfg.show_func          = true;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    cfg.record_framing     = true;
+    log_init(cfg);
+
+    /* Both lanes, from several threads */
+    const int                THREADS = 4;
+    const int                RECORDS = 2000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+    {
+        threads.push_back(std::thread([t] () {
+            for (int i = 0; i < RECORDS; i++)
+            {
+                if (0 == i % 10)
+                {
+                    LOG(WARNING) << "thread " << t << " urgent " << i;
+                }
+                else
+                {
+                    LOG(INFO) << "thread " << t << " record " << i;
+                }
+                if (0 == i % 100)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+        }));
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    /* The idle background thread writes the last buffer within a second */
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    std::string data   = read_file(name);
+    FrameReport report = verify(data);
+    check(report.clean(), "written log is clean");
+    check(THREADS * RECORDS == static_cast<int>(report.records), "records " + std::to_string(report.records));
+    check((1 == report.runs) && (0 == report.unframed), "one run, nothing unframed");
+
+    /* A changed byte */
+    size_t      middle  = data.find("record 1001");
+    std::string damaged = data;
+    damaged[middle]     = 'R';
+    report              = verify(damaged);
+    check((1 == report.corrupt) && (0 == report.torn) && (0 == report.missing), "corruption detected");
+
+    /* A record cut short by the end of the file */
+    report = verify(data.substr(0, data.size() - 5));
+    check((1 == report.torn) && (0 == report.corrupt), "torn tail detected");
+
+    /* A partial write followed by the next record */
+    size_t start = data.rfind('@', middle);
+    size_t next  = data.find('@', middle);
+    damaged      = data.substr(0, start + 50) + data.substr(next);
+    report       = verify(damaged);
+    check((1 == report.torn) && (0 == report.corrupt) && (0 == report.missing), "torn record detected");
+
+    /* A record that never made it */
+    damaged = data.substr(0, start) + data.substr(next);
+    report  = verify(damaged);
+    check((1 == report.missing) && (1 == report.gaps.size()) && report.gaps[0].first == report.gaps[0].last,
+          "gap detected");
+
+    /* Duplicated data and a second run */
+    report = verify(data.substr(0, next) + data.substr(start));
+    check(1 == report.duplicates, "duplicate detected");
+    report = verify(data + data);
+    check((2 == report.runs) && report.clean(), "second run");
+
+    /* Cost of the framing on the hot path (the prefix) and in the background
+     * thread (the checksum of a 120 byte record) */
+    std::string record(120, 'x');
+    const int   ROUNDS = 1000000;
+    uint32_t    sum    = 0;
+    auto        begin  = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        record_frame(i, 120, frame);
+        sum += frame[16];
+    }
+    auto middle_time = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        record[i & 63] = static_cast<char>(i);
+        sum += crc32c(0, record.data(), record.size());
+    }
+    auto end_time = std::chrono::steady_clock::now();
+    std::cout << "frame prefix: " << std::chrono::duration<double, std::nano>(middle_time - begin).count() / ROUNDS
+              << " ns, checksum: " << std::chrono::duration<double, std::nano>(end_time - middle_time).count() / ROUNDS
+              << " ns (" << sum % 10 << ")" << std::endl;
+
+    remove(name);
+    std::cout << (failures ? "test_framing FAILED" : "test_framing PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
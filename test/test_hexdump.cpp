@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+/**
+ * @brief The lines of hexdump -C, with printf
+ */
+std::string
+reference_hexdump (const std::string &data, size_t offset)
+{
+    std::string out;
+    char        line[128];
+    for (size_t i = 0; i < data.size(); i += 16)
+    {
+        int len = snprintf(line, sizeof(line), "%08zx  ", offset + i);
+        for (size_t k = 0; k < 16; k++)
+        {
+            if (i + k < data.size())
+            {
+                len += snprintf(line + len, sizeof(line) - len, "%02x ", static_cast<uint8_t>(data[i + k]));
+            }
+            else
+            {
+                len += snprintf(line + len, sizeof(line) - len, "   ");
+            }
+            if (7 == k)
+            {
+                line[len++] = ' ';
+            }
+        }
+        line[len++] = ' ';
+        line[len++] = '|';
+        for (size_t k = 0; (k < 16) && (i + k < data.size()); k++)
+        {
+            uint8_t c   = static_cast<uint8_t>(data[i + k]);
+            line[len++] = ((c >= 0x20) && (c < 0x7f)) ? static_cast<char>(c) : '.';
+        }
+        line[len++] = '|';
+        line[len++] = '\n';
+        out.append(line, len);
+    }
+    return out;
+}
+
+std::string
+random_bytes (std::mt19937 &rng, size_t size)
+{
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = static_cast<char>(rng() & 0xff);
+    }
+    return data;
+}
+
+int
+main (void)
+{
+    std::mt19937 rng(49);
+    for (size_t size = 0; size < 200; size++)
+    {
+        std::string data = random_bytes(rng, size);
+        std::string out(hexdump_size(size), '\0');
+        size_t      len = hexdump_format(data.data(), size, 0x1230, &out[0]);
+        check(out.size() == len, "hexdump size " + std::to_string(size));
+        check(reference_hexdump(data, 0x1230) == out, "hexdump " + std::to_string(size));
+    }
+    std::string all;
+    for (int i = 0; i < 256; i++)
+    {
+        all += static_cast<char>(i);
+    }
+    std::string out(hexdump_size(all.size()), '\0');
+    hexdump_format(all.data(), all.size(), 0, &out[0]);
+    check(reference_hexdump(all, 0) == out, "hexdump of every byte value");
+
+    const char *name = "test_hexdump.log";
+    remove(name);
+    LogContorl cfg;
+    cfg.use_ms             = false;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    cfg.record_max_kbytes  = 32;
+    log_init(cfg);
+
+    std::string packet = random_bytes(rng, 1500);
+    LOG(INFO) << "before\n";
+    LOG_HEXDUMP(INFO, packet.data(), packet.size());
+    LOG(INFO) << "between\n";
+    LOG_HEXDUMP_DEFERRED(INFO, packet.data(), packet.size());
+    LOG(INFO) << "after\n";
+    /* Past the record limit the immediate form is cut off, the deferred one
+     * is not */
+    std::string large = random_bytes(rng, 16 * 1024);
+    LOG_HEXDUMP(INFO, large.data(), large.size());
+    LOG_HEXDUMP_DEFERRED(INFO, large.data(), large.size());
+    LOG_HEXDUMP(DEBUG, packet.data(), packet.size());
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    std::string text     = read_file(name);
+    std::string expected = " ] hexdump 1500 bytes\n" + reference_hexdump(packet, 0);
+    size_t      before   = text.find(" ] before\n");
+    size_t      first    = text.find(expected);
+    size_t      between  = text.find(" ] between\n");
+    size_t      second   = text.find(expected, first + 1);
+    size_t      after    = text.find(" ] after\n");
+    check((std::string::npos != first) && (std::string::npos != second), "hex dump records written");
+    check((before < first) && (first < between) && (between < second) && (second < after)
+              && (std::string::npos != after),
+          "hex dump records in order");
+    check(std::string::npos != text.find(std::string(" ] hexdump 16384 bytes\n00000000  ")), "large dump written");
+    check(std::string::npos != text.find(LogStream::TRUNCATED_MARK), "large immediate dump cut off");
+    check(std::string::npos != text.find(reference_hexdump(large, 0)), "large deferred dump complete");
+    check(std::string::npos == text.find("hexdump", text.find(reference_hexdump(large, 0)) + 1), "disabled dump");
+
+    /* Cost per byte of a 256 byte packet: stream manipulators, LOG_HEXDUMP
+     * and the deferred form */
+    const int   ROUNDS = 5000;
+    std::string small  = random_bytes(rng, 256);
+    double      cost[3];
+    for (int pass = 0; pass < 3; pass++)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < ROUNDS; i++)
+        {
+            if (0 == pass)
+            {
+                Logger     logger(LOG_INFO, __FILE__, __func__, __LINE__);
+                LogStream &stream = logger.stream();
+                for (size_t k = 0; k < small.size(); k++)
+                {
+                    stream << std::hex << std::setw(2) << std::setfill('0')
+                           << static_cast<unsigned>(static_cast<uint8_t>(small[k])) << " ";
+                }
+                stream << "\n";
+            }
+            else if (1 == pass)
+            {
+                LOG_HEXDUMP(INFO, small.data(), small.size());
+            }
+            else
+            {
+                LOG_HEXDUMP_DEFERRED(INFO, small.data(), small.size());
+            }
+        }
+        cost[pass] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count()
+                     / ROUNDS / small.size();
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+    std::cout << "hex dump (" << hexdump_isa() << "): std::hex loop " << cost[0] << " ns/byte, LOG_HEXDUMP "
+              << cost[1] << " ns/byte, deferred " << cost[2] << " ns/byte" << std::endl;
+
+    /* Past PAYLOAD_INLINE_BYTES the deferred form hands the copy over and the
+     * writer formats it */
+    const int   LARGE_ROUNDS = 200;
+    std::string page         = random_bytes(rng, 4096);
+    double      page_cost[2];
+    for (int pass = 0; pass < 2; pass++)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < LARGE_ROUNDS; i++)
+        {
+            if (0 == pass)
+            {
+                LOG_HEXDUMP(INFO, page.data(), page.size());
+            }
+            else
+            {
+                LOG_HEXDUMP_DEFERRED(INFO, page.data(), page.size());
+            }
+        }
+        page_cost[pass] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count()
+                          / LARGE_ROUNDS / page.size();
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+    std::cout << "4 KB dump: LOG_HEXDUMP " << page_cost[0] << " ns/byte, deferred " << page_cost[1] << " ns/byte"
+              << std::endl;
+
+    remove(name);
+    std::cout << (failures ? "test_hexdump FAILED" : "test_hexdump PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
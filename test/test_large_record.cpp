@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+/**
+ * @brief A body of the given size that differs at every position modulo 26
+ */
+std::string
+make_body (size_t size, char first)
+{
+    std::string body(size, ' ');
+    for (size_t i = 0; i < size; i++)
+    {
+        body[i] = static_cast<char>('a' + (first - 'a' + i) % 26);
+    }
+    return body;
+}
+
+/**
+ * @brief Position of a record with the given head and body, npos if missing
+ */
+size_t
+find_record (const std::string &text, const std::string &head, const std::string &body, size_t pos)
+{
+    pos = text.find(head, pos);
+    if ((std::string::npos == pos) || (0 != text.compare(pos + head.size(), body.size(), body))
+        || (pos + head.size() + body.size() >= text.size()) || ('\n' != text[pos + head.size() + body.size()]))
+    {
+        return std::string::npos;
+    }
+    return pos;
+}
+
+/**
+ * @brief Large records between small ones, in the given lane
+ */
+void
+run_pass (const std::string &name, const std::string &tag, bool urgent)
+{
+    std::string body_100k = make_body(100 * 1024, 'c');
+    std::string body_1m   = make_body(1024 * 1024, 'k');
+    for (int i = 0; i < 3; i++)
+    {
+        if (urgent)
+        {
+            LOG(WARNING) << tag << " before " << i << "\n";
+            LOG(WARNING) << tag << " large " << i << " " << body_100k << "\n";
+            LOG(WARNING) << tag << " huge " << i << " " << body_1m << "\n";
+            LOG(WARNING) << tag << " after " << i << "\n";
+        }
+        else
+        {
+            LOG(INFO) << tag << " before " << i << "\n";
+            LOG(INFO) << tag << " large " << i << " " << body_100k << "\n";
+            LOG(INFO) << tag << " huge " << i << " " << body_1m << "\n";
+            LOG(INFO) << tag << " after " << i << "\n";
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    std::string text = read_file(name);
+    size_t      pos  = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        std::string n       = std::to_string(i);
+        size_t      before = text.find(tag + " before " + n + "\n", pos);
+        size_t      large  = find_record(text, tag + " large " + n + " ", body_100k, pos);
+        size_t      huge   = find_record(text, tag + " huge " + n + " ", body_1m, pos);
+        size_t      after  = text.find(tag + " after " + n + "\n", pos);
+        bool        found  = (std::string::npos != before) && (std::string::npos != large)
+                      && (std::string::npos != huge) && (std::string::npos != after);
+        check(found, tag + " records complete " + n);
+        check(found && (before < large) && (large < huge) && (huge < after), tag + " records in order " + n);
+        if (found)
+        {
+            pos = after;
+        }
+    }
+}
+
+int
+main (void)
+{
+    const char *name = "test_large_record.log";
+    remove(name);
+    LogContorl cfg;
+    cfg.use_ms             = false;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    /* record_max_kbytes is left at its default, which must not cut the
+     * records the extents carry */
+    log_init(cfg);
+
+    run_pass(name, "normal", false);
+    run_pass(name, "urgent", true);
+
+    cfg.record_framing = true;
+    log_reconfigure(cfg);
+    run_pass(name, "framed", false);
+
+    cfg.record_framing    = false;
+    cfg.reorder_window_ms = 50;
+    log_reconfigure(cfg);
+    run_pass(name, "merged", false);
+    run_pass(name, "merged-urgent", true);
+
+    /* Small records take the same path as before */
+    cfg.reorder_window_ms = 0;
+    log_reconfigure(cfg);
+    const int ROUNDS = 200000;
+    auto      begin  = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        LOG(INFO) << "small " << i << "\n";
+    }
+    double cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / ROUNDS;
+    std::string body = make_body(256 * 1024, 'a');
+    begin            = std::chrono::steady_clock::now();
+    for (int i = 0; i < 200; i++)
+    {
+        LOG(INFO) << body << "\n";
+    }
+    double large_cost
+        = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count() / 200;
+    std::cout << "small records: " << cost << " ns/record, 256 KB records: " << large_cost << " us/record"
+              << std::endl;
+
+    remove(name);
+    std::cout << (failures ? "test_large_record FAILED" : "test_large_record PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "async_logging.h"
+#include "log_container.h"
+#include "test_util.h"
+
+using namespace logging;
+
+const char *file_name = "test_container.log";
+
+int
+main (void)
+{
+    const uint32_t records_per_thread = 20000;
+    const uint32_t num_threads        = 4;
+    const uint64_t base_ts            = 1700000000000000ULL;
+
+    remove(file_name);
+    {
+        AsyncLogging logger;
+        logger.init(file_name, 0, 0, RetentionPolicy(), true);
+        logger.start();
+
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < num_threads; t++)
+        {
+            threads.push_back(std::thread([&logger, t] () {
+                char line[128];
+                for (uint32_t i = 0; i < records_per_thread; i++)
+                {
+                    /* one record per microsecond of fake time */
+                    uint64_t ts = base_ts + i * num_threads + t;
+                    int      n  = snprintf(line, sizeof(line), "INFO : record %u of thread %u\n", i, t);
+                    logger.append_data(line, n, ts);
+                }
+            }));
+        }
+        for (auto &t : threads)
+        {
+            t.join();
+        }
+    }
+
+    ContainerReader reader;
+    check(reader.open(file_name), "open container");
+    check(reader.has_index(), "index block present");
+
+    uint64_t records  = 0;
+    uint64_t next_seq = 0;
+    bool     ordered  = true;
+    for (size_t i = 0; i < reader.block_count(); i++)
+    {
+        const ContainerBlock &block = reader.block(i);
+        check(reader.verify(i), "block checksum");
+        if (block.meta.first_seq != next_seq)
+        {
+            ordered = false;
+        }
+        next_seq = block.meta.last_seq + 1;
+        records += block.meta.record_count;
+
+        /* Record count in the header matches the lines in the payload */
+        const char *p     = reader.payload(i);
+        uint32_t    lines = 0;
+        for (uint32_t k = 0; k < block.payload_size; k++)
+        {
+            lines += ('\n' == p[k]);
+        }
+        check(lines == block.meta.record_count, "record count of block " + std::to_string(i));
+    }
+    check(ordered, "sequence numbers are contiguous across blocks");
+    check(records == records_per_thread * num_threads, "total record count " + std::to_string(records));
+
+    /* Binary search: the block found for a time must reach it */
+    uint64_t probe = base_ts + records_per_thread * num_threads / 2;
+    size_t   found = reader.find_block(probe);
+    check(found < reader.block_count(), "find_block inside the file");
+    check((found < reader.block_count()) && (reader.block(found).meta.last_ts_us >= probe),
+          "found block reaches the probe time");
+    check(reader.find_block(base_ts + records_per_thread * num_threads * 2) == reader.block_count(),
+          "find_block past the end");
+
+    std::cout << "blocks:" << reader.block_count() << " records:" << records << std::endl;
+    std::cout << (failures ? "test_log_container FAILED" : "test_log_container PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
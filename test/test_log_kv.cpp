@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <chrono>
+#include <thread>
+#include "log_kv.h"
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+std::string captured;
+
+void
+capture_output (const char *data, size_t size)
+{
+    captured.append(data, size);
+}
+
+LogStream capture_stream(16, capture_output);
+
+std::string
+encode (const KvField &field, KvFormat format)
+{
+    captured.clear();
+    capture_stream.reset_buffer();
+    KvEncoder::field(capture_stream, field, format);
+    capture_stream.flush_data();
+    return captured;
+}
+
+/**
+ * @brief Compare an encoding with what it should be
+ */
+void
+check (const std::string &got, const std::string &expected)
+{
+    if (got != expected)
+    {
+        std::cout << "FAILED: got [" << got << "] expected [" << expected << "]\n";
+        failures++;
+    }
+}
+
+int
+main (void)
+{
+    /* numbers */
+    check(encode(kv("n", 0), KV_FORMAT_JSON), ",\"n\":0");
+    check(encode(kv("n", -42), KV_FORMAT_JSON), ",\"n\":-42");
+    check(encode(kv("n", std::numeric_limits<long long>::min()), KV_FORMAT_JSON), ",\"n\":-9223372036854775808");
+    check(encode(kv("n", std::numeric_limits<unsigned long long>::max()), KV_FORMAT_LOGFMT),
+          " n=18446744073709551615");
+    check(encode(kv("d", 2.0), KV_FORMAT_JSON), ",\"d\":2");
+    check(encode(kv("d", 0.5), KV_FORMAT_LOGFMT), " d=0.5");
+    check(encode(kv("d", std::nan("")), KV_FORMAT_JSON), ",\"d\":null");
+    check(encode(kv("b", true), KV_FORMAT_LOGFMT), " b=true");
+
+    /* strings, long enough to exercise the 16-byte SIMD scan */
+    check(encode(kv("path", "/api/v1/users/profile/settings"), KV_FORMAT_JSON),
+          ",\"path\":\"/api/v1/users/profile/settings\"");
+    check(encode(kv("path", "/api/v1/users/profile/settings"), KV_FORMAT_LOGFMT),
+          " path=/api/v1/users/profile/settings");
+    check(encode(kv("s", "0123456789abcdef\"quoted\"\\tail\n\x01"), KV_FORMAT_JSON),
+          ",\"s\":\"0123456789abcdef\\\"quoted\\\"\\\\tail\\n\\u0001\"");
+    check(encode(kv("s", "hello world"), KV_FORMAT_LOGFMT), " s=\"hello world\"");
+    check(encode(kv("s", "a=b"), KV_FORMAT_LOGFMT), " s=\"a=b\"");
+    check(encode(kv("s", ""), KV_FORMAT_LOGFMT), " s=\"\"");
+    check(encode(kv("bad key", 1), KV_FORMAT_LOGFMT), " bad_key=1");
+    check(encode(kv("utf8", "\xe4\xbd\xa0\xe5\xa5\xbd"), KV_FORMAT_JSON), ",\"utf8\":\"\xe4\xbd\xa0\xe5\xa5\xbd\"");
+
+    /* Before log_init the records go to the standard terminal */
+    std::string path = "/index.html";
+    LOG_KV(INFO, "req done", kv("latency_us", 125), kv("path", path), kv("ok", true));
+    LOG_KV(DEBUG, "no fields");
+
+    /* The records in the log file, in both formats */
+    const char *name = "test_log_kv.log";
+    remove(name);
+    LogContorl cfg;
+    cfg.use_ms             = false;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    log_init(cfg);
+    LOG_KV(INFO, "req done", kv("latency_us", 125), kv("path", path), kv("ok", true));
+    LOG_KV(WARNING, "no fields");
+    LOG_KV(DEBUG, "below the level");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    cfg.kv_format = KV_FORMAT_LOGFMT;
+    log_reconfigure(cfg);
+    LOG_KV(INFO, "req done", kv("latency_us", 125), kv("path", path), kv("ok", true));
+    LOG_KV(ERROR, "no fields");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    /* The time is the only part that changes, it is blanked out of the records.
+     * The priority lane may write the warnings first, so the order is not
+     * checked. */
+    std::string text = read_file(name);
+    std::string records;
+    for (size_t begin = 0, end; begin < text.size(); begin = end + 1)
+    {
+        end              = text.find('\n', begin);
+        std::string line = text.substr(begin, end - begin);
+        size_t      time = line.find("time");
+        if (std::string::npos != time)
+        {
+            size_t open  = line.find('"', time + 5);
+            size_t close = line.find('"', open + 1);
+            line.erase(open + 1, close - open - 1);
+        }
+        records += line + "\n";
+    }
+    const char *expected[] = {
+        "{\"level\":\"info\",\"time\":\"\",\"msg\":\"req done\",\"latency_us\":125,\"path\":\"/index.html\",\"ok\":true}\n",
+        "{\"level\":\"warn\",\"time\":\"\",\"msg\":\"no fields\"}\n",
+        "level=info time=\"\" msg=\"req done\" latency_us=125 path=/index.html ok=true\n",
+        "level=error time=\"\" msg=\"no fields\"\n",
+    };
+    size_t size = 0;
+    for (const char *record : expected)
+    {
+        check(std::string::npos != records.find(record), std::string("record in the log file: ") + record);
+        size += strlen(record);
+    }
+    check(size == records.size(), "no other records in the log file");
+    remove(name);
+
+    std::cout << (failures ? "test_log_kv FAILED" : "test_log_kv PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
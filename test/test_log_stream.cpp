@@ -0,0 +1,103 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "log_stream.h"
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+std::string captured;
+int         output_calls = 0;
+int         gather_calls = 0;
+
+void
+capture_output (const char *data, size_t size)
+{
+    captured.append(data, size);
+    output_calls++;
+}
+
+void
+capture_gather (const struct iovec *pieces, int num_pieces)
+{
+    for (int i = 0; i < num_pieces; i++)
+    {
+        captured.append(static_cast<const char *>(pieces[i].iov_base), pieces[i].iov_len);
+    }
+    gather_calls++;
+}
+
+int
+main (void)
+{
+    LogStream::set_limits(4096, 512);
+    LogStream stream(64, capture_output, capture_gather);
+    check(64 == stream.capacity(), "initial capacity");
+
+    /* A short record fits the first chunk and uses the plain output */
+    captured.clear();
+    stream << "short record\n";
+    stream.flush_data();
+    check("short record\n" == captured, "short record");
+    check((1 == output_calls) && (0 == gather_calls), "short record output");
+
+    /* A long record grows the stream chunk by chunk and comes out in one
+     * gathered call */
+    std::string long_record;
+    for (int i = 0; i < 100; i++)
+    {
+        long_record += "0123456789";
+    }
+    long_record += "\n";
+    captured.clear();
+    stream.reset_buffer();
+    stream << long_record;
+    check(stream.capacity() >= long_record.size(), "grown capacity");
+    size_t grown = stream.capacity();
+    stream.flush_data();
+    check(long_record == captured, "long record content");
+    check(1 == gather_calls, "long record gathered");
+    check(stream.capacity() <= 512, "shrunk after oversized record, capacity " + std::to_string(stream.capacity()));
+    check(LogStream::memory().peak_stream_bytes >= grown, "peak reported");
+
+    /* Past the cap the record is cut and marked */
+    std::string huge(10000, 'x');
+    captured.clear();
+    stream.reset_buffer();
+    stream << huge << "\n";
+    check(stream.truncated(), "huge record truncated");
+    check(stream.capacity() <= 4096, "capacity capped");
+    stream.flush_data();
+    check(captured.size() == 4096 + strlen(LogStream::TRUNCATED_MARK), "truncated size");
+    check(0 == captured.compare(captured.size() - strlen(LogStream::TRUNCATED_MARK),
+                                std::string::npos, LogStream::TRUNCATED_MARK),
+          "truncated mark");
+
+    /* The stream is usable again after a truncated record */
+    captured.clear();
+    stream << "after " << 42 << "\n";
+    stream.flush_data();
+    check("after 42\n" == captured, "record after truncation");
+
+    /* Memory of other threads is accounted while they live */
+    LogStreamMemory before = LogStream::memory();
+    std::thread     t([&before] () {
+        LogStream       local(256, capture_output);
+        LogStreamMemory during = LogStream::memory();
+        check(during.streams == before.streams + 1, "thread stream counted");
+        check(during.total_bytes == before.total_bytes + 256, "thread bytes counted");
+    });
+    t.join();
+    check(LogStream::memory().total_bytes == before.total_bytes, "thread bytes released");
+
+    /* Same through the logger: the calling thread's buffer is reported */
+    LogStream::set_limits(LogStream::DEFAULT_MAX_BYTES, LogStream::DEFAULT_RETAIN_BYTES);
+    LOG(INFO) << std::string(2000, 'y') << "\n";
+    check(log_thread_memory() <= LogStream::DEFAULT_RETAIN_BYTES, "logger buffer shrunk");
+    check(log_memory().streams >= 2, "logger stream counted");
+
+    std::cout << (failures ? "test_log_stream FAILED" : "test_log_stream PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
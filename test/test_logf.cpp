@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+int evaluations = 0;
+
+int
+counted (int value)
+{
+    evaluations++;
+    return value;
+}
+
+int
+main (void)
+{
+    const char *name = "test_logf.log";
+    remove(name);
+    LogContorl cfg;
+    cfg.use_ms             = false;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    cfg.record_max_kbytes  = 4;
+    log_init(cfg);
+
+    LOGF(INFO, "plain %d %s %05.2f %x|\n", 42, "text", 3.14159, 255);
+    LOGF(WARNING, "warning %lu\n", 7UL);
+    /* Longer than what is left of the first chunk */
+    std::string long_text(1000, 'l');
+    LOGF(INFO, "long %s end\n", long_text.c_str());
+    /* Cut off at the record limit */
+    std::string huge_text(10000, 'h');
+    LOGF(INFO, "huge %s end\n", huge_text.c_str());
+    LOG(INFO) << "stream after huge\n";
+    /* Mixed with stream output in the same record */
+    LOGF(INFO, "mixed %d", 1) << " then stream\n";
+    /* Disabled levels evaluate nothing */
+    LOGF(DEBUG, "hidden %d\n", counted(1));
+    check(0 == evaluations, "arguments of a disabled LOGF are not evaluated");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    std::string text = read_file(name);
+    check(std::string::npos != text.find(" ] plain 42 text 03.14 ff|\n"), "formatted record");
+    check(std::string::npos != text.find(" ] warning 7\n"), "priority record");
+    check(std::string::npos != text.find(" ] long " + long_text + " end\n"), "record grown on overflow");
+    check(std::string::npos != text.find(" ] huge hhhh"), "huge record written");
+    check(std::string::npos == text.find(huge_text), "huge record cut off");
+    check(std::string::npos != text.find(LogStream::TRUNCATED_MARK), "huge record marked");
+    check(std::string::npos != text.find(" ] stream after huge\n"), "stream usable after a cut off record");
+    check(std::string::npos != text.find(" ] mixed 1 then stream\n"), "format and stream in one record");
+    check(std::string::npos == text.find("hidden"), "disabled record not written");
+
+    /* The same record through the stream, snprintf and LOGF */
+    const int ROUNDS = 300000;
+    double    cost[3];
+    for (int pass = 0; pass < 3; pass++)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < ROUNDS; i++)
+        {
+            if (0 == pass)
+            {
+                LOG(INFO) << "request " << i << " took " << 0.25 * i << " ms from " << "10.0.0.1" << "\n";
+            }
+            else if (1 == pass)
+            {
+                char buffer[128];
+                snprintf(buffer, sizeof(buffer), "request %d took %g ms from %s", i, 0.25 * i, "10.0.0.1");
+                LOG(INFO) << buffer << "\n";
+            }
+            else
+            {
+                LOGF(INFO, "request %d took %g ms from %s\n", i, 0.25 * i, "10.0.0.1");
+            }
+        }
+        cost[pass] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / ROUNDS;
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    }
+    std::cout << "ostream: " << cost[0] << " ns/record, snprintf + ostream: " << cost[1]
+              << " ns/record, LOGF: " << cost[2] << " ns/record" << std::endl;
+
+    remove(name);
+    std::cout << (failures ? "test_logf FAILED" : "test_logf PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "fast_memcpy.h"
+#include "test_util.h"
+
+using namespace logging;
+
+/**
+ * @brief Copy every size up to a few KB at every alignment and compare
+ */
+void
+check_copies (void)
+{
+    std::vector<char> src(160 * 1024), dst(160 * 1024 + 64);
+    for (size_t i = 0; i < src.size(); i++)
+    {
+        src[i] = static_cast<char>(rand());
+    }
+    std::vector<size_t> sizes;
+    for (size_t size = 0; size <= 4200; size++)
+    {
+        sizes.push_back(size);
+    }
+    sizes.push_back(64 * 1024);
+    sizes.push_back(100 * 1024 + 13);
+    for (size_t size : sizes)
+    {
+        for (int policy = COPY_READ_SOON; policy <= COPY_READ_LATER; policy++)
+        {
+            for (size_t offset = 0; offset < 8; offset++)
+            {
+                memset(dst.data(), 0x5a, size + 32);
+                memcpy_fast(dst.data() + offset, src.data() + 3, size, static_cast<CopyPolicy>(policy));
+                bool ok = (0 == memcmp(dst.data() + offset, src.data() + 3, size))
+                          && (0x5a == dst[offset + size]) && ((0 == offset) || (0x5a == dst[offset - 1]));
+                if (!ok)
+                {
+                    check(false, "copy of " + std::to_string(size) + " bytes at offset " + std::to_string(offset));
+                    return;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Append records to a 32 KB buffer the way DataBuffer::input_data does
+ * and report the time per copy
+ */
+template <typename Copy>
+double
+bench (const std::vector<size_t> &sizes, Copy copy)
+{
+    static char       buffer[32 * 1024];
+    std::vector<char> record(4096, 'r');
+    const int         rounds = 200;
+    auto              start  = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+        size_t used = 0;
+        for (size_t size : sizes)
+        {
+            if (used + size > sizeof(buffer))
+            {
+                used = 0;
+            }
+            copy(buffer + used, record.data(), size);
+            used += size;
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    /* Keep the copies alive */
+    volatile char sink = buffer[rand() % sizeof(buffer)];
+    (void)sink;
+    return ns / (rounds * sizes.size());
+}
+
+int
+main (void)
+{
+    check_copies();
+
+    std::cout << "memcpy_fast streams with " << memcpy_fast_impl() << std::endl;
+
+    /* Record pieces as input_data sees them: a header of 40-60 bytes and a
+     * body of 40-300 bytes, and a few fixed sizes */
+    struct Case
+    {
+        const char *name;
+        size_t      min;
+        size_t      max;
+    };
+    const Case cases[] = {
+        {"header 40-60", 40, 60},   {"body 40-300", 40, 300}, {"16", 16, 16},     {"64", 64, 64},
+        {"128", 128, 128},          {"256", 256, 256},        {"300", 300, 300}, {"1024", 1024, 1024},
+        {"4096", 4096, 4096},
+    };
+    for (const Case &c : cases)
+    {
+        std::vector<size_t> sizes(100000);
+        for (size_t &size : sizes)
+        {
+            size = c.min + rand() % (c.max - c.min + 1);
+        }
+        double glibc = bench(sizes, [] (char *dst, const char *src, size_t size) { memcpy(dst, src, size); });
+        double fast  = bench(sizes, [] (char *dst, const char *src, size_t size) { memcpy_fast(dst, src, size); });
+        std::cout << c.name << ": memcpy " << glibc << " ns, memcpy_fast " << fast << " ns" << std::endl;
+    }
+
+    std::cout << (failures ? "test_memcpy FAILED" : "test_memcpy PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
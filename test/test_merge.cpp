@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+std::vector<std::string>
+read_lines (const std::string &name)
+{
+    std::ifstream            in(name);
+    std::vector<std::string> lines;
+    std::string              line;
+    while (std::getline(in, line))
+    {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+/**
+ * @brief Records of a pass and how many of them have an earlier time than the
+ * record before them
+ */
+void
+scan (const std::string &name, const std::string &tag, size_t &records, size_t &out_of_order)
+{
+    records      = 0;
+    out_of_order = 0;
+    std::string last;
+    for (const std::string &line : read_lines(name))
+    {
+        size_t pos = line.find("[ ");
+        if ((std::string::npos == line.find(tag)) || (std::string::npos == pos))
+        {
+            continue;
+        }
+        /* "YYYY-mm-dd HH:MM:SS.mmm" compares as a string */
+        std::string time = line.substr(pos + 2, 23);
+        if (time < last)
+        {
+            out_of_order++;
+        }
+        last = time;
+        records++;
+    }
+}
+
+/**
+ * @brief Normal records from one thread, priority records from another
+ */
+void
+produce (const std::string &tag, int normal, int urgent)
+{
+    std::thread writer([&tag, normal] () {
+        for (int i = 0; i < normal; i++)
+        {
+            LOG(INFO) << tag << " info " << i << "\n";
+            if (0 == (i % 10))
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    });
+    for (int i = 0; i < urgent; i++)
+    {
+        LOG(WARNING) << tag << " warning " << i << "\n";
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    writer.join();
+}
+
+int
+main (void)
+{
+    const char *name = "test_merge.log";
+    remove(name);
+    LogContorl cfg;
+    cfg.use_ms             = true;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    cfg.reorder_window_ms  = 200;
+    log_init(cfg);
+
+    /* The priority lane is written ahead of the queued normal records unless
+     * the lanes are merged */
+    const int NORMAL = 3000;
+    const int URGENT = 300;
+    produce("merged", NORMAL, URGENT);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    size_t records, out_of_order;
+    scan(name, "merged ", records, out_of_order);
+    check(NORMAL + URGENT == records, "all merged records written");
+    check(0 == out_of_order, "merged records in time order");
+    MergeStats stats = log_merge_stats();
+    check(stats.records >= static_cast<uint64_t>(NORMAL + URGENT), "merge counters");
+    check(0 == stats.late, "no late records");
+    std::cout << "merged: " << stats.records << " records in " << stats.runs << " buffers, " << stats.late
+              << " late, " << static_cast<double>(stats.merge_ns) / stats.records << " ns/record" << std::endl;
+
+    cfg.reorder_window_ms = 0;
+    log_reconfigure(cfg);
+    produce("direct", NORMAL, URGENT);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    scan(name, "direct ", records, out_of_order);
+    check(NORMAL + URGENT == records, "all direct records written");
+    std::cout << "without the merge " << out_of_order << " of " << records << " records are out of order"
+              << std::endl;
+
+    /* Records held back when the merge is switched off are still written */
+    cfg.reorder_window_ms = 5000;
+    log_reconfigure(cfg);
+    for (int i = 0; i < 100; i++)
+    {
+        LOG(INFO) << "held " << i << "\n";
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+    cfg.reorder_window_ms = 0;
+    log_reconfigure(cfg);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    scan(name, "held ", records, out_of_order);
+    check(100 == records, "held records written once the merge is off");
+
+    /* Both lanes fill more buffers within one window than they have: the
+     * merge hands the buffers back at once, so no record is dropped and the
+     * priority writer never waits for the window to pass */
+    cfg.reorder_window_ms = 3000;
+    log_reconfigure(cfg);
+    const int         FLOOD_NORMAL = 80000;
+    const int         FLOOD_URGENT = 3000;
+    const std::string padding(100, 'x');
+    std::thread       flood([&padding] () {
+        for (int i = 0; i < FLOOD_NORMAL; i++)
+        {
+            LOG(INFO) << "flood info " << i << " " << padding << "\n";
+            if (0 == (i % 50))
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    });
+    double longest_ms = 0;
+    for (int i = 0; i < FLOOD_URGENT; i++)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        LOG(WARNING) << "flood warning " << i << " " << padding << "\n";
+        longest_ms = std::max(
+            longest_ms, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+        if (0 == (i % 10))
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+    flood.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(4500));
+    scan(name, "flood ", records, out_of_order);
+    check(FLOOD_NORMAL + FLOOD_URGENT == records, "all records of the saturated lanes written, " + std::to_string(records));
+    check(longest_ms < 1000, "priority writer waited " + std::to_string(longest_ms) + " ms");
+    check(log_merge_stats().early > 0, "records written early while the merge held too much");
+    std::cout << "saturated lanes: " << log_merge_stats().early << " records written early, " << out_of_order
+              << " out of order, longest priority record " << longest_ms << " ms" << std::endl;
+
+    /* Producer cost with and without the merge */
+    const int ROUNDS = 200000;
+    double    cost[2];
+    for (int pass = 0; pass < 2; pass++)
+    {
+        cfg.reorder_window_ms = (0 == pass) ? 50 : 0;
+        log_reconfigure(cfg);
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < ROUNDS; i++)
+        {
+            LOG(INFO) << "throughput " << i << "\n";
+        }
+        cost[pass] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / ROUNDS;
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    std::cout << "with the merge: " << cost[0] << " ns/record, without: " << cost[1] << " ns/record" << std::endl;
+
+    remove(name);
+    std::cout << (failures ? "test_merge FAILED" : "test_merge PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
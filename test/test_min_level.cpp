@@ -0,0 +1,68 @@
+#define TINYLOG_MIN_LEVEL TINYLOG_LEVEL_WARNING
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+int evaluations = 0;
+int releases    = 0;
+
+int
+side_effect (void)
+{
+    return ++evaluations;
+}
+
+const char *
+side_effect_name (void)
+{
+    ++evaluations;
+    return "side_effect";
+}
+
+int
+main (void)
+{
+    LogContorl cfg;
+    cfg.level   = LOG_DEBUG;
+    cfg.logfile = "test_min_level.log";
+    log_init(cfg);
+
+    /* Compiled out: the arguments are not evaluated although the runtime
+     * level would let the records through */
+    LOG(DEBUG) << "min_level_marker_" << "debug_only " << side_effect() << "\n";
+    LOG(INFO) << side_effect() << "\n";
+    LOG_KV(INFO, "kv", kv("value", side_effect()));
+    {
+        LOG_SCOPE(DEBUG, "min_level_marker_scope");
+        LOG_SPAN(INFO, side_effect_name(), side_effect());
+    }
+    static const char data[] = "payload";
+    LOG_PAYLOAD(INFO, side_effect_name(), data, sizeof(data), PAYLOAD_RAW,
+                [] (const char *, size_t) { releases++; });
+    LOG_PAYLOAD(DEBUG, "min_level_marker_payload", data, sizeof(data), PAYLOAD_HEX, PayloadRelease());
+    check(0 == evaluations, "arguments below the minimum not evaluated");
+    check(1 == releases, "payload below the minimum released");
+    check(!LOG_ENABLED(INFO), "INFO compiled out");
+
+    /* At or above the minimum the runtime level applies */
+    LOG(WARNING) << side_effect() << "\n";
+    LOG(ERROR) << side_effect() << "\n";
+    check(2 == evaluations, "arguments at the minimum evaluated");
+    check(LOG_ENABLED(WARNING), "WARNING compiled in");
+
+    /* The text of the compiled out statement is not in the binary. The needle
+     * is put together at run time so that it does not appear itself. */
+    std::ifstream     exe("/proc/self/exe", std::ios::binary);
+    std::string       image((std::istreambuf_iterator<char>(exe)), std::istreambuf_iterator<char>());
+    std::string       needle = std::string("min_level") + "_marker_";
+    check(!image.empty(), "read own binary");
+    check(std::string::npos == image.find(needle), "string of a compiled out statement left in the binary");
+
+    std::cout << (failures ? "test_min_level FAILED" : "test_min_level PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+#include <dirent.h>
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "async_logging.h"
+
+using namespace logging;
+
+const int num_threads        = 4;
+const int records_per_thread = 250000;
+const int record_size        = 128;
+
+/**
+ * @brief Destination that discards everything, the consumer is as fast as it
+ * gets and spends most of its time waiting for the producers
+ */
+class NullSink : public LogSink
+{
+public:
+    void write_logdata(const char *logdata, uint32_t size, bool flush_now = false) override
+    {
+        (void)logdata;
+        (void)size;
+        (void)flush_now;
+    }
+
+    void flush(void) override
+    {
+    }
+};
+
+/**
+ * @brief Voluntary context switches of the thread with the given name, each of
+ * them is a FUTEX_WAIT that slept
+ */
+long
+voluntary_switches (const std::string &thread_name)
+{
+    DIR *dir = opendir("/proc/self/task");
+    if (nullptr == dir)
+    {
+        return 0;
+    }
+    long           switches = 0;
+    struct dirent *entry;
+    while (nullptr != (entry = readdir(dir)))
+    {
+        std::string   task = std::string("/proc/self/task/") + entry->d_name;
+        std::ifstream comm(task + "/comm");
+        std::string   name;
+        if (!std::getline(comm, name) || (name != thread_name))
+        {
+            continue;
+        }
+        std::ifstream status(task + "/status");
+        std::string   line;
+        while (std::getline(status, line))
+        {
+            if (0 == line.compare(0, 24, "voluntary_ctxt_switches:"))
+            {
+                switches += atol(line.c_str() + 24);
+            }
+        }
+    }
+    closedir(dir);
+    return switches;
+}
+
+/**
+ * @brief Log 128 MB from 4 threads and report, per logged MB, the condition
+ * variable notifications, each of which is a potential FUTEX_WAKE, and the
+ * wakeups of the background thread.
+ * For exact syscall counts run under: strace -f -c -e trace=futex
+ */
+void
+run (uint32_t notify_batch)
+{
+    AsyncLogging    logger;
+    ConsumerOptions options;
+    options.notify_batch = notify_batch;
+    options.name         = "tinylog-notify";
+    logger.init(std::unique_ptr<LogSink>(new NullSink()));
+    logger.set_consumer_options(options);
+    logger.start();
+
+    long                     switches_before = voluntary_switches(options.name);
+    auto                     start           = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++)
+    {
+        threads.push_back(std::thread([&logger] () {
+            std::string line(record_size, 'x');
+            line[line.size() - 1] = '\n';
+            for (int i = 0; i < records_per_thread; i++)
+            {
+                logger.append_data(line.data(), line.size());
+                /* Steady traffic the consumer keeps up with, as in a service */
+                if (0 == (i % 64))
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+            }
+        }));
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double elapsed  = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    long   switches = voluntary_switches(options.name) - switches_before;
+
+    uint64_t pushes, notifies;
+    logger.notify_stats(pushes, notifies);
+    double mbytes = static_cast<double>(num_threads) * records_per_thread * record_size / (1024 * 1024);
+    std::cout << "notify_batch " << notify_batch << ": pushes/MB:" << pushes / mbytes
+              << " notifies/MB:" << notifies / mbytes << " consumer wakeups/MB:" << switches / mbytes
+              << " elapsed:" << elapsed << "s" << std::endl;
+}
+
+int
+main (void)
+{
+    /* Before waiter-aware notification every push notified, pushes/MB is
+     * what that cost */
+    run(1);
+    run(8);
+    run(32);
+    return 0;
+}
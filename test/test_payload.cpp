@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include "log_frame.h"
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+/**
+ * @brief Position of a record with the given head and body, npos if missing
+ */
+size_t
+find_record (const std::string &text, const std::string &head, const std::string &body, size_t pos)
+{
+    pos = text.find(head, pos);
+    if ((std::string::npos == pos) || (0 != text.compare(pos + head.size(), body.size(), body))
+        || (pos + head.size() + body.size() >= text.size()) || ('\n' != text[pos + head.size() + body.size()]))
+    {
+        return std::string::npos;
+    }
+    return pos;
+}
+
+std::string
+reference_hex (const std::string &data)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string       out;
+    for (unsigned char c : data)
+    {
+        out += digits[c >> 4];
+        out += digits[c & 0x0f];
+    }
+    return out;
+}
+
+std::string
+reference_base64 (const std::string &data)
+{
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string       out;
+    size_t            i = 0;
+    for (; i + 3 <= data.size(); i += 3)
+    {
+        uint32_t v = (static_cast<uint8_t>(data[i]) << 16) | (static_cast<uint8_t>(data[i + 1]) << 8)
+                     | static_cast<uint8_t>(data[i + 2]);
+        out += digits[v >> 18];
+        out += digits[(v >> 12) & 0x3f];
+        out += digits[(v >> 6) & 0x3f];
+        out += digits[v & 0x3f];
+    }
+    if (i + 1 == data.size())
+    {
+        uint32_t v = static_cast<uint8_t>(data[i]) << 16;
+        out += digits[v >> 18];
+        out += digits[(v >> 12) & 0x3f];
+        out += "==";
+    }
+    else if (i + 2 == data.size())
+    {
+        uint32_t v = (static_cast<uint8_t>(data[i]) << 16) | (static_cast<uint8_t>(data[i + 1]) << 8);
+        out += digits[v >> 18];
+        out += digits[(v >> 12) & 0x3f];
+        out += digits[(v >> 6) & 0x3f];
+        out += '=';
+    }
+    return out;
+}
+
+std::string
+random_bytes (std::mt19937 &rng, size_t size)
+{
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = static_cast<char>(rng() & 0xff);
+    }
+    return data;
+}
+
+/**
+ * @brief The SIMD encoders against the byte at a time references, for sizes
+ * around every vector width
+ */
+void
+test_encoders (void)
+{
+    std::mt19937 rng(47);
+    for (size_t size = 0; size < 300; size++)
+    {
+        std::string data = random_bytes(rng, size);
+        std::string hex(payload_encoded_size(size, PAYLOAD_HEX), '\0');
+        std::string base64(payload_encoded_size(size, PAYLOAD_BASE64), '\0');
+        check(hex.size() == hex_encode(data.data(), size, &hex[0]), "hex size " + std::to_string(size));
+        check(base64.size() == base64_encode(data.data(), size, &base64[0]), "base64 size " + std::to_string(size));
+        check(reference_hex(data) == hex, "hex " + std::to_string(size));
+        check(reference_base64(data) == base64, "base64 " + std::to_string(size));
+    }
+    std::string all;
+    for (int i = 0; i < 256; i++)
+    {
+        all += static_cast<char>(i);
+    }
+    std::string base64(payload_encoded_size(all.size(), PAYLOAD_BASE64), '\0');
+    base64_encode(all.data(), all.size(), &base64[0]);
+    check(reference_base64(all) == base64, "base64 of every byte value");
+
+    std::string data = random_bytes(rng, 1 << 20);
+    std::string out(payload_encoded_size(data.size(), PAYLOAD_HEX), '\0');
+    auto        begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < 20; i++)
+    {
+        hex_encode(data.data(), data.size(), &out[0]);
+    }
+    double hex_gbps
+        = 20.0 * data.size() / std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    begin           = std::chrono::steady_clock::now();
+    for (int i = 0; i < 20; i++)
+    {
+        base64_encode(data.data(), data.size(), &out[0]);
+    }
+    double base64_gbps
+        = 20.0 * data.size() / std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << "encoders (" << payload_encoder_isa() << "): hex " << hex_gbps << " GB/s, base64 " << base64_gbps
+              << " GB/s" << std::endl;
+}
+
+std::atomic<int> released(0);
+
+/**
+ * @brief A payload record of each encoding between two text records, in the
+ * given lane
+ */
+void
+run_pass (const std::string &name, const std::string &tag, bool urgent)
+{
+    std::mt19937 rng(static_cast<uint32_t>(tag.size()));
+    std::string  payloads[3] = {random_bytes(rng, 100), random_bytes(rng, 5000), random_bytes(rng, 100 * 1024)};
+    for (std::string &payload : payloads)
+    {
+        /* Raw payloads must not contain the record separator */
+        for (char &c : payload)
+        {
+            c = static_cast<char>('a' + static_cast<uint8_t>(c) % 26);
+        }
+    }
+    int before = released.load();
+    for (int i = 0; i < 3; i++)
+    {
+        const std::string &payload = payloads[i];
+        auto release = [&payload] (const char *data, size_t size) {
+            if ((data == payload.data()) && (size == payload.size()))
+            {
+                released++;
+            }
+        };
+        if (urgent)
+        {
+            LOG(WARNING) << tag << " before " << i << "\n";
+            LOG_PAYLOAD(WARNING, (tag + " raw").c_str(), payload.data(), payload.size(), PAYLOAD_RAW, release);
+            LOG_PAYLOAD(WARNING, (tag + " hex").c_str(), payload.data(), payload.size(), PAYLOAD_HEX, release);
+            LOG_PAYLOAD(WARNING, (tag + " base64").c_str(), payload.data(), payload.size(), PAYLOAD_BASE64, release);
+            LOG(WARNING) << tag << " after " << i << "\n";
+        }
+        else
+        {
+            LOG(INFO) << tag << " before " << i << "\n";
+            LOG_PAYLOAD(INFO, (tag + " raw").c_str(), payload.data(), payload.size(), PAYLOAD_RAW, release);
+            LOG_PAYLOAD(INFO, (tag + " hex").c_str(), payload.data(), payload.size(), PAYLOAD_HEX, release);
+            LOG_PAYLOAD(INFO, (tag + " base64").c_str(), payload.data(), payload.size(), PAYLOAD_BASE64, release);
+            LOG(INFO) << tag << " after " << i << "\n";
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    check(9 == released.load() - before, tag + " payloads released once written");
+
+    std::string text = read_file(name);
+    size_t      pos  = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        std::string n      = std::to_string(i);
+        size_t      first  = text.find(tag + " before " + n + "\n", pos);
+        size_t      raw    = find_record(text, tag + " raw ", payloads[i], pos);
+        size_t      hex    = find_record(text, tag + " hex ", reference_hex(payloads[i]), pos);
+        size_t      base64 = find_record(text, tag + " base64 ", reference_base64(payloads[i]), pos);
+        size_t      last   = text.find(tag + " after " + n + "\n", pos);
+        bool        found  = (std::string::npos != first) && (std::string::npos != raw) && (std::string::npos != hex)
+                      && (std::string::npos != base64) && (std::string::npos != last);
+        check(found, tag + " records complete " + n);
+        check(found && (first < raw) && (raw < hex) && (hex < base64) && (base64 < last),
+              tag + " records in order " + n);
+        if (found)
+        {
+            pos = last;
+        }
+    }
+}
+
+int
+main (void)
+{
+    test_encoders();
+
+    const char *name = "test_payload.log";
+    remove(name);
+    LogContorl cfg;
+    cfg.use_ms             = false;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    cfg.record_max_kbytes  = 0;
+    log_init(cfg);
+
+    run_pass(name, "normal", false);
+    run_pass(name, "urgent", true);
+
+    cfg.reorder_window_ms = 50;
+    log_reconfigure(cfg);
+    run_pass(name, "merged", false);
+    run_pass(name, "merged-urgent", true);
+    cfg.reorder_window_ms = 0;
+    log_reconfigure(cfg);
+
+    /* Below the level the payload is only released */
+    int before = released.load();
+    LOG_PAYLOAD(DEBUG, "hidden", name, 4, PAYLOAD_RAW, [] (const char *, size_t) { released++; });
+    check(before + 1 == released.load(), "disabled payload released at once");
+
+    /* A small payload is copied into the record and released at once, a
+     * large one is held until written */
+    std::string small(PAYLOAD_INLINE_BYTES, 's');
+    std::string large(PAYLOAD_INLINE_BYTES + 1, 'l');
+    before = released.load();
+    LOG_PAYLOAD(INFO, "small", small.data(), small.size(), PAYLOAD_RAW, [] (const char *, size_t) { released++; });
+    check(before + 1 == released.load(), "small payload released at once");
+    LOG_PAYLOAD(INFO, "large", large.data(), large.size(), PAYLOAD_RAW, [] (const char *, size_t) { released++; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    check(before + 2 == released.load(), "large payload released once written");
+    check(std::string::npos != find_record(read_file(name), "small ", small, 0), "small payload written");
+    check(std::string::npos != find_record(read_file(name), "large ", large, 0), "large payload written");
+
+    /* A refcounted slice is held until written */
+    std::shared_ptr<std::string> shared = std::make_shared<std::string>("shared slice payload");
+    LOG_PAYLOAD(INFO, "slice", shared->data() + 7, 5, PAYLOAD_RAW, payload_keep(shared));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    check(1 == shared.use_count(), "slice reference dropped");
+    check(std::string::npos != read_file(name).find("slice slice\n"), "slice written");
+
+    /* Framed payload records carry a checksum over header and payload */
+    const char *framed_name = "test_payload_framed.log";
+    remove(framed_name);
+    cfg.logfile        = framed_name;
+    cfg.record_framing = true;
+    log_reconfigure(cfg);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::string payload(3000, 'p');
+    for (int i = 0; i < 10; i++)
+    {
+        LOG(INFO) << "framed " << i << "\n";
+        LOG_PAYLOAD(INFO, "framed", payload.data(), payload.size(), (i % 2) ? PAYLOAD_HEX : PAYLOAD_BASE64, nullptr);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    std::string   framed = read_file(framed_name);
+    FrameVerifier verifier;
+    verifier.scan(framed.data(), framed.size());
+    FrameReport report = verifier.finish();
+    check((20 == report.records) && (0 == report.corrupt) && (0 == report.torn), "framed payload records verify");
+    cfg.record_framing = false;
+    cfg.logfile        = name;
+    log_reconfigure(cfg);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    /* Producer cost of a 64 KB record: copied through the stream and the
+     * buffers, or handed over */
+    const int   ROUNDS = 200;
+    std::string body(64 * 1024, 'x');
+    auto        begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        LOG_RAW(INFO) << "copied " << body << "\n";
+    }
+    double copy_cost
+        = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count() / ROUNDS;
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    std::shared_ptr<std::string> owner = std::make_shared<std::string>(body);
+    begin                              = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        LOG_PAYLOAD(INFO, "handed over", owner->data(), owner->size(), PAYLOAD_RAW, payload_keep(owner));
+    }
+    double payload_cost
+        = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count() / ROUNDS;
+    std::cout << "64 KB record: LOG_RAW " << copy_cost << " us, LOG_PAYLOAD " << payload_cost << " us" << std::endl;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    check(1 == owner.use_count(), "handed over payloads released");
+
+    remove(name);
+    remove(framed_name);
+    std::cout << (failures ? "test_payload FAILED" : "test_payload PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "async_logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+uint64_t
+now_us (void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * @brief A slow destination: every write of normal data takes 2 ms, so that a
+ * DEBUG storm builds up a long backlog. Urgent records carry their append
+ * time and the sink measures how long they waited.
+ */
+class SlowSink : public LogSink
+{
+public:
+    SlowSink(void)
+        : errors(0)
+        , max_latency_us(0)
+        , syncs(0)
+    {
+    }
+
+    void write_logdata(const char *logdata, uint32_t size, bool flush_now = false) override
+    {
+        (void)flush_now;
+        uint64_t    now   = now_us();
+        bool        debug = false;
+        const char *p     = logdata;
+        const char *end   = logdata + size;
+        while (p < end)
+        {
+            const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+            if (nullptr == nl)
+            {
+                break;
+            }
+            unsigned long long sent_us = 0;
+            unsigned           index   = 0;
+            if (2 == sscanf(p, "ERROR: %u %llu", &index, &sent_us))
+            {
+                errors++;
+                uint64_t latency = now - sent_us;
+                if (latency > max_latency_us)
+                {
+                    max_latency_us = latency;
+                }
+            }
+            else
+            {
+                debug = true;
+            }
+            p = nl + 1;
+        }
+        if (debug)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    void flush(void) override
+    {
+    }
+
+    void sync(void) override
+    {
+        syncs++;
+    }
+
+    std::atomic<uint32_t> errors;
+    std::atomic<uint64_t> max_latency_us;
+    std::atomic<uint32_t> syncs;
+};
+
+int
+main (void)
+{
+    const uint32_t num_errors = 2000;
+
+    AsyncLogging logger;
+    SlowSink    *sink = new SlowSink();
+    logger.init(std::unique_ptr<LogSink>(sink));
+    logger.set_urgent_sync(true);
+    logger.start();
+
+    /* DEBUG storm, far more than the consumer can write */
+    std::atomic<bool>        storm(true);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; t++)
+    {
+        threads.push_back(std::thread([&logger, &storm] () {
+            std::string line(200, 'd');
+            line[0]            = 'D';
+            line[line.size() - 1] = '\n';
+            while (storm.load(std::memory_order_relaxed))
+            {
+                logger.append_data(line.data(), line.size());
+            }
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    /* ERROR records must overtake the backlog and none may be lost */
+    char line[128];
+    for (uint32_t i = 0; i < num_errors; i++)
+    {
+        int n = snprintf(line, sizeof(line), "ERROR: %u %llu\n", i, static_cast<unsigned long long>(now_us()));
+        logger.append_data(line, n, 0, true);
+        if (0 == (i % 100))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    uint32_t errors_before_stop = sink->errors.load();
+    uint64_t max_latency        = sink->max_latency_us.load();
+    check(sink->syncs.load() > 0, "priority lane synced");
+
+    /* Producers that run the lane out of reserved buffers wait for the
+     * consumer side by side, none of their records may be lost */
+    const uint32_t           num_producers = 4, per_producer = 500;
+    std::vector<std::thread> producers;
+    for (uint32_t t = 0; t < num_producers; t++)
+    {
+        producers.push_back(std::thread([&logger, t] () {
+            std::string line;
+            for (uint32_t i = 0; i < per_producer; i++)
+            {
+                line = "ERROR: " + std::to_string(t * per_producer + i) + " " + std::to_string(now_us()) + " ";
+                line.append(2000, 'e');
+                line += "\n";
+                logger.append_data(line.data(), line.size(), 0, true);
+            }
+        }));
+    }
+    for (auto &t : producers)
+    {
+        t.join();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    uint32_t contended = sink->errors.load() - errors_before_stop;
+
+    storm = false;
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    check(errors_before_stop == num_errors, "error records delivered " + std::to_string(errors_before_stop));
+    check(num_producers * per_producer == contended, "contended error records delivered " + std::to_string(contended));
+    /* Bounded by one normal buffer write (2 ms here) plus scheduling */
+    check(max_latency < 50000, "error latency " + std::to_string(max_latency) + " us");
+
+    std::cout << "max error latency:" << max_latency << " us" << std::endl;
+    std::cout << (failures ? "test_priority_lane FAILED" : "test_priority_lane PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
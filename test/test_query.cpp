@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "log_file.h"
+#include "log_frame.h"
+#include "test_util.h"
+
+using namespace logging;
+
+/**
+ * @brief tinylog-query is built next to the tests
+ */
+std::string
+tool_path (void)
+{
+    char    path[4096];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len <= 0)
+    {
+        return "tinylog-query";
+    }
+    path[len]        = '\0';
+    std::string self = path;
+    return self.substr(0, self.rfind('/') + 1) + "tinylog-query";
+}
+
+/**
+ * @brief Output of tinylog-query with the given arguments
+ */
+std::string
+query (const std::string &args)
+{
+    std::string output;
+    FILE       *pipe = popen((tool_path() + " -j 2 " + args + " 2>&1").c_str(), "r");
+    if (nullptr == pipe)
+    {
+        return "popen failed";
+    }
+    char   data[4096];
+    size_t n;
+    while ((n = fread(data, 1, sizeof(data), pipe)) > 0)
+    {
+        output.append(data, n);
+    }
+    pclose(pipe);
+    return output;
+}
+
+/**
+ * @brief Microseconds of a "YYYY-mm-dd HH:MM:SS" local time
+ */
+uint64_t
+local_us (const char *text)
+{
+    struct tm tm_data;
+    memset(&tm_data, 0, sizeof(tm_data));
+    strptime(text, "%Y-%m-%d %H:%M:%S", &tm_data);
+    tm_data.tm_isdst = -1;
+    return static_cast<uint64_t>(mktime(&tm_data)) * 1000000;
+}
+
+/**
+ * @brief Framed record, the frame prefix followed by the record
+ */
+std::string
+framed (uint64_t seq, const std::string &record)
+{
+    char prefix[RECORD_FRAME_SIZE];
+    record_frame(seq, static_cast<uint32_t>(record.size()), prefix);
+    return std::string(prefix, RECORD_FRAME_SIZE) + record;
+}
+
+const char *rolled_name    = "test_query.log.20240102030400_0";
+const char *active_name    = "test_query.log";
+const char *container_name = "test_query.tlc";
+
+const std::string A1 = "INFO : [ 2024-01-02 03:04:05.100 app.cpp:10 main ] a1 started\n";
+const std::string A2 = "DEBUG: [ 2024-01-02 03:04:06.000 app.cpp:11 main ] a2 detail\n";
+const std::string A3 = "ERROR: [ 2024-01-02 03:04:08.000 net.cpp:20 send ] a3 failed\n  at the second line\n";
+const std::string B1 = "WARN : [ 2024-01-02 03:04:07.000 net.cpp:21 send ] b1 slow\n";
+const std::string B2 = "INFO : [ 2024-01-02 03:04:09.000 app.cpp:12 main ] b2 done\n";
+const std::string B3 = "{\"level\":\"error\",\"time\":\"2024-01-02 03:04:09.500\",\"msg\":\"b3 structured\"}\n";
+const std::string C1 = "INFO : [ 2024-01-02 03:05:00.000 c.cpp:1 f ] c1 first block\n";
+const std::string C2 = "ERROR: [ 2024-01-02 03:06:00.000 c.cpp:2 f ] c2 second block\n";
+
+int
+main (void)
+{
+    /* A rolled and an active text file, the records of the two interleave in
+     * time; the active file has framed records */
+    std::ofstream(rolled_name) << A1 << A2 << A3;
+    std::ofstream(active_name) << framed(1, B1) << framed(2, B2) << B3;
+
+    /* A container file of two blocks a minute apart */
+    remove(container_name);
+    {
+        LogFile   file(container_name, 0, 0, RetentionPolicy(), true);
+        BlockMeta meta;
+        meta.first_ts_us  = local_us("2024-01-02 03:05:00");
+        meta.last_ts_us   = meta.first_ts_us;
+        meta.record_count = 1;
+        file.write_block(C1.data(), static_cast<uint32_t>(C1.size()), meta);
+        meta.first_ts_us = local_us("2024-01-02 03:06:00");
+        meta.last_ts_us  = meta.first_ts_us;
+        file.write_block(C2.data(), static_cast<uint32_t>(C2.size()), meta);
+    }
+
+    std::string files = std::string(rolled_name) + " " + active_name + " " + container_name;
+    check(A1 + A2 + framed(1, B1) + A3 + framed(2, B2) + B3 + C1 + C2 == query(files),
+          "all records merged in time order");
+    check(framed(1, B1) + A3 + B3 + C2 == query("-l WARN " + files), "level query");
+    check(A3 + framed(2, B2) + B3 == query("-f \"2024-01-02 03:04:08\" -t \"2024-01-02 03:04:59\" " + files),
+          "time range query over text files");
+    check(C2 == query("-f \"2024-01-02 03:05:30\" " + files), "time range query skips container blocks");
+    check(framed(1, B1) + A3 == query("-s net.cpp " + files), "site query");
+    check(A3 == query("-g \"second line\" " + files), "substring in a continuation line");
+    check(framed(2, B2) == query(std::string("-g b2 -l INFO ") + active_name), "framed record found by its body");
+    check(framed(2, B2) == query("-q 2 " + files), "sequence number query");
+    check(framed(1, B1) + framed(2, B2) == query("-q 1-2 " + files), "sequence range query");
+    check(framed(1, B1) == query("-q 0-9 -l WARN " + files), "sequence range and level query");
+    check(std::string::npos != query("-q 5-3 " + files).find("bad sequence range"), "bad sequence range rejected");
+    check(std::string::npos != query("-l NOTICE " + files).find("unknown level"), "bad level rejected");
+
+    remove(rolled_name);
+    remove(active_name);
+    remove(container_name);
+    std::cout << (failures ? "test_query FAILED" : "test_query PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+int
+count_lines (const std::string &name, const std::string &needle = "")
+{
+    std::ifstream in(name);
+    std::string   line;
+    int           lines = 0;
+    while (std::getline(in, line))
+    {
+        lines += (needle.empty() || (std::string::npos != line.find(needle))) ? 1 : 0;
+    }
+    return lines;
+}
+
+void
+write_file (const std::string &name, const std::string &text)
+{
+    /* Replace the file the way editors do, by renaming a new one over it */
+    std::string tmp = name + ".tmp";
+    {
+        std::ofstream out(tmp);
+        out << text;
+    }
+    rename(tmp.c_str(), name.c_str());
+}
+
+template <typename Pred>
+bool
+wait_for (Pred pred)
+{
+    for (int i = 0; i < 300; i++)
+    {
+        if (pred())
+        {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+int
+main (void)
+{
+    const char *first  = "test_reconfigure_1.log";
+    const char *second = "test_reconfigure_2.log";
+    const char *conf   = "test_reconfigure.conf";
+    remove(first);
+    remove(second);
+    remove(conf);
+
+    LogContorl cfg;
+    cfg.use_ms             = false;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = first;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    log_init(cfg);
+
+    /* Producers keep logging while the configuration changes under them */
+    std::atomic<bool>        running(true);
+    std::atomic<int>         produced(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; t++)
+    {
+        threads.push_back(std::thread([&running, &produced] () {
+            while (running)
+            {
+                LOG(WARNING) << "producer record\n";
+                produced++;
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }));
+    }
+
+    /* Header options and sinks flip back and forth */
+    for (int i = 0; i < 20; i++)
+    {
+        cfg.show_func = !cfg.show_func;
+        cfg.use_ms    = !cfg.use_ms;
+        cfg.logfile   = (i % 2) ? first : second;
+        check(log_reconfigure(cfg), "reconfigure " + std::to_string(i));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    running = false;
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    /* Levels apply to the next record */
+    cfg.level = LOG_ERROR;
+    check(log_reconfigure(cfg), "raise level");
+    LOG(WARNING) << "filtered record\n";
+    cfg.level = LOG_INFO;
+    check(log_reconfigure(cfg), "lower level");
+    LOG(INFO) << "after level record\n";
+
+    /* The configuration file is applied on start and on every change */
+    write_file(conf, "# test configuration\nlevel = debug\nshow_func = yes\n");
+    check(log_watch_config(conf), "watch config");
+    check(LOG_DEBUG == log_config().level, "config file applied on watch");
+    write_file(conf, "level = warning\nshow_func = no\n");
+    check(wait_for([] () { return LOG_WARNING == log_config().level; }), "config file change applied");
+    write_file(conf, "level = loud\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    check(LOG_WARNING == log_config().level, "invalid config file ignored");
+    log_unwatch_config();
+
+    /* The idle background thread writes the last buffer within a second */
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    int written = count_lines(first, "producer record") + count_lines(second, "producer record");
+    check(written == produced, "records " + std::to_string(written) + " of " + std::to_string(produced));
+    check(0 == count_lines(first, "filtered record") + count_lines(second, "filtered record"), "level raised");
+    check(1 == count_lines(first, "after level record") + count_lines(second, "after level record"),
+          "level lowered");
+
+    remove(conf);
+    std::cout << (failures ? "test_reconfigure FAILED" : "test_reconfigure PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
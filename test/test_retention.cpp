@@ -0,0 +1,216 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log_file.h"
+#include "test_util.h"
+
+using namespace logging;
+
+const char *dir_name  = "test_retention_dir";
+const char *file_name = "test_retention_dir/app.log";
+
+struct Rolled
+{
+    uint32_t    index;
+    uint64_t    size;
+    std::string name;
+};
+
+/**
+ * @brief Rolled files of the log file on disk, by index
+ */
+std::vector<Rolled>
+rolled_files (void)
+{
+    std::vector<Rolled> files;
+    DIR                *dir = opendir(dir_name);
+    struct dirent      *ent = nullptr;
+    while ((nullptr != dir) && (nullptr != (ent = readdir(dir))))
+    {
+        std::string name = ent->d_name;
+        size_t      sep  = name.rfind('_');
+        if ((0 != name.compare(0, 8, "app.log.")) || (std::string::npos == sep) || (name.size() < 9 + 15))
+        {
+            continue;
+        }
+        struct stat st;
+        std::string path = std::string(dir_name) + "/" + name;
+        if (0 == stat(path.c_str(), &st))
+        {
+            files.push_back({static_cast<uint32_t>(strtoul(name.c_str() + sep + 1, nullptr, 10)),
+                             static_cast<uint64_t>(st.st_size), path});
+        }
+    }
+    if (nullptr != dir)
+    {
+        closedir(dir);
+    }
+    std::sort(files.begin(), files.end(), [] (const Rolled &a, const Rolled &b) { return a.index < b.index; });
+    return files;
+}
+
+void
+clear_dir (void)
+{
+    DIR           *dir = opendir(dir_name);
+    struct dirent *ent = nullptr;
+    while ((nullptr != dir) && (nullptr != (ent = readdir(dir))))
+    {
+        if ('.' != ent->d_name[0])
+        {
+            remove((std::string(dir_name) + "/" + ent->d_name).c_str());
+        }
+    }
+    if (nullptr != dir)
+    {
+        closedir(dir);
+    }
+    (void)mkdir(dir_name, 0755);
+}
+
+/**
+ * @brief Write 1 KB blocks to a log file rolling every 4 KB, giving the
+ * helper thread time to pre-open the next file
+ */
+void
+write_blocks (LogFile &file, int count)
+{
+    std::string block(1023, 'r');
+    block += '\n';
+    for (int i = 0; i < count; i++)
+    {
+        file.write_logdata(block.data(), static_cast<uint32_t>(block.size()), true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    /* The last roll is finished and the policy applied */
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+}
+
+uint32_t
+largest_index (const std::vector<Rolled> &files)
+{
+    return files.empty() ? 0 : files.back().index;
+}
+
+/**
+ * @brief Rolled files over the count limit are removed oldest first, across
+ * restarts; the roll index continues after the files on disk
+ */
+void
+test_count (void)
+{
+    clear_dir();
+    RetentionPolicy policy;
+    policy.max_files = 3;
+    {
+        LogFile file(file_name, 0, 4096, policy);
+        write_blocks(file, 40);
+        std::vector<Rolled> files = rolled_files();
+        check(3 == files.size(), "count limit kept " + std::to_string(files.size()) + " files");
+        check(largest_index(files) >= 8, "files rolled by size");
+        check((3 == files.size()) && (files[0].index + 2 == files[2].index), "newest files kept");
+    }
+    uint32_t last = largest_index(rolled_files());
+
+    /* A restart with a tighter limit prunes the files left on disk before
+     * anything rolls */
+    policy.max_files = 2;
+    {
+        LogFile file(file_name, 0, 4096, policy);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        std::vector<Rolled> files = rolled_files();
+        check(2 == files.size(), "files of the previous run pruned on restart");
+        check(last == largest_index(files), "newest file of the previous run kept");
+
+        write_blocks(file, 10);
+        files = rolled_files();
+        check(2 == files.size(), "count limit after restart");
+        check((2 == files.size()) && (files[0].index > last), "roll index continues after the previous run");
+    }
+}
+
+/**
+ * @brief Rolled files beyond the total size limit are removed oldest first
+ */
+void
+test_size (void)
+{
+    clear_dir();
+    RetentionPolicy policy;
+    policy.max_total_bytes = 10 * 1024;
+    {
+        LogFile file(file_name, 0, 4096, policy);
+        write_blocks(file, 40);
+    }
+    std::vector<Rolled> files = rolled_files();
+    uint64_t            total = 0;
+    for (const Rolled &rolled : files)
+    {
+        total += rolled.size;
+    }
+    /* The last roll of the run may not have been pruned yet */
+    check(total <= policy.max_total_bytes + 4096 + 1024, "size limit kept " + std::to_string(total) + " bytes");
+
+    /* Restarted, the files on disk are counted against the limit */
+    {
+        LogFile file(file_name, 0, 4096, policy);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        files = rolled_files();
+        total = 0;
+        for (const Rolled &rolled : files)
+        {
+            total += rolled.size;
+        }
+        check(total <= policy.max_total_bytes, "size limit applied on restart, " + std::to_string(total) + " bytes");
+        check(!files.empty(), "files within the size limit kept");
+    }
+}
+
+/**
+ * @brief Rolled files older than the age limit are removed at startup
+ */
+void
+test_age (void)
+{
+    clear_dir();
+    std::string old_name    = std::string(file_name) + ".20000101000000_4";
+    std::string recent_name = std::string(file_name) + ".20000101000001_5";
+    std::ofstream(old_name) << "old\n";
+    std::ofstream(recent_name) << "recent\n";
+    struct utimbuf times;
+    times.actime  = 946684800; // 2000-01-01
+    times.modtime = times.actime;
+    check(0 == utime(old_name.c_str(), &times), "old file dated back");
+
+    RetentionPolicy policy;
+    policy.max_age_minutes = 60;
+    LogFile file(file_name, 0, 4096, policy);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    std::vector<Rolled> files = rolled_files();
+    check((1 == files.size()) && (5 == files[0].index), "file older than the age limit removed");
+
+    write_blocks(file, 6);
+    files = rolled_files();
+    check((files.size() >= 2) && (6 == files[1].index), "roll index continues after the files on disk");
+}
+
+int
+main (void)
+{
+    test_count();
+    test_size();
+    test_age();
+    clear_dir();
+    (void)remove(dir_name);
+    std::cout << (failures ? "test_retention FAILED" : "test_retention PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
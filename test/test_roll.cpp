@@ -0,0 +1,244 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log_file.h"
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+const char *dir_name = "test_roll_dir";
+
+struct Rolled
+{
+    uint32_t    index;
+    std::string name;
+};
+
+/**
+ * @brief Rolled files of a log file in the test directory, by index
+ */
+std::vector<Rolled>
+rolled_files (const std::string &base)
+{
+    std::vector<Rolled> files;
+    std::string         prefix = base + ".";
+    DIR                *dir    = opendir(dir_name);
+    struct dirent      *ent    = nullptr;
+    while ((nullptr != dir) && (nullptr != (ent = readdir(dir))))
+    {
+        std::string name = ent->d_name;
+        size_t      sep  = name.rfind('_');
+        if ((0 == name.compare(0, prefix.size(), prefix)) && (std::string::npos != sep) && (sep > prefix.size()))
+        {
+            files.push_back({static_cast<uint32_t>(strtoul(name.c_str() + sep + 1, nullptr, 10)),
+                             std::string(dir_name) + "/" + name});
+        }
+    }
+    if (nullptr != dir)
+    {
+        closedir(dir);
+    }
+    std::sort(files.begin(), files.end(), [] (const Rolled &a, const Rolled &b) { return a.index < b.index; });
+    return files;
+}
+
+/**
+ * @brief The rolled files in order followed by the active file
+ */
+std::string
+read_all (const std::string &base, size_t *max_rolled_size = nullptr, size_t *num_rolled = nullptr)
+{
+    std::string         text;
+    size_t              largest = 0;
+    std::vector<Rolled> files   = rolled_files(base);
+    for (const Rolled &rolled : files)
+    {
+        std::string data = read_file(rolled.name);
+        largest          = std::max(largest, data.size());
+        text += data;
+    }
+    if (nullptr != max_rolled_size)
+    {
+        *max_rolled_size = largest;
+    }
+    if (nullptr != num_rolled)
+    {
+        *num_rolled = files.size();
+    }
+    return text + read_file(std::string(dir_name) + "/" + base);
+}
+
+void
+clear_dir (void)
+{
+    DIR           *dir = opendir(dir_name);
+    struct dirent *ent = nullptr;
+    while ((nullptr != dir) && (nullptr != (ent = readdir(dir))))
+    {
+        if ('.' != ent->d_name[0])
+        {
+            remove((std::string(dir_name) + "/" + ent->d_name).c_str());
+        }
+    }
+    if (nullptr != dir)
+    {
+        closedir(dir);
+    }
+    (void)mkdir(dir_name, 0755);
+}
+
+std::string
+numbered_line (int i)
+{
+    char line[128];
+    snprintf(line, sizeof(line), "line %08d %s\n", i, std::string(80, 'x').c_str());
+    return line;
+}
+
+/**
+ * @brief Size rolls in bursts of writes: the helper thread syncs and renames
+ * each rolled file and pre-opens the next one while the writer keeps going,
+ * so the writer finds no pre-opened file within a burst and rolls on a later
+ * write. No line may be lost, duplicated or reordered across the files.
+ */
+void
+test_size_roll (void)
+{
+    const int    LINES     = 20000;
+    const size_t ROLL_SIZE = 4096;
+    clear_dir();
+    {
+        LogFile file(std::string(dir_name) + "/size.log", 0, ROLL_SIZE);
+        for (int i = 0; i < LINES; i++)
+        {
+            std::string line = numbered_line(i);
+            file.write_logdata(line.data(), static_cast<uint32_t>(line.size()), false);
+            if (0 == i % 200)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }
+    }
+    std::string expected;
+    for (int i = 0; i < LINES; i++)
+    {
+        expected += numbered_line(i);
+    }
+    size_t largest = 0, rolled = 0;
+    check(expected == read_all("size.log", &largest, &rolled), "size rolled lines complete and in order");
+    check(rolled >= 10, "files rolled by size, " + std::to_string(rolled));
+    /* A roll put off while the helper was busy leaves a larger file */
+    check(largest > ROLL_SIZE + numbered_line(0).size(), "roll retried after the helper thread was busy");
+}
+
+/**
+ * @brief Time rolls: the helper thread raises the roll flag at the minute
+ * boundary and the next write rolls the file
+ */
+void
+test_time_roll (void)
+{
+    clear_dir();
+    {
+        LogFile file(std::string(dir_name) + "/time.log", 1, 0);
+        std::time_t start = std::time(nullptr);
+        std::time_t until = (start / 60 + 1) * 60 + 2;
+        for (int i = 0; std::time(nullptr) < until; i++)
+        {
+            std::string line = numbered_line(i);
+            file.write_logdata(line.data(), static_cast<uint32_t>(line.size()), true);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        check(1 == rolled_files("time.log").size(), "file rolled at the minute boundary");
+    }
+    std::string text = read_all("time.log");
+    std::string expected;
+    for (int i = 0; expected.size() < text.size(); i++)
+    {
+        expected += numbered_line(i);
+    }
+    check(expected == text, "time rolled lines complete and in order");
+}
+
+/**
+ * @brief Several threads log through the background thread to a file that
+ * rolls by size, every record ends up in exactly one file
+ */
+void
+test_roll_under_load (void)
+{
+    const int THREADS = 4;
+    const int RECORDS = 20000;
+    clear_dir();
+    LogContorl cfg;
+    cfg.use_ms             = false;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = std::string(dir_name) + "/load.log";
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 64;
+    log_init(cfg);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+    {
+        threads.emplace_back([t] () {
+            for (int i = 0; i < RECORDS; i++)
+            {
+                LOG(INFO) << "t" << t << " n" << i << "\n";
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    size_t             rolled = 0;
+    std::istringstream in(read_all("load.log", nullptr, &rolled));
+    std::vector<int>   next(THREADS, 0);
+    std::string        line;
+    int                bad = 0;
+    while (std::getline(in, line))
+    {
+        int    t = -1, i = -1;
+        size_t pos = line.rfind(" t");
+        if ((std::string::npos == pos) || (2 != sscanf(line.c_str() + pos, " t%d n%d", &t, &i)) || (t < 0)
+            || (t >= THREADS) || (next[t] != i))
+        {
+            bad++;
+            continue;
+        }
+        next[t]++;
+    }
+    check(rolled >= 2, "files rolled under load, " + std::to_string(rolled));
+    check(0 == bad, std::to_string(bad) + " records lost, duplicated or out of order across the files");
+    for (int t = 0; t < THREADS; t++)
+    {
+        check(RECORDS == next[t], "thread " + std::to_string(t) + " records " + std::to_string(next[t]));
+    }
+}
+
+int
+main (void)
+{
+    test_size_roll();
+    test_roll_under_load();
+    test_time_roll();
+    clear_dir();
+    (void)remove(dir_name);
+    std::cout << (failures ? "test_roll FAILED" : "test_roll PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,356 @@
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logging.h"
+#include "shm_ring.h"
+#include "test_util.h"
+
+using namespace logging;
+
+const int num_children      = 4;
+const int records_per_child = 20000;
+
+/**
+ * @brief Keeps what the writer drains
+ */
+class MemorySink : public LogSink
+{
+public:
+    void write_logdata (const char *logdata, uint32_t size, bool flush_now = false) override
+    {
+        (void)flush_now;
+        data.append(logdata, size);
+    }
+
+    void flush (void) override
+    {
+    }
+
+    std::string data;
+};
+
+/**
+ * @brief Drain the ring until it is empty or a second has passed
+ */
+void
+drain_all (ShmRing &ring, LogSink &sink)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while ((0 != ring.stats().used) && (std::chrono::steady_clock::now() < deadline))
+    {
+        (void)ring.drain(sink, 10);
+    }
+}
+
+/**
+ * @brief Crashed producers and writers, on a ring used directly
+ */
+void
+test_crashes (const std::string &name)
+{
+    ShmRing::remove(name);
+    ShmRing ring;
+    check(ring.open(name, 64 * 1024), "ring opened");
+
+    /* Without a writer a full ring drops at once */
+    std::string  entry(1000, 'e');
+    struct iovec piece = {&entry[0], entry.size()};
+    int          taken = 0;
+    auto         begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < 100; i++)
+    {
+        taken += ring.append(&piece, 1, 1000) ? 1 : 0;
+    }
+    check((taken > 0) && (taken < 100) && (100 - taken == static_cast<int>(ring.stats().dropped_entries)),
+          "entries dropped when full without a writer");
+    check(std::chrono::steady_clock::now() - begin < std::chrono::milliseconds(500), "no wait without a writer");
+
+    /* A writer that exits gives the role to the next one */
+    pid_t pid = fork();
+    if (0 == pid)
+    {
+        ShmRing child;
+        _exit((child.open(name, 0) && child.acquire_writer()) ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    check(WIFEXITED(status) && (0 == WEXITSTATUS(status)), "child took the writer role");
+    check(ring.acquire_writer(), "writer role taken over from an exited writer");
+    MemorySink drained;
+    drain_all(ring, drained);
+    check(static_cast<size_t>(taken) * entry.size() == drained.data.size(), "entries written by the new writer");
+
+    /* A producer that dies between reserving and committing */
+    pid = fork();
+    if (0 == pid)
+    {
+        ShmRing  child;
+        uint64_t token = 0;
+        char    *out   = child.open(name, 0) ? child.reserve(100, 0, token) : nullptr;
+        if (nullptr != out)
+        {
+            memcpy(out, "torn", 4);
+        }
+        _exit((nullptr != out) ? 0 : 1);
+    }
+    waitpid(pid, &status, 0);
+    check(WIFEXITED(status) && (0 == WEXITSTATUS(status)), "child reserved an entry");
+    const char  *after       = "after the crash\n";
+    struct iovec after_piece = {const_cast<char *>(after), strlen(after)};
+    check(ring.append(&after_piece, 1, 1000), "entry behind the crashed reservation");
+    MemorySink rest;
+    drain_all(ring, rest);
+    check(after == rest.data, "crashed reservation skipped, later entries written");
+    check(1 == ring.stats().skipped_entries, "one reservation skipped");
+
+    ring.close();
+    ShmRing::remove(name);
+}
+
+/**
+ * @brief Two producers race for the last space of the ring, the winner is
+ * killed before it commits. The loser gives up waiting for space and lives
+ * on; its slot must not keep the writer from skipping the winner's
+ * reservation. Both children spin on a shared flag, so that on more than
+ * one core they usually meet at the compare and swap of the head.
+ */
+void
+test_racing_producers (const std::string &name)
+{
+    const int      ROUNDS      = 10;
+    const uint64_t CHILD_ENTRY = 20000;
+    void          *shared      = mmap(nullptr, sizeof(std::atomic<int>), PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    check(MAP_FAILED != shared, "start flag mapped");
+    std::atomic<int> *start = new (shared) std::atomic<int>(0);
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        ShmRing::remove(name);
+        ShmRing ring;
+        check(ring.open(name, 64 * 1024) && ring.acquire_writer(), "racing ring opened");
+        /* Half the ring is taken, one child entry fits behind it */
+        std::string  filler(ring.max_entry_size(), 'f');
+        struct iovec piece = {&filler[0], filler.size()};
+        check(ring.append(&piece, 1, 0), "racing ring filled");
+
+        int   report[2][2];
+        pid_t pids[2];
+        start->store(0);
+        check((0 == pipe(report[0])) && (0 == pipe(report[1])), "pipes");
+        for (int c = 0; c < 2; c++)
+        {
+            pids[c] = fork();
+            if (0 == pids[c])
+            {
+                ShmRing  child;
+                uint64_t token = 0;
+                bool     open  = child.open(name, 0);
+                start->fetch_add(1);
+                while (start->load() < 3)
+                {
+                }
+                char won = (open && (nullptr != child.reserve(CHILD_ENTRY, 200, token))) ? 'W' : 'L';
+                (void)write(report[c][1], &won, 1);
+                pause();
+                _exit(0);
+            }
+        }
+        while (start->load() < 2)
+        {
+            std::this_thread::yield();
+        }
+        start->store(3);
+        char result[2] = {0, 0};
+        for (int c = 0; c < 2; c++)
+        {
+            (void)read(report[c][0], &result[c], 1);
+        }
+        check((('W' == result[0]) && ('L' == result[1])) || (('L' == result[0]) && ('W' == result[1])),
+              "one racing producer reserved");
+        int winner = ('W' == result[0]) ? 0 : 1;
+        kill(pids[winner], SIGKILL);
+        waitpid(pids[winner], nullptr, 0);
+
+        MemorySink drained;
+        drain_all(ring, drained);
+        check(0 == ring.stats().used, "reservation of the killed winner skipped, round " + std::to_string(round));
+        check(filler == drained.data, "entries before the reservation written");
+
+        kill(pids[1 - winner], SIGKILL);
+        waitpid(pids[1 - winner], nullptr, 0);
+        for (int fd : {report[0][0], report[0][1], report[1][0], report[1][1]})
+        {
+            ::close(fd);
+        }
+        ring.close();
+    }
+    munmap(shared, sizeof(std::atomic<int>));
+    ShmRing::remove(name);
+}
+
+/**
+ * @brief Damaged entry headers do not take the writer out of the ring
+ */
+void
+test_damaged_header (const std::string &name)
+{
+    ShmRing::remove(name);
+    ShmRing ring;
+    check(ring.open(name, 64 * 1024) && ring.acquire_writer(), "ring opened");
+    const char  *first        = "first\n";
+    const char  *second       = "second\n";
+    struct iovec first_piece  = {const_cast<char *>(first), strlen(first)};
+    struct iovec second_piece = {const_cast<char *>(second), strlen(second)};
+    uint64_t     token        = 0;
+    check(ring.append(&first_piece, 1, 0), "entry appended");
+    char *out = ring.reserve(100, 0, token);
+    check(nullptr != out, "entry reserved");
+    /* A committed size far beyond the reservation, as a stray write could
+     * leave it */
+    *(reinterpret_cast<uint64_t *>(out) - 1) = (1ULL << 63) | 0x7ffff;
+    MemorySink drained;
+    drain_all(ring, drained);
+    check(0 == ring.stats().used, "damaged entry skipped");
+    check(1 == ring.stats().skipped_entries, "damaged entry counted as skipped");
+    check(ring.append(&second_piece, 1, 0), "entry behind the damaged one appended");
+    drain_all(ring, drained);
+    check(std::string(first) + second == drained.data, "entries around the damaged one written");
+    ring.close();
+    ShmRing::remove(name);
+}
+
+/**
+ * @brief Records of one process, "<tag> record <i> <pad>"
+ */
+void
+log_records (const std::string &tag, int count, const std::string &pad)
+{
+    for (int i = 0; (count < 0) || (i < count); i++)
+    {
+        LOG(INFO) << tag << " record " << i << " " << pad << "\n";
+    }
+}
+
+int
+main (void)
+{
+    std::string name = "test_shm_ring." + std::to_string(getpid());
+    test_crashes(name);
+    test_racing_producers(name);
+    test_damaged_header(name);
+
+    /* Pre-forked workers log to the ring, the parent writes the file */
+    const char *file_name = "test_shm_ring.log";
+    remove(file_name);
+    ShmRing::remove(name);
+    LogContorl cfg;
+    cfg.use_ms             = false;
+    cfg.show_path          = false;
+    cfg.show_func          = false;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = "shm://" + name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    cfg.shm_ring_kbytes    = 4096;
+    cfg.shm_writer_file    = file_name;
+    log_init(cfg);
+
+    const std::string pad(60, 'p');
+    LOG(INFO) << "parent before fork\n";
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto               begin = std::chrono::steady_clock::now();
+    std::vector<pid_t> children;
+    for (int c = 0; c < num_children; c++)
+    {
+        pid_t pid = fork();
+        if (0 == pid)
+        {
+            log_records("child " + std::to_string(c), records_per_child, pad);
+            exit(0);
+        }
+        children.push_back(pid);
+    }
+    /* A worker killed while it logs */
+    pid_t killed = fork();
+    if (0 == killed)
+    {
+        log_records("killed", -1, pad);
+        exit(0);
+    }
+    for (pid_t pid : children)
+    {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        check(WIFEXITED(status) && (0 == WEXITSTATUS(status)), "child exit status");
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    kill(killed, SIGKILL);
+    waitpid(killed, nullptr, 0);
+
+    LOG(INFO) << "parent after the workers\n";
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    std::ifstream    in(file_name);
+    std::string      line;
+    std::vector<int> counts(num_children, 0);
+    int              killed_records = 0;
+    int              torn           = 0;
+    bool             before = false, after = false;
+    while (std::getline(in, line))
+    {
+        size_t      pos  = line.find(" ] ");
+        std::string body = (std::string::npos == pos) ? line : line.substr(pos + 3);
+        int         c = -1, i = -1, n = 0;
+        char        rest[128];
+        if ("parent before fork" == body)
+        {
+            before = true;
+        }
+        else if ("parent after the workers" == body)
+        {
+            after = true;
+        }
+        else if ((2 == sscanf(body.c_str(), "child %d record %d %n", &c, &i, &n)) && (c >= 0) && (c < num_children)
+                 && (body.substr(n) == pad))
+        {
+            counts[c]++;
+        }
+        else if ((2 == sscanf(body.c_str(), "killed record %d %127s", &i, rest)) && (pad == rest))
+        {
+            killed_records++;
+        }
+        else
+        {
+            torn++;
+        }
+    }
+    for (int c = 0; c < num_children; c++)
+    {
+        check(records_per_child == counts[c],
+              "child " + std::to_string(c) + " records " + std::to_string(counts[c]));
+    }
+    check(killed_records > 0, "records of the killed worker written");
+    check(0 == torn, "no torn or interleaved lines, " + std::to_string(torn) + " found");
+    check(before && after, "parent records written");
+
+    ShmRingStats stats = ShmRingSink(cfg.logfile, 0).stats();
+    std::cout << "shared ring: " << num_children * records_per_child / elapsed << " records/s from " << num_children
+              << " processes, " << stats.entries << " entries, " << stats.dropped_entries << " dropped, "
+              << stats.skipped_entries << " skipped" << std::endl;
+
+    remove(file_name);
+    ShmRing::remove(name);
+    std::cout << (failures ? "test_shm_ring FAILED" : "test_shm_ring PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
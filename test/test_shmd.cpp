@@ -0,0 +1,134 @@
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "shm_ring.h"
+#include "test_util.h"
+
+using namespace logging;
+
+/**
+ * @brief tinylog-shmd is built next to the tests
+ */
+std::string
+tool_path (void)
+{
+    char    path[4096];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len <= 0)
+    {
+        return "tinylog-shmd";
+    }
+    path[len]        = '\0';
+    std::string self = path;
+    return self.substr(0, self.rfind('/') + 1) + "tinylog-shmd";
+}
+
+/**
+ * @brief Start the daemon with the given options before "name logfile"
+ */
+pid_t
+start_daemon (const std::string &options, const std::string &name, const std::string &logfile)
+{
+    pid_t pid = fork();
+    if (0 == pid)
+    {
+        std::string command = "exec " + tool_path() + " " + options + " " + name + " " + logfile;
+        execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char *>(nullptr));
+        _exit(127);
+    }
+    return pid;
+}
+
+/**
+ * @brief Wait for the daemon for up to seconds
+ * @retval Its exit status, -1 if it is still running (it is then killed)
+ */
+int
+wait_daemon (pid_t pid, int seconds)
+{
+    int status = 0;
+    for (int waited = 0; waited < seconds * 100; waited++)
+    {
+        if (pid == waitpid(pid, &status, WNOHANG))
+        {
+            return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    return -1;
+}
+
+/**
+ * @brief Lines "<tag> <i>\n" written to the ring, one entry per 100 lines
+ */
+std::string
+produce (ShmRingSink &sink, const std::string &tag, int lines)
+{
+    std::string all, entry;
+    for (int i = 0; i < lines; i++)
+    {
+        entry += tag + " " + std::to_string(i) + "\n";
+        if ((99 == i % 100) || (lines - 1 == i))
+        {
+            sink.write_logdata(entry.data(), static_cast<uint32_t>(entry.size()));
+            all += entry;
+            entry.clear();
+        }
+    }
+    return all;
+}
+
+int
+main (void)
+{
+    std::string name    = "test_shmd." + std::to_string(getpid());
+    std::string logfile = "test_shmd.log";
+    remove(logfile.c_str());
+    ShmRing::remove(name);
+
+    /* Entries written before the daemon starts wait in the ring, the daemon
+     * writes them and those that follow, and exits once the ring is idle */
+    std::string expected;
+    {
+        ShmRingSink sink("shm://" + name, 1024 * 1024);
+        check(sink.valid(), "producer attached");
+        expected = produce(sink, "early", 1000);
+        pid_t pid = start_daemon("-s 1024 -x 1", name, logfile);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        expected += produce(sink, "late", 1000);
+        auto begin = std::chrono::steady_clock::now();
+        check(0 == wait_daemon(pid, 10), "daemon exited when idle");
+        check(std::chrono::steady_clock::now() - begin >= std::chrono::milliseconds(900), "daemon waited while idle");
+        check(expected == read_file(logfile), "entries written by the daemon in order");
+        check(0 == sink.stats().used, "ring drained");
+    }
+
+    /* SIGTERM stops the daemon after it wrote what the ring holds; -u removes
+     * the ring */
+    {
+        pid_t pid = start_daemon("-u", name, logfile);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        ShmRingSink sink("shm://" + name, 0);
+        expected += produce(sink, "stopped", 1000);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        kill(pid, SIGTERM);
+        check(0 == wait_daemon(pid, 10), "daemon stopped by SIGTERM");
+        check(expected == read_file(logfile), "entries written before the stop");
+        check(!ShmRing::remove(name), "ring removed on exit");
+    }
+
+    /* Bad usage */
+    check(1 == wait_daemon(start_daemon("", name, ""), 10), "usage error");
+
+    remove(logfile.c_str());
+    ShmRing::remove(name);
+    std::cout << (failures ? "test_shmd FAILED" : "test_shmd PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,238 @@
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include "async_logging.h"
+#include "socket_sink.h"
+#include "test_util.h"
+
+using namespace logging;
+
+/**
+ * @brief Collector process: reads everything sent on the socket until the
+ * writer closes it (stream) or an "END\n" datagram arrives, and reports the
+ * number of complete records and bytes through a pipe.
+ */
+pid_t
+start_collector (int listen_fd, bool datagram, int report_fd)
+{
+    pid_t pid = fork();
+    if (0 != pid)
+    {
+        return pid;
+    }
+
+    int fd = datagram ? listen_fd : accept(listen_fd, nullptr, nullptr);
+    uint64_t records = 0, bytes = 0;
+    char     buf[65536];
+    while (fd >= 0)
+    {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+        {
+            break;
+        }
+        if (datagram && (4 == n) && (0 == memcmp(buf, "END\n", 4)))
+        {
+            break;
+        }
+        bytes += n;
+        for (ssize_t i = 0; i < n; i++)
+        {
+            records += ('\n' == buf[i]);
+        }
+        /* Datagrams never split a record */
+        if (datagram && ('\n' != buf[n - 1]))
+        {
+            records = ~0ULL;
+            break;
+        }
+    }
+    uint64_t report[2] = { records, bytes };
+    (void)!write(report_fd, report, sizeof(report));
+    _exit(0);
+}
+
+void
+finish_collector (pid_t pid, int report_fd, uint64_t &records, uint64_t &bytes)
+{
+    uint64_t report[2] = { 0, 0 };
+    (void)!read(report_fd, report, sizeof(report));
+    waitpid(pid, nullptr, 0);
+    records = report[0];
+    bytes   = report[1];
+}
+
+void
+write_records (AsyncLogging &logger, uint32_t first, uint32_t count)
+{
+    char line[128];
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        int n = snprintf(line, sizeof(line), "INFO : socket sink record %u\n", i);
+        logger.append_data(line, n);
+    }
+}
+
+void
+test_tcp (void)
+{
+    const uint32_t count = 200000;
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+    bind(listen_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    listen(listen_fd, 1);
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, reinterpret_cast<struct sockaddr *>(&addr), &len);
+    std::string address = "tcp://127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+
+    int report[2];
+    (void)!pipe(report);
+    pid_t pid = start_collector(listen_fd, false, report[1]);
+    close(listen_fd);
+
+    {
+        AsyncLogging logger;
+        SocketSink  *sink = new SocketSink(address);
+        logger.init(std::unique_ptr<LogSink>(sink));
+        logger.start();
+        check(sink->connected(), "tcp connected");
+        write_records(logger, 0, count);
+    }
+
+    uint64_t records, bytes;
+    finish_collector(pid, report[0], records, bytes);
+    check(records == count, "tcp records " + std::to_string(records));
+    close(report[0]);
+    close(report[1]);
+}
+
+void
+test_unixgram (void)
+{
+    const uint32_t count = 50000;
+    const char    *path  = "test_socket_sink.sock";
+    unlink(path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    bind(listen_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(listen_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    int report[2];
+    (void)!pipe(report);
+    pid_t pid = start_collector(listen_fd, true, report[1]);
+
+    {
+        AsyncLogging logger;
+        SocketSink  *sink = new SocketSink(std::string("unixgram://") + path, "test_socket_sink.spill");
+        logger.init(std::unique_ptr<LogSink>(sink));
+        logger.start();
+        check(sink->connected(), "unixgram connected");
+        write_records(logger, 0, count);
+    }
+
+    /* Tell the collector the test is over */
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    sendto(fd, "END\n", 4, 0, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    close(fd);
+
+    uint64_t records, bytes;
+    finish_collector(pid, report[0], records, bytes);
+    check(records == count, "unixgram records " + std::to_string(records));
+    close(listen_fd);
+    close(report[0]);
+    close(report[1]);
+    unlink(path);
+    remove("test_socket_sink.spill");
+}
+
+void
+test_spill (void)
+{
+    const uint32_t count = 20000;
+    const char    *path  = "test_socket_sink_stream.sock";
+    const char    *spill = "test_socket_sink_stream.spill";
+    unlink(path);
+    remove(spill);
+
+    AsyncLogging *logger = new AsyncLogging();
+    SocketSink   *sink   = new SocketSink(std::string("unix://") + path, spill);
+    logger->init(std::unique_ptr<LogSink>(sink));
+    logger->start();
+    check(!sink->connected(), "no collector yet");
+
+    /* The collector is not there, everything goes to the spill file */
+    write_records(*logger, 0, count);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    check(sink->spilled_bytes() > 0, "data spilled");
+    check(0 == sink->sent_bytes(), "nothing sent");
+
+    /* The collector comes up, the spill file is replayed ahead of the new
+     * records */
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    bind(listen_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    listen(listen_fd, 1);
+
+    int report[2];
+    (void)!pipe(report);
+    pid_t pid = start_collector(listen_fd, false, report[1]);
+    close(listen_fd);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    write_records(*logger, count, count);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    check(sink->connected(), "connected after backoff");
+    uint64_t dropped = sink->dropped_bytes();
+    delete logger;
+
+    uint64_t records, bytes;
+    finish_collector(pid, report[0], records, bytes);
+    check(0 == dropped, "nothing dropped");
+    check(records == 2 * count, "spilled and new records " + std::to_string(records));
+
+    FILE *f = fopen(spill, "rb");
+    check((nullptr != f) && (0 == fseek(f, 0, SEEK_END)) && (0 == ftell(f)), "spill file drained");
+    if (nullptr != f)
+    {
+        fclose(f);
+    }
+    close(report[0]);
+    close(report[1]);
+    unlink(path);
+    remove(spill);
+}
+
+int
+main (void)
+{
+    signal(SIGPIPE, SIG_IGN);
+    test_tcp();
+    test_unixgram();
+    test_spill();
+    std::cout << (failures ? "test_socket_sink FAILED" : "test_socket_sink PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
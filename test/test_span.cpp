@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "logging.h"
+#include "test_util.h"
+
+using namespace logging;
+
+const SpanStats *
+find_span (const std::vector<SpanStats> &spans, const std::string &name)
+{
+    for (const SpanStats &stats : spans)
+    {
+        if (stats.name == name)
+        {
+            return &stats;
+        }
+    }
+    return nullptr;
+}
+
+void
+handle_request (int i)
+{
+    LOG_SCOPE(INFO, "request");
+    {
+        LOG_SCOPE(INFO, "parse");
+    }
+    {
+        LOG_SPAN(INFO, "slow_io", 1000);
+        if (0 == i % 10)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+    /* Below the level, not part of the path */
+    LOG_SCOPE(DEBUG, "debug_only");
+    LOG_SCOPE(INFO, "reply");
+}
+
+int
+main (void)
+{
+    const SpanClock &clock = span_clock();
+    std::cout << "span clock: " << (clock.tsc() ? "tsc" : "steady_clock") << std::endl;
+
+    /* The clock agrees with the steady clock */
+    {
+        auto     begin = std::chrono::steady_clock::now();
+        uint64_t start = clock.now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        uint64_t ns    = clock.to_ns(clock.now() - start);
+        uint64_t ref   = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin)
+                           .count();
+        check((ns > ref * 95 / 100) && (ns < ref * 105 / 100),
+              "clock " + std::to_string(ns) + " ns, steady " + std::to_string(ref) + " ns");
+    }
+
+    /* Parsing: other records and framing prefixes are skipped */
+    {
+        SpanSummary summary;
+        std::string data = "INFO : [ 2024-01-01 10:00:00 ] span=a ns=100 depth=0\n"
+                           "INFO : [ 2024-01-01 10:00:00 ] hello\n"
+                           "@0000000000000002:00000000:00000030 INFO : [ 2024-01-01 10:00:00 ] span=a ns=300 depth=0\n"
+                           "INFO : [ 2024-01-01 10:00:00 ] span=a/b ns=50 depth=1\n"
+                           "INFO : [ 2024-01-01 10:00:00 ] span=a ns=200 depth=0";
+        summary.scan(data.data(), data.size());
+        check(4 == summary.records(), "span records");
+        std::vector<SpanStats> spans = summary.finish();
+        check((2 == spans.size()) && ("a" == spans[0].name), "spans by total time");
+        const SpanStats *a = find_span(spans, "a");
+        check((nullptr != a) && (3 == a->count) && (600 == a->total_ns) && (100 == a->min_ns) && (200 == a->p50_ns)
+                  && (300 == a->max_ns),
+              "distribution of a");
+        check((nullptr != a) && (9 == a->histogram.size()) && (1 == a->histogram[6]) && (1 == a->histogram[7])
+                  && (1 == a->histogram[8]),
+              "histogram of a");
+        check(0 == summary.records(), "summary starts over");
+    }
+
+    const char *name = "test_span.log";
+    remove(name);
+    LogContorl cfg;
+    cfg.use_ms             = true;
+    cfg.show_path          = true;
+    cfg.show_func          = true;
+    cfg.level              = LOG_INFO;
+    cfg.logfile            = name;
+    cfg.roll_cycle_minutes = 0;
+    cfg.roll_size_kbytes   = 0;
+    log_init(cfg);
+
+    const int REQUESTS = 200;
+    for (int i = 0; i < REQUESTS; i++)
+    {
+        handle_request(i);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    std::string text = read_file(name);
+    SpanSummary summary;
+    summary.scan(text.data(), text.size());
+    std::vector<SpanStats> spans = summary.finish();
+    const SpanStats       *request = find_span(spans, "request");
+    const SpanStats       *parse   = find_span(spans, "request/parse");
+    const SpanStats       *slow    = find_span(spans, "request/slow_io");
+    const SpanStats       *reply   = find_span(spans, "request/reply");
+    check((nullptr != request) && (REQUESTS == request->count), "outer spans");
+    check((nullptr != parse) && (REQUESTS == parse->count), "nested spans");
+    check((nullptr != reply) && (REQUESTS == reply->count), "spans after a disabled one");
+    check((nullptr != slow) && (REQUESTS / 10 == slow->count) && (slow->min_ns >= 1000000),
+          "only spans above the threshold");
+    check(4 == spans.size(), "no disabled spans");
+    check(std::string::npos != text.find("span=request/parse ns="), "record format");
+    check(std::string::npos != text.find(" depth=1\n"), "depth");
+    if ((nullptr != request) && (nullptr != slow))
+    {
+        check(request->total_ns >= slow->total_ns, "outer span covers the inner ones");
+    }
+
+    /* Cost of a span that writes nothing, and of a disabled one */
+    const int ROUNDS = 1000000;
+    auto      begin  = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        LOG_SPAN(INFO, "quiet", 1000000);
+    }
+    double below = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / ROUNDS;
+    begin        = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        LOG_SCOPE(DEBUG, "disabled");
+    }
+    double disabled
+        = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / ROUNDS;
+    begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS / 10; i++)
+    {
+        LOG_SCOPE(INFO, "written");
+    }
+    double written
+        = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / (ROUNDS / 10);
+    std::cout << "span below threshold: " << below << " ns, disabled: " << disabled << " ns, written: " << written
+              << " ns" << std::endl;
+
+    remove(name);
+    std::cout << (failures ? "test_span FAILED" : "test_span PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+#ifndef _LOGGING_TEST_UTIL_H_
+#define _LOGGING_TEST_UTIL_H_
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/* Helpers shared by the tests, each of which is a program of its own */
+
+/* Number of failed checks, a test fails if it is not 0 */
+static int failures = 0;
+
+/**
+ * @brief Print and count a failed check
+ */
+static inline void
+check (bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+/**
+ * @brief Whole content of a file, empty if it can not be read
+ */
+static inline std::string
+read_file (const std::string &name)
+{
+    std::ifstream     in(name, std::ios::binary);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+#endif // _LOGGING_TEST_UTIL_H_
@@ -0,0 +1,110 @@
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "async_logging.h"
+
+using namespace logging;
+
+const int num_threads        = 2;
+const int records_per_thread = 200000;
+
+/**
+ * @brief Destination that discards everything, so only the hand-off between
+ * producers and the background thread is measured
+ */
+class NullSink : public LogSink
+{
+public:
+    void write_logdata(const char *logdata, uint32_t size, bool flush_now = false) override
+    {
+        (void)logdata;
+        (void)size;
+        (void)flush_now;
+    }
+
+    void flush(void) override
+    {
+    }
+};
+
+double
+cpu_seconds (void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+           + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * @brief Time every append_data call of the producers with one wait strategy.
+ * The producers pause now and then so that the consumer goes idle and has to
+ * be woken up again, which is where the strategies differ.
+ */
+void
+run (WaitStrategy wait, const char *name)
+{
+    AsyncLogging    logger;
+    ConsumerOptions options;
+    options.wait = wait;
+    options.name = std::string("tinylog-") + name;
+    logger.init(std::unique_ptr<LogSink>(new NullSink()));
+    logger.set_consumer_options(options);
+    logger.start();
+
+    std::vector<std::vector<uint32_t>> latencies(num_threads);
+    std::vector<std::thread>           threads;
+    double                             cpu_start  = cpu_seconds();
+    auto                               wall_start = std::chrono::steady_clock::now();
+    for (int t = 0; t < num_threads; t++)
+    {
+        threads.push_back(std::thread([&logger, &latencies, t] () {
+            std::string line(120, 'x');
+            line[line.size() - 1] = '\n';
+            std::vector<uint32_t> &samples = latencies[t];
+            samples.reserve(records_per_thread);
+            for (int i = 0; i < records_per_thread; i++)
+            {
+                auto begin = std::chrono::steady_clock::now();
+                logger.append_data(line.data(), line.size());
+                auto end = std::chrono::steady_clock::now();
+                samples.push_back(static_cast<uint32_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()));
+                if (0 == (i % 20000))
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+            }
+        }));
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    double cpu  = cpu_seconds() - cpu_start;
+
+    std::vector<uint32_t> all;
+    for (auto &samples : latencies)
+    {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    std::sort(all.begin(), all.end());
+    size_t n = all.size();
+    std::cout << name << ": p50:" << all[n / 2] << "ns p99:" << all[n * 99 / 100] << "ns p999:" << all[n * 999 / 1000]
+              << "ns max:" << all[n - 1] << "ns cpu:" << cpu << "s wall:" << wall << "s" << std::endl;
+}
+
+int
+main (void)
+{
+    run(WAIT_BLOCKING, "blocking");
+    run(WAIT_SPIN_YIELD, "spin-yield");
+    run(WAIT_BUSY_POLL, "busy-poll");
+    return 0;
+}
@@ -0,0 +1,644 @@
+/**
+ * @brief tinylog-query: search log files written by tinylog.
+ *
+ * Files are memory mapped and cut into chunks on record boundaries, the
+ * chunks are filtered in parallel and the matching records of all files are
+ * printed in timestamp order. A record starts at a line that begins with the
+ * header written by Logger::Logger ("INFO : [ 2024-01-02 03:04:05.678 ...
+ * ] "), or with a LOG_KV record ({"level":... or level=...); lines that do not
+ * start a record belong to the previous one. The frame prefix of framed
+ * records (log_frame.h) is skipped. Container files (see
+ * log_container.h) are searched block by block, and their index is used to
+ * skip the blocks outside the time range.
+ *
+ * usage: tinylog-query [-l level] [-f time] [-t time] [-q seq[-seq]] [-s site]
+ *                      [-g text] [-j threads] file...
+ */
+#include <emmintrin.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log_container.h"
+#include "log_frame.h"
+
+using namespace logging;
+
+/* Query parameters */
+struct Query
+{
+    int         min_level = 0;
+    uint64_t    from_us   = 0;
+    uint64_t    to_us     = UINT64_MAX;
+    bool        by_seq    = false;  // Only framed records within [from_seq, to_seq]
+    uint64_t    from_seq  = 0;
+    uint64_t    to_seq    = UINT64_MAX;
+    std::string site;
+    std::string text;
+};
+
+/* A mapped input file */
+struct InputFile
+{
+    std::string name;
+    const char *data = nullptr;
+    size_t      size = 0;
+    bool        container = false;
+    ContainerReader reader;
+};
+
+/* A piece of work: a byte range of a text file or a block range of a
+ * container file */
+struct Task
+{
+    size_t file;
+    size_t begin;
+    size_t end;
+};
+
+struct Match
+{
+    uint64_t    ts_us;
+    size_t      file;
+    const char *data;
+    size_t      size;
+};
+
+static const char *LEVEL_NAMES[] = { "IDEBUG", "DEBUG", "INFO", "WARN", "ERROR" };
+static const int   NUM_LEVELS    = 5;
+
+/**
+ * @brief Level of a text header ("DEBUG: ", "INFO : " ...), -1 if the line
+ * does not start with one
+ */
+static int
+header_level (const char *p, size_t n)
+{
+    if (n < 9)
+    {
+        return -1;
+    }
+    /* Every level name is padded to 7 characters followed by "[ " */
+    if (('[' != p[7]) || (' ' != p[8]))
+    {
+        return -1;
+    }
+    if (0 == memcmp(p, "IDEBUG:", 7)) return 0;
+    if (0 == memcmp(p, "DEBUG: ", 7)) return 1;
+    if (0 == memcmp(p, "INFO : ", 7)) return 2;
+    if (0 == memcmp(p, "WARN : ", 7)) return 3;
+    if (0 == memcmp(p, "ERROR: ", 7)) return 4;
+    return -1;
+}
+
+/**
+ * @brief Level of a structured record, -1 if the line is not one
+ * @param[out] time_pos Offset of the time value
+ */
+static int
+kv_level (const char *p, size_t n, size_t &time_pos)
+{
+    static const char *KV_NAMES[] = { "idebug", "debug", "info", "warn", "error" };
+    size_t             skip       = 0;
+
+    if ((n > 10) && (0 == memcmp(p, "{\"level\":\"", 10)))
+    {
+        skip = 10;
+    }
+    else if ((n > 6) && (0 == memcmp(p, "level=", 6)))
+    {
+        skip = 6;
+    }
+    else
+    {
+        return -1;
+    }
+
+    for (int level = 0; level < NUM_LEVELS; level++)
+    {
+        size_t len = strlen(KV_NAMES[level]);
+        if ((n > skip + len) && (0 == memcmp(p + skip, KV_NAMES[level], len)))
+        {
+            const char *t = static_cast<const char *>(memchr(p + skip + len, 't', n - skip - len));
+            if ((nullptr == t) || (static_cast<size_t>(t - p) > skip + len + 4))
+            {
+                return -1;
+            }
+            /* "time":"  or  time=" */
+            time_pos = (t - p) + ((10 == skip) ? 7 : 6);
+            return level;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Level of the record starting at p, -1 if no record starts there
+ * @param[out] time_pos Offset of the "YYYY-mm-dd HH:MM:SS" time
+ * @param[out] framed Whether the record has a frame prefix
+ * @param[out] seq Sequence number of a framed record
+ */
+static int
+record_level (const char *p, size_t n, size_t &time_pos, bool &framed, uint64_t &seq)
+{
+    /* A framed record has its header behind the frame prefix */
+    size_t   skip = 0;
+    uint32_t crc, size;
+    framed = ('@' == p[0]) && parse_record_frame(p, n, seq, crc, size);
+    if (framed)
+    {
+        skip = RECORD_FRAME_SIZE;
+    }
+
+    int level = header_level(p + skip, n - skip);
+    if (level >= 0)
+    {
+        time_pos = skip + 9;
+        return level;
+    }
+    level = kv_level(p + skip, n - skip, time_pos);
+    time_pos += skip;
+    return level;
+}
+
+/**
+ * @brief Find the next '\n' with SSE2, returns end if there is none
+ */
+static const char *
+find_newline (const char *p, const char *end)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (p + 16 <= end)
+    {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), nl));
+        if (0 != mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    while ((p < end) && ('\n' != *p))
+    {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * @brief Substring search. Candidate positions are found 16 at a time by
+ * comparing the first and the last byte of the needle with SSE2, only those
+ * are verified with memcmp.
+ */
+static bool
+contains (const char *hay, size_t n, const std::string &needle)
+{
+    size_t m = needle.size();
+    if (0 == m)
+    {
+        return true;
+    }
+    if (m > n)
+    {
+        return false;
+    }
+
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last  = _mm_set1_epi8(needle[m - 1]);
+    size_t        i     = 0;
+    for (; i + m - 1 + 16 <= n; i += 16)
+    {
+        __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hay + i));
+        __m128i block_last  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hay + i + m - 1));
+        int     mask        = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+        while (0 != mask)
+        {
+            int bit = __builtin_ctz(mask);
+            if (0 == memcmp(hay + i + bit + 1, needle.data() + 1, (m > 2) ? m - 2 : 0))
+            {
+                return true;
+            }
+            mask &= mask - 1;
+        }
+    }
+    for (; i + m <= n; i++)
+    {
+        if ((hay[i] == needle[0]) && (0 == memcmp(hay + i, needle.data(), m)))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Converts "YYYY-mm-dd HH:MM:SS[.mmm]" local time to microseconds.
+ * mktime is only called when the minute changes.
+ */
+class TimeParser
+{
+public:
+    bool parse (const char *p, size_t n, uint64_t &ts_us)
+    {
+        if ((n < 19) || ('-' != p[4]) || ('-' != p[7]) || (':' != p[13]) || (':' != p[16]))
+        {
+            return false;
+        }
+        if (0 != memcmp(p, _minute_key, 16))
+        {
+            struct tm tm_data;
+            memset(&tm_data, 0, sizeof(tm_data));
+            tm_data.tm_year  = atoi2(p, 4) - 1900;
+            tm_data.tm_mon   = atoi2(p + 5, 2) - 1;
+            tm_data.tm_mday  = atoi2(p + 8, 2);
+            tm_data.tm_hour  = atoi2(p + 11, 2);
+            tm_data.tm_min   = atoi2(p + 14, 2);
+            tm_data.tm_isdst = -1;
+            _minute_us       = static_cast<uint64_t>(mktime(&tm_data)) * 1000000;
+            memcpy(_minute_key, p, 16);
+        }
+        ts_us = _minute_us + static_cast<uint64_t>(atoi2(p + 17, 2)) * 1000000;
+        if ((n >= 23) && ('.' == p[19]))
+        {
+            ts_us += static_cast<uint64_t>(atoi2(p + 20, 3)) * 1000;
+        }
+        return true;
+    }
+
+private:
+    static int atoi2 (const char *p, int n)
+    {
+        int value = 0;
+        for (int i = 0; i < n; i++)
+        {
+            value = value * 10 + (p[i] - '0');
+        }
+        return value;
+    }
+
+    char     _minute_key[16] = { 0 };
+    uint64_t _minute_us      = 0;
+};
+
+/**
+ * @brief Filter the records of a memory range, appending the matches
+ */
+static void
+scan_range (const Query &query, size_t file, const char *base, size_t begin, size_t end, std::vector<Match> &out)
+{
+    TimeParser  parser;
+    const char *p          = base + begin;
+    const char *stop       = base + end;
+    const char *rec_start  = nullptr;
+    int         rec_level  = -1;
+    size_t      time_pos   = 0;
+    bool        rec_framed = false;
+    uint64_t    rec_seq    = 0;
+
+    /* Flush the record [rec_start, rec_end) through the filters */
+    auto finish = [&] (const char *rec_end) {
+        if ((nullptr == rec_start) || (rec_level < query.min_level))
+        {
+            return;
+        }
+        if (query.by_seq && (!rec_framed || (rec_seq < query.from_seq) || (rec_seq > query.to_seq)))
+        {
+            return;
+        }
+        size_t   size = rec_end - rec_start;
+        uint64_t ts   = 0;
+        if (!parser.parse(rec_start + time_pos, size - time_pos, ts) || (ts < query.from_us) || (ts > query.to_us))
+        {
+            return;
+        }
+        if (!query.site.empty())
+        {
+            /* The site (file:line and function) lives in the text header */
+            const char *close = static_cast<const char *>(memmem(rec_start, size, " ] ", 3));
+            size_t      hdr   = (nullptr == close) ? size : (close - rec_start);
+            if (!contains(rec_start, hdr, query.site))
+            {
+                return;
+            }
+        }
+        if (!contains(rec_start, size, query.text))
+        {
+            return;
+        }
+        Match match;
+        match.ts_us  = ts;
+        match.file   = file;
+        match.data   = rec_start;
+        match.size   = size;
+        out.push_back(match);
+    };
+
+    while (p < stop)
+    {
+        const char *eol   = find_newline(p, stop);
+        const char *next  = (eol < stop) ? eol + 1 : stop;
+        size_t      tpos  = 0;
+        bool        frm   = false;
+        uint64_t    seq   = 0;
+        int         level = record_level(p, next - p, tpos, frm, seq);
+        if (level >= 0)
+        {
+            finish(p);
+            rec_start  = p;
+            rec_level  = level;
+            time_pos   = tpos;
+            rec_framed = frm;
+            rec_seq    = seq;
+        }
+        p = next;
+    }
+    finish(stop);
+}
+
+/**
+ * @brief Move pos forward to the start of the next record
+ */
+static size_t
+align_to_record (const char *data, size_t size, size_t pos)
+{
+    while (pos < size)
+    {
+        const char *eol  = find_newline(data + pos, data + size);
+        size_t      next = (eol - data) + 1;
+        if (next >= size)
+        {
+            return size;
+        }
+        size_t   tpos   = 0;
+        bool     framed = false;
+        uint64_t seq    = 0;
+        if (record_level(data + next, size - next, tpos, framed, seq) >= 0)
+        {
+            return next;
+        }
+        pos = next;
+    }
+    return size;
+}
+
+static bool
+parse_time_arg (const char *arg, uint64_t &ts_us)
+{
+    TimeParser parser;
+    return parser.parse(arg, strlen(arg), ts_us);
+}
+
+/**
+ * @brief Parse "seq" or "first-last", decimal
+ */
+static bool
+parse_seq_arg (const char *arg, uint64_t &from_seq, uint64_t &to_seq)
+{
+    char *end = nullptr;
+    from_seq  = strtoull(arg, &end, 10);
+    if (end == arg)
+    {
+        return false;
+    }
+    to_seq = from_seq;
+    if ('-' == *end)
+    {
+        const char *last = end + 1;
+        to_seq           = strtoull(last, &end, 10);
+        if (end == last)
+        {
+            return false;
+        }
+    }
+    return ('\0' == *end) && (from_seq <= to_seq);
+}
+
+static void
+usage (void)
+{
+    std::cerr << "usage: tinylog-query [-l level] [-f \"YYYY-mm-dd HH:MM:SS\"] [-t \"YYYY-mm-dd HH:MM:SS\"]\n"
+                 "                     [-q seq[-seq]] [-s site] [-g text] [-j threads] file...\n"
+                 "  -l  minimum level: IDEBUG, DEBUG, INFO, WARN, ERROR\n"
+                 "  -f  -t  time range, inclusive\n"
+                 "  -q  sequence number or inclusive range of framed records (record_framing)\n"
+                 "  -s  substring of the source site (file:line function) in the header\n"
+                 "  -g  substring anywhere in the record\n"
+                 "  -j  number of worker threads, defaults to the number of CPUs\n";
+}
+
+int
+main (int argc, char *argv[])
+{
+    Query    query;
+    unsigned num_threads = std::thread::hardware_concurrency();
+    int      opt;
+
+    while (-1 != (opt = getopt(argc, argv, "l:f:t:q:s:g:j:h")))
+    {
+        switch (opt)
+        {
+            case 'l':
+                query.min_level = -1;
+                for (int level = 0; level < NUM_LEVELS; level++)
+                {
+                    if (0 == strcasecmp(optarg, LEVEL_NAMES[level]))
+                    {
+                        query.min_level = level;
+                    }
+                }
+                if (query.min_level < 0)
+                {
+                    std::cerr << "unknown level " << optarg << std::endl;
+                    return 1;
+                }
+                break;
+            case 'f':
+            case 't':
+                if (!parse_time_arg(optarg, ('f' == opt) ? query.from_us : query.to_us))
+                {
+                    std::cerr << "bad time " << optarg << ", expected \"YYYY-mm-dd HH:MM:SS\"" << std::endl;
+                    return 1;
+                }
+                if ('t' == opt)
+                {
+                    /* the end of the range includes the whole second */
+                    query.to_us += 999999;
+                }
+                break;
+            case 'q':
+                if (!parse_seq_arg(optarg, query.from_seq, query.to_seq))
+                {
+                    std::cerr << "bad sequence range " << optarg << ", expected seq or seq-seq" << std::endl;
+                    return 1;
+                }
+                query.by_seq = true;
+                break;
+            case 's':
+                query.site = optarg;
+                break;
+            case 'g':
+                query.text = optarg;
+                break;
+            case 'j':
+                num_threads = atoi(optarg);
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        usage();
+        return 1;
+    }
+    if (0 == num_threads)
+    {
+        num_threads = 1;
+    }
+
+    /* Map the inputs and cut them into tasks */
+    std::vector<InputFile> files(argc - optind);
+    std::vector<Task>      tasks;
+    const size_t           CHUNK_SIZE = 8 * 1024 * 1024;
+    for (size_t f = 0; f < files.size(); f++)
+    {
+        InputFile &input = files[f];
+        input.name       = argv[optind + f];
+
+        if (input.reader.open(input.name))
+        {
+            /* Container: use the block index to skip to the time range */
+            input.container = true;
+            size_t first    = input.reader.find_block(query.from_us);
+            size_t last     = first;
+            while ((last < input.reader.block_count()) && (input.reader.block(last).meta.first_ts_us <= query.to_us))
+            {
+                last++;
+            }
+            const size_t BLOCKS_PER_TASK = 64;
+            for (size_t b = first; b < last; b += BLOCKS_PER_TASK)
+            {
+                Task task = { f, b, std::min(last, b + BLOCKS_PER_TASK) };
+                tasks.push_back(task);
+            }
+            continue;
+        }
+
+        int fd = open(input.name.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if ((fd < 0) || (0 != fstat(fd, &st)))
+        {
+            std::cerr << "can not open " << input.name << std::endl;
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            continue;
+        }
+        if (0 == st.st_size)
+        {
+            close(fd);
+            continue;
+        }
+        void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (MAP_FAILED == map)
+        {
+            std::cerr << "can not map " << input.name << std::endl;
+            continue;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        input.data = static_cast<const char *>(map);
+        input.size = st.st_size;
+
+        size_t begin = 0;
+        while (begin < input.size)
+        {
+            size_t end = (input.size - begin > CHUNK_SIZE) ? align_to_record(input.data, input.size, begin + CHUNK_SIZE)
+                                                           : input.size;
+            Task task = { f, begin, end };
+            tasks.push_back(task);
+            begin = end;
+        }
+    }
+
+    /* Filter in parallel, each task collects its own matches */
+    std::vector<std::vector<Match>> results(tasks.size());
+    std::atomic<size_t>             next_task(0);
+    std::vector<std::thread>        workers;
+    for (unsigned t = 0; t < std::min<size_t>(num_threads, tasks.size()); t++)
+    {
+        workers.push_back(std::thread([&] () {
+            size_t i;
+            while ((i = next_task.fetch_add(1)) < tasks.size())
+            {
+                const Task &task  = tasks[i];
+                InputFile  &input = files[task.file];
+                if (input.container)
+                {
+                    for (size_t b = task.begin; b < task.end; b++)
+                    {
+                        const char *payload = input.reader.payload(b);
+                        size_t      size    = input.reader.block(b).payload_size;
+                        scan_range(query, task.file, payload, 0, size, results[i]);
+                    }
+                }
+                else
+                {
+                    scan_range(query, task.file, input.data, task.begin, task.end, results[i]);
+                }
+            }
+        }));
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    /* Merge in timestamp order, ties keep the file and position order */
+    std::vector<Match> matches;
+    for (auto &result : results)
+    {
+        matches.insert(matches.end(), result.begin(), result.end());
+    }
+    std::stable_sort(matches.begin(), matches.end(), [] (const Match &a, const Match &b) {
+        if (a.ts_us != b.ts_us)
+        {
+            return a.ts_us < b.ts_us;
+        }
+        if (a.file != b.file)
+        {
+            return a.file < b.file;
+        }
+        return a.data < b.data;
+    });
+
+    for (auto &match : matches)
+    {
+        fwrite(match.data, 1, match.size, stdout);
+        if ((0 == match.size) || ('\n' != match.data[match.size - 1]))
+        {
+            fputc('\n', stdout);
+        }
+    }
+
+    for (auto &input : files)
+    {
+        if (nullptr != input.data)
+        {
+            munmap(const_cast<char *>(input.data), input.size);
+        }
+    }
+    return 0;
+}
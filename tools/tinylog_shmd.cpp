@@ -0,0 +1,133 @@
+/**
+ * @brief tinylog-shmd: the writer of a shared ring (shm_ring.h) as a small
+ * daemon. Processes log with logfile = shm://<name>; the daemon drains the
+ * ring of all of them to one rolling log file. If another writer is running
+ * the daemon stands by and takes over once that writer exits. It stops on
+ * SIGINT or SIGTERM after writing what the ring holds, or with -x once the
+ * ring has been idle for the given time.
+ *
+ * usage: tinylog-shmd [-s ring_kbytes] [-r roll_size_kbytes] [-c roll_minutes]
+ *                     [-k keep_files] [-x idle_seconds] [-u] name logfile
+ */
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include "log_file.h"
+#include "shm_ring.h"
+
+using namespace logging;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void
+on_signal (int)
+{
+    stop_requested = 1;
+}
+
+static void
+usage (void)
+{
+    std::cerr << "usage: tinylog-shmd [-s ring_kbytes] [-r roll_size_kbytes] [-c roll_minutes] [-k keep_files]\n"
+                 "                    [-x idle_seconds] [-u] name logfile\n"
+                 "  -s  size of the ring if it has to be created, in Kbytes (4096)\n"
+                 "  -r  roll the log file at this size, in Kbytes\n"
+                 "  -c  roll the log file every this many minutes\n"
+                 "  -k  keep at most this many rolled files\n"
+                 "  -x  exit once nothing has been written for this many seconds\n"
+                 "  -u  remove the ring on exit\n";
+}
+
+int
+main (int argc, char *argv[])
+{
+    uint64_t        ring_kbytes  = 4096;
+    uint64_t        roll_kbytes  = 0;
+    uint64_t        roll_minutes = 0;
+    uint32_t        idle_seconds = 0;
+    bool            remove_ring  = false;
+    RetentionPolicy retention;
+    int             opt;
+
+    while (-1 != (opt = getopt(argc, argv, "s:r:c:k:x:uh")))
+    {
+        switch (opt)
+        {
+            case 's':
+                ring_kbytes = strtoull(optarg, nullptr, 10);
+                break;
+            case 'r':
+                roll_kbytes = strtoull(optarg, nullptr, 10);
+                break;
+            case 'c':
+                roll_minutes = strtoull(optarg, nullptr, 10);
+                break;
+            case 'k':
+                retention.max_files = static_cast<uint32_t>(strtoul(optarg, nullptr, 10));
+                break;
+            case 'x':
+                idle_seconds = static_cast<uint32_t>(strtoul(optarg, nullptr, 10));
+                break;
+            case 'u':
+                remove_ring = true;
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+    if (optind + 2 != argc)
+    {
+        usage();
+        return 1;
+    }
+    std::string name    = argv[optind];
+    std::string logfile = argv[optind + 1];
+
+    struct sigaction action;
+    action.sa_handler = on_signal;
+    action.sa_flags   = 0;
+    sigemptyset(&action.sa_mask);
+    (void)sigaction(SIGINT, &action, nullptr);
+    (void)sigaction(SIGTERM, &action, nullptr);
+
+    ShmRingWriter writer;
+    if (!writer.start(name, ring_kbytes * 1024,
+                      std::unique_ptr<LogSink>(new LogFile(logfile, roll_minutes, roll_kbytes * 1024, retention))))
+    {
+        return 1;
+    }
+
+    uint64_t                              entries = writer.stats().entries;
+    std::chrono::steady_clock::time_point active  = std::chrono::steady_clock::now();
+    while (!stop_requested)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ShmRingStats stats = writer.stats();
+        if ((stats.entries != entries) || (0 != stats.used))
+        {
+            entries = stats.entries;
+            active  = std::chrono::steady_clock::now();
+        }
+        else if ((0 != idle_seconds) && (std::chrono::steady_clock::now() - active > std::chrono::seconds(idle_seconds)))
+        {
+            break;
+        }
+    }
+
+    ShmRingStats stats = writer.stats();
+    writer.stop();
+    std::cerr << "tinylog-shmd: " << stats.entries << " entries, " << stats.bytes << " bytes, dropped "
+              << stats.dropped_entries << " entries, skipped " << stats.skipped_entries
+              << " reservations of crashed producers" << std::endl;
+    if (remove_ring)
+    {
+        (void)ShmRing::remove(name);
+    }
+    return 0;
+}
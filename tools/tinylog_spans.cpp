@@ -0,0 +1,193 @@
+/**
+ * @brief tinylog-spans: latency distributions of the timing spans
+ * (LOG_SCOPE, LOG_SPAN) found in log files.
+ *
+ * Every span path gets a line with its count, total time and the min, p50,
+ * p90, p99 and max durations, the spans that took the most time in total
+ * first. With -H a log2 histogram of the durations follows each line. Text
+ * and container files may be mixed, other records are skipped.
+ *
+ * usage: tinylog-spans [-H] [-n count] file...
+ */
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include "log_container.h"
+#include "log_span.h"
+
+using namespace logging;
+
+static void
+usage (void)
+{
+    std::cerr << "usage: tinylog-spans [-H] [-n count] file...\n"
+                 "  -H        print a histogram of the durations of every span\n"
+                 "  -n count  only print the count spans with the largest total time\n";
+}
+
+/**
+ * @brief Feed a text file to the summary
+ * @retval false if the file can not be read
+ */
+static bool
+scan_text_file (const std::string &name, SpanSummary &summary)
+{
+    int         fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if ((fd < 0) || (0 != fstat(fd, &st)))
+    {
+        std::cerr << "can not open " << name << std::endl;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return false;
+    }
+    if (0 == st.st_size)
+    {
+        close(fd);
+        return true;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == map)
+    {
+        std::cerr << "can not map " << name << std::endl;
+        return false;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    summary.scan(static_cast<const char *>(map), st.st_size);
+    munmap(map, st.st_size);
+    return true;
+}
+
+/**
+ * @brief Print a duration with a unit that keeps it short
+ */
+static void
+print_duration (uint64_t ns)
+{
+    if (ns < 10000)
+    {
+        printf(" %8" PRIu64 "ns", ns);
+    }
+    else if (ns < 10000000)
+    {
+        printf(" %8.1fus", ns / 1e3);
+    }
+    else if (ns < 10000000000ULL)
+    {
+        printf(" %8.1fms", ns / 1e6);
+    }
+    else
+    {
+        printf(" %8.1fs ", ns / 1e9);
+    }
+}
+
+static void
+print_histogram (const SpanStats &stats)
+{
+    static const int BAR_WIDTH = 40;
+
+    uint64_t peak = 0;
+    for (uint64_t n : stats.histogram)
+    {
+        peak = (n > peak) ? n : peak;
+    }
+    for (size_t i = 0; i < stats.histogram.size(); i++)
+    {
+        if (0 == stats.histogram[i])
+        {
+            continue;
+        }
+        printf("    >=");
+        print_duration(1ULL << i);
+        printf(" %10" PRIu64 " ", stats.histogram[i]);
+        int width = static_cast<int>(stats.histogram[i] * BAR_WIDTH / peak);
+        for (int c = 0; c < width; c++)
+        {
+            putchar('#');
+        }
+        putchar('\n');
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+    bool   histogram = false;
+    size_t limit     = 0;
+    int    opt;
+    while (-1 != (opt = getopt(argc, argv, "Hn:h")))
+    {
+        switch (opt)
+        {
+            case 'H':
+                histogram = true;
+                break;
+            case 'n':
+                limit = strtoul(optarg, nullptr, 10);
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        usage();
+        return 1;
+    }
+
+    SpanSummary summary;
+    bool        failed = false;
+    for (int i = optind; i < argc; i++)
+    {
+        std::string     name = argv[i];
+        ContainerReader reader;
+        if (reader.open(name))
+        {
+            for (size_t b = 0; b < reader.block_count(); b++)
+            {
+                summary.scan(reader.payload(b), reader.block(b).payload_size);
+            }
+            continue;
+        }
+        if (!scan_text_file(name, summary))
+        {
+            failed = true;
+        }
+    }
+
+    uint64_t               records = summary.records();
+    std::vector<SpanStats> spans   = summary.finish();
+    printf("%10s %10s %10s %10s %10s %10s %10s %10s  %s\n", "count", "total", "mean", "min", "p50", "p90", "p99",
+           "max", "span");
+    for (size_t i = 0; (i < spans.size()) && ((0 == limit) || (i < limit)); i++)
+    {
+        const SpanStats &stats = spans[i];
+        printf("%10" PRIu64, stats.count);
+        print_duration(stats.total_ns);
+        print_duration(stats.total_ns / stats.count);
+        print_duration(stats.min_ns);
+        print_duration(stats.p50_ns);
+        print_duration(stats.p90_ns);
+        print_duration(stats.p99_ns);
+        print_duration(stats.max_ns);
+        printf("  %s\n", stats.name.c_str());
+        if (histogram)
+        {
+            print_histogram(stats);
+        }
+    }
+    printf("%" PRIu64 " span records, %zu spans\n", records, spans.size());
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+/**
+ * @brief tinylog-verify: check log files written with record framing
+ * (LogControl::record_framing, see log_frame.h).
+ *
+ * Every record is checked against its CRC32C; records that were changed are
+ * reported as corrupt, records that were cut short by the end of the file or
+ * by the next record (a partial write) as torn. The sequence numbers of each
+ * logger run are then checked for gaps, which are records the logger dropped
+ * or that never made it to the file, and for duplicates. Pass the files of a
+ * log in the order they were written, e.g. the rolled files oldest first.
+ * Container files are checked block by block, with the block checksums.
+ *
+ * usage: tinylog-verify [-q] file...
+ * The exit status is 0 if everything checks out, 1 if a problem was found.
+ */
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include "log_container.h"
+#include "log_frame.h"
+
+using namespace logging;
+
+static void
+usage (void)
+{
+    std::cerr << "usage: tinylog-verify [-q] file...\n"
+                 "  -q  only print the summary\n";
+}
+
+/**
+ * @brief Feed a text file to the verifier
+ * @retval false if the file can not be read
+ */
+static bool
+scan_text_file (const std::string &name, FrameVerifier &verifier)
+{
+    int         fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if ((fd < 0) || (0 != fstat(fd, &st)))
+    {
+        std::cerr << "can not open " << name << std::endl;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return false;
+    }
+    if (0 == st.st_size)
+    {
+        close(fd);
+        return true;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == map)
+    {
+        std::cerr << "can not map " << name << std::endl;
+        return false;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    verifier.scan(static_cast<const char *>(map), st.st_size);
+    munmap(map, st.st_size);
+    return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+    bool quiet = false;
+    int  opt;
+    while (-1 != (opt = getopt(argc, argv, "qh")))
+    {
+        switch (opt)
+        {
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        usage();
+        return 1;
+    }
+
+    FrameVerifier verifier;
+    uint64_t      bad_blocks = 0;
+    bool          failed     = false;
+    for (int i = optind; i < argc; i++)
+    {
+        std::string     name = argv[i];
+        ContainerReader reader;
+        if (reader.open(name))
+        {
+            for (size_t b = 0; b < reader.block_count(); b++)
+            {
+                if (!reader.verify(b))
+                {
+                    bad_blocks++;
+                    if (!quiet)
+                    {
+                        printf("%s: block %zu at offset %" PRIu64 ": checksum mismatch\n", name.c_str(), b,
+                               reader.block(b).offset);
+                    }
+                }
+                verifier.scan(reader.payload(b), reader.block(b).payload_size);
+            }
+            continue;
+        }
+        if (!scan_text_file(name, verifier))
+        {
+            failed = true;
+        }
+    }
+
+    FrameReport report = verifier.finish();
+    if (!quiet)
+    {
+        for (const FrameReport::Gap &gap : report.gaps)
+        {
+            if (gap.first == gap.last)
+            {
+                printf("run %" PRIu64 ": missing record %" PRIu64 "\n", gap.run + 1, gap.first);
+            }
+            else
+            {
+                printf("run %" PRIu64 ": missing records %" PRIu64 "-%" PRIu64 "\n", gap.run + 1, gap.first,
+                       gap.last);
+            }
+        }
+        if (FrameReport::MAX_GAPS == report.gaps.size())
+        {
+            printf("(the list stops at %zu gaps)\n", static_cast<size_t>(FrameReport::MAX_GAPS));
+        }
+    }
+    printf("records %" PRIu64 ", runs %" PRIu64 ", missing %" PRIu64 ", duplicate %" PRIu64 ", corrupt %" PRIu64
+           ", torn %" PRIu64 ", unframed bytes %" PRIu64 "\n",
+           report.records, report.runs, report.missing, report.duplicates, report.corrupt, report.torn,
+           report.unframed);
+    if (bad_blocks > 0)
+    {
+        printf("container blocks with a bad checksum %" PRIu64 "\n", bad_blocks);
+    }
+    return (failed || !report.clean() || (bad_blocks > 0)) ? 1 : 0;
+}